@@ -0,0 +1,634 @@
+/*
+  MongoDB Storage Engine - Multi-Session Load Generator
+
+  Opens N client sessions to mysqld and runs a weighted mix of point
+  lookups, filtered scans, cross-engine joins and COUNTs against a MONGODB
+  table, doubling N from 1 up to --sessions. For each concurrency level it
+  reports QPS, latency percentiles per query type, scaling efficiency and
+  the change in the engine's status counters (SHOW GLOBAL STATUS LIKE
+  'mongodb%'), so pooling and caching changes can be checked for scaling
+  and hardware can be sized.
+
+  By default the MONGODB table is backed by the loopback wire protocol stub
+  running inside this process, so mysqld must run on the same host. With
+  --mongo-uri the table points at a real server instead; --populate then
+  loads it with the same synthetic documents
+  ({_id: <int64>, name, value: <double>, f0: <int32>, ...}).
+
+  Setup (unless --no-setup) recreates:
+    load_customers  ENGINE=MONGODB, one row per document
+    load_orders     ENGINE=InnoDB, --orders rows referencing customers
+
+  Usage: load_generator [--host 127.0.0.1] [--port 3306] [--socket path]
+                        [--user root] [--password ''] [--database mongodb_load]
+                        [--sessions 32] [--seconds 10] [--warmup-seconds 2]
+                        [--mix point=70,scan=10,join=10,count=10]
+                        [--documents 100000] [--orders 100000]
+                        [--payload-bytes 256] [--scan-rows 100]
+                        [--mongo-latency-us 0] [--mongo-uri uri] [--populate 1]
+                        [--no-setup 1]
+
+  Query types:
+    point  SELECT ... FROM load_customers WHERE _id = ?
+    scan   SELECT ... FROM load_customers WHERE value >= ? AND value < ?
+    join   load_orders range joined to load_customers on _id
+    count  SELECT COUNT(*) FROM load_customers [WHERE value < ?]
+*/
+
+#include "mock_server.h"
+#include "mongodb_uri_parser.h"
+#include <mongoc/mongoc.h>
+#include <mysql.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define LOAD_MONGO_DATABASE "load"
+#define LOAD_MONGO_COLLECTION "customers"
+#define LOAD_INSERT_BATCH 1000
+
+enum LoadQuery {
+  LOAD_POINT,
+  LOAD_SCAN,
+  LOAD_JOIN,
+  LOAD_COUNT,
+  LOAD_QUERY_COUNT
+};
+
+static const char *load_query_names[LOAD_QUERY_COUNT] = {
+  "point", "scan", "join", "count"
+};
+
+struct LoadOptions {
+  std::string host = "127.0.0.1";
+  unsigned port = 3306;
+  std::string socket;
+  std::string user = "root";
+  std::string password;
+  std::string database = "mongodb_load";
+  unsigned max_sessions = 32;
+  double seconds = 10.0;
+  double warmup_seconds = 2.0;
+  unsigned weights[LOAD_QUERY_COUNT] = {70, 10, 10, 10};
+  size_t documents = 100000;
+  size_t orders = 100000;
+  size_t payload_bytes = 256;
+  size_t scan_rows = 100;
+  uint64_t mongo_latency_us = 0;
+  std::string mongo_uri;        // Real server instead of the mock
+  bool populate = false;
+  bool setup = true;
+};
+
+struct LoadSessionResult {
+  uint64_t queries[LOAD_QUERY_COUNT] = {};
+  uint64_t rows = 0;
+  uint64_t errors = 0;
+  std::vector<uint32_t> latencies_us[LOAD_QUERY_COUNT];
+};
+
+static inline uint64_t next_random(uint64_t *state)
+{
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+static MYSQL *connect_session(const LoadOptions &options, bool with_database)
+{
+  MYSQL *mysql = mysql_init(nullptr);
+  if (!mysql) {
+    return nullptr;
+  }
+
+  unsigned timeout = 10;
+  mysql_options(mysql, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+
+  if (!mysql_real_connect(mysql, options.host.c_str(), options.user.c_str(),
+                          options.password.c_str(),
+                          with_database ? options.database.c_str() : nullptr,
+                          options.port, options.socket.empty() ? nullptr : options.socket.c_str(), 0)) {
+    fprintf(stderr, "LOAD: cannot connect to mysqld: %s\n", mysql_error(mysql));
+    mysql_close(mysql);
+    return nullptr;
+  }
+  return mysql;
+}
+
+static bool run_statement(MYSQL *mysql, const std::string &sql)
+{
+  if (mysql_real_query(mysql, sql.c_str(), sql.size())) {
+    fprintf(stderr, "LOAD: %s\n  in: %.200s\n", mysql_error(mysql), sql.c_str());
+    return false;
+  }
+  MYSQL_RES *result = mysql_store_result(mysql);
+  if (result) {
+    mysql_free_result(result);
+  }
+  return true;
+}
+
+/*
+  Engine counters, by status variable name
+*/
+static std::map<std::string, long long> read_engine_counters(MYSQL *mysql)
+{
+  std::map<std::string, long long> counters;
+  static const char query[] = "SHOW GLOBAL STATUS LIKE 'mongodb%'";
+
+  if (mysql_real_query(mysql, query, sizeof(query) - 1)) {
+    fprintf(stderr, "LOAD: %s\n", mysql_error(mysql));
+    return counters;
+  }
+
+  MYSQL_RES *result = mysql_store_result(mysql);
+  if (!result) {
+    return counters;
+  }
+  MYSQL_ROW row;
+  while ((row = mysql_fetch_row(result))) {
+    if (row[0] && row[1]) {
+      char *end;
+      long long value = strtoll(row[1], &end, 10);
+      if (end != row[1] && *end == '\0') {
+        counters[row[0]] = value;
+      }
+    }
+  }
+  mysql_free_result(result);
+  return counters;
+}
+
+/*
+  Load the synthetic documents into a real MongoDB collection
+*/
+static bool populate_collection(const LoadOptions &options, const MockCollection &mock)
+{
+  MongoURI uri = MongoURIParser::parse(options.mongo_uri);
+  if (!uri.is_valid) {
+    fprintf(stderr, "LOAD: invalid --mongo-uri: %s\n", uri.error_message.c_str());
+    return false;
+  }
+
+  mongoc_client_t *client = mongoc_client_new(uri.to_connection_string().c_str());
+  if (!client) {
+    fprintf(stderr, "LOAD: cannot create a client for %s\n", uri.to_safe_string().c_str());
+    return false;
+  }
+  mongoc_collection_t *collection = mongoc_client_get_collection(client, uri.database.c_str(),
+                                                                 uri.collection.c_str());
+  bson_error_t error;
+  bool ok = true;
+
+  for (size_t start = 0; ok && start < mock.size(); start += LOAD_INSERT_BATCH) {
+    size_t count = std::min<size_t>(LOAD_INSERT_BATCH, mock.size() - start);
+    std::vector<bson_t> documents(count);
+    std::vector<const bson_t*> pointers(count);
+
+    for (size_t i = 0; i < count; i++) {
+      const std::string &raw = mock.raw(start + i);
+      bson_init_static(&documents[i], (const uint8_t*)raw.data(), raw.size());
+      pointers[i] = &documents[i];
+    }
+    if (!mongoc_collection_insert_many(collection, pointers.data(), count, nullptr, nullptr, &error)) {
+      fprintf(stderr, "LOAD: insert failed: %s\n", error.message);
+      ok = false;
+    }
+  }
+
+  mongoc_collection_destroy(collection);
+  mongoc_client_destroy(client);
+  return ok;
+}
+
+static bool setup_schema(const LoadOptions &options, const std::string &connection_string)
+{
+  MYSQL *mysql = connect_session(options, false);
+  if (!mysql) {
+    return false;
+  }
+
+  std::string db = "`" + options.database + "`";
+  bool ok = run_statement(mysql, "CREATE DATABASE IF NOT EXISTS " + db) &&
+            run_statement(mysql, "USE " + db) &&
+            run_statement(mysql, "DROP TABLE IF EXISTS load_orders, load_customers") &&
+            run_statement(mysql,
+              "CREATE TABLE load_customers ("
+              "  _id BIGINT NOT NULL PRIMARY KEY,"
+              "  name VARCHAR(64),"
+              "  value DOUBLE,"
+              "  f0 INT"
+              ") ENGINE=MONGODB CONNECTION='" + connection_string + "'") &&
+            run_statement(mysql,
+              "CREATE TABLE load_orders ("
+              "  id INT NOT NULL PRIMARY KEY,"
+              "  customer_id BIGINT NOT NULL,"
+              "  amount DOUBLE NOT NULL,"
+              "  KEY (customer_id)"
+              ") ENGINE=InnoDB");
+
+  uint64_t state = 0x9E3779B97F4A7C15ULL;
+  for (size_t start = 0; ok && start < options.orders; start += LOAD_INSERT_BATCH) {
+    std::string sql = "INSERT INTO load_orders VALUES ";
+    size_t end = std::min(options.orders, start + LOAD_INSERT_BATCH);
+    for (size_t id = start; id < end; id++) {
+      char values[96];
+      uint64_t r = next_random(&state);
+      snprintf(values, sizeof(values), "%s(%zu,%llu,%.2f)", id > start ? "," : "", id,
+               (unsigned long long)(r % options.documents), (double)((r >> 32) % 100000) / 100.0);
+      sql += values;
+    }
+    ok = run_statement(mysql, sql);
+  }
+
+  mysql_close(mysql);
+  return ok;
+}
+
+static LoadQuery pick_query(const LoadOptions &options, uint64_t r)
+{
+  unsigned total = 0;
+  for (unsigned weight : options.weights) {
+    total += weight;
+  }
+
+  unsigned bucket = (unsigned)(r % total);
+  for (int q = 0; q < LOAD_QUERY_COUNT; q++) {
+    if (bucket < options.weights[q]) {
+      return (LoadQuery)q;
+    }
+    bucket -= options.weights[q];
+  }
+  return LOAD_POINT;
+}
+
+static std::string make_query(LoadQuery query, const LoadOptions &options, uint64_t r)
+{
+  char sql[256];
+  uint64_t id = r % options.documents;
+  // value is (_id % 1000) / 10, so a width covers about scan_rows documents per 1000
+  double width = std::max(0.1, (double)options.scan_rows * 100.0 / (double)options.documents);
+  double low = (double)((r >> 16) % 1000) / 10.0;
+
+  switch (query) {
+    case LOAD_POINT:
+      snprintf(sql, sizeof(sql), "SELECT name, value FROM load_customers WHERE _id = %llu",
+               (unsigned long long)id);
+      break;
+    case LOAD_SCAN:
+      snprintf(sql, sizeof(sql),
+               "SELECT _id, name FROM load_customers WHERE value >= %.1f AND value < %.1f",
+               low, low + width);
+      break;
+    case LOAD_JOIN:
+      snprintf(sql, sizeof(sql),
+               "SELECT o.id, o.amount, c.name FROM load_orders o "
+               "JOIN load_customers c ON c._id = o.customer_id "
+               "WHERE o.id BETWEEN %llu AND %llu",
+               (unsigned long long)(r % std::max<size_t>(options.orders, 1)),
+               (unsigned long long)(r % std::max<size_t>(options.orders, 1) + 9));
+      break;
+    default:
+      if ((r >> 8) % 2) {
+        snprintf(sql, sizeof(sql), "SELECT COUNT(*) FROM load_customers");
+      } else {
+        snprintf(sql, sizeof(sql), "SELECT COUNT(*) FROM load_customers WHERE value < %.1f", low);
+      }
+      break;
+  }
+  return sql;
+}
+
+static void session_worker(const LoadOptions &options, MYSQL *mysql, unsigned session_index,
+                           const std::atomic<bool> &recording, const std::atomic<bool> &stop,
+                           LoadSessionResult *result)
+{
+  mysql_thread_init();
+  uint64_t state = 0x2545F4914F6CDD1DULL * (session_index + 1) + (uint64_t)time(nullptr);
+
+  while (!stop.load(std::memory_order_relaxed)) {
+    uint64_t r = next_random(&state);
+    LoadQuery query = pick_query(options, r);
+    std::string sql = make_query(query, options, r >> 4);
+
+    auto started = std::chrono::steady_clock::now();
+    bool ok = !mysql_real_query(mysql, sql.c_str(), sql.size());
+    uint64_t rows = 0;
+    if (ok) {
+      MYSQL_RES *res = mysql_store_result(mysql);
+      if (res) {
+        rows = mysql_num_rows(res);
+        mysql_free_result(res);
+      } else {
+        ok = mysql_field_count(mysql) == 0;
+      }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - started).count();
+
+    if (!recording.load(std::memory_order_relaxed)) {
+      continue;
+    }
+    if (ok) {
+      result->queries[query]++;
+      result->rows += rows;
+      result->latencies_us[query].push_back((uint32_t)std::min<int64_t>(elapsed, UINT32_MAX));
+    } else {
+      if (!result->errors) {
+        fprintf(stderr, "LOAD: session %u: %s\n", session_index, mysql_error(mysql));
+      }
+      result->errors++;
+    }
+  }
+
+  mysql_thread_end();
+}
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, double fraction)
+{
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = (size_t)(fraction * (double)(sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static bool parse_mix(const char *value, LoadOptions *options)
+{
+  unsigned weights[LOAD_QUERY_COUNT] = {};
+  std::string mix = value;
+  size_t pos = 0;
+
+  while (pos < mix.size()) {
+    size_t comma = mix.find(',', pos);
+    std::string item = mix.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+    size_t equals = item.find('=');
+    bool known = false;
+
+    for (int q = 0; equals != std::string::npos && q < LOAD_QUERY_COUNT; q++) {
+      if (item.compare(0, equals, load_query_names[q]) == 0) {
+        weights[q] = (unsigned)strtoul(item.c_str() + equals + 1, nullptr, 10);
+        known = true;
+      }
+    }
+    if (!known) {
+      fprintf(stderr, "Unknown mix entry %s\n", item.c_str());
+      return false;
+    }
+    pos = comma == std::string::npos ? mix.size() : comma + 1;
+  }
+
+  memcpy(options->weights, weights, sizeof(weights));
+  return true;
+}
+
+static bool parse_options(int argc, char **argv, LoadOptions *options)
+{
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      fprintf(stderr, "Missing value for %s\n", argv[i]);
+      return false;
+    }
+
+    const char *name = argv[i];
+    const char *value = argv[++i];
+
+    if (!strcmp(name, "--host")) {
+      options->host = value;
+    } else if (!strcmp(name, "--port")) {
+      options->port = (unsigned)strtoul(value, nullptr, 10);
+    } else if (!strcmp(name, "--socket")) {
+      options->socket = value;
+    } else if (!strcmp(name, "--user")) {
+      options->user = value;
+    } else if (!strcmp(name, "--password")) {
+      options->password = value;
+    } else if (!strcmp(name, "--database")) {
+      options->database = value;
+    } else if (!strcmp(name, "--sessions")) {
+      options->max_sessions = (unsigned)strtoul(value, nullptr, 10);
+    } else if (!strcmp(name, "--seconds")) {
+      options->seconds = strtod(value, nullptr);
+    } else if (!strcmp(name, "--warmup-seconds")) {
+      options->warmup_seconds = strtod(value, nullptr);
+    } else if (!strcmp(name, "--mix")) {
+      if (!parse_mix(value, options)) {
+        return false;
+      }
+    } else if (!strcmp(name, "--documents")) {
+      options->documents = strtoull(value, nullptr, 10);
+    } else if (!strcmp(name, "--orders")) {
+      options->orders = strtoull(value, nullptr, 10);
+    } else if (!strcmp(name, "--payload-bytes")) {
+      options->payload_bytes = strtoull(value, nullptr, 10);
+    } else if (!strcmp(name, "--scan-rows")) {
+      options->scan_rows = strtoull(value, nullptr, 10);
+    } else if (!strcmp(name, "--mongo-latency-us")) {
+      options->mongo_latency_us = strtoull(value, nullptr, 10);
+    } else if (!strcmp(name, "--mongo-uri")) {
+      options->mongo_uri = value;
+    } else if (!strcmp(name, "--populate")) {
+      options->populate = atoi(value) != 0;
+    } else if (!strcmp(name, "--no-setup")) {
+      options->setup = atoi(value) == 0;
+    } else {
+      fprintf(stderr, "Unknown option %s\n", name);
+      return false;
+    }
+  }
+
+  unsigned total_weight = 0;
+  for (unsigned weight : options->weights) {
+    total_weight += weight;
+  }
+  if (!options->max_sessions || options->seconds <= 0 || options->warmup_seconds < 0 ||
+      !options->documents || !total_weight ||
+      (options->weights[LOAD_JOIN] && !options->orders)) {
+    fprintf(stderr, "Invalid options\n");
+    return false;
+  }
+  return true;
+}
+
+/*
+  One concurrency level: connect every session first, warm up, then record
+*/
+static bool run_level(const LoadOptions &options, unsigned sessions, MYSQL *monitor,
+                      double baseline_qps, double *level_qps)
+{
+  std::vector<MYSQL*> connections;
+  for (unsigned s = 0; s < sessions; s++) {
+    MYSQL *mysql = connect_session(options, true);
+    if (!mysql) {
+      for (MYSQL *open : connections) {
+        mysql_close(open);
+      }
+      return false;
+    }
+    connections.push_back(mysql);
+  }
+
+  std::vector<LoadSessionResult> results(sessions);
+  std::vector<std::thread> workers;
+  std::atomic<bool> recording(false), stop(false);
+
+  for (unsigned s = 0; s < sessions; s++) {
+    workers.emplace_back(session_worker, std::cref(options), connections[s], s,
+                         std::cref(recording), std::cref(stop), &results[s]);
+  }
+
+  std::this_thread::sleep_for(std::chrono::duration<double>(options.warmup_seconds));
+  std::map<std::string, long long> before = read_engine_counters(monitor);
+  auto started = std::chrono::steady_clock::now();
+  recording = true;
+
+  std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+  recording = false;
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  std::map<std::string, long long> after = read_engine_counters(monitor);
+
+  stop = true;
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  for (MYSQL *mysql : connections) {
+    mysql_close(mysql);
+  }
+
+  uint64_t total = 0, rows = 0, errors = 0;
+  std::vector<uint32_t> all;
+  std::vector<uint32_t> by_query[LOAD_QUERY_COUNT];
+  for (const auto &result : results) {
+    rows += result.rows;
+    errors += result.errors;
+    for (int q = 0; q < LOAD_QUERY_COUNT; q++) {
+      total += result.queries[q];
+      by_query[q].insert(by_query[q].end(), result.latencies_us[q].begin(), result.latencies_us[q].end());
+    }
+  }
+  for (int q = 0; q < LOAD_QUERY_COUNT; q++) {
+    std::sort(by_query[q].begin(), by_query[q].end());
+    all.insert(all.end(), by_query[q].begin(), by_query[q].end());
+  }
+  std::sort(all.begin(), all.end());
+
+  double qps = total / elapsed;
+  double efficiency = baseline_qps > 0 ? qps / (baseline_qps * sessions) : 1.0;
+  *level_qps = qps;
+
+  printf("%8u %12.0f %12.0f %10u %10u %10u %10.2f %8llu\n", sessions, qps, rows / elapsed,
+         percentile(all, 0.50), percentile(all, 0.99), percentile(all, 0.999), efficiency,
+         (unsigned long long)errors);
+  for (int q = 0; q < LOAD_QUERY_COUNT; q++) {
+    if (by_query[q].empty()) {
+      continue;
+    }
+    printf("%8s %12.0f %12s %10u %10u %10u\n", load_query_names[q], by_query[q].size() / elapsed, "",
+           percentile(by_query[q], 0.50), percentile(by_query[q], 0.99),
+           percentile(by_query[q], 0.999));
+  }
+
+  // Counter changes over the recorded interval, per second
+  std::string changes;
+  for (const auto &counter : after) {
+    auto previous = before.find(counter.first);
+    long long delta = counter.second - (previous == before.end() ? 0 : previous->second);
+    if (delta) {
+      char entry[128];
+      snprintf(entry, sizeof(entry), " %s=%.0f/s", counter.first.c_str(), delta / elapsed);
+      changes += entry;
+    }
+  }
+  if (!changes.empty()) {
+    printf("%8s%s\n", "engine", changes.c_str());
+  }
+  fflush(stdout);
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  LoadOptions options;
+  if (!parse_options(argc, argv, &options)) {
+    return 1;
+  }
+
+  if (mysql_library_init(0, nullptr, nullptr)) {
+    fprintf(stderr, "LOAD: cannot initialize the client library\n");
+    return 1;
+  }
+  mongoc_init();
+
+  auto mock = std::make_shared<const MockCollection>(options.documents, options.payload_bytes, 1);
+  MockServerOptions server_options;
+  server_options.latency_us = options.mongo_latency_us;
+  MockMongoServer server(mock, server_options);
+
+  std::string connection_string = options.mongo_uri;
+  if (connection_string.empty()) {
+    if (!server.start()) {
+      return 1;
+    }
+    connection_string = server.connection_string(LOAD_MONGO_DATABASE, LOAD_MONGO_COLLECTION);
+  } else if (options.populate && !populate_collection(options, *mock)) {
+    return 1;
+  }
+
+  if (options.setup && !setup_schema(options, connection_string)) {
+    return 1;
+  }
+
+  MYSQL *monitor = connect_session(options, true);
+  if (!monitor) {
+    return 1;
+  }
+
+  printf("Load generator: mysqld %s:%u, %zu documents, %zu orders, mix", options.host.c_str(),
+         options.port, options.documents, options.orders);
+  for (int q = 0; q < LOAD_QUERY_COUNT; q++) {
+    printf(" %s=%u", load_query_names[q], options.weights[q]);
+  }
+  printf(", %s MongoDB, %.1fs per level\n", options.mongo_uri.empty() ? "mock" : "external",
+         options.seconds);
+  printf("%8s %12s %12s %10s %10s %10s %10s %8s\n", "sessions", "qps", "rows/s",
+         "p50_us", "p99_us", "p999_us", "efficiency", "errors");
+
+  double baseline_qps = 0;
+  bool ok = true;
+  for (unsigned sessions = 1; ok && sessions <= options.max_sessions; sessions *= 2) {
+    double qps = 0;
+    ok = run_level(options, sessions, monitor, baseline_qps, &qps);
+    if (sessions == 1) {
+      baseline_qps = qps;
+    }
+  }
+
+  if (options.mongo_uri.empty()) {
+    printf("Mock MongoDB: %llu connections, %llu finds, %llu getMores, %llu aggregates, "
+           "%llu counts, %llu documents, %llu bytes sent\n",
+           (unsigned long long)server.counters.connections.load(),
+           (unsigned long long)server.counters.finds.load(),
+           (unsigned long long)server.counters.get_mores.load(),
+           (unsigned long long)server.counters.aggregates.load(),
+           (unsigned long long)server.counters.counts.load(),
+           (unsigned long long)server.counters.documents_returned.load(),
+           (unsigned long long)server.counters.bytes_sent.load());
+  }
+
+  mysql_close(monitor);
+  server.stop();
+  mongoc_cleanup();
+  mysql_library_end();
+  return ok ? 0 : 2;
+}
@@ -0,0 +1,123 @@
+#ifndef MONGODB_BENCH_MOCK_COLLECTION_H
+#define MONGODB_BENCH_MOCK_COLLECTION_H
+
+/*
+  In-process mock collection for benchmarks
+
+  Synthetic documents shaped like a typical mapped table:
+  { _id: <int64>, name: <string>, value: <double>, active: <bool>,
+    tags: [<string>, ...], payload: <string of payload_bytes>,
+    f0: <int32>, ... f<extra_fields - 1>: <int32> }
+  Documents are generated once and shared read-only by every thread.
+*/
+
+#include <bson/bson.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class MockCollection {
+private:
+  std::vector<std::string> documents;   // Raw BSON, indexed by _id
+
+public:
+  MockCollection(size_t document_count, size_t payload_bytes, unsigned extra_fields = 0)
+  {
+    std::string payload(payload_bytes, 'x');
+    documents.reserve(document_count);
+
+    for (size_t i = 0; i < document_count; i++) {
+      char name[32];
+      snprintf(name, sizeof(name), "customer-%zu", i);
+
+      bson_t doc, tags;
+      bson_init(&doc);
+      BSON_APPEND_INT64(&doc, "_id", (int64_t)i);
+      BSON_APPEND_UTF8(&doc, "name", name);
+      BSON_APPEND_DOUBLE(&doc, "value", (double)(i % 1000) / 10.0);
+      BSON_APPEND_BOOL(&doc, "active", i % 3 != 0);
+      BSON_APPEND_ARRAY_BEGIN(&doc, "tags", &tags);
+      BSON_APPEND_UTF8(&tags, "0", i % 2 ? "odd" : "even");
+      BSON_APPEND_UTF8(&tags, "1", i % 5 ? "regular" : "vip");
+      bson_append_array_end(&doc, &tags);
+      BSON_APPEND_UTF8(&doc, "payload", payload.c_str());
+      for (unsigned f = 0; f < extra_fields; f++) {
+        char field[16];
+        snprintf(field, sizeof(field), "f%u", f);
+        BSON_APPEND_INT32(&doc, field, (int32_t)((i * (f + 1)) % 100000));
+      }
+
+      documents.emplace_back((const char*)bson_get_data(&doc), doc.len);
+      bson_destroy(&doc);
+    }
+  }
+
+  size_t size() const { return documents.size(); }
+
+  /*
+    Point read by _id - what a find({_id: id}).limit(1) would return
+  */
+  bool find_by_id(uint64_t id, bson_t *doc) const
+  {
+    if (id >= documents.size()) {
+      return false;
+    }
+    const std::string &bytes = documents[(size_t)id];
+    return bson_init_static(doc, (const uint8_t*)bytes.data(), bytes.size());
+  }
+
+  const std::string &raw(size_t index) const { return documents[index]; }
+};
+
+/*
+  Walk every field the way convert_document_to_row() does for a mapped row
+  and fold the values into a checksum so the work cannot be optimized away
+*/
+static inline uint64_t mock_consume_document(const bson_t *doc)
+{
+  uint64_t checksum = 0;
+  bson_iter_t iter;
+
+  if (!bson_iter_init(&iter, doc)) {
+    return 0;
+  }
+
+  while (bson_iter_next(&iter)) {
+    switch (bson_iter_type(&iter)) {
+    case BSON_TYPE_INT32:
+      checksum += (uint64_t)bson_iter_int32(&iter);
+      break;
+    case BSON_TYPE_INT64:
+      checksum += (uint64_t)bson_iter_int64(&iter);
+      break;
+    case BSON_TYPE_DOUBLE:
+      checksum += (uint64_t)bson_iter_double(&iter);
+      break;
+    case BSON_TYPE_BOOL:
+      checksum += bson_iter_bool(&iter) ? 1 : 0;
+      break;
+    case BSON_TYPE_UTF8: {
+      uint32_t length;
+      bson_iter_utf8(&iter, &length);
+      checksum += length;
+      break;
+    }
+    case BSON_TYPE_ARRAY: {
+      bson_iter_t child;
+      if (bson_iter_recurse(&iter, &child)) {
+        while (bson_iter_next(&child)) {
+          checksum++;
+        }
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+
+  return checksum;
+}
+
+#endif /* MONGODB_BENCH_MOCK_COLLECTION_H */
@@ -0,0 +1,1230 @@
+/*
+  MongoDB Storage Engine - Loopback Wire Protocol Stub Implementation
+
+  One thread accepts connections and each connection gets its own thread
+  reading messages in order, which is all libmongoc needs: a pooled or
+  single-threaded client never pipelines requests on one socket.
+*/
+
+#include "mock_server.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#define MOCK_OP_REPLY 1
+#define MOCK_OP_QUERY 2004
+#define MOCK_OP_MSG 2013
+
+#define MOCK_MSG_CHECKSUM_PRESENT 0x1
+#define MOCK_MSG_MORE_TO_COME 0x2
+
+/*
+  Wire protocol integers are little-endian regardless of the host
+*/
+static inline int32_t read_int32(const uint8_t *p)
+{
+  return (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static inline void append_int32(std::string *out, int32_t value)
+{
+  uint32_t v = (uint32_t)value;
+  char bytes[4] = {(char)(v & 0xFF), (char)((v >> 8) & 0xFF), (char)((v >> 16) & 0xFF), (char)((v >> 24) & 0xFF)};
+  out->append(bytes, 4);
+}
+
+static inline void append_int64(std::string *out, int64_t value)
+{
+  append_int32(out, (int32_t)(uint32_t)((uint64_t)value & 0xFFFFFFFFULL));
+  append_int32(out, (int32_t)(uint32_t)((uint64_t)value >> 32));
+}
+
+static bool recv_all(int fd, uint8_t *buffer, size_t length)
+{
+  while (length > 0) {
+    ssize_t received = recv(fd, buffer, length, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    buffer += received;
+    length -= (size_t)received;
+  }
+  return true;
+}
+
+static bool send_all(int fd, const char *buffer, size_t length)
+{
+  while (length > 0) {
+    ssize_t sent = send(fd, buffer, length, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    buffer += sent;
+    length -= (size_t)sent;
+  }
+  return true;
+}
+
+/*
+  Filter evaluation
+*/
+
+// Orders two scalar values; false when the types cannot be compared
+static bool compare_values(const bson_iter_t *a, const bson_iter_t *b, int *result)
+{
+  bson_type_t type_a = bson_iter_type(a);
+  bson_type_t type_b = bson_iter_type(b);
+
+  auto is_number = [](bson_type_t type) {
+    return type == BSON_TYPE_INT32 || type == BSON_TYPE_INT64 || type == BSON_TYPE_DOUBLE;
+  };
+
+  if (is_number(type_a) && is_number(type_b)) {
+    if (type_a != BSON_TYPE_DOUBLE && type_b != BSON_TYPE_DOUBLE) {
+      int64_t x = bson_iter_as_int64(a), y = bson_iter_as_int64(b);
+      *result = x < y ? -1 : (x > y ? 1 : 0);
+    } else {
+      double x = bson_iter_as_double(a), y = bson_iter_as_double(b);
+      *result = x < y ? -1 : (x > y ? 1 : 0);
+    }
+    return true;
+  }
+
+  if (type_a != type_b) {
+    return false;
+  }
+
+  switch (type_a) {
+  case BSON_TYPE_UTF8: {
+    uint32_t length_a, length_b;
+    const char *x = bson_iter_utf8(a, &length_a);
+    const char *y = bson_iter_utf8(b, &length_b);
+    int cmp = memcmp(x, y, std::min(length_a, length_b));
+    *result = cmp ? cmp : (length_a < length_b ? -1 : (length_a > length_b ? 1 : 0));
+    return true;
+  }
+  case BSON_TYPE_BOOL:
+    *result = (int)bson_iter_bool(a) - (int)bson_iter_bool(b);
+    return true;
+  case BSON_TYPE_DATE_TIME: {
+    int64_t x = bson_iter_date_time(a), y = bson_iter_date_time(b);
+    *result = x < y ? -1 : (x > y ? 1 : 0);
+    return true;
+  }
+  case BSON_TYPE_OID:
+    *result = bson_oid_compare(bson_iter_oid(a), bson_iter_oid(b));
+    return true;
+  case BSON_TYPE_NULL:
+    *result = 0;
+    return true;
+  case BSON_TYPE_DOCUMENT:
+  case BSON_TYPE_ARRAY: {
+    uint32_t length_a, length_b;
+    const uint8_t *x, *y;
+    if (type_a == BSON_TYPE_DOCUMENT) {
+      bson_iter_document(a, &length_a, &x);
+      bson_iter_document(b, &length_b, &y);
+    } else {
+      bson_iter_array(a, &length_a, &x);
+      bson_iter_array(b, &length_b, &y);
+    }
+    // Only equality is meaningful here
+    *result = (length_a == length_b && !memcmp(x, y, length_a)) ? 0 : 1;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+static bool values_equal(const bson_iter_t *a, const bson_iter_t *b)
+{
+  int cmp;
+  return compare_values(a, b, &cmp) && cmp == 0;
+}
+
+// Applies one comparison operator to a single field value
+static bool scalar_matches(const bson_iter_t *field, const char *op, const bson_iter_t *operand)
+{
+  int cmp;
+
+  if (!strcmp(op, "$eq")) {
+    return values_equal(field, operand);
+  }
+  if (!strcmp(op, "$gt")) {
+    return compare_values(field, operand, &cmp) && cmp > 0;
+  }
+  if (!strcmp(op, "$gte")) {
+    return compare_values(field, operand, &cmp) && cmp >= 0;
+  }
+  if (!strcmp(op, "$lt")) {
+    return compare_values(field, operand, &cmp) && cmp < 0;
+  }
+  if (!strcmp(op, "$lte")) {
+    return compare_values(field, operand, &cmp) && cmp <= 0;
+  }
+  if (!strcmp(op, "$in")) {
+    bson_iter_t element;
+    if (BSON_ITER_HOLDS_ARRAY(operand) && bson_iter_recurse(operand, &element)) {
+      while (bson_iter_next(&element)) {
+        if (values_equal(field, &element)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // Unknown operators are not evaluated
+  return true;
+}
+
+// Array fields match when any element does, like the server's implicit $elemMatch
+static bool field_matches(const bson_iter_t *field, const char *op, const bson_iter_t *operand)
+{
+  if (scalar_matches(field, op, operand)) {
+    return true;
+  }
+
+  bson_iter_t element;
+  if (BSON_ITER_HOLDS_ARRAY(field) && !BSON_ITER_HOLDS_ARRAY(operand) && bson_iter_recurse(field, &element)) {
+    while (bson_iter_next(&element)) {
+      if (scalar_matches(&element, op, operand)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static bool find_field(const bson_t *doc, const char *path, bson_iter_t *field)
+{
+  bson_iter_t iter;
+  if (!bson_iter_init(&iter, doc)) {
+    return false;
+  }
+  if (strchr(path, '.')) {
+    return bson_iter_find_descendant(&iter, path, field);
+  }
+  if (bson_iter_find(&iter, path)) {
+    *field = iter;
+    return true;
+  }
+  return false;
+}
+
+static bool operator_document(const bson_iter_t *value)
+{
+  bson_iter_t child;
+  return BSON_ITER_HOLDS_DOCUMENT(value) && bson_iter_recurse(value, &child) &&
+         bson_iter_next(&child) && bson_iter_key(&child)[0] == '$';
+}
+
+static bool condition_matches(const bson_t *doc, const char *path, const bson_iter_t *condition)
+{
+  bson_iter_t field;
+  bool present = find_field(doc, path, &field);
+
+  if (!operator_document(condition)) {
+    if (!present) {
+      return BSON_ITER_HOLDS_NULL(condition);
+    }
+    return field_matches(&field, "$eq", condition);
+  }
+
+  bson_iter_t op;
+  bson_iter_recurse(condition, &op);
+  while (bson_iter_next(&op)) {
+    const char *name = bson_iter_key(&op);
+    bool matched;
+
+    if (!strcmp(name, "$exists")) {
+      matched = present == bson_iter_as_bool(&op);
+    } else if (!strcmp(name, "$ne")) {
+      matched = !present || !field_matches(&field, "$eq", &op);
+    } else if (!strcmp(name, "$nin")) {
+      matched = !present || !field_matches(&field, "$in", &op);
+    } else if (!present) {
+      matched = (!strcmp(name, "$eq") && BSON_ITER_HOLDS_NULL(&op)) ||
+                (strcmp(name, "$eq") && strcmp(name, "$gt") && strcmp(name, "$gte") &&
+                 strcmp(name, "$lt") && strcmp(name, "$lte") && strcmp(name, "$in"));
+    } else {
+      matched = field_matches(&field, name, &op);
+    }
+
+    if (!matched) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool mock_document_matches(const bson_t *doc, const bson_t *filter)
+{
+  bson_iter_t iter;
+  if (!filter || !bson_iter_init(&iter, filter)) {
+    return true;
+  }
+
+  while (bson_iter_next(&iter)) {
+    const char *key = bson_iter_key(&iter);
+
+    if (key[0] == '$') {
+      bool is_and = !strcmp(key, "$and");
+      bool is_or = !strcmp(key, "$or");
+      bool is_nor = !strcmp(key, "$nor");
+      bson_iter_t clause;
+
+      if (!(is_and || is_or || is_nor) || !BSON_ITER_HOLDS_ARRAY(&iter) ||
+          !bson_iter_recurse(&iter, &clause)) {
+        continue;   // $expr, $text, ... are not evaluated
+      }
+
+      bool any = false, all = true;
+      while (bson_iter_next(&clause)) {
+        uint32_t length;
+        const uint8_t *data;
+        bson_t sub;
+        if (!BSON_ITER_HOLDS_DOCUMENT(&clause)) {
+          continue;
+        }
+        bson_iter_document(&clause, &length, &data);
+        if (!bson_init_static(&sub, data, length)) {
+          continue;
+        }
+        bool matched = mock_document_matches(doc, &sub);
+        any = any || matched;
+        all = all && matched;
+      }
+
+      if ((is_and && !all) || (is_or && !any) || (is_nor && any)) {
+        return false;
+      }
+      continue;
+    }
+
+    if (!condition_matches(doc, key, &iter)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+  Filters of the form {_id: <integer>} address one document directly; the
+  mock collection stores document i under _id i
+*/
+static bool id_equality(const bson_t *filter, int64_t *id)
+{
+  bson_iter_t iter;
+  if (!filter || !bson_iter_init(&iter, filter) || !bson_iter_next(&iter) ||
+      strcmp(bson_iter_key(&iter), "_id") ||
+      !(BSON_ITER_HOLDS_INT32(&iter) || BSON_ITER_HOLDS_INT64(&iter))) {
+    return false;
+  }
+  *id = bson_iter_as_int64(&iter);
+  return !bson_iter_next(&iter);
+}
+
+size_t mock_count_matches(const MockCollection &collection, const bson_t *filter)
+{
+  int64_t id;
+  if (id_equality(filter, &id)) {
+    bson_t doc;
+    return id >= 0 && collection.find_by_id((uint64_t)id, &doc) ? 1 : 0;
+  }
+
+  size_t count = 0;
+  for (size_t i = 0; i < collection.size(); i++) {
+    const std::string &raw = collection.raw(i);
+    bson_t doc;
+    if (bson_init_static(&doc, (const uint8_t*)raw.data(), raw.size()) &&
+        mock_document_matches(&doc, filter)) {
+      count++;
+    }
+  }
+  return count;
+}
+
+/*
+  Small command helpers
+*/
+static bool embedded_document(const bson_iter_t *iter, bson_t *doc)
+{
+  uint32_t length;
+  const uint8_t *data;
+  if (!BSON_ITER_HOLDS_DOCUMENT(iter)) {
+    return false;
+  }
+  bson_iter_document(iter, &length, &data);
+  return bson_init_static(doc, data, length);
+}
+
+static int64_t command_int64(const bson_t *command, const char *key, int64_t default_value)
+{
+  bson_iter_t iter;
+  if (bson_iter_init_find(&iter, command, key) &&
+      (BSON_ITER_HOLDS_INT32(&iter) || BSON_ITER_HOLDS_INT64(&iter) || BSON_ITER_HOLDS_DOUBLE(&iter))) {
+    return bson_iter_as_int64(&iter);
+  }
+  return default_value;
+}
+
+static std::string command_filter(const bson_t *command, const char *key)
+{
+  bson_iter_t iter;
+  bson_t filter;
+  if (bson_iter_init_find(&iter, command, key) && embedded_document(&iter, &filter) && !bson_empty(&filter)) {
+    return std::string((const char*)bson_get_data(&filter), filter.len);
+  }
+  return std::string();
+}
+
+static void append_error(bson_t *reply, int32_t code, const char *code_name, const std::string &message)
+{
+  BSON_APPEND_DOUBLE(reply, "ok", 0.0);
+  BSON_APPEND_UTF8(reply, "errmsg", message.c_str());
+  BSON_APPEND_INT32(reply, "code", code);
+  BSON_APPEND_UTF8(reply, "codeName", code_name);
+}
+
+static void append_empty_cursor(bson_t *reply, const std::string &ns)
+{
+  bson_t cursor, batch;
+  BSON_APPEND_DOCUMENT_BEGIN(reply, "cursor", &cursor);
+  BSON_APPEND_ARRAY_BEGIN(&cursor, "firstBatch", &batch);
+  bson_append_array_end(&cursor, &batch);
+  BSON_APPEND_INT64(&cursor, "id", 0);
+  BSON_APPEND_UTF8(&cursor, "ns", ns.c_str());
+  bson_append_document_end(reply, &cursor);
+  BSON_APPEND_DOUBLE(reply, "ok", 1.0);
+}
+
+static void append_handshake(bson_t *reply, uint64_t connection_id)
+{
+  int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+
+  BSON_APPEND_BOOL(reply, "helloOk", true);
+  BSON_APPEND_BOOL(reply, "ismaster", true);
+  BSON_APPEND_BOOL(reply, "isWritablePrimary", true);
+  BSON_APPEND_INT32(reply, "maxBsonObjectSize", 16 * 1024 * 1024);
+  BSON_APPEND_INT32(reply, "maxMessageSizeBytes", MOCK_SERVER_MAX_MESSAGE_BYTES);
+  BSON_APPEND_INT32(reply, "maxWriteBatchSize", 100000);
+  BSON_APPEND_DATE_TIME(reply, "localTime", now_ms);
+  BSON_APPEND_INT32(reply, "logicalSessionTimeoutMinutes", 30);
+  BSON_APPEND_INT64(reply, "connectionId", (int64_t)connection_id);
+  BSON_APPEND_INT32(reply, "minWireVersion", 0);
+  BSON_APPEND_INT32(reply, "maxWireVersion", MOCK_SERVER_MAX_WIRE_VERSION);
+  BSON_APPEND_BOOL(reply, "readOnly", false);
+  BSON_APPEND_DOUBLE(reply, "ok", 1.0);
+}
+
+/*
+  MockMongoServer
+*/
+MockMongoServer::MockMongoServer(std::shared_ptr<const MockCollection> collection,
+                                 const MockServerOptions &server_options)
+  : options(server_options), default_collection(std::move(collection)),
+    listen_fd(-1), bound_port(0), stopping(false), next_cursor_id(1), next_request_id(1)
+{
+}
+
+MockMongoServer::~MockMongoServer()
+{
+  stop();
+}
+
+void MockMongoServer::add_collection(const std::string &name, std::shared_ptr<const MockCollection> collection)
+{
+  collections[name] = std::move(collection);
+}
+
+const MockCollection *MockMongoServer::collection_for(const std::string &name) const
+{
+  auto it = collections.find(name);
+  return it != collections.end() ? it->second.get() : default_collection.get();
+}
+
+std::string MockMongoServer::connection_string(const std::string &database, const std::string &collection) const
+{
+  return "mongodb://127.0.0.1:" + std::to_string(bound_port) + "/" + database + "/" + collection;
+}
+
+bool MockMongoServer::start()
+{
+  listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    fprintf(stderr, "MOCK_SERVER: socket() failed: %s\n", strerror(errno));
+    return false;
+  }
+
+  int enable = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = 0;
+
+  socklen_t address_length = sizeof(address);
+  if (bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+      listen(listen_fd, 128) < 0 ||
+      getsockname(listen_fd, (struct sockaddr*)&address, &address_length) < 0) {
+    fprintf(stderr, "MOCK_SERVER: cannot listen on loopback: %s\n", strerror(errno));
+    close(listen_fd);
+    listen_fd = -1;
+    return false;
+  }
+
+  bound_port = ntohs(address.sin_port);
+  stopping = false;
+  accept_thread = std::thread(&MockMongoServer::accept_loop, this);
+  return true;
+}
+
+void MockMongoServer::stop()
+{
+  if (listen_fd < 0) {
+    return;
+  }
+
+  stopping = true;
+  shutdown(listen_fd, SHUT_RDWR);
+  if (accept_thread.joinable()) {
+    accept_thread.join();
+  }
+  close(listen_fd);
+  listen_fd = -1;
+
+  std::vector<std::thread> threads;
+  {
+    std::lock_guard<std::mutex> lock(connections_mutex);
+    for (int fd : connection_fds) {
+      shutdown(fd, SHUT_RDWR);
+    }
+    threads.swap(connection_threads);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  std::lock_guard<std::mutex> lock(cursors_mutex);
+  cursors.clear();
+}
+
+void MockMongoServer::accept_loop()
+{
+  while (!stopping.load()) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR && !stopping.load()) {
+        continue;
+      }
+      break;
+    }
+
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    counters.connections++;
+
+    std::lock_guard<std::mutex> lock(connections_mutex);
+    connection_fds.push_back(fd);
+    connection_threads.emplace_back(&MockMongoServer::serve_connection, this, fd);
+  }
+}
+
+bool MockMongoServer::send_reply(int fd, const std::string &message)
+{
+  if (options.latency_us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(options.latency_us));
+  }
+
+  auto started = std::chrono::steady_clock::now();
+  if (!send_all(fd, message.data(), message.size())) {
+    return false;
+  }
+  counters.bytes_sent += message.size();
+
+  // Pace the connection to the configured bandwidth
+  if (options.bandwidth_bytes_per_second) {
+    auto budget = std::chrono::microseconds(
+      (uint64_t)((double)message.size() * 1e6 / (double)options.bandwidth_bytes_per_second));
+    auto spent = std::chrono::steady_clock::now() - started;
+    if (spent < budget) {
+      std::this_thread::sleep_for(budget - spent);
+    }
+  }
+  return true;
+}
+
+void MockMongoServer::serve_connection(int fd)
+{
+  std::vector<uint8_t> message;
+  uint64_t connection_id = counters.connections.load();
+
+  while (!stopping.load()) {
+    uint8_t header[16];
+    if (!recv_all(fd, header, sizeof(header))) {
+      break;
+    }
+
+    int32_t length = read_int32(header);
+    int32_t request_id = read_int32(header + 4);
+    int32_t opcode = read_int32(header + 12);
+    if (length < (int32_t)sizeof(header) || length > MOCK_SERVER_MAX_MESSAGE_BYTES) {
+      fprintf(stderr, "MOCK_SERVER: invalid message length %d\n", length);
+      break;
+    }
+
+    message.resize((size_t)length);
+    memcpy(message.data(), header, sizeof(header));
+    if (!recv_all(fd, message.data() + sizeof(header), (size_t)length - sizeof(header))) {
+      break;
+    }
+    counters.bytes_received += (uint64_t)length;
+
+    // Both opcodes start with 4 bytes of flags and at least one more byte
+    if ((opcode == MOCK_OP_QUERY || opcode == MOCK_OP_MSG) && length < (int32_t)sizeof(header) + 5) {
+      fprintf(stderr, "MOCK_SERVER: message of %d bytes too short for opcode %d\n", length, opcode);
+      break;
+    }
+
+    const uint8_t *end = message.data() + length;
+    bson_t reply;
+    bson_init(&reply);
+    std::string out;
+    bool respond = true;
+
+    if (opcode == MOCK_OP_QUERY) {
+      // Legacy handshake: flags, full collection name, skip, return, query
+      const uint8_t *p = message.data() + 20;
+      const uint8_t *name_end = (const uint8_t*)memchr(p, '\0', end - p);
+      const uint8_t *document = name_end ? name_end + 9 : nullptr;
+      bson_t query;
+      if (!name_end || end - name_end < 9 + 5 || read_int32(document) < 5 ||
+          read_int32(document) > end - document ||
+          !bson_init_static(&query, document, (size_t)read_int32(document))) {
+        bson_destroy(&reply);
+        break;
+      }
+
+      // Commands may arrive wrapped as {$query: {...}, $readPreference: ...}
+      bson_iter_t iter;
+      bson_t inner;
+      const bson_t *command = &query;
+      if (bson_iter_init_find(&iter, &query, "$query") && embedded_document(&iter, &inner)) {
+        command = &inner;
+      }
+
+      std::string database((const char*)p, (const char*)name_end - (const char*)p);
+      size_t dot = database.find('.');
+      if (dot != std::string::npos) {
+        database.resize(dot);
+      }
+
+      bson_iter_t first;
+      if (bson_iter_init(&first, command) && bson_iter_next(&first) &&
+          (!strcmp(bson_iter_key(&first), "isMaster") || !strcmp(bson_iter_key(&first), "ismaster") ||
+           !strcmp(bson_iter_key(&first), "hello"))) {
+        append_handshake(&reply, connection_id);
+      } else {
+        handle_command(command, database, std::vector<MockRawDocument>(), &reply);
+      }
+      counters.commands++;
+
+      append_int32(&out, 0);                              // Length, patched below
+      append_int32(&out, next_request_id++);
+      append_int32(&out, request_id);
+      append_int32(&out, MOCK_OP_REPLY);
+      append_int32(&out, 0);                              // Response flags
+      append_int64(&out, 0);                              // Cursor id
+      append_int32(&out, 0);                              // Starting from
+      append_int32(&out, 1);                              // Documents returned
+      out.append((const char*)bson_get_data(&reply), reply.len);
+    } else if (opcode == MOCK_OP_MSG) {
+      uint32_t flags = (uint32_t)read_int32(message.data() + 16);
+      const uint8_t *p = message.data() + 20;
+      if (flags & MOCK_MSG_CHECKSUM_PRESENT) {
+        end -= 4;
+      }
+      respond = !(flags & MOCK_MSG_MORE_TO_COME);
+
+      const uint8_t *body = nullptr;
+      std::vector<MockRawDocument> sequence;
+      bool valid = true;
+
+      while (valid && p < end) {
+        uint8_t kind = *p++;
+        if (end - p < 4) {
+          valid = false;
+          break;
+        }
+        int32_t section_length = read_int32(p);
+        if (section_length < 5 || section_length > end - p) {
+          valid = false;
+          break;
+        }
+
+        if (kind == 0) {
+          body = p;
+        } else if (kind == 1) {
+          // Document sequence: size, identifier, documents
+          const uint8_t *section_end = p + section_length;
+          const uint8_t *q = (const uint8_t*)memchr(p + 4, '\0', section_end - (p + 4));
+          if (!q) {
+            valid = false;
+            break;
+          }
+          for (q++; q + 4 <= section_end;) {
+            int32_t document_length = read_int32(q);
+            if (document_length < 5 || document_length > section_end - q) {
+              valid = false;
+              break;
+            }
+            sequence.push_back(MockRawDocument{q, (uint32_t)document_length});
+            q += document_length;
+          }
+        } else {
+          valid = false;
+        }
+        p += section_length;
+      }
+
+      bson_t command;
+      if (!valid || !body || !bson_init_static(&command, body, (size_t)read_int32(body))) {
+        fprintf(stderr, "MOCK_SERVER: malformed OP_MSG\n");
+        bson_destroy(&reply);
+        break;
+      }
+
+      bson_iter_t iter;
+      std::string database = "admin";
+      if (bson_iter_init_find(&iter, &command, "$db") && BSON_ITER_HOLDS_UTF8(&iter)) {
+        database = bson_iter_utf8(&iter, nullptr);
+      }
+
+      handle_command(&command, database, sequence, &reply);
+      counters.commands++;
+
+      append_int32(&out, 0);
+      append_int32(&out, next_request_id++);
+      append_int32(&out, request_id);
+      append_int32(&out, MOCK_OP_MSG);
+      append_int32(&out, 0);                              // Flag bits
+      out.push_back('\0');                                // Section kind 0
+      out.append((const char*)bson_get_data(&reply), reply.len);
+    } else {
+      fprintf(stderr, "MOCK_SERVER: unsupported opcode %d\n", opcode);
+      bson_destroy(&reply);
+      break;
+    }
+
+    bson_destroy(&reply);
+
+    if (respond) {
+      int32_t out_length = (int32_t)out.size();
+      for (int i = 0; i < 4; i++) {
+        out[i] = (char)((out_length >> (8 * i)) & 0xFF);
+      }
+      if (!send_reply(fd, out)) {
+        break;
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(connections_mutex);
+  connection_fds.erase(std::remove(connection_fds.begin(), connection_fds.end(), fd), connection_fds.end());
+  close(fd);
+}
+
+void MockMongoServer::handle_command(const bson_t *command, const std::string &database,
+                                     const std::vector<MockRawDocument> &sequence_documents,
+                                     bson_t *reply)
+{
+  bson_iter_t first;
+  if (!bson_iter_init(&first, command) || !bson_iter_next(&first)) {
+    append_error(reply, 59, "CommandNotFound", "empty command");
+    return;
+  }
+
+  const char *name = bson_iter_key(&first);
+  const char *collection_name = BSON_ITER_HOLDS_UTF8(&first) ? bson_iter_utf8(&first, nullptr) : "";
+
+  if (!strcmp(name, "hello") || !strcmp(name, "isMaster") || !strcmp(name, "ismaster")) {
+    append_handshake(reply, counters.connections.load());
+  } else if (!strcmp(name, "ping") || !strcmp(name, "endSessions") || !strcmp(name, "getLastError")) {
+    BSON_APPEND_DOUBLE(reply, "ok", 1.0);
+  } else if (!strcmp(name, "buildInfo") || !strcmp(name, "buildinfo")) {
+    bson_t version_array;
+    BSON_APPEND_UTF8(reply, "version", "6.0.0-mock");
+    BSON_APPEND_ARRAY_BEGIN(reply, "versionArray", &version_array);
+    BSON_APPEND_INT32(&version_array, "0", 6);
+    BSON_APPEND_INT32(&version_array, "1", 0);
+    BSON_APPEND_INT32(&version_array, "2", 0);
+    BSON_APPEND_INT32(&version_array, "3", 0);
+    bson_append_array_end(reply, &version_array);
+    BSON_APPEND_DOUBLE(reply, "ok", 1.0);
+  } else if (!strcmp(name, "collStats")) {
+    const MockCollection *collection = collection_for(collection_name);
+    int64_t size = 0;
+    for (size_t i = 0; i < collection->size(); i++) {
+      size += (int64_t)collection->raw(i).size();
+    }
+    std::string ns = database + "." + collection_name;
+    BSON_APPEND_UTF8(reply, "ns", ns.c_str());
+    BSON_APPEND_INT64(reply, "count", (int64_t)collection->size());
+    BSON_APPEND_INT64(reply, "size", size);
+    BSON_APPEND_INT64(reply, "avgObjSize", collection->size() ? size / (int64_t)collection->size() : 0);
+    BSON_APPEND_DOUBLE(reply, "ok", 1.0);
+  } else if (!strcmp(name, "find")) {
+    handle_find(command, collection_name, database, reply);
+  } else if (!strcmp(name, "getMore")) {
+    handle_get_more(command, reply);
+  } else if (!strcmp(name, "killCursors")) {
+    handle_kill_cursors(command, reply);
+  } else if (!strcmp(name, "aggregate")) {
+    handle_aggregate(command, collection_name, database, reply);
+  } else if (!strcmp(name, "count")) {
+    handle_count(command, collection_name, reply);
+  } else if (!strcmp(name, "insert") || !strcmp(name, "update") || !strcmp(name, "delete")) {
+    handle_write(command, name, collection_name, sequence_documents, reply);
+  } else if (!strcmp(name, "listCollections") || !strcmp(name, "listIndexes")) {
+    append_empty_cursor(reply, database + ".$cmd." + name);
+  } else {
+    append_error(reply, 59, "CommandNotFound", std::string("no such command: '") + name + "'");
+  }
+}
+
+/*
+  Fills a cursor document with the next batch and registers the rest of
+  the cursor under a new id when it may continue; returns true when
+  nothing is left open
+*/
+bool MockMongoServer::append_batch(MockServerCursor *cursor, int64_t batch_size, bool first_batch,
+                                   bool may_continue, bson_t *reply)
+{
+  bson_t cursor_doc, batch, filter;
+  bool has_filter = !cursor->filter.empty() &&
+    bson_init_static(&filter, (const uint8_t*)cursor->filter.data(), cursor->filter.size());
+  const MockCollection *collection = cursor->collection;
+  size_t batch_bytes = 0;
+  uint32_t returned = 0;
+
+  BSON_APPEND_DOCUMENT_BEGIN(reply, "cursor", &cursor_doc);
+  bson_append_array_begin(&cursor_doc, first_batch ? "firstBatch" : "nextBatch", -1, &batch);
+
+  while (cursor->position < collection->size() && cursor->remaining != 0 &&
+         (batch_size <= 0 || (int64_t)returned < batch_size) && batch_bytes < MOCK_SERVER_MAX_BATCH_BYTES) {
+    const std::string &raw = collection->raw(cursor->position++);
+    bson_t doc;
+    if (!bson_init_static(&doc, (const uint8_t*)raw.data(), raw.size()) ||
+        (has_filter && !mock_document_matches(&doc, &filter))) {
+      continue;
+    }
+
+    char buffer[16];
+    const char *key;
+    bson_uint32_to_string(returned, &key, buffer, sizeof(buffer));
+    bson_append_document(&batch, key, -1, &doc);
+
+    returned++;
+    batch_bytes += raw.size();
+    if (cursor->remaining > 0) {
+      cursor->remaining--;
+    }
+  }
+
+  bson_append_array_end(&cursor_doc, &batch);
+  counters.documents_returned += returned;
+
+  // Skip ahead so a cursor whose last match was just returned reports id 0
+  if (has_filter && cursor->remaining != 0) {
+    while (cursor->position < collection->size()) {
+      const std::string &raw = collection->raw(cursor->position);
+      bson_t doc;
+      if (bson_init_static(&doc, (const uint8_t*)raw.data(), raw.size()) &&
+          mock_document_matches(&doc, &filter)) {
+        break;
+      }
+      cursor->position++;
+    }
+  }
+
+  bool exhausted = !may_continue || cursor->position >= collection->size() || cursor->remaining == 0;
+  int64_t id = 0;
+  if (!exhausted) {
+    id = next_cursor_id++;
+    std::lock_guard<std::mutex> lock(cursors_mutex);
+    cursors[id] = *cursor;
+  }
+
+  BSON_APPEND_INT64(&cursor_doc, "id", id);
+  BSON_APPEND_UTF8(&cursor_doc, "ns", cursor->ns.c_str());
+  bson_append_document_end(reply, &cursor_doc);
+  BSON_APPEND_DOUBLE(reply, "ok", 1.0);
+  return exhausted;
+}
+
+void MockMongoServer::handle_find(const bson_t *command, const char *collection_name,
+                                  const std::string &database, bson_t *reply)
+{
+  counters.finds++;
+
+  MockServerCursor cursor;
+  cursor.collection = collection_for(collection_name);
+  cursor.ns = database + "." + collection_name;
+  cursor.filter = command_filter(command, "filter");
+  cursor.position = 0;
+
+  int64_t limit = command_int64(command, "limit", 0);
+  int64_t batch_size = command_int64(command, "batchSize", MOCK_SERVER_DEFAULT_BATCH_SIZE);
+  bool single_batch = limit < 0;
+  bson_iter_t iter;
+  if (bson_iter_init_find(&iter, command, "singleBatch") && bson_iter_as_bool(&iter)) {
+    single_batch = true;
+  }
+  if (limit < 0) {
+    limit = -limit;
+  }
+  cursor.remaining = limit > 0 ? limit : -1;
+
+  // Point reads go straight to the document
+  bson_t filter;
+  int64_t id;
+  if (!cursor.filter.empty() &&
+      bson_init_static(&filter, (const uint8_t*)cursor.filter.data(), cursor.filter.size()) &&
+      id_equality(&filter, &id)) {
+    cursor.position = id >= 0 && (uint64_t)id < cursor.collection->size() ? (size_t)id
+                                                                            : cursor.collection->size();
+    cursor.remaining = 1;
+  }
+
+  // Skip is applied by consuming matches before the first batch
+  int64_t skip = command_int64(command, "skip", 0);
+  if (skip > 0) {
+    bool has_filter = !cursor.filter.empty() &&
+      bson_init_static(&filter, (const uint8_t*)cursor.filter.data(), cursor.filter.size());
+    while (skip > 0 && cursor.position < cursor.collection->size()) {
+      const std::string &raw = cursor.collection->raw(cursor.position++);
+      bson_t doc;
+      if (bson_init_static(&doc, (const uint8_t*)raw.data(), raw.size()) &&
+          (!has_filter || mock_document_matches(&doc, &filter))) {
+        skip--;
+      }
+    }
+  }
+
+  if (single_batch && cursor.remaining > 0 && (batch_size <= 0 || cursor.remaining < batch_size)) {
+    batch_size = cursor.remaining;
+  }
+
+  append_batch(&cursor, batch_size, true, !single_batch, reply);
+}
+
+void MockMongoServer::handle_get_more(const bson_t *command, bson_t *reply)
+{
+  counters.get_mores++;
+
+  bson_iter_t iter;
+  if (!bson_iter_init_find(&iter, command, "getMore") ||
+      !(BSON_ITER_HOLDS_INT64(&iter) || BSON_ITER_HOLDS_INT32(&iter))) {
+    append_error(reply, 14, "TypeMismatch", "getMore requires a cursor id");
+    return;
+  }
+  int64_t id = bson_iter_as_int64(&iter);
+
+  MockServerCursor cursor;
+  {
+    std::lock_guard<std::mutex> lock(cursors_mutex);
+    auto it = cursors.find(id);
+    if (it == cursors.end()) {
+      append_error(reply, 43, "CursorNotFound", "cursor id " + std::to_string(id) + " not found");
+      return;
+    }
+    cursor = it->second;
+    cursors.erase(it);
+  }
+
+  // A continuing cursor is registered again under a new id by append_batch
+  append_batch(&cursor, command_int64(command, "batchSize", 0), false, true, reply);
+}
+
+void MockMongoServer::handle_kill_cursors(const bson_t *command, bson_t *reply)
+{
+  bson_iter_t iter, element;
+  bson_t killed;
+
+  BSON_APPEND_ARRAY_BEGIN(reply, "cursorsKilled", &killed);
+  if (bson_iter_init_find(&iter, command, "cursors") && BSON_ITER_HOLDS_ARRAY(&iter) &&
+      bson_iter_recurse(&iter, &element)) {
+    std::lock_guard<std::mutex> lock(cursors_mutex);
+    uint32_t index = 0;
+    while (bson_iter_next(&element)) {
+      int64_t id = bson_iter_as_int64(&element);
+      if (cursors.erase(id)) {
+        char buffer[16];
+        const char *key;
+        bson_uint32_to_string(index++, &key, buffer, sizeof(buffer));
+        bson_append_int64(&killed, key, -1, id);
+      }
+    }
+  }
+  bson_append_array_end(reply, &killed);
+  BSON_APPEND_DOUBLE(reply, "ok", 1.0);
+}
+
+void MockMongoServer::handle_aggregate(const bson_t *command, const char *collection_name,
+                                       const std::string &database, bson_t *reply)
+{
+  counters.aggregates++;
+
+  MockServerCursor cursor;
+  cursor.collection = collection_for(collection_name);
+  cursor.ns = database + "." + collection_name;
+  cursor.position = 0;
+  cursor.remaining = -1;
+
+  int64_t skip = 0;
+  bool counting = false;
+  std::string count_field = "n";
+  bson_value_t group_id;
+  bool has_group_id = false;
+  std::vector<std::string> matches;
+
+  bson_iter_t iter, stage_iter;
+  if (!bson_iter_init_find(&iter, command, "pipeline") || !BSON_ITER_HOLDS_ARRAY(&iter) ||
+      !bson_iter_recurse(&iter, &stage_iter)) {
+    append_error(reply, 9, "FailedToParse", "aggregate requires a pipeline array");
+    return;
+  }
+
+  // Stages are applied as $match, then $skip, then $limit, then any count
+  while (bson_iter_next(&stage_iter)) {
+    bson_t stage;
+    bson_iter_t op;
+    if (!embedded_document(&stage_iter, &stage) || !bson_iter_init(&op, &stage) || !bson_iter_next(&op)) {
+      continue;
+    }
+    const char *name = bson_iter_key(&op);
+
+    if (!strcmp(name, "$match")) {
+      bson_t match;
+      if (embedded_document(&op, &match) && !bson_empty(&match)) {
+        matches.emplace_back((const char*)bson_get_data(&match), match.len);
+      }
+    } else if (!strcmp(name, "$skip")) {
+      skip += bson_iter_as_int64(&op);
+    } else if (!strcmp(name, "$limit")) {
+      int64_t limit = bson_iter_as_int64(&op);
+      cursor.remaining = cursor.remaining < 0 ? limit : std::min(cursor.remaining, limit);
+    } else if (!strcmp(name, "$sample")) {
+      bson_iter_t size;
+      if (BSON_ITER_HOLDS_DOCUMENT(&op) && bson_iter_recurse(&op, &size) && bson_iter_find(&size, "size")) {
+        int64_t limit = bson_iter_as_int64(&size);
+        cursor.remaining = cursor.remaining < 0 ? limit : std::min(cursor.remaining, limit);
+      }
+    } else if (!strcmp(name, "$count")) {
+      counting = true;
+      if (BSON_ITER_HOLDS_UTF8(&op)) {
+        count_field = bson_iter_utf8(&op, nullptr);
+      }
+    } else if (!strcmp(name, "$group")) {
+      // Only {_id: <constant>, <field>: {$sum: 1}} is evaluated
+      bson_iter_t field;
+      counting = true;
+      if (BSON_ITER_HOLDS_DOCUMENT(&op) && bson_iter_recurse(&op, &field)) {
+        while (bson_iter_next(&field)) {
+          if (!strcmp(bson_iter_key(&field), "_id")) {
+            group_id = *bson_iter_value(&field);
+            has_group_id = true;
+          } else {
+            count_field = bson_iter_key(&field);
+          }
+        }
+      }
+    } else if (!strcmp(name, "$changeStream")) {
+      append_error(reply, 40573, "Location40573",
+                   "The $changeStream stage is only supported on replica sets");
+      return;
+    }
+  }
+
+  bson_t combined;
+  bson_init(&combined);
+  if (matches.size() == 1) {
+    cursor.filter = matches[0];
+  } else if (matches.size() > 1) {
+    bson_t clauses;
+    BSON_APPEND_ARRAY_BEGIN(&combined, "$and", &clauses);
+    for (size_t i = 0; i < matches.size(); i++) {
+      bson_t clause;
+      char buffer[16];
+      const char *key;
+      bson_uint32_to_string((uint32_t)i, &key, buffer, sizeof(buffer));
+      if (bson_init_static(&clause, (const uint8_t*)matches[i].data(), matches[i].size())) {
+        bson_append_document(&clauses, key, -1, &clause);
+      }
+    }
+    bson_append_array_end(&combined, &clauses);
+    cursor.filter.assign((const char*)bson_get_data(&combined), combined.len);
+  }
+  bson_destroy(&combined);
+
+  bson_t filter;
+  bool has_filter = !cursor.filter.empty() &&
+    bson_init_static(&filter, (const uint8_t*)cursor.filter.data(), cursor.filter.size());
+
+  if (counting) {
+    size_t matched = mock_count_matches(*cursor.collection, has_filter ? &filter : nullptr);
+    int64_t n = std::max<int64_t>(0, (int64_t)matched - skip);
+    if (cursor.remaining >= 0) {
+      n = std::min(n, cursor.remaining);
+    }
+
+    bson_t cursor_doc, batch;
+    BSON_APPEND_DOCUMENT_BEGIN(reply, "cursor", &cursor_doc);
+    BSON_APPEND_ARRAY_BEGIN(&cursor_doc, "firstBatch", &batch);
+    if (n > 0) {
+      bson_t result;
+      BSON_APPEND_DOCUMENT_BEGIN(&batch, "0", &result);
+      if (has_group_id) {
+        bson_append_value(&result, "_id", 3, &group_id);
+      }
+      bson_append_int32(&result, count_field.c_str(), -1, (int32_t)n);
+      bson_append_document_end(&batch, &result);
+      counters.documents_returned++;
+    }
+    bson_append_array_end(&cursor_doc, &batch);
+    BSON_APPEND_INT64(&cursor_doc, "id", 0);
+    BSON_APPEND_UTF8(&cursor_doc, "ns", cursor.ns.c_str());
+    bson_append_document_end(reply, &cursor_doc);
+    BSON_APPEND_DOUBLE(reply, "ok", 1.0);
+    return;
+  }
+
+  while (skip > 0 && cursor.position < cursor.collection->size()) {
+    const std::string &raw = cursor.collection->raw(cursor.position++);
+    bson_t doc;
+    if (bson_init_static(&doc, (const uint8_t*)raw.data(), raw.size()) &&
+        (!has_filter || mock_document_matches(&doc, &filter))) {
+      skip--;
+    }
+  }
+
+  int64_t batch_size = MOCK_SERVER_DEFAULT_BATCH_SIZE;
+  bson_iter_t cursor_opts, batch_iter;
+  if (bson_iter_init_find(&cursor_opts, command, "cursor") && BSON_ITER_HOLDS_DOCUMENT(&cursor_opts) &&
+      bson_iter_recurse(&cursor_opts, &batch_iter) && bson_iter_find(&batch_iter, "batchSize")) {
+    batch_size = bson_iter_as_int64(&batch_iter);
+  }
+
+  // batchSize 0 asks for an empty first batch and an open cursor
+  if (batch_size == 0) {
+    bson_t cursor_doc, batch;
+    int64_t id = next_cursor_id++;
+    {
+      std::lock_guard<std::mutex> lock(cursors_mutex);
+      cursors[id] = cursor;
+    }
+    BSON_APPEND_DOCUMENT_BEGIN(reply, "cursor", &cursor_doc);
+    BSON_APPEND_ARRAY_BEGIN(&cursor_doc, "firstBatch", &batch);
+    bson_append_array_end(&cursor_doc, &batch);
+    BSON_APPEND_INT64(&cursor_doc, "id", id);
+    BSON_APPEND_UTF8(&cursor_doc, "ns", cursor.ns.c_str());
+    bson_append_document_end(reply, &cursor_doc);
+    BSON_APPEND_DOUBLE(reply, "ok", 1.0);
+    return;
+  }
+
+  append_batch(&cursor, batch_size, true, true, reply);
+}
+
+void MockMongoServer::handle_count(const bson_t *command, const char *collection_name, bson_t *reply)
+{
+  counters.counts++;
+
+  bson_iter_t iter;
+  bson_t query;
+  bool has_query = bson_iter_init_find(&iter, command, "query") && embedded_document(&iter, &query);
+  const MockCollection *collection = collection_for(collection_name);
+
+  int64_t n = (int64_t)mock_count_matches(*collection, has_query ? &query : nullptr);
+  n = std::max<int64_t>(0, n - command_int64(command, "skip", 0));
+  int64_t limit = command_int64(command, "limit", 0);
+  if (limit) {
+    n = std::min(n, limit < 0 ? -limit : limit);
+  }
+
+  BSON_APPEND_INT64(reply, "n", n);
+  BSON_APPEND_DOUBLE(reply, "ok", 1.0);
+}
+
+void MockMongoServer::handle_write(const bson_t *command, const char *command_name, const char *collection_name,
+                                   const std::vector<MockRawDocument> &sequence_documents, bson_t *reply)
+{
+  counters.writes++;
+
+  const char *array_name = !strcmp(command_name, "insert") ? "documents"
+                         : !strcmp(command_name, "update") ? "updates" : "deletes";
+  const MockCollection *collection = collection_for(collection_name);
+
+  // Statements arrive either as a body array or as a kind 1 document sequence
+  std::vector<MockRawDocument> statements;
+  bson_iter_t iter, element;
+  if (bson_iter_init_find(&iter, command, array_name) && BSON_ITER_HOLDS_ARRAY(&iter) &&
+      bson_iter_recurse(&iter, &element)) {
+    while (bson_iter_next(&element)) {
+      uint32_t length;
+      const uint8_t *data;
+      if (BSON_ITER_HOLDS_DOCUMENT(&element)) {
+        bson_iter_document(&element, &length, &data);
+        statements.push_back(MockRawDocument{data, length});
+      }
+    }
+  }
+  statements.insert(statements.end(), sequence_documents.begin(), sequence_documents.end());
+
+  int64_t n = 0;
+  if (!strcmp(command_name, "insert")) {
+    n = (int64_t)statements.size();
+  } else {
+    for (const MockRawDocument &raw : statements) {
+      bson_t statement, query;
+      bson_iter_t field;
+      if (!bson_init_static(&statement, raw.data, raw.length) ||
+          !bson_iter_init_find(&field, &statement, "q") || !embedded_document(&field, &query)) {
+        continue;
+      }
+
+      bool many;
+      if (!strcmp(command_name, "update")) {
+        many = bson_iter_init_find(&field, &statement, "multi") && bson_iter_as_bool(&field);
+      } else {
+        many = !(bson_iter_init_find(&field, &statement, "limit") && bson_iter_as_int64(&field) == 1);
+      }
+
+      size_t matched = mock_count_matches(*collection, &query);
+      n += many ? (int64_t)matched : std::min<int64_t>(1, (int64_t)matched);
+    }
+  }
+
+  BSON_APPEND_INT32(reply, "n", (int32_t)n);
+  if (!strcmp(command_name, "update")) {
+    BSON_APPEND_INT32(reply, "nModified", (int32_t)n);
+  }
+  BSON_APPEND_DOUBLE(reply, "ok", 1.0);
+}
@@ -0,0 +1,149 @@
+#ifndef MONGODB_BENCH_MOCK_SERVER_H
+#define MONGODB_BENCH_MOCK_SERVER_H
+
+/*
+  Loopback MongoDB wire protocol stub for benchmarks
+
+  Listens on 127.0.0.1 and answers the commands the engine and libmongoc
+  send: the hello handshake (OP_QUERY or OP_MSG), ping, buildInfo,
+  collStats, find, getMore, killCursors, aggregate, count, and
+  insert/update/delete with document sequences. Every namespace is served
+  from a synthetic MockCollection, so results are reproducible and no
+  external mongod is needed.
+
+  Filters support top-level and dotted equality, $eq/$ne/$gt/$gte/$lt/
+  $lte/$in/$nin/$exists, and $and/$or; operators the stub does not know
+  match every document. Aggregation understands $match, $skip, $limit,
+  $sample (first N documents), $count and a counting $group; other stages
+  pass documents through. Writes are acknowledged with the number of
+  documents they address but leave the data unchanged, so repeated runs
+  see the same collection.
+
+  Latency and bandwidth can be injected per reply to model a remote
+  server: every reply is delayed by latency_us, then paced so a connection
+  never sends faster than bandwidth_bytes_per_second.
+*/
+
+#include "mock_collection.h"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define MOCK_SERVER_DEFAULT_BATCH_SIZE 101
+#define MOCK_SERVER_MAX_MESSAGE_BYTES (48 * 1000 * 1000)
+#define MOCK_SERVER_MAX_BATCH_BYTES (16 * 1024 * 1024 - 16 * 1024)
+#define MOCK_SERVER_MAX_WIRE_VERSION 17                      // MongoDB 6.0
+
+/*
+  Document inside a received message; bson_t views are made on demand
+  because a static bson_t cannot be copied
+*/
+struct MockRawDocument {
+  const uint8_t *data;
+  uint32_t length;
+};
+
+struct MockServerOptions {
+  uint64_t latency_us = 0;                    // Added before every reply
+  uint64_t bandwidth_bytes_per_second = 0;    // 0 = unlimited
+};
+
+/*
+  What the server has been asked to do (reported by the benchmarks)
+*/
+struct MockServerCounters {
+  std::atomic<uint64_t> connections{0};
+  std::atomic<uint64_t> commands{0};
+  std::atomic<uint64_t> finds{0};
+  std::atomic<uint64_t> get_mores{0};
+  std::atomic<uint64_t> aggregates{0};
+  std::atomic<uint64_t> counts{0};
+  std::atomic<uint64_t> writes{0};
+  std::atomic<uint64_t> documents_returned{0};
+  std::atomic<uint64_t> bytes_received{0};
+  std::atomic<uint64_t> bytes_sent{0};
+};
+
+/*
+  Open server-side cursor: the remaining part of a find or aggregate
+*/
+struct MockServerCursor {
+  const MockCollection *collection;
+  std::string ns;
+  std::string filter;         // Raw BSON, empty matches everything
+  size_t position;            // Next document index to examine
+  int64_t remaining;          // Documents still to return, -1 = unlimited
+};
+
+class MockMongoServer {
+private:
+  MockServerOptions options;
+  std::shared_ptr<const MockCollection> default_collection;
+  std::map<std::string, std::shared_ptr<const MockCollection>> collections;  // By collection name
+
+  int listen_fd;
+  uint16_t bound_port;
+  std::atomic<bool> stopping;
+  std::thread accept_thread;
+
+  std::mutex connections_mutex;
+  std::vector<int> connection_fds;
+  std::vector<std::thread> connection_threads;
+
+  std::mutex cursors_mutex;
+  std::map<int64_t, MockServerCursor> cursors;
+  std::atomic<int64_t> next_cursor_id;
+  std::atomic<int32_t> next_request_id;
+
+  void accept_loop();
+  void serve_connection(int fd);
+  bool send_reply(int fd, const std::string &message);
+
+  const MockCollection *collection_for(const std::string &name) const;
+  void handle_command(const bson_t *command, const std::string &database,
+                      const std::vector<MockRawDocument> &sequence_documents, bson_t *reply);
+
+  void handle_find(const bson_t *command, const char *collection_name, const std::string &database,
+                   bson_t *reply);
+  void handle_get_more(const bson_t *command, bson_t *reply);
+  void handle_kill_cursors(const bson_t *command, bson_t *reply);
+  void handle_aggregate(const bson_t *command, const char *collection_name,
+                        const std::string &database, bson_t *reply);
+  void handle_count(const bson_t *command, const char *collection_name, bson_t *reply);
+  void handle_write(const bson_t *command, const char *command_name, const char *collection_name,
+                    const std::vector<MockRawDocument> &sequence_documents, bson_t *reply);
+
+  bool append_batch(MockServerCursor *cursor, int64_t batch_size, bool first_batch, bool may_continue,
+                    bson_t *reply);
+
+public:
+  MockServerCounters counters;
+
+  MockMongoServer(std::shared_ptr<const MockCollection> collection, const MockServerOptions &options);
+  ~MockMongoServer();
+
+  // Serve a specific data set for one collection name; others use the default
+  void add_collection(const std::string &name, std::shared_ptr<const MockCollection> collection);
+
+  bool start();               // Binds an ephemeral loopback port
+  void stop();
+
+  uint16_t port() const { return bound_port; }
+
+  // Engine connection string (mongodb://host:port/database/collection)
+  std::string connection_string(const std::string &database, const std::string &collection) const;
+};
+
+/*
+  Filter evaluation used by the server, exposed so benchmarks can check
+  how many rows a pushed condition should return
+*/
+bool mock_document_matches(const bson_t *doc, const bson_t *filter);
+size_t mock_count_matches(const MockCollection &collection, const bson_t *filter);
+
+#endif /* MONGODB_BENCH_MOCK_SERVER_H */
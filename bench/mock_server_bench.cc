@@ -0,0 +1,416 @@
+/*
+  MongoDB Storage Engine - End-to-End Benchmark Against the Mock Server
+
+  Starts the loopback wire protocol stub (or uses --uri to target a real
+  server), then runs N threads that each take a client from the engine's
+  connection pool and issue the same requests the handler does: point
+  reads by _id, full and filtered scans with the handler's cursor options,
+  counts, aggregations and batched inserts. Reports throughput, latency
+  percentiles and what the server saw, so regressions in the driver path
+  can be measured without mysqld or mongod.
+
+  Usage: mock_server_bench [--workload mixed] [--threads 8] [--seconds 5]
+                           [--documents 100000] [--payload-bytes 256]
+                           [--extra-fields 0] [--scan-rows 1000]
+                           [--insert-batch 100] [--latency-us 0]
+                           [--bandwidth-mbps 0] [--uri mongodb://host/db/coll]
+
+  Workloads: point, scan, filter, count, aggregate, insert, mixed
+*/
+
+#include "mock_server.h"
+#include "mongodb_connection.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#define BENCH_DATABASE "bench"
+#define BENCH_COLLECTION "documents"
+
+enum BenchOperation {
+  BENCH_POINT,
+  BENCH_SCAN,
+  BENCH_FILTER,
+  BENCH_COUNT,
+  BENCH_AGGREGATE,
+  BENCH_INSERT,
+  BENCH_OPERATION_COUNT
+};
+
+static const char *bench_operation_names[BENCH_OPERATION_COUNT] = {
+  "point", "scan", "filter", "count", "aggregate", "insert"
+};
+
+struct BenchOptions {
+  std::string workload = "mixed";
+  unsigned threads = 8;
+  double seconds = 5.0;
+  size_t documents = 100000;
+  size_t payload_bytes = 256;
+  unsigned extra_fields = 0;
+  int64_t scan_rows = 1000;
+  size_t insert_batch = 100;
+  uint64_t latency_us = 0;
+  double bandwidth_mbps = 0;
+  std::string uri;              // External server instead of the mock
+};
+
+struct BenchThreadResult {
+  uint64_t operations[BENCH_OPERATION_COUNT] = {};
+  uint64_t errors = 0;
+  uint64_t documents = 0;
+  uint64_t checksum = 0;
+  std::vector<uint32_t> latencies_us;
+};
+
+static inline uint64_t next_random(uint64_t *state)
+{
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+  Mixed workload: 70% point reads, 15% scans, 5% filtered scans, 2% counts,
+  3% aggregations, 5% inserts
+*/
+static BenchOperation pick_operation(const BenchOptions &options, uint64_t r)
+{
+  for (int op = 0; op < BENCH_OPERATION_COUNT; op++) {
+    if (options.workload == bench_operation_names[op]) {
+      return (BenchOperation)op;
+    }
+  }
+
+  unsigned bucket = (unsigned)(r % 100);
+  if (bucket < 70) return BENCH_POINT;
+  if (bucket < 85) return BENCH_SCAN;
+  if (bucket < 90) return BENCH_FILTER;
+  if (bucket < 92) return BENCH_COUNT;
+  if (bucket < 95) return BENCH_AGGREGATE;
+  return BENCH_INSERT;
+}
+
+static uint64_t drain_cursor(mongoc_cursor_t *cursor, BenchThreadResult *result, bool *failed)
+{
+  const bson_t *doc;
+  uint64_t rows = 0;
+  bson_error_t error;
+
+  while (mongoc_cursor_next(cursor, &doc)) {
+    result->checksum += mock_consume_document(doc);
+    rows++;
+  }
+  if (mongoc_cursor_error(cursor, &error)) {
+    fprintf(stderr, "MOCK_SERVER_BENCH: cursor error: %s\n", error.message);
+    *failed = true;
+  }
+  mongoc_cursor_destroy(cursor);
+  return rows;
+}
+
+static bool run_operation(BenchOperation op, const BenchOptions &options, mongoc_collection_t *collection,
+                          uint64_t r, const std::vector<bson_t*> &insert_documents,
+                          BenchThreadResult *result)
+{
+  bool failed = false;
+  bson_error_t error;
+  int64_t id = (int64_t)(r % options.documents);
+
+  switch (op) {
+  case BENCH_POINT: {
+    // rnd_pos() / unique key lookup
+    bson_t filter, opts;
+    bson_init(&filter);
+    bson_init(&opts);
+    BSON_APPEND_INT64(&filter, "_id", id);
+    BSON_APPEND_INT64(&opts, "limit", 1);
+    result->documents += drain_cursor(mongoc_collection_find_with_opts(collection, &filter, &opts, nullptr),
+                                      result, &failed);
+    bson_destroy(&opts);
+    bson_destroy(&filter);
+    break;
+  }
+  case BENCH_SCAN:
+  case BENCH_FILTER: {
+    // rnd_init() cursor options, bounded so one scan cannot dominate a run
+    bson_t filter, opts, range;
+    bson_init(&filter);
+    bson_init(&opts);
+    if (op == BENCH_FILTER) {
+      BSON_APPEND_BOOL(&filter, "active", true);
+      BSON_APPEND_DOCUMENT_BEGIN(&filter, "value", &range);
+      BSON_APPEND_DOUBLE(&range, "$gte", (double)(r % 900) / 10.0);
+      bson_append_document_end(&filter, &range);
+    } else {
+      BSON_APPEND_DOCUMENT_BEGIN(&filter, "_id", &range);
+      BSON_APPEND_INT64(&range, "$gte", id);
+      bson_append_document_end(&filter, &range);
+    }
+    BSON_APPEND_INT32(&opts, "batchSize", 1000);
+    BSON_APPEND_BOOL(&opts, "noCursorTimeout", true);
+    BSON_APPEND_INT64(&opts, "limit", options.scan_rows);
+    result->documents += drain_cursor(mongoc_collection_find_with_opts(collection, &filter, &opts, nullptr),
+                                      result, &failed);
+    bson_destroy(&opts);
+    bson_destroy(&filter);
+    break;
+  }
+  case BENCH_COUNT: {
+    // records() / info() with a pushed condition
+    bson_t filter;
+    bson_init(&filter);
+    BSON_APPEND_BOOL(&filter, "active", false);
+    if (mongoc_collection_count_documents(collection, &filter, nullptr, nullptr, nullptr, &error) < 0) {
+      fprintf(stderr, "MOCK_SERVER_BENCH: count failed: %s\n", error.message);
+      failed = true;
+    }
+    bson_destroy(&filter);
+    break;
+  }
+  case BENCH_AGGREGATE: {
+    bson_t *pipeline = BCON_NEW("pipeline", "[",
+                                "{", "$match", "{", "_id", "{", "$gte", BCON_INT64(id), "}", "}", "}",
+                                "{", "$limit", BCON_INT64(options.scan_rows), "}",
+                                "]");
+    result->documents += drain_cursor(mongoc_collection_aggregate(collection, MONGOC_QUERY_NONE, pipeline,
+                                                                  nullptr, nullptr),
+                                      result, &failed);
+    bson_destroy(pipeline);
+    break;
+  }
+  case BENCH_INSERT:
+    if (!mongoc_collection_insert_many(collection, (const bson_t**)insert_documents.data(),
+                                       insert_documents.size(), nullptr, nullptr, &error)) {
+      fprintf(stderr, "MOCK_SERVER_BENCH: insert failed: %s\n", error.message);
+      failed = true;
+    }
+    break;
+  default:
+    break;
+  }
+
+  return !failed;
+}
+
+static void bench_worker(const BenchOptions &options, const std::string &connection_string,
+                         const MockCollection &mock, const std::atomic<bool> &stop,
+                         unsigned thread_index, BenchThreadResult *result)
+{
+  uint64_t state = 0x9E3779B97F4A7C15ULL * (thread_index + 1);
+  MongoConnectionPool *pool = get_or_create_connection_pool(connection_string);
+  std::string database = pool->get_database_name();
+  std::string collection_name = pool->get_collection_name();
+
+  // Each thread inserts its own copies of a slice of the mock documents
+  std::vector<bson_t*> insert_documents;
+  for (size_t i = 0; i < options.insert_batch; i++) {
+    const std::string &raw = mock.raw((thread_index * options.insert_batch + i) % mock.size());
+    insert_documents.push_back(bson_new_from_data((const uint8_t*)raw.data(), raw.size()));
+  }
+
+  while (!stop.load(std::memory_order_relaxed)) {
+    uint64_t r = next_random(&state);
+    BenchOperation op = pick_operation(options, r >> 48);
+
+    auto started = std::chrono::steady_clock::now();
+
+    // What every handler call does: take a pooled client, use it, return it
+    mongoc_client_t *client = pool->acquire_connection();
+    if (!client) {
+      result->errors++;
+      std::this_thread::yield();
+      continue;
+    }
+    mongoc_collection_t *collection = mongoc_client_get_collection(client, database.c_str(),
+                                                                   collection_name.c_str());
+    bool ok = run_operation(op, options, collection, r >> 8, insert_documents, result);
+    mongoc_collection_destroy(collection);
+    pool->release_connection(client);
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - started).count();
+
+    if (ok) {
+      result->operations[op]++;
+      result->latencies_us.push_back((uint32_t)std::min<int64_t>(elapsed, UINT32_MAX));
+    } else {
+      result->errors++;
+    }
+  }
+
+  for (bson_t *doc : insert_documents) {
+    bson_destroy(doc);
+  }
+}
+
+static bool parse_options(int argc, char **argv, BenchOptions *options)
+{
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      fprintf(stderr, "Missing value for %s\n", argv[i]);
+      return false;
+    }
+
+    const char *name = argv[i];
+    const char *value = argv[++i];
+
+    if (!strcmp(name, "--workload")) {
+      options->workload = value;
+    } else if (!strcmp(name, "--threads")) {
+      options->threads = (unsigned)strtoul(value, nullptr, 10);
+    } else if (!strcmp(name, "--seconds")) {
+      options->seconds = strtod(value, nullptr);
+    } else if (!strcmp(name, "--documents")) {
+      options->documents = strtoull(value, nullptr, 10);
+    } else if (!strcmp(name, "--payload-bytes")) {
+      options->payload_bytes = strtoull(value, nullptr, 10);
+    } else if (!strcmp(name, "--extra-fields")) {
+      options->extra_fields = (unsigned)strtoul(value, nullptr, 10);
+    } else if (!strcmp(name, "--scan-rows")) {
+      options->scan_rows = strtoll(value, nullptr, 10);
+    } else if (!strcmp(name, "--insert-batch")) {
+      options->insert_batch = strtoull(value, nullptr, 10);
+    } else if (!strcmp(name, "--latency-us")) {
+      options->latency_us = strtoull(value, nullptr, 10);
+    } else if (!strcmp(name, "--bandwidth-mbps")) {
+      options->bandwidth_mbps = strtod(value, nullptr);
+    } else if (!strcmp(name, "--uri")) {
+      options->uri = value;
+    } else {
+      fprintf(stderr, "Unknown option %s\n", name);
+      return false;
+    }
+  }
+
+  bool known_workload = options->workload == "mixed";
+  for (int op = 0; op < BENCH_OPERATION_COUNT; op++) {
+    known_workload = known_workload || options->workload == bench_operation_names[op];
+  }
+
+  if (!known_workload || !options->threads || !options->documents || options->seconds <= 0 ||
+      options->scan_rows <= 0 || !options->insert_batch) {
+    fprintf(stderr, "Invalid options\n");
+    return false;
+  }
+  return true;
+}
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, double fraction)
+{
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = (size_t)(fraction * (double)(sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+int main(int argc, char **argv)
+{
+  BenchOptions options;
+  if (!parse_options(argc, argv, &options)) {
+    return 1;
+  }
+
+  mongoc_init();
+
+  auto mock = std::make_shared<MockCollection>(options.documents, options.payload_bytes, options.extra_fields);
+  MockServerOptions server_options;
+  server_options.latency_us = options.latency_us;
+  server_options.bandwidth_bytes_per_second = (uint64_t)(options.bandwidth_mbps * 1024 * 1024);
+  MockMongoServer server(mock, server_options);
+
+  std::string connection_string = options.uri;
+  if (connection_string.empty()) {
+    if (!server.start()) {
+      mongoc_cleanup();
+      return 1;
+    }
+    connection_string = server.connection_string(BENCH_DATABASE, BENCH_COLLECTION);
+  }
+
+  MongoConnectionPool *pool = get_or_create_connection_pool(connection_string);
+  if (!pool->is_connection_valid()) {
+    fprintf(stderr, "Invalid connection string: %s\n", pool->get_connection_error().c_str());
+    mongoc_cleanup();
+    return 1;
+  }
+  pool->set_max_connections(options.threads);
+
+  printf("Mock server bench: %s workload, %u threads, %zu documents of %zu payload bytes, "
+         "%u extra fields, latency %llu us, bandwidth %s, target %s\n",
+         options.workload.c_str(), options.threads, options.documents, options.payload_bytes,
+         options.extra_fields, (unsigned long long)options.latency_us,
+         options.bandwidth_mbps > 0 ? (std::to_string(options.bandwidth_mbps) + " MB/s").c_str() : "unlimited",
+         pool->get_safe_connection_string().c_str());
+
+  std::vector<BenchThreadResult> results(options.threads);
+  std::vector<std::thread> workers;
+  std::atomic<bool> stop(false);
+
+  auto started = std::chrono::steady_clock::now();
+  for (unsigned t = 0; t < options.threads; t++) {
+    workers.emplace_back(bench_worker, std::cref(options), std::cref(connection_string), std::cref(*mock),
+                         std::cref(stop), t, &results[t]);
+  }
+
+  std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+  stop = true;
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  uint64_t operations[BENCH_OPERATION_COUNT] = {};
+  uint64_t total = 0, errors = 0, documents = 0, checksum = 0;
+  std::vector<uint32_t> latencies;
+  for (const auto &result : results) {
+    for (int op = 0; op < BENCH_OPERATION_COUNT; op++) {
+      operations[op] += result.operations[op];
+      total += result.operations[op];
+    }
+    errors += result.errors;
+    documents += result.documents;
+    checksum += result.checksum;
+    latencies.insert(latencies.end(), result.latencies_us.begin(), result.latencies_us.end());
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  printf("%12s %14s %14s %10s %10s %10s %10s\n", "operations", "ops/s", "docs/s",
+         "p50_us", "p99_us", "p999_us", "errors");
+  printf("%12llu %14.0f %14.0f %10u %10u %10u %10llu\n", (unsigned long long)total, total / elapsed,
+         documents / elapsed, percentile(latencies, 0.50), percentile(latencies, 0.99),
+         percentile(latencies, 0.999), (unsigned long long)errors);
+
+  printf("By operation:");
+  for (int op = 0; op < BENCH_OPERATION_COUNT; op++) {
+    if (operations[op]) {
+      printf(" %s=%llu", bench_operation_names[op], (unsigned long long)operations[op]);
+    }
+  }
+  printf(" (checksum %llu)\n", (unsigned long long)checksum);
+
+  if (options.uri.empty()) {
+    printf("Server: %llu connections, %llu commands, %llu finds, %llu getMores, %llu aggregates, "
+           "%llu writes, %llu documents, %llu bytes sent\n",
+           (unsigned long long)server.counters.connections.load(),
+           (unsigned long long)server.counters.commands.load(),
+           (unsigned long long)server.counters.finds.load(),
+           (unsigned long long)server.counters.get_mores.load(),
+           (unsigned long long)server.counters.aggregates.load(),
+           (unsigned long long)server.counters.writes.load(),
+           (unsigned long long)server.counters.documents_returned.load(),
+           (unsigned long long)server.counters.bytes_sent.load());
+  }
+
+  cleanup_all_connection_pools();
+  server.stop();
+  mongoc_cleanup();
+  return errors ? 2 : 0;
+}
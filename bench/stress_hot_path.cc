@@ -0,0 +1,224 @@
+/*
+  MongoDB Storage Engine - Hot Path Concurrency Stress Benchmark
+
+  Runs N threads of mixed point reads and scans against an in-process mock
+  collection, doubling N from 1 up to --threads, and reports throughput and
+  scaling efficiency per level. Every operation goes through the same
+  engine-wide structures a handler uses: the registry lookup done by
+  open(), the sharded point cache for unique-key reads, and per-document
+  field walks for scans. Near-linear scaling (efficiency close to 1.0 up to
+  the number of cores) means no global lock is left on these paths.
+
+  Usage: stress_hot_path [--threads 64] [--seconds 2] [--documents 100000]
+                         [--hot-keys 10000] [--scan-percent 20] [--scan-rows 100]
+                         [--collections 8] [--payload-bytes 256]
+                         [--point-cache-bytes 67108864]
+*/
+
+#include "mock_collection.h"
+#include "mongodb_point_cache.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#define STRESS_CONNECTION_STRING "mongodb://mock.invalid:27017/bench"
+
+struct StressOptions {
+  unsigned max_threads = 64;
+  double seconds = 2.0;
+  size_t documents = 100000;
+  size_t hot_keys = 10000;
+  unsigned scan_percent = 20;
+  size_t scan_rows = 100;
+  unsigned collections = 8;
+  size_t payload_bytes = 256;
+  size_t point_cache_bytes = 64 * 1024 * 1024;
+};
+
+struct StressThreadResult {
+  uint64_t point_reads = 0;
+  uint64_t scans = 0;
+  uint64_t checksum = 0;
+};
+
+/*
+  xorshift64* - cheap per-thread generator, no shared state
+*/
+static inline uint64_t next_random(uint64_t *state)
+{
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+static void stress_worker(const StressOptions &options, const MockCollection &mock,
+                          const std::vector<std::string> &collection_names,
+                          const std::atomic<bool> &stop, unsigned thread_index,
+                          StressThreadResult *result)
+{
+  uint64_t state = 0x9E3779B97F4A7C15ULL * (thread_index + 1);
+  std::string key;
+
+  while (!stop.load(std::memory_order_relaxed)) {
+    uint64_t r = next_random(&state);
+    const std::string &collection_name = collection_names[r % collection_names.size()];
+
+    // What open() does for every handler
+    MongoPointCache *cache = get_or_create_point_cache(STRESS_CONNECTION_STRING, collection_name);
+
+    if ((r >> 8) % 100 < options.scan_percent) {
+      // Scan - walk a run of consecutive documents
+      size_t start = (size_t)((r >> 16) % mock.size());
+      for (size_t i = 0; i < options.scan_rows; i++) {
+        const std::string &raw = mock.raw((start + i) % mock.size());
+        bson_t doc;
+        if (bson_init_static(&doc, (const uint8_t*)raw.data(), raw.size())) {
+          result->checksum += mock_consume_document(&doc);
+        }
+      }
+      result->scans++;
+      continue;
+    }
+
+    // Point read - unique key lookup through the point cache
+    uint64_t id = (r >> 16) % options.hot_keys;
+    key.assign("_id:");
+    key.append(std::to_string(id));
+
+    std::shared_ptr<const std::string> cached = cache->lookup(key);
+    bson_t doc;
+    if (cached) {
+      if (bson_init_static(&doc, (const uint8_t*)cached->data(), cached->size())) {
+        result->checksum += mock_consume_document(&doc);
+      }
+    } else {
+      uint64_t generation = cache->get_generation();
+      if (mock.find_by_id(id, &doc)) {
+        cache->insert(key, &doc, generation, options.point_cache_bytes,
+                      MONGODB_DEFAULT_POINT_CACHE_TTL_SECONDS);
+        result->checksum += mock_consume_document(&doc);
+      }
+    }
+    result->point_reads++;
+  }
+}
+
+static bool parse_options(int argc, char **argv, StressOptions *options)
+{
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      fprintf(stderr, "Missing value for %s\n", argv[i]);
+      return false;
+    }
+
+    const char *name = argv[i];
+    const char *value = argv[++i];
+
+    if (!strcmp(name, "--threads")) {
+      options->max_threads = (unsigned)strtoul(value, nullptr, 10);
+    } else if (!strcmp(name, "--seconds")) {
+      options->seconds = strtod(value, nullptr);
+    } else if (!strcmp(name, "--documents")) {
+      options->documents = strtoull(value, nullptr, 10);
+    } else if (!strcmp(name, "--hot-keys")) {
+      options->hot_keys = strtoull(value, nullptr, 10);
+    } else if (!strcmp(name, "--scan-percent")) {
+      options->scan_percent = (unsigned)strtoul(value, nullptr, 10);
+    } else if (!strcmp(name, "--scan-rows")) {
+      options->scan_rows = strtoull(value, nullptr, 10);
+    } else if (!strcmp(name, "--collections")) {
+      options->collections = (unsigned)strtoul(value, nullptr, 10);
+    } else if (!strcmp(name, "--payload-bytes")) {
+      options->payload_bytes = strtoull(value, nullptr, 10);
+    } else if (!strcmp(name, "--point-cache-bytes")) {
+      options->point_cache_bytes = strtoull(value, nullptr, 10);
+    } else {
+      fprintf(stderr, "Unknown option %s\n", name);
+      return false;
+    }
+  }
+
+  if (!options->max_threads || !options->documents || !options->collections ||
+      options->seconds <= 0 || options->scan_percent > 100) {
+    fprintf(stderr, "Invalid options\n");
+    return false;
+  }
+  if (options->hot_keys == 0 || options->hot_keys > options->documents) {
+    options->hot_keys = options->documents;
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  StressOptions options;
+  if (!parse_options(argc, argv, &options)) {
+    return 1;
+  }
+
+  MockCollection mock(options.documents, options.payload_bytes);
+
+  std::vector<std::string> collection_names;
+  for (unsigned i = 0; i < options.collections; i++) {
+    collection_names.push_back("bench_" + std::to_string(i));
+  }
+
+  printf("Hot path stress: %zu documents, %u%% scans of %zu rows, %u collections, %u hardware threads\n",
+         options.documents, options.scan_percent, options.scan_rows, options.collections,
+         std::thread::hardware_concurrency());
+  printf("%8s %14s %14s %14s %11s\n", "threads", "ops/s", "point_reads/s", "scans/s", "efficiency");
+
+  double base_ops_per_thread = 0;
+  uint64_t checksum = 0;
+
+  for (unsigned threads = 1; threads <= options.max_threads; threads *= 2) {
+    std::vector<StressThreadResult> results(threads);
+    std::vector<std::thread> workers;
+    std::atomic<bool> stop(false);
+
+    auto started = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < threads; t++) {
+      workers.emplace_back(stress_worker, std::cref(options), std::cref(mock),
+                           std::cref(collection_names), std::cref(stop), t, &results[t]);
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+    stop = true;
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    uint64_t point_reads = 0, scans = 0;
+    for (const auto &result : results) {
+      point_reads += result.point_reads;
+      scans += result.scans;
+      checksum += result.checksum;
+    }
+
+    double ops_per_second = (point_reads + scans) / elapsed;
+    if (threads == 1) {
+      base_ops_per_thread = ops_per_second;
+    }
+    double efficiency = base_ops_per_thread > 0 ? ops_per_second / (base_ops_per_thread * threads) : 0;
+
+    printf("%8u %14.0f %14.0f %14.0f %11.2f\n", threads, ops_per_second,
+           point_reads / elapsed, scans / elapsed, efficiency);
+    fflush(stdout);
+  }
+
+  printf("Point cache: %llu hits, %llu misses, %llu evictions (checksum %llu)\n",
+         (unsigned long long)point_cache_counters.hits.load(),
+         (unsigned long long)point_cache_counters.misses.load(),
+         (unsigned long long)point_cache_counters.evictions.load(),
+         (unsigned long long)checksum);
+
+  cleanup_all_point_caches();
+  return 0;
+}
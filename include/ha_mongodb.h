@@ -28,14 +28,28 @@
 // Standard C++ includes for Phase 3A enhancements
 #include <chrono>
 #include <cstdint>
+#include <memory>
+#include <string>
 
 // Include forward declarations for MongoDB components
 #include "mongodb_schema.h"
+#include "mongodb_result_cache.h"
+#include "mongodb_row_convert.h"
+#include "mongodb_plan_cache.h"
 
 // Forward declarations
 class MongoConnectionPool;
 class MongoQueryTranslator;
 class MongoCursorManager;
+class MongoChangeStreamWatcher;
+class MongoCollectionMirror;
+class MongoPointCache;
+class MongoFilterPlanCache;
+class MongoSharedScan;
+class MongoSharedScanCoordinator;
+class MongoKeyFetch;
+struct MongoMirrorSnapshot;
+struct MongoScanBatch;
 
 /*
   MongoDB server connection information - shared among all handlers
@@ -90,6 +104,11 @@ typedef struct st_mongodb_share {
   bool schema_inferred;
   std::vector<MongoFieldMapping> field_mappings;
   time_t schema_last_updated;
+  MongoChangeStreamWatcher *change_watcher; // Owned by the global watcher registry
+  MongoCollectionMirror *mirror;            // LOCAL_MIRROR copy, owned by the global mirror registry
+  MongoPointCache *point_cache;             // Unique-key lookups, owned by the global cache registry
+  MongoSharedScanCoordinator *shared_scans; // Cooperative full scans, owned by the global coordinator registry
+  MongoFilterPlanCache *filter_plans;       // Translated pushed conditions, owned by Mongo_table_share
   
   // Statistics
   ha_rows records;
@@ -106,6 +125,26 @@ typedef struct st_mongodb_share {
   MONGODB_SERVER *server;
 } MONGODB_SHARE;
 
+/*
+  State of one table definition that every handler opened on it sees,
+  attached to the TABLE_SHARE through handler::get_ha_share_ptr() and
+  freed with it. Filter plans name columns by field index, so they hold
+  for every TABLE instance of the definition.
+*/
+class Mongo_table_share : public Handler_share
+{
+public:
+  MongoFilterPlanCache filter_plans;  // Translated pushed conditions of all sessions
+};
+
+/*
+  Engine-defined table options, e.g. CREATE TABLE ... ENGINE=MONGODB RESULT_CACHE=YES
+*/
+struct ha_table_option_struct {
+  bool result_cache;            // Opt in to the engine-wide result cache
+  bool local_mirror;            // Serve scans from a local columnar mirror
+};
+
 /*
   Error codes specific to MongoDB storage engine
 */
@@ -130,6 +169,8 @@ typedef struct st_mongodb_share {
 class ha_mongodb final : public handler
 {
   friend int mongodb_db_init(void *p);
+  friend class ha_mongodb_distinct;
+  friend group_by_handler *mongodb_create_group_by(THD *thd, Query *query);
 
   THR_LOCK_DATA lock;           // MariaDB lock integration
   MONGODB_SHARE *share;         // Shared table metadata
@@ -168,10 +209,67 @@ class ha_mongodb final : public handler
   
   // Query state
   bson_t *pushed_condition;     // Condition pushed down to MongoDB
+  bson_t *condition_buffer;     // Spare filter buffer reused by cond_push()
   bson_t *sort_spec;           // ORDER BY specification for MongoDB
   bool position_called;         // Track if position() was called
   ha_rows scan_position;        // Current position in table scan (for rnd_pos support)
   
+  // Result cache state (see mongodb_result_cache.h)
+  std::string result_cache_key;  // Key of the current scan, empty if not cacheable
+  std::shared_ptr<const MongoCachedResult> cached_result; // Entry being replayed
+  std::unique_ptr<MongoCachedResult> result_builder;      // Rows captured on a miss
+  size_t result_builder_limit;   // Largest entry the cache will accept
+  ha_rows cached_row_index;      // Next row to replay
+  bool result_scan_complete;     // Cursor reached the end, capture is usable
+  bool capture_shared;           // Current scan may enter the result cache
+  bool capture_rescan;           // Current scan repeats one of this statement
+  
+  // Scans of the current statement by key; null until one is repeated
+  std::unordered_map<std::string, std::shared_ptr<const MongoCachedResult>> rescan_results;
+  size_t rescan_bytes;           // Memory held by rescan_results
+  
+  // Local mirror scan state (see mongodb_mirror.h)
+  std::shared_ptr<const MongoMirrorSnapshot> mirror_snapshot; // Snapshot being scanned
+  std::vector<uint64_t> mirror_rows;  // Matching row references, indexed by scan position
+  
+  // Shared scan state (see mongodb_shared_scan.h)
+  std::shared_ptr<MongoSharedScan> shared_scan;            // Attached producer, null once detached
+  std::shared_ptr<const MongoScanBatch> shared_batch;      // Batch being read
+  std::shared_ptr<const MongoScanBatch> shared_last_batch; // Holds the last returned document
+  uint64_t shared_sequence;      // Sequence of shared_batch
+  size_t shared_batch_offset;    // Next document in shared_batch
+  size_t shared_last_offset;     // Last returned document in shared_last_batch
+  bool shared_joined_late;       // Attached after the producer's first batch left the window
+  std::string shared_first_id;   // First _id seen by a late reader
+  bson_t *shared_filter;         // Filter of the shared scan, for the remainder cursor
+  /*
+    The document views are allocated with bson_aligned_alloc0(): bson_t
+    requires 128 byte alignment, which the memory mysqld creates handlers
+    in does not provide, so they cannot be members
+  */
+  bson_t *shared_doc_view;       // current_doc for documents read from a shared batch (bson_init_static)
+  bool positions_by_id;          // position() stores indexes into positioned_ids
+  std::vector<std::string> positioned_ids; // Encoded _ids of positioned rows
+  
+  // Batched multi-range read state (see mongodb_key_fetch.h)
+  bool mrr_batched;              // multi_range_read_next() reads chunks of keys
+  bool mrr_associate;            // Each row is returned once per range with its key
+  uint mrr_key_length;           // Key image length shared by the ranges
+  std::unordered_multimap<std::string, range_id_t> mrr_ranges; // Ranges by key image
+  std::vector<range_id_t> mrr_owed;  // Ranges still to be given the current row
+  std::string mrr_key_image;     // Key image of the current row
+  std::unique_ptr<MongoKeyFetch> key_fetch;         // Pipelined chunks, null for one chunk
+  std::shared_ptr<const MongoScanBatch> mrr_batch;  // Batch being read
+  size_t mrr_batch_offset;       // Next document in mrr_batch
+  bson_t *mrr_doc_view;          // current_doc for documents read from mrr_batch
+  
+  // Key images are decoded through the fields into this, not record[0]
+  std::vector<uchar> key_record;
+  std::string checked_key;       // Key image of an exact read sent without its predicate
+  
+  // Document to row conversion (see mongodb_row_convert.h)
+  std::vector<MongoColumn> row_columns; // Table columns, resolved on first conversion
+  
   // Error handling
   int remote_error_number;
   char remote_error_buf[MONGODB_QUERY_BUFFER_SIZE];
@@ -182,6 +280,7 @@ private:
   */
   MONGODB_SHARE *get_share();
   int free_share();
+  Mongo_table_share *get_table_share();
   int parse_connection_string(const char *connection_string);
   int connect_to_mongodb();
   void disconnect_from_mongodb();
@@ -192,12 +291,68 @@ private:
   */
   // Document-to-row conversion methods (virtual column approach)
   int convert_document_to_row(const bson_t *doc, uchar *buf);
-  int convert_full_document_field(const bson_t *doc, Field *field, uint array_index);
-  int convert_simple_field_from_document(const bson_t *doc, Field *field, const char *field_name);
-  int convert_mongodb_id_field(const bson_t *doc, Field *field);
+  // Into record[0] of another table, field i from columns[i]
+  int convert_document_to_fields(const bson_t *doc, TABLE *dest,
+                                 const std::vector<MongoColumn> &columns);
   int convert_bson_value_to_field(bson_iter_t *iter, Field *field, MongoFieldMapping *mapping);
   int convert_row_to_document(const uchar *buf, bson_t **doc);
   
+  /*
+    Result cache helpers
+  */
+  bool result_cache_lookup(const bson_t *query, const char *projection_mode);
+  void result_cache_begin();
+  void result_cache_capture_row(const uchar *buf);
+  void result_cache_finish();
+  size_t rescan_room() const;
+  int result_cache_replay_row(uchar *buf, ha_rows row);
+  
+  /*
+    Local mirror helpers
+  */
+  bool mirror_scan_begin(bool scan);
+  int mirror_read_row(uchar *buf, ha_rows row);
+  
+  /*
+    Shared scan helpers
+  */
+  bool shared_scan_begin(const bson_t *query, bool scan);
+  int shared_scan_next(const uint8_t **data, uint32_t *length);
+  int shared_scan_start_remainder(bool detached);
+  void shared_scan_end();
+  
+  /*
+    Unique key point lookups
+  */
+  bool append_key_filter(const uchar *key, key_part_map keypart_map, bson_t *filter,
+                         std::string *cache_key);
+  int point_lookup(uchar *buf, const uchar *key, key_part_map keypart_map, bool *handled);
+  
+  /*
+    Index condition pushdown
+  */
+  bool index_condition_active() const;
+  bool lookup_filter(const bson_t *key_filter, bson_t *filter, bool *indexed);
+  int check_index_condition();
+  int next_index_row(uchar *buf);
+  bool row_matches_key(uchar *buf);
+  
+  /*
+    Batched multi-range reads
+  */
+  bool mrr_collect_keys(std::vector<std::string> *keys);
+  void mrr_normalize_key(std::string *image);
+  int mrr_start(const std::vector<std::string> &keys);
+  int mrr_next_document(const bson_t **doc);
+  void mrr_end();
+  
+  /*
+    Reusable filter buffers
+  */
+  const bson_t *scan_filter() const;
+  void recycle_condition(bson_t *condition);
+  bool reads_only_id() const;
+  
   /*
     Query building helpers
   */
@@ -225,7 +380,7 @@ public:
 
   ulong index_flags(uint inx, uint part, bool all_parts) const override
   {
-    return (HA_READ_NEXT | HA_READ_RANGE);
+    return (HA_READ_NEXT | HA_READ_RANGE | HA_DO_INDEX_COND_PUSHDOWN);
   }
 
   /*
@@ -269,6 +424,16 @@ public:
                       bool eq_range, bool sorted) override;
   int read_range_next() override;
   
+  // Multi-range reads - exact keys are fetched in chunks
+  int multi_range_read_init(RANGE_SEQ_IF *seq, void *seq_init_param, uint n_ranges,
+                            uint mode, HANDLER_BUFFER *buf) override;
+  int multi_range_read_next(range_id_t *range_info) override;
+  ha_rows multi_range_read_info_const(uint keyno, RANGE_SEQ_IF *seq, void *seq_init_param,
+                                      uint n_ranges, uint *bufsz, uint *mrr_mode,
+                                      ha_rows limit, Cost_estimate *cost) override;
+  ha_rows multi_range_read_info(uint keyno, uint n_ranges, uint keys, uint key_parts,
+                                uint *bufsz, uint *mrr_mode, Cost_estimate *cost) override;
+  
   // Record counting - implement MongoDB native count pushdown
   ha_rows records() override;
   
@@ -289,6 +454,7 @@ public:
     // Condition pushdown support
   const COND *cond_push(const COND *cond) override;
   void cond_pop() override;
+  Item *idx_cond_push(uint keyno, Item *idx_cond) override;
   
   // Locking integration
   int external_lock(THD *thd, int lock_type) override;
@@ -324,6 +490,23 @@ public:
 extern const char mongodb_ident_quote_char;    // Character for quoting identifiers
 extern const char mongodb_value_quote_char;    // Character for quoting literals
 
+extern handlerton *mongodb_hton;
+
+// DISTINCT pushdown (ha_mongodb_distinct.h), null for queries left to MariaDB
+group_by_handler *mongodb_create_group_by(THD *thd, Query *query);
+
+/*
+  System variables read outside the plugin declaration unit
+*/
+extern my_bool mongodb_enable_change_streams;
+extern ulonglong mongodb_result_cache_size;
+extern ulonglong mongodb_rescan_cache_size;
+extern int mongodb_result_cache_ttl;
+extern ulonglong mongodb_point_cache_size;
+extern int mongodb_point_cache_ttl;
+extern my_bool mongodb_shared_scans;
+extern my_bool mongodb_enable_aggregation_pushdown;
+
 /*
   Connection and schema management functions
 */
@@ -0,0 +1,55 @@
+#ifndef HA_MONGODB_DISTINCT_INCLUDED
+#define HA_MONGODB_DISTINCT_INCLUDED
+
+/*
+  MongoDB DISTINCT pushdown
+
+  A group by handler (handlerton::create_group_by) taking over two query
+  forms on one MONGODB table whose whole WHERE clause translates:
+
+    SELECT DISTINCT a, b FROM t WHERE ...
+    SELECT COUNT(DISTINCT a) FROM t WHERE ...
+
+  DISTINCT rows are read from MongoDB's distinct values
+  (mongodb_distinct.h); MariaDB still removes duplicates and sorts, so
+  values MongoDB tells apart but the column's collation does not ('a' and
+  'A') come out once. COUNT(DISTINCT) is counted by MongoDB and is taken
+  over only for integer and double columns and binary strings without
+  padding, where BSON equality agrees with the column's, and only when
+  no matching document holds a value the column would show otherwise
+  (a double in an INT column, a null, a subdocument), which one probe
+  query checks while the query is planned.
+
+  Disabled with mongodb_enable_aggregation_pushdown = OFF.
+*/
+
+#include "group_by_handler.h"
+#include "mongodb_distinct.h"
+#include "mongodb_row_convert.h"
+#include <vector>
+
+class ha_mongodb;
+
+class ha_mongodb_distinct : public group_by_handler
+{
+private:
+  ha_mongodb *file;                     // Handler of the MONGODB table
+  std::vector<MongoColumn> columns;     // Source columns, one per select item
+  bool count_only;                      // COUNT(DISTINCT column)
+  bool count_returned;
+  MongoDistinctDomain domain;           // Values COUNT(DISTINCT) counts
+  bson_t *filter;                       // Translated WHERE clause, null for none
+  MongoDistinctReader reader;
+
+public:
+  ha_mongodb_distinct(THD *thd_arg, handlerton *hton, ha_mongodb *file_arg,
+                      const std::vector<MongoColumn> &columns_arg, bool count_arg,
+                      const MongoDistinctDomain &domain_arg, bson_t *filter_arg);
+  ~ha_mongodb_distinct();
+
+  int init_scan() override;
+  int next_row() override;
+  int end_scan() override;
+};
+
+#endif /* HA_MONGODB_DISTINCT_INCLUDED */
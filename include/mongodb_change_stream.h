@@ -0,0 +1,107 @@
+#ifndef MONGODB_CHANGE_STREAM_H
+#define MONGODB_CHANGE_STREAM_H
+
+/*
+  MongoDB Change Stream Watcher
+
+  Optional background watcher that tails a collection's change stream to keep
+  document count estimates current and to invalidate the cached schema as
+  soon as new paths or types appear. With a watcher running, schema caches
+  can use long TTLs without periodic re-sampling.
+*/
+
+#include "mongodb_schema.h"
+#include <mongoc/mongoc.h>
+#include <bson/bson.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*
+  Change stream configuration
+*/
+#define MONGODB_CHANGE_STREAM_MAX_AWAIT_MS 1000
+#define MONGODB_CHANGE_STREAM_RETRY_MS 5000
+
+/*
+  Engine-wide change stream counters (reported as status variables)
+*/
+struct MongoChangeStreamCounters {
+  std::atomic<uint64_t> events_processed;
+  std::atomic<uint64_t> schema_invalidations;
+  std::atomic<uint64_t> stream_errors;
+  std::atomic<uint64_t> watchers_running;
+
+  MongoChangeStreamCounters()
+    : events_processed(0), schema_invalidations(0), stream_errors(0),
+      watchers_running(0) {}
+};
+
+extern MongoChangeStreamCounters change_stream_counters;
+
+/*
+  Per-collection change stream watcher
+
+  Owns a dedicated client (mongoc clients are not thread-safe) and a
+  background thread. The thread resumes from the last resume token after
+  transient errors.
+*/
+class MongoChangeStreamWatcher {
+private:
+  std::string connection_string;
+  std::string database_name;
+  std::string collection_name;
+  std::string table_key;             // database.collection, as used by the schema registry
+
+  std::thread worker;
+  std::atomic<bool> stop_requested;
+  std::mutex wait_mutex;
+  std::condition_variable wait_cond;
+
+  // Incrementally maintained statistics
+  std::atomic<int64_t> document_count_estimate;
+  std::atomic<bool> count_estimate_valid;
+  std::atomic<uint64_t> last_event_time_ms;       // Wall clock of the last event seen
+
+  bson_t *resume_token;              // Only touched by the worker thread
+
+  void run();
+  bool seed_document_count(mongoc_collection_t *collection);
+  void handle_event(const bson_t *event);
+  bool observe_paths(const bson_t *doc, const std::string &prefix, uint32_t depth,
+                     const MongoSchemaCache *schema);
+  bool observe_path(const std::string &path, bson_type_t type,
+                    const MongoSchemaCache *schema);
+  void invalidate_schema();
+  void wait_for_retry();
+
+public:
+  MongoChangeStreamWatcher(const std::string &connection_str,
+                           const std::string &database,
+                           const std::string &collection);
+  ~MongoChangeStreamWatcher();
+
+  // Lifecycle
+  bool start();
+  void stop();
+  bool is_running() const { return worker.joinable() && !stop_requested.load(); }
+
+  // Statistics access
+  bool get_document_count_estimate(ha_rows *count) const;
+  uint64_t get_last_event_time_ms() const { return last_event_time_ms.load(); }
+  const std::string &get_table_key() const { return table_key; }
+};
+
+/*
+  Global watcher management - one watcher per connection and collection
+*/
+MongoChangeStreamWatcher* get_or_create_change_stream_watcher(const std::string &connection_string,
+                                                              const std::string &database_name,
+                                                              const std::string &collection_name);
+void cleanup_all_change_stream_watchers();
+
+#endif /* MONGODB_CHANGE_STREAM_H */
@@ -8,8 +8,8 @@
   with automatic connection lifecycle management.
 */
 
-#include "my_global.h"
 #include "mongodb_uri_parser.h"
+#include "mongodb_registry.h"
 #include <mongoc/mongoc.h>
 #include <chrono>
 #include <memory>
@@ -104,8 +104,7 @@ public:
 /*
   Global connection pool management
 */
-extern std::mutex global_pool_mutex;
-extern std::map<std::string, std::shared_ptr<MongoConnectionPool>> global_connection_pools;
+extern MongoRegistry<MongoConnectionPool> global_connection_pools;
 
 /*
   Helper functions
@@ -0,0 +1,144 @@
+#ifndef MONGODB_DISTINCT_H
+#define MONGODB_DISTINCT_H
+
+/*
+  MongoDB Distinct Values
+
+  SELECT DISTINCT and COUNT(DISTINCT) over one MONGODB table are answered
+  by the server rather than by reading every document (see
+  ha_mongodb_distinct.h for the queries taken over):
+
+    one column    - the distinct command on the documents where the field
+                    is a non-null scalar, plus one probe each for a
+                    document where it is missing or null (both read as
+                    NULL) and one holding an array (distinct would list
+                    the array's elements, a row shows the array)
+    several, or   - {$group: {_id: {a: "$a", b: "$b"}}} and $replaceRoot,
+    distinct too    with allowDiskUse, when the reply would exceed the
+    large           distinct command's 16MB limit
+    COUNT         - $group on the field then $count, over the documents
+                    holding a value of the column's domain (below)
+
+  Values come back as documents holding the selected fields, so they are
+  converted like rows (mongodb_row_convert.h).
+*/
+
+#include <mongoc/mongoc.h>
+#include <bson/bson.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+/*
+  Distinct configuration
+*/
+#define MONGODB_DISTINCT_BATCH_DOCS 1000      // Pipeline results per batch
+
+enum mongo_distinct_status {
+  MONGO_DISTINCT_ROW,           // Document of the next distinct value returned
+  MONGO_DISTINCT_END,           // Every value was returned
+  MONGO_DISTINCT_ERROR          // The command or pipeline failed
+};
+
+/*
+  Engine-wide distinct counters (reported as status variables)
+*/
+struct MongoDistinctCounters {
+  std::atomic<uint64_t> commands;       // distinct commands
+  std::atomic<uint64_t> pipelines;      // $group pipelines returning values
+  std::atomic<uint64_t> counts;         // COUNT(DISTINCT) pipelines
+  std::atomic<uint64_t> fallbacks;      // distinct commands retried as pipelines
+  std::atomic<uint64_t> values;         // Documents returned
+
+  MongoDistinctCounters()
+    : commands(0), pipelines(0), counts(0), fallbacks(0), values(0) {}
+};
+
+extern MongoDistinctCounters distinct_counters;
+
+// Top-level field a pipeline can refer to as "$name"
+bool mongodb_distinct_field(const std::string &name);
+
+// {distinct: collection, key: field, query: filter}; filter may be null
+bool mongodb_distinct_command(const char *collection, const std::string &field,
+                              const bson_t *filter, bson_t *command);
+
+// Pipeline of the distinct combinations of fields, one document each
+bool mongodb_distinct_pipeline(const std::vector<std::string> &fields, const bson_t *filter,
+                               bson_t *pipeline);
+
+/*
+  BSON values a column shows unchanged, one column value for each value
+  MongoDB tells apart. Outside it the row conversion collapses values
+  (5.4 and 5 in an INT column, any two non-numeric strings as 0, every
+  subdocument as the same tag), so a count of BSON values is the
+  column's only when no document holds the field outside the domain.
+*/
+enum MongoDistinctDomainKind {
+  MONGODB_DISTINCT_INTEGER,     // int32 and int64 within [min, max]
+  MONGODB_DISTINCT_DOUBLE,      // Finite doubles, int32, int64 exact as doubles
+  MONGODB_DISTINCT_STRING       // UTF-8 strings of at most max_length
+};
+
+struct MongoDistinctDomain {
+  MongoDistinctDomainKind kind;
+  int64_t min;                  // INTEGER bounds
+  int64_t max;
+  uint32_t max_length;          // STRING limit, in code points or bytes
+  bool length_in_bytes;
+};
+
+// field holds a value of domain (never an array, null or missing)
+bool mongodb_distinct_domain_filter(const std::string &field, const MongoDistinctDomain &domain,
+                                    bson_t *clause);
+
+// Pipeline returning {count: n} for n distinct values of field within
+// domain, nothing for none
+bool mongodb_count_distinct_pipeline(const std::string &field, const MongoDistinctDomain &domain,
+                                     const bson_t *filter, bson_t *pipeline);
+
+/*
+  The distinct values of one query
+*/
+class MongoDistinctReader {
+private:
+  std::vector<std::string> fields;
+  mongoc_cursor_t *cursor;              // Pipeline results
+  bson_t reply;                         // distinct command reply
+  bool have_reply;                      // reply was initialized by the driver
+  bson_iter_t values;                   // Next value of reply
+  bool reading_values;
+  std::vector<bson_t*> probes;          // Documents distinct leaves out
+  size_t next_probe;
+  bson_t *value_doc;                    // {field: value} of the current value
+  bson_error_t error;
+
+  bool run_command(mongoc_collection_t *collection, const bson_t *filter);
+  bool run_probe(mongoc_collection_t *collection, const bson_t *filter, const bson_t *clause);
+  bool run_pipeline(mongoc_collection_t *collection, const bson_t *filter);
+
+public:
+  MongoDistinctReader();
+  ~MongoDistinctReader();
+
+  bool open(mongoc_collection_t *collection, const std::vector<std::string> &fields,
+            const bson_t *filter);
+  void close();
+
+  mongo_distinct_status next(const bson_t **doc);
+  const bson_error_t &last_error() const { return error; }
+};
+
+// Whether a document matching filter holds a non-null field outside
+// domain (an array included); false with error set if the query failed
+bool mongodb_distinct_outside_domain(mongoc_collection_t *collection, const std::string &field,
+                                     const MongoDistinctDomain &domain, const bson_t *filter,
+                                     bool *outside, bson_error_t *error);
+
+// Number of distinct values of field within domain; false with error set
+// if the pipeline failed
+bool mongodb_count_distinct(mongoc_collection_t *collection, const std::string &field,
+                            const MongoDistinctDomain &domain, const bson_t *filter,
+                            int64_t *count, bson_error_t *error);
+
+#endif /* MONGODB_DISTINCT_H */
@@ -0,0 +1,166 @@
+#ifndef MONGODB_FILTER_H
+#define MONGODB_FILTER_H
+
+/*
+  MongoDB Filter Builder
+
+  Builds find() filters from already-analysed predicates: a field path, an
+  operator and constant values as bson_value_t. It does not know about
+  MariaDB Items; the translator walks the condition tree and calls these
+  functions, one clause document per predicate, then combines clauses
+  with mongodb_filter_and/or/not. A failed child can simply be dropped
+  from an AND (MariaDB keeps it as a residual condition) without undoing
+  anything already appended.
+
+  Predicates follow SQL semantics where MongoDB's differ: NULL never
+  compares equal or unequal, so "<>" and NOT IN exclude null and missing
+  fields, which $ne and $nin alone would match.
+*/
+
+#include <bson/bson.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum MongoFilterOp {
+  MONGODB_FILTER_EQ,
+  MONGODB_FILTER_NE,
+  MONGODB_FILTER_LT,
+  MONGODB_FILTER_LTE,
+  MONGODB_FILTER_GT,
+  MONGODB_FILTER_GTE
+};
+
+/*
+  Constant constructors (strings are borrowed, not copied)
+*/
+bson_value_t mongodb_value_int64(int64_t value);
+bson_value_t mongodb_value_double(double value);
+bson_value_t mongodb_value_utf8(const char *value, size_t length);
+bson_value_t mongodb_value_bool(bool value);
+bson_value_t mongodb_value_date_time(int64_t msec_since_epoch);
+bson_value_t mongodb_value_oid(const bson_oid_t *oid);
+bson_value_t mongodb_value_regex(const char *pattern, const char *options);
+
+/*
+  Predicates - each appends one condition on path to clause
+*/
+// path <op> value
+bool mongodb_filter_compare(bson_t *clause, const char *path, MongoFilterOp op,
+                            const bson_value_t *value);
+
+// low <(=) path <(=) high, either bound may be null
+bool mongodb_filter_range(bson_t *clause, const char *path,
+                          const bson_value_t *low, bool low_inclusive,
+                          const bson_value_t *high, bool high_inclusive);
+
+// path [NOT] IN (values)
+bool mongodb_filter_in(bson_t *clause, const char *path,
+                       const bson_value_t *values, size_t count, bool negated);
+
+// path IS [NOT] NULL - a missing field reads as NULL
+bool mongodb_filter_null(bson_t *clause, const char *path, bool is_null);
+
+// path [NOT] matching a PCRE pattern
+bool mongodb_filter_regex(bson_t *clause, const char *path, const char *pattern,
+                          const char *options, bool negated);
+
+// path holds one of the $type aliases ("string", "number", ...); negated
+// requires the field to exist with another type
+bool mongodb_filter_type(bson_t *clause, const char *path, const char *const *types,
+                         size_t count, bool negated);
+
+// path is present, with any value including null, or missing
+bool mongodb_filter_exists(bson_t *clause, const char *path, bool exists);
+
+/*
+  Restrict clause, a predicate on path, to documents where path does not
+  hold an array, which MongoDB would otherwise match element by element.
+  A single-field clause keeps one operator document ({path: {$eq: v,
+  $not: {$type: "array"}}}), so it stays on an index; others are ANDed.
+*/
+bool mongodb_filter_scalar(bson_t *clause, const char *path);
+
+/*
+  path [NOT] LIKE pattern, both UTF-8. escape is an ASCII escape character
+  or 0 for none. Patterns without wildcards become plain equality; others
+  an anchored regex, so 'abc%' is the prefix expression ^abc that MongoDB
+  answers with an index range. Matching is exact, as under a binary
+  collation.
+*/
+bool mongodb_filter_like(bson_t *clause, const char *path, const char *pattern,
+                         size_t length, int escape, bool negated);
+
+// Append value to regex with PCRE metacharacters escaped; fails on NUL
+bool mongodb_regex_append_literal(std::string *regex, const char *value, size_t length);
+
+// Anchored regex matching value with any number of trailing spaces, as
+// equality under a PAD SPACE collation; fails on NUL
+bool mongodb_regex_pad_space(std::string *regex, const char *value, size_t length);
+
+/*
+  SQL/JSON path ($.address.city, $.tags[0]) as a dotted MongoDB path
+  (address.city, tags.0). Wildcards, ranges, last and lax/strict modes
+  have no dotted form and fail, as do keys MongoDB would read as paths or
+  operators.
+*/
+bool mongodb_filter_json_path(const char *json_path, size_t length, std::string *path);
+
+/*
+  MariaDB's JSON_CONTAINS and JSON_OVERLAPS of a constant JSON candidate
+  against the value at path ("" for the whole document). Scalars match
+  array elements directly, arrays of them through $all / $in, objects in
+  arrays through $elemMatch. Documents whose arrays nest arrays are kept,
+  as MariaDB looks into those too, so the filter is a superset for
+  MariaDB to recheck.
+*/
+bool mongodb_filter_json_contains(bson_t *clause, const char *path, const char *candidate,
+                                  size_t length);
+bool mongodb_filter_json_overlaps(bson_t *clause, const char *path, const char *candidate,
+                                  size_t length);
+
+/*
+  Aggregation expressions, for $expr predicates find() operators cannot
+  state: column against column, arithmetic, CASE. Each expression is
+  held in its own bson_t as that document's only element; the functions
+  below build one into expr from operands held the same way.
+*/
+enum MongoExprType {
+  MONGODB_EXPR_NUMBER,
+  MONGODB_EXPR_STRING
+};
+
+// Value at path; values of other BSON types read as null, so operators
+// that reject them cannot fail the query
+bool mongodb_expr_field(bson_t *expr, const char *path, MongoExprType type);
+
+// A constant, never read as a path or an operator
+bool mongodb_expr_literal(bson_t *expr, const bson_value_t *value);
+
+// {op: [args]}: $add, $multiply, $ifNull, $concat, $cond, $and, ...
+bool mongodb_expr_operator(bson_t *expr, const char *op, const bson_t *const *args,
+                           size_t count);
+
+// left <op> right, in BSON order; null sorts below every other value
+bool mongodb_expr_compare(bson_t *expr, MongoFilterOp op, const bson_t *left,
+                          const bson_t *right);
+
+// operand is neither null nor missing
+bool mongodb_expr_not_null(bson_t *expr, const bson_t *operand);
+
+// Value of the first true case; otherwise, or null when that is nullptr
+bool mongodb_expr_switch(bson_t *expr, const bson_t *const *cases, const bson_t *const *values,
+                         size_t count, const bson_t *otherwise);
+
+// Documents for which expr is true
+bool mongodb_filter_expr(bson_t *clause, const bson_t *expr);
+
+/*
+  Combinators - clauses are copied into out, callers keep ownership
+*/
+bool mongodb_filter_and(bson_t *out, const bson_t *const *clauses, size_t count);
+bool mongodb_filter_or(bson_t *out, const bson_t *const *clauses, size_t count);
+// MongoDB negation: also matches documents missing the clause's fields
+bool mongodb_filter_not(bson_t *out, const bson_t *clause);
+
+#endif /* MONGODB_FILTER_H */
@@ -0,0 +1,103 @@
+#ifndef MONGODB_KEY_FETCH_H
+#define MONGODB_KEY_FETCH_H
+
+/*
+  MongoDB Batched Key Fetches
+
+  Multi-range reads of exact keys (a batched key access join, the key set
+  of a materialized semi-join looked up in the MongoDB table, a long IN
+  list) fetch their distinct keys in chunks, one find per chunk with the
+  keys as a $in list. Chunks are fetched by up to
+  MONGODB_KEY_FETCH_WORKERS threads on connections of the collection's
+  pool, at most MONGODB_KEY_FETCH_WINDOW batches ahead of the reader, so
+  the next chunks are in flight while the rows of earlier ones are read.
+*/
+
+#include <mongoc/mongoc.h>
+#include <bson/bson.h>
+#include "mongodb_shared_scan.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+  Key fetch configuration
+*/
+#define MONGODB_KEY_FETCH_CHUNK 10000         // Keys per find
+#define MONGODB_KEY_FETCH_WORKERS 4           // Chunks fetched at once
+#define MONGODB_KEY_FETCH_WINDOW 8            // Batches buffered ahead of the reader
+#define MONGODB_KEY_FETCH_BATCH_DOCS 1000     // Documents per batch
+
+enum mongo_key_fetch_status {
+  MONGO_KEY_FETCH_BATCH,        // Batch returned
+  MONGO_KEY_FETCH_END,          // Every chunk was read
+  MONGO_KEY_FETCH_ERROR         // A chunk's cursor failed
+};
+
+/*
+  Engine-wide key fetch counters (reported as status variables)
+*/
+struct MongoKeyFetchCounters {
+  std::atomic<uint64_t> reads;          // Multi-range reads served by chunks
+  std::atomic<uint64_t> keys;           // Distinct keys sent
+  std::atomic<uint64_t> chunks;
+  std::atomic<uint64_t> documents;      // Read by pipelined workers
+
+  MongoKeyFetchCounters()
+    : reads(0), keys(0), chunks(0), documents(0) {}
+};
+
+extern MongoKeyFetchCounters key_fetch_counters;
+
+/*
+  Filter of one chunk: base ANDed with the key predicates keys[begin, end),
+  each the raw BSON of an equality document. Single-field predicates on
+  one field become one $in list (a predicate that is itself a $in adds
+  its values); others are ORed.
+*/
+bool mongodb_key_chunk_filter(const bson_t *base, const std::vector<std::string> &keys,
+                              size_t begin, size_t end, bson_t *filter);
+
+/*
+  The chunks of one multi-range read
+*/
+class MongoKeyFetch {
+private:
+  std::string pool_connection_string;   // CONNECTION string, keys the pool
+  std::string client_uri;               // For a private client if the pool has none free
+  std::string database_name;
+  std::string collection_name;
+  std::vector<bson_t*> chunks;
+
+  std::vector<std::thread> workers;
+  std::mutex fetch_mutex;
+  std::condition_variable batch_ready;       // Workers -> reader
+  std::condition_variable window_space;      // Reader -> workers
+  std::deque<std::shared_ptr<const MongoScanBatch>> ready;
+  size_t next_chunk;
+  size_t running;
+  bool failed;
+  bool stop_requested;
+
+  void run();
+  bool publish_batch(std::shared_ptr<MongoScanBatch> batch);
+
+public:
+  MongoKeyFetch(const std::string &pool_connection, const std::string &uri,
+                const std::string &database, const std::string &collection);
+  ~MongoKeyFetch();
+
+  bool add_chunk(const bson_t *filter);
+  bool start();
+  void stop();
+
+  // Reader API; batches come in completion order, not chunk order
+  mongo_key_fetch_status next_batch(std::shared_ptr<const MongoScanBatch> *batch);
+};
+
+#endif /* MONGODB_KEY_FETCH_H */
@@ -0,0 +1,56 @@
+#ifndef MONGODB_MEMORY_H
+#define MONGODB_MEMORY_H
+
+/*
+  MongoDB Driver Memory Management
+
+  libbson and libmongoc allocate through a vtable installed at plugin init.
+  Small blocks are served from per-thread free lists of fixed size classes,
+  so steady-state BSON traffic never reaches the global allocator; larger
+  blocks go straight to it. Backing memory comes from my_malloc() under the
+  "memory/mongodb/bson" instrument, which charges it to the allocating
+  thread in performance_schema and to the server's Memory_used.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+  Allocator configuration
+*/
+#define MONGODB_MEMORY_SIZE_CLASSES 8                        // 32 bytes .. 4 KB
+#define MONGODB_MEMORY_MIN_CLASS_SIZE 32
+#define MONGODB_DEFAULT_THREAD_CACHE_BYTES (1024 * 1024)     // Cached free blocks per thread
+
+/*
+  Engine-wide driver memory counters (reported as status variables)
+*/
+struct MongoMemoryCounters {
+  std::atomic<int64_t> current_bytes;     // Requested bytes currently allocated
+  std::atomic<int64_t> peak_bytes;
+  std::atomic<int64_t> cached_bytes;      // Free blocks held by thread caches
+  std::atomic<uint64_t> allocations;
+  std::atomic<uint64_t> cache_hits;       // Allocations served from a thread cache
+
+  MongoMemoryCounters()
+    : current_bytes(0), peak_bytes(0), cached_bytes(0), allocations(0), cache_hits(0) {}
+};
+
+extern MongoMemoryCounters memory_counters;
+
+/*
+  Install the vtable - must run before mongoc_init() or any other driver
+  allocation. Returns false if it could not be installed.
+*/
+bool mongodb_memory_install();
+
+/*
+  Restore libbson's default allocator once nothing allocated through the
+  vtable is still live; otherwise the vtable stays in place
+*/
+void mongodb_memory_uninstall();
+
+void mongodb_memory_set_thread_cache_limit(size_t bytes);
+
+#endif /* MONGODB_MEMORY_H */
@@ -0,0 +1,186 @@
+#ifndef MONGODB_MIRROR_H
+#define MONGODB_MIRROR_H
+
+/*
+  MongoDB Local Columnar Mirror
+
+  Opt-in (LOCAL_MIRROR=YES) local copy of a collection's mapped columns for
+  scan-heavy reporting. The mirror is bootstrapped by a parallel scan over
+  _id ranges and kept current by tailing the collection's change stream.
+  Columns are dictionary encoded in fixed-size segments; readers take an
+  immutable snapshot and filter on dictionary codes without touching the
+  cluster.
+*/
+
+#include <mongoc/mongoc.h>
+#include <bson/bson.h>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*
+  Mirror configuration
+*/
+#define MONGODB_MIRROR_SEGMENT_ROWS 16384        // Rows per column segment
+#define MONGODB_MIRROR_BOOTSTRAP_THREADS 4       // Parallel _id range scans
+#define MONGODB_MIRROR_PUBLISH_EVENTS 1000       // Publish at least every N applied events
+#define MONGODB_MIRROR_MAX_LAG_MS 60000          // Stale mirrors are not served
+#define MONGODB_MIRROR_MISSING_CODE 0            // Dictionary code of an absent field
+#define MONGODB_MIRROR_ROOT_COLUMN "$$ROOT"      // Whole document, for tables with a `document` column
+
+/*
+  One dictionary-encoded column of a segment
+  Values are stored as single-element BSON documents with an empty key;
+  dictionary[MONGODB_MIRROR_MISSING_CODE] is an empty string.
+*/
+struct MongoMirrorColumn {
+  std::vector<std::string> dictionary;
+  std::vector<uint32_t> codes;         // One per row
+};
+
+/*
+  A fixed-size block of rows; immutable once published
+*/
+struct MongoMirrorSegment {
+  std::vector<MongoMirrorColumn> columns;
+  std::vector<uint8_t> deleted;        // Rows superseded by an update or delete
+  uint32_t row_count;
+  uint32_t live_rows;
+  size_t encoded_bytes;
+
+  MongoMirrorSegment() : row_count(0), live_rows(0), encoded_bytes(0) {}
+  explicit MongoMirrorSegment(size_t column_count);
+};
+
+/*
+  What a scan sees - shared with readers through an atomic shared_ptr
+*/
+struct MongoMirrorSnapshot {
+  std::vector<std::string> column_names;   // Column 0 is always _id
+  std::vector<std::shared_ptr<const MongoMirrorSegment>> segments;
+  uint64_t live_rows;
+  size_t encoded_bytes;
+
+  MongoMirrorSnapshot() : live_rows(0), encoded_bytes(0) {}
+};
+
+/*
+  Engine-wide mirror counters (reported as status variables)
+*/
+struct MongoMirrorCounters {
+  std::atomic<uint64_t> mirrors_ready;
+  std::atomic<uint64_t> bootstraps;
+  std::atomic<uint64_t> events_applied;
+  std::atomic<uint64_t> compactions;
+  std::atomic<uint64_t> local_scans;
+  std::atomic<uint64_t> remote_fallbacks;
+  std::atomic<uint64_t> stream_errors;
+
+  MongoMirrorCounters()
+    : mirrors_ready(0), bootstraps(0), events_applied(0), compactions(0),
+      local_scans(0), remote_fallbacks(0), stream_errors(0) {}
+};
+
+extern MongoMirrorCounters mirror_counters;
+
+/*
+  Per-collection mirror
+
+  Owns a dedicated client and a background thread that bootstraps the
+  segments and then applies change events. Only the worker thread mutates
+  segments; every batch is published as a new snapshot, copying only the
+  segments it touched.
+*/
+class MongoCollectionMirror {
+private:
+  std::string connection_string;
+  std::string database_name;
+  std::string collection_name;
+  std::string table_key;
+  std::vector<std::string> column_names;
+  bool root_column;
+
+  std::thread worker;
+  std::atomic<bool> stop_requested;
+  std::mutex wait_mutex;
+  std::condition_variable wait_cond;
+
+  std::shared_ptr<const MongoMirrorSnapshot> published;   // Read with atomic_load
+  std::atomic<uint64_t> last_synced_ms;                   // Stream drained at this wall clock time
+  std::atomic<uint64_t> live_rows;
+  std::atomic<size_t> encoded_bytes;
+
+  // Worker-only state
+  std::vector<std::shared_ptr<const MongoMirrorSegment>> segments;
+  std::map<size_t, std::shared_ptr<MongoMirrorSegment>> dirty_segments;
+  std::unordered_map<std::string, uint64_t> id_index;    // Encoded _id -> segment << 32 | row
+  std::vector<std::unordered_map<std::string, uint32_t>> tail_dictionary;
+  size_t tail_segment;
+  uint64_t dead_rows;
+  bson_t *resume_token;
+
+  void run();
+  bool bootstrap();
+  bool scan_range(const bson_t *filter, std::vector<std::shared_ptr<MongoMirrorSegment>> *out);
+  void build_projection(bson_t *projection) const;
+  bool apply_event(const bson_t *event);
+  void upsert_document(const bson_t *doc);
+  void delete_document(const std::string &encoded_id);
+  MongoMirrorSegment *writable_segment(size_t index);
+  void publish();
+  void compact();
+  void reset_state();
+  void wait_for_retry();
+
+public:
+  MongoCollectionMirror(const std::string &connection_str,
+                        const std::string &database,
+                        const std::string &collection,
+                        const std::vector<std::string> &columns);
+  ~MongoCollectionMirror();
+
+  // Lifecycle
+  bool start();
+  void stop();
+
+  // Reader access - null until the bootstrap has completed
+  std::shared_ptr<const MongoMirrorSnapshot> get_snapshot() const;
+  uint64_t get_freshness_lag_ms() const;
+  uint64_t get_live_rows() const { return live_rows.load(); }
+  size_t get_encoded_bytes() const { return encoded_bytes.load(); }
+  const std::string &get_table_key() const { return table_key; }
+};
+
+/*
+  Snapshot scanning helpers
+
+  mongodb_mirror_select_rows() evaluates a pushed-down filter on dictionary
+  codes and returns the matching row references (segment << 32 | row). It
+  returns false when the filter uses operators or fields the mirror cannot
+  evaluate exactly, or a filtered column holds values it cannot compare
+  (such as Decimal128); the caller then scans MongoDB instead.
+*/
+bool mongodb_mirror_select_rows(const MongoMirrorSnapshot &snapshot, const bson_t *filter,
+                                std::vector<uint64_t> *rows);
+void mongodb_mirror_build_document(const MongoMirrorSnapshot &snapshot, uint64_t row,
+                                   bson_t *doc);
+
+/*
+  Global mirror management - one mirror per connection, collection and column set
+*/
+MongoCollectionMirror* get_or_create_collection_mirror(const std::string &connection_string,
+                                                       const std::string &database_name,
+                                                       const std::string &collection_name,
+                                                       const std::vector<std::string> &columns);
+void cleanup_all_collection_mirrors();
+uint64_t mongodb_mirror_max_freshness_lag_ms();
+uint64_t mongodb_mirror_total_rows();
+size_t mongodb_mirror_total_bytes();
+
+#endif /* MONGODB_MIRROR_H */
@@ -0,0 +1,108 @@
+#ifndef MONGODB_PLAN_CACHE_H
+#define MONGODB_PLAN_CACHE_H
+
+/*
+  MongoDB Filter Plan Cache
+
+  Translated filters of pushed conditions, kept per table by the shape of
+  the condition. A plan is the raw filter of one translation plus the
+  byte offsets of the numeric values its constants put there; a condition
+  of the same shape with other numbers (a prepared statement re-executed,
+  a dependent subquery probed per outer row) is served by copying the
+  filter and writing the new values in place instead of walking the Item
+  tree again.
+*/
+
+#include <bson/bson.h>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+  Plan cache configuration
+*/
+#define MONGODB_FILTER_PLAN_ENTRIES 128
+
+/*
+  Engine-wide filter plan counters (reported as status variables)
+*/
+struct MongoFilterPlanCounters {
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> misses;
+  std::atomic<uint64_t> inserts;
+  std::atomic<uint64_t> evictions;
+
+  MongoFilterPlanCounters()
+    : hits(0), misses(0), inserts(0), evictions(0) {}
+};
+
+extern MongoFilterPlanCounters filter_plan_counters;
+
+/*
+  A numeric value a constant of the condition appended to the filter
+*/
+struct MongoFilterParam {
+  uint32_t constant;            // Index of the constant in the condition
+  bson_value_t value;           // BSON_TYPE_INT64 or BSON_TYPE_DOUBLE
+};
+
+/*
+  Where a constant's value lives in the plan's filter
+*/
+struct MongoFilterSlot {
+  uint32_t offset;              // Byte offset of the 8-byte value
+  uint32_t constant;
+  bson_type_t type;
+};
+
+struct MongoFilterPlan {
+  std::string filter;           // Raw filter of the translation the plan came from
+  std::vector<MongoFilterSlot> slots;
+  uint32_t constants;           // Constants of the condition
+  bool exact;                   // The filter decides the condition alone
+};
+
+/*
+  Build a plan from a translated filter. params lists, in the order they
+  were appended, the values the constants put there; every INT64 and
+  DOUBLE of the filter must be one of them and every constant must have
+  one, or the filter depends on its values some other way and is not
+  cacheable.
+*/
+bool mongodb_filter_plan_build(const bson_t *filter, const std::vector<MongoFilterParam> &params,
+                               uint32_t constants, bool exact, MongoFilterPlan *plan);
+
+/*
+  Fill an empty filter from a plan; values holds one value per constant
+  of the type its slots were recorded with
+*/
+bool mongodb_filter_plan_apply(const MongoFilterPlan &plan, const std::vector<bson_value_t> &values,
+                               bson_t *filter);
+
+/*
+  Bounded LRU of plans keyed by condition fingerprint, shared by the
+  handlers of one table definition in all sessions
+*/
+class MongoFilterPlanCache {
+private:
+  struct Entry {
+    std::string fingerprint;
+    std::shared_ptr<const MongoFilterPlan> plan;
+  };
+
+  std::mutex mutex;
+  std::list<Entry> lru;                // Most recently used first
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+
+public:
+  std::shared_ptr<const MongoFilterPlan> lookup(const std::string &fingerprint);
+  void insert(const std::string &fingerprint, std::shared_ptr<const MongoFilterPlan> plan);
+  size_t size();
+};
+
+#endif /* MONGODB_PLAN_CACHE_H */
@@ -0,0 +1,96 @@
+#ifndef MONGODB_POINT_CACHE_H
+#define MONGODB_POINT_CACHE_H
+
+/*
+  MongoDB Point Lookup Cache
+
+  Per-collection cache of documents fetched by exact unique-key lookups
+  (_id and other unique keys). Joins that probe the same few documents
+  millions of times are answered from mysqld memory. The cache is split into
+  independently locked shards, bounded by bytes, expires entries by TTL and
+  is invalidated by the change stream watcher when one is running.
+*/
+
+#include <bson/bson.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*
+  Point cache configuration
+*/
+#define MONGODB_POINT_CACHE_SHARDS 16
+#define MONGODB_DEFAULT_POINT_CACHE_TTL_SECONDS 60
+
+/*
+  Engine-wide point cache counters (reported as status variables)
+*/
+struct MongoPointCacheCounters {
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> misses;
+  std::atomic<uint64_t> inserts;
+  std::atomic<uint64_t> evictions;
+  std::atomic<uint64_t> invalidations;
+
+  MongoPointCacheCounters()
+    : hits(0), misses(0), inserts(0), evictions(0), invalidations(0) {}
+};
+
+extern MongoPointCacheCounters point_cache_counters;
+
+/*
+  Sharded LRU of raw BSON documents keyed by lookup key
+  Invalidation bumps a generation; stale entries are dropped lazily.
+*/
+class MongoPointCache {
+private:
+  struct Entry {
+    std::string key;
+    std::shared_ptr<const std::string> document;
+    uint64_t generation;
+    std::chrono::steady_clock::time_point expires_at;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::list<Entry> lru;              // Most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t used_bytes;
+
+    Shard() : used_bytes(0) {}
+  };
+
+  Shard shards[MONGODB_POINT_CACHE_SHARDS];
+  std::atomic<uint64_t> generation;
+  std::atomic<size_t> used_bytes;
+
+  Shard &shard_for(const std::string &key);
+  void erase_entry(Shard &shard, std::list<Entry>::iterator it);
+
+public:
+  MongoPointCache();
+
+  std::shared_ptr<const std::string> lookup(const std::string &key);
+  bool insert(const std::string &key, const bson_t *document, uint64_t generation,
+              size_t capacity, uint32_t ttl_seconds);
+  uint64_t get_generation() const { return generation.load(); }
+  void invalidate();
+  size_t get_used_bytes() const { return used_bytes.load(); }
+};
+
+/*
+  Global cache management - one cache per connection and collection
+*/
+MongoPointCache* get_or_create_point_cache(const std::string &connection_string,
+                                           const std::string &collection_name);
+void invalidate_point_cache(const std::string &connection_string,
+                            const std::string &collection_name);
+void cleanup_all_point_caches();
+size_t mongodb_point_cache_total_bytes();
+
+#endif /* MONGODB_POINT_CACHE_H */
@@ -0,0 +1,130 @@
+#ifndef MONGODB_REGISTRY_H
+#define MONGODB_REGISTRY_H
+
+/*
+  MongoDB Engine Object Registry
+
+  Engine-wide map from "connection/collection" keys to long-lived objects
+  (connection pools, schema registries, change stream watchers, mirrors,
+  point caches, shared scan coordinators). Keys are spread over shards;
+  each shard publishes an immutable map that lookups read with atomic_load,
+  so handlers opening tables never wait on each other. Only inserts take
+  the shard's writer mutex and copy its map.
+
+  Objects are never removed while the engine runs, so raw pointers handed
+  out by find() and get_or_create() stay valid until take_all() at
+  shutdown.
+*/
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define MONGODB_REGISTRY_SHARDS 16
+
+template <typename T>
+class MongoRegistry {
+public:
+  typedef std::map<std::string, std::shared_ptr<T>> Map;
+
+private:
+  struct Shard {
+    std::mutex writer_mutex;              // Serializes inserts, never taken by lookups
+    std::shared_ptr<const Map> entries;   // Read with atomic_load
+
+    Shard() : entries(std::make_shared<const Map>()) {}
+  };
+
+  Shard shards[MONGODB_REGISTRY_SHARDS];
+
+  Shard &shard_for(const std::string &key)
+  {
+    return shards[std::hash<std::string>()(key) % MONGODB_REGISTRY_SHARDS];
+  }
+
+  static T *find_in(const std::shared_ptr<const Map> &entries, const std::string &key)
+  {
+    auto it = entries->find(key);
+    return it != entries->end() ? it->second.get() : nullptr;
+  }
+
+public:
+  T *find(const std::string &key)
+  {
+    return find_in(std::atomic_load_explicit(&shard_for(key).entries, std::memory_order_acquire), key);
+  }
+
+  /*
+    create() runs under the shard's writer mutex, so each key is created
+    once. It returns a shared_ptr<T>, or nullptr to insert nothing.
+  */
+  template <typename Factory>
+  T *get_or_create(const std::string &key, Factory create)
+  {
+    Shard &shard = shard_for(key);
+
+    T *existing = find_in(std::atomic_load_explicit(&shard.entries, std::memory_order_acquire), key);
+    if (existing) {
+      return existing;
+    }
+
+    std::lock_guard<std::mutex> lock(shard.writer_mutex);
+
+    // Another thread may have inserted it while we waited
+    std::shared_ptr<const Map> current = std::atomic_load_explicit(&shard.entries, std::memory_order_acquire);
+    existing = find_in(current, key);
+    if (existing) {
+      return existing;
+    }
+
+    std::shared_ptr<T> object = create();
+    if (!object) {
+      return nullptr;
+    }
+
+    auto updated = std::make_shared<Map>(*current);
+    (*updated)[key] = object;
+    std::atomic_store_explicit(&shard.entries, std::shared_ptr<const Map>(std::move(updated)),
+                               std::memory_order_release);
+    return object.get();
+  }
+
+  /*
+    Visit every object of the current snapshot without locking
+  */
+  template <typename Visitor>
+  void for_each(Visitor visit)
+  {
+    for (Shard &shard : shards) {
+      std::shared_ptr<const Map> entries = std::atomic_load_explicit(&shard.entries, std::memory_order_acquire);
+      for (const auto &entry : *entries) {
+        visit(*entry.second);
+      }
+    }
+  }
+
+  /*
+    Empty the registry and hand back the objects, e.g. to stop their
+    threads outside any lock
+  */
+  std::vector<std::shared_ptr<T>> take_all()
+  {
+    std::vector<std::shared_ptr<T>> objects;
+    auto empty = std::make_shared<const Map>();
+
+    for (Shard &shard : shards) {
+      std::lock_guard<std::mutex> lock(shard.writer_mutex);
+      std::shared_ptr<const Map> entries =
+        std::atomic_exchange_explicit(&shard.entries, empty, std::memory_order_acq_rel);
+      for (const auto &entry : *entries) {
+        objects.push_back(entry.second);
+      }
+    }
+    return objects;
+  }
+};
+
+#endif /* MONGODB_REGISTRY_H */
@@ -0,0 +1,115 @@
+#ifndef MONGODB_RESULT_CACHE_H
+#define MONGODB_RESULT_CACHE_H
+
+/*
+  MongoDB Result Cache
+
+  Optional, memory-bounded cache of converted rows for repeated identical
+  pushed-down scans (same collection, filter and find options). Entries
+  expire by TTL and are invalidated per table by the change stream watcher,
+  so dashboards refreshing the same query every few seconds are served from
+  mysqld memory instead of re-scanning the collection.
+
+  The same entries also serve rescans within one statement: a dependent
+  subquery or derived table re-evaluated per outer row scans its table
+  again with the same filter. Each handler keeps those rows, whatever the
+  table's RESULT_CACHE option, until the statement ends.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+  Result cache configuration
+*/
+#define MONGODB_DEFAULT_RESULT_CACHE_TTL_SECONDS 30
+#define MONGODB_RESULT_CACHE_MAX_ENTRY_FRACTION 8   // One entry may use 1/8 of the cache
+
+/*
+  Rows of one complete scan, in the table's record format
+  Blob columns are stored out of line; replay points the record's blob
+  fields at these payloads, so an entry must stay referenced while its rows
+  are in use.
+*/
+struct MongoCachedResult {
+  std::string table_id;
+  uint32_t record_length;
+  uint32_t blob_count;
+  uint64_t row_count;
+  std::vector<unsigned char> records;  // row_count * record_length bytes
+  std::vector<std::string> blobs;      // row_count * blob_count payloads
+  size_t blob_bytes;
+  uint64_t generation;                 // Table generation when the scan started
+  std::chrono::steady_clock::time_point expires_at;
+
+  MongoCachedResult()
+    : record_length(0), blob_count(0), row_count(0), blob_bytes(0), generation(0) {}
+
+  size_t memory_size() const
+  {
+    return sizeof(*this) + records.size() + blob_bytes +
+           blobs.size() * sizeof(std::string) + table_id.size();
+  }
+};
+
+/*
+  Engine-wide LRU result cache
+*/
+class MongoResultCache {
+private:
+  struct Entry {
+    std::string key;
+    std::shared_ptr<const MongoCachedResult> result;
+  };
+
+  std::list<Entry> lru;                // Most recently used first
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+  std::unordered_map<std::string, uint64_t> table_generations;
+  mutable std::mutex cache_mutex;
+  size_t capacity;
+  size_t used_bytes;
+
+  void evict_to(size_t target_bytes);
+  void erase_entry(std::list<Entry>::iterator it);
+
+public:
+  // Statistics
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> misses;
+  std::atomic<uint64_t> inserts;
+  std::atomic<uint64_t> evictions;
+  std::atomic<uint64_t> invalidations;
+  std::atomic<uint64_t> rescan_hits;     // Scans replayed within their statement
+  std::atomic<uint64_t> rescan_inserts;
+
+  MongoResultCache();
+
+  std::shared_ptr<const MongoCachedResult> lookup(const std::string &key);
+  bool insert(const std::string &key, std::shared_ptr<const MongoCachedResult> result);
+  uint64_t table_generation(const std::string &table_id);
+  void invalidate_table(const std::string &table_id);
+  void clear();
+
+  // Configuration
+  void set_capacity(size_t bytes);
+  size_t get_capacity() const;
+  size_t get_max_entry_size() const;
+  size_t get_used_bytes() const;
+};
+
+extern MongoResultCache mongodb_result_cache;
+
+/*
+  Identity of a cached table - matches the change stream watcher key
+*/
+std::string mongodb_result_cache_table_id(const std::string &connection_string,
+                                          const std::string &collection_name);
+
+#endif /* MONGODB_RESULT_CACHE_H */
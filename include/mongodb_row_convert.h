@@ -0,0 +1,65 @@
+#ifndef MONGODB_ROW_CONVERT_H
+#define MONGODB_ROW_CONVERT_H
+
+/*
+  Document to row conversion
+
+  Maps one BSON document onto the columns of a MONGODB table. The kernel
+  does not know about server types: values are handed to a MongoFieldSink,
+  which the handler implements over MariaDB Field objects and benchmarks
+  implement over plain buffers. Columns are resolved once per table
+  (mongodb_row_columns) rather than by name for every row.
+
+  Column mapping:
+    _id       - ObjectId as 24 hex digits, strings and integers as is
+    document  - the whole document as relaxed extended JSON
+    _id_time  - creation time of an ObjectId _id, NULL for other ids
+    other     - top-level field of the same name, NULL when missing or
+                null; BSON dates are stored as instants (store_time), and
+                unmapped types (arrays, documents) as "[BSON_TYPE_<n>]"
+*/
+
+#include <bson/bson.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define MONGODB_ID_TIME_COLUMN "_id_time"
+
+enum MongoColumnKind {
+  MONGODB_COLUMN_ID,          // Document _id
+  MONGODB_COLUMN_ID_TIME,     // Timestamp embedded in an ObjectId _id
+  MONGODB_COLUMN_DOCUMENT,    // Whole document as JSON
+  MONGODB_COLUMN_FIELD        // Top-level field of the same name
+};
+
+struct MongoColumn {
+  std::string name;
+  MongoColumnKind kind;
+};
+
+/*
+  Receiver for converted values, one call per non-NULL column. Storing a
+  value marks the column not NULL; columns are NULL until stored.
+*/
+class MongoFieldSink {
+public:
+  virtual ~MongoFieldSink() {}
+
+  virtual void set_null(size_t column) = 0;
+  virtual void store_int(size_t column, int64_t value) = 0;
+  virtual void store_double(size_t column, double value) = 0;
+  virtual void store_string(size_t column, const char *value, size_t length) = 0;
+  // Instant in milliseconds since the epoch (UTC)
+  virtual void store_time(size_t column, int64_t msec_since_epoch) = 0;
+};
+
+// Classify table columns by name, in column order
+std::vector<MongoColumn> mongodb_row_columns(const std::vector<std::string> &names);
+
+// Convert one document; returns 0 on success
+int mongodb_convert_document(const bson_t *doc, const std::vector<MongoColumn> &columns,
+                             MongoFieldSink *sink);
+
+#endif /* MONGODB_ROW_CONVERT_H */
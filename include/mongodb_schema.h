@@ -13,9 +13,10 @@
 #include "my_global.h"
 #include "field.h"
 #else
-// Standalone mode - define required types
+// Standalone mode (mongodb_engine_core) - define required types, matching
+// the server's so the plugin can link code built without its headers
 typedef unsigned char uchar;
-typedef unsigned long ha_rows;
+typedef unsigned long long ha_rows;
 struct TABLE;
 
 // Define minimal field types for standalone compilation
@@ -43,17 +44,25 @@ enum enum_field_types {
 #include <mongoc/mongoc.h>
 #include <bson/bson.h>
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
 #include <mutex>
 #include <chrono>
+#include <memory>
+#include "mongodb_registry.h"
 
 /*
   Schema configuration
 */
 #define MONGODB_DEFAULT_SCHEMA_CACHE_TTL_SECONDS 300
+#define MONGODB_WATCHED_SCHEMA_CACHE_TTL_SECONDS 86400
 #define MONGODB_MAX_FIELD_MAPPINGS 1000
 #define MONGODB_SCHEMA_SAMPLE_SIZE 100
+#define MONGODB_SCHEMA_SAMPLE_BATCH_SIZE 25
+#define MONGODB_SCHEMA_SAMPLE_TIME_BUDGET_MS 2000
+#define MONGODB_SCHEMA_SAMPLE_BYTE_BUDGET (4 * 1024 * 1024)
+#define MONGODB_SCHEMA_MAX_DEPTH 4
 
 /*
   Field mapping information for MongoDB document fields
@@ -68,10 +77,49 @@ struct MongoFieldMapping {
   std::string default_value;         // Default value if missing
   uint32_t max_length;               // Maximum field length
   uint32_t decimals;                 // Decimal places for numeric types
+  double presence_ratio;             // Fraction of sampled documents holding the path
   
   MongoFieldMapping()
     : sql_type(MYSQL_TYPE_STRING), is_virtual(false), is_indexed(false),
-      is_nullable(true), max_length(255), decimals(0) {}
+      is_nullable(true), max_length(255), decimals(0), presence_ratio(1.0) {}
+};
+
+/*
+  Per-path statistics gathered while sampling a collection.
+  Paths use MongoDB dot notation; fields of documents nested inside arrays
+  share the array's path prefix (e.g. "items.sku"), like MongoDB queries do.
+*/
+struct MongoFieldStats {
+  uint64_t present_count;            // Documents in which the path was found
+  uint64_t sampled_documents;        // Documents examined for this path
+  std::map<bson_type_t, uint64_t> type_counts;         // BSON type histogram
+  std::map<bson_type_t, uint64_t> element_type_counts; // Array element types
+  uint32_t max_string_length;        // Longest UTF-8 value seen, in bytes
+  uint32_t depth;                    // Nesting depth (0 = top level)
+  bool inside_array;                 // Reached through an array of documents
+  uint64_t last_document_seq;        // Last sample that counted towards presence
+  
+  MongoFieldStats()
+    : present_count(0), sampled_documents(0), max_string_length(0),
+      depth(0), inside_array(false), last_document_seq(0) {}
+};
+
+/*
+  Sampling budget - inference stops at whichever limit is hit first
+*/
+struct MongoSchemaSampleBudget {
+  uint32_t max_documents;
+  uint32_t batch_size;
+  std::chrono::milliseconds max_time;
+  size_t max_bytes;
+  uint32_t max_depth;
+  
+  MongoSchemaSampleBudget()
+    : max_documents(MONGODB_SCHEMA_SAMPLE_SIZE),
+      batch_size(MONGODB_SCHEMA_SAMPLE_BATCH_SIZE),
+      max_time(MONGODB_SCHEMA_SAMPLE_TIME_BUDGET_MS),
+      max_bytes(MONGODB_SCHEMA_SAMPLE_BYTE_BUDGET),
+      max_depth(MONGODB_SCHEMA_MAX_DEPTH) {}
 };
 
 /*
@@ -80,40 +128,80 @@ struct MongoFieldMapping {
 struct MongoSchemaCache {
   std::string collection_name;
   std::vector<MongoFieldMapping> field_mappings;
+  std::map<std::string, MongoFieldStats> field_stats; // Keyed by MongoDB path
   std::chrono::steady_clock::time_point last_updated;
   std::chrono::steady_clock::time_point expires_at;
   ha_rows estimated_documents;
   size_t average_document_size;
+  uint64_t documents_sampled;
   bool is_valid;
   
-  MongoSchemaCache() : estimated_documents(0), average_document_size(0), is_valid(false) {}
+  MongoSchemaCache()
+    : estimated_documents(0), average_document_size(0), documents_sampled(0),
+      is_valid(false) {}
 };
 
+/*
+  Immutable, versioned view of every cached collection schema.
+
+  The registry never mutates a published snapshot. Readers grab the current
+  pointer without taking a lock and keep a zero-copy reference for as long
+  as they need it; writers build the next version off to the side and
+  publish it with an atomic pointer swap (RCU-style). Old versions are
+  reclaimed when the last reader drops its reference.
+*/
+typedef std::map<std::string, std::shared_ptr<const MongoSchemaCache>> MongoSchemaSnapshot;
+
 /*
   MongoDB Schema Registry - manages dynamic schema inference and caching
 */
 class MongoSchemaRegistry {
 private:
-  std::map<std::string, MongoSchemaCache> schema_cache;
-  std::mutex cache_mutex;
+  std::shared_ptr<const MongoSchemaSnapshot> schema_snapshot; // Use load/publish only
+  std::mutex writer_mutex;           // Serializes publishers, never taken by readers
   std::chrono::seconds cache_ttl;
+  std::chrono::seconds watched_cache_ttl;
+  std::set<std::string> watched_tables; // Kept current by a change stream (writer_mutex)
+  std::map<std::string, uint64_t> generations; // Bumped by invalidate_cache (writer_mutex)
   
   // MongoDB connection for schema operations
   mongoc_client_t *schema_client;
   std::string connection_string;
   
   // Schema inference methods
-  bool sample_collection_documents(mongoc_collection_t *collection, 
-                                  std::vector<bson_t*> &samples);
+  MongoSchemaSampleBudget sample_budget;
+  
+  bool collect_server_side_statistics(mongoc_collection_t *collection,
+                                      std::map<std::string, MongoFieldStats> &stats,
+                                      uint64_t &documents_sampled);
+  bool sample_collection_documents(mongoc_collection_t *collection,
+                                  const bson_t *projection,
+                                  std::map<std::string, MongoFieldStats> &stats,
+                                  uint64_t &documents_sampled,
+                                  size_t &bytes_sampled);
   enum_field_types infer_field_type(const bson_value_t *value);
-  bool analyze_document_structure(const bson_t *doc, 
-                                 std::map<std::string, MongoFieldMapping> &fields);
+  enum_field_types infer_field_type(bson_type_t type);
+  enum_field_types resolve_field_type(const MongoFieldStats &stats);
+  bool analyze_document_structure(const bson_t *doc, const std::string &prefix,
+                                 uint32_t depth, bool inside_array,
+                                 uint64_t document_seq,
+                                 std::map<std::string, MongoFieldStats> &stats);
+  void build_field_mappings(const std::map<std::string, MongoFieldStats> &stats,
+                            std::vector<MongoFieldMapping> &mappings);
   bool merge_field_mappings(const std::map<std::string, MongoFieldMapping> &new_fields,
                            std::vector<MongoFieldMapping> &existing_fields);
   
   // Cache management
   bool is_cache_valid(const MongoSchemaCache &cache) const;
   void cleanup_expired_cache();
+  
+  // Snapshot publication (copy-on-write)
+  std::shared_ptr<const MongoSchemaSnapshot> load_snapshot() const;
+  uint64_t table_generation(const std::string &table_key);
+  bool publish_entry(const std::string &table_key, uint64_t generation,
+                     std::shared_ptr<const MongoSchemaCache> entry);
+  void store_entry(const std::string &table_key,
+                   std::shared_ptr<const MongoSchemaCache> entry);
 
 public:
   MongoSchemaRegistry(const std::string &connection_str);
@@ -126,6 +214,7 @@ public:
                              const MongoFieldMapping &mapping);
   bool get_field_mappings(const std::string &table_name,
                          std::vector<MongoFieldMapping> &mappings);
+  std::shared_ptr<const MongoSchemaCache> get_schema(const std::string &table_name) const;
   
   // Document conversion
   bool document_to_row(const bson_t *doc, uchar *buf, TABLE *table);
@@ -150,6 +239,10 @@ public:
   // Configuration
   void set_cache_ttl(std::chrono::seconds ttl);
   std::chrono::seconds get_cache_ttl() const { return cache_ttl; }
+  void set_sample_budget(const MongoSchemaSampleBudget &budget) { sample_budget = budget; }
+  void set_watched_cache_ttl(std::chrono::seconds ttl) { watched_cache_ttl = ttl; }
+  void set_table_watched(const std::string &table_name, bool watched);
+  const MongoSchemaSampleBudget &get_sample_budget() const { return sample_budget; }
   
   // Connection management
   bool reconnect();
@@ -159,8 +252,7 @@ public:
 /*
   Global schema registry management
 */
-extern std::mutex global_schema_mutex;
-extern std::map<std::string, std::shared_ptr<MongoSchemaRegistry>> global_schema_registries;
+extern MongoRegistry<MongoSchemaRegistry> global_schema_registries;
 
 /*
   Helper functions for schema operations
@@ -0,0 +1,142 @@
+#ifndef MONGODB_SHARED_SCAN_H
+#define MONGODB_SHARED_SCAN_H
+
+/*
+  MongoDB Shared Cooperative Scans
+
+  When mongodb_shared_scans is enabled, full scans of a collection with the
+  same filter share one producer cursor. The producer reads in _id order
+  into a bounded window of batches; a scan starting while another is in
+  flight attaches at the oldest retained batch and afterwards fetches only
+  the _id range it missed with a private cursor. Readers that fall out of
+  the window detach and continue privately after the last _id they saw.
+*/
+
+#include <mongoc/mongoc.h>
+#include <bson/bson.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*
+  Shared scan configuration
+*/
+#define MONGODB_SHARED_SCAN_BATCH_DOCS 1000   // Documents per shared batch
+#define MONGODB_SHARED_SCAN_WINDOW 16         // Batches retained for late and slower readers
+
+/*
+  A batch of raw BSON documents stored back to back
+*/
+struct MongoScanBatch {
+  std::string data;
+  uint32_t count;
+
+  MongoScanBatch() : count(0) {}
+};
+
+enum mongo_shared_scan_status {
+  MONGO_SHARED_SCAN_BATCH,      // Batch returned
+  MONGO_SHARED_SCAN_END,        // Producer finished, nothing more to share
+  MONGO_SHARED_SCAN_DETACHED,   // Requested batch already left the window
+  MONGO_SHARED_SCAN_ERROR       // Producer cursor failed
+};
+
+/*
+  Engine-wide shared scan counters (reported as status variables)
+*/
+struct MongoSharedScanCounters {
+  std::atomic<uint64_t> scans_started;
+  std::atomic<uint64_t> readers_joined;      // Attached to a scan already in flight
+  std::atomic<uint64_t> readers_detached;
+  std::atomic<uint64_t> batches_produced;
+  std::atomic<uint64_t> batches_consumed;
+
+  MongoSharedScanCounters()
+    : scans_started(0), readers_joined(0), readers_detached(0),
+      batches_produced(0), batches_consumed(0) {}
+};
+
+extern MongoSharedScanCounters shared_scan_counters;
+
+/*
+  One in-flight producer scan
+*/
+class MongoSharedScan {
+private:
+  std::string connection_string;
+  std::string database_name;
+  std::string collection_name;
+  bson_t *filter;
+
+  std::thread worker;
+  std::mutex scan_mutex;
+  std::condition_variable batch_ready;       // Producer -> readers
+  std::condition_variable window_space;      // Readers -> producer
+  std::deque<std::shared_ptr<const MongoScanBatch>> window;
+  uint64_t base_sequence;                    // Sequence of window.front()
+  uint64_t produced;                         // Batches produced so far
+  uint64_t max_consumed;                     // Fastest reader's next sequence
+  uint32_t readers;
+  bool finished;
+  bool failed;
+  bool stop_requested;
+
+  void run();
+  void publish_batch(std::shared_ptr<MongoScanBatch> batch);
+
+public:
+  MongoSharedScan(const std::string &connection_str, const std::string &database,
+                  const std::string &collection, const bson_t *scan_filter);
+  ~MongoSharedScan();
+
+  bool start();
+  void stop();
+
+  // Reader API
+  bool attach(uint64_t *first_sequence);
+  void detach();
+  mongo_shared_scan_status next_batch(uint64_t sequence, std::shared_ptr<const MongoScanBatch> *batch);
+  bool is_idle();
+};
+
+/*
+  Per-collection coordinator - one in-flight scan per filter
+*/
+class MongoSharedScanCoordinator {
+private:
+  std::string connection_string;
+  std::string database_name;
+  std::string collection_name;
+  std::mutex coordinator_mutex;
+  std::map<std::string, std::shared_ptr<MongoSharedScan>> scans;   // Keyed by filter bytes
+
+public:
+  MongoSharedScanCoordinator(const std::string &connection_str, const std::string &database,
+                             const std::string &collection);
+
+  std::shared_ptr<MongoSharedScan> attach(const bson_t *filter, uint64_t *first_sequence);
+  void stop_all();
+};
+
+/*
+  Helpers for readers
+*/
+bool mongodb_shared_scan_document_id(const bson_t *doc, std::string *encoded_id);
+bson_t *mongodb_shared_scan_remainder_filter(const bson_t *filter, const std::string &first_id,
+                                             const std::string &last_id);
+void mongodb_shared_scan_id_filter(const std::string &encoded_id, bson_t *filter);
+
+/*
+  Global coordinator management - one coordinator per connection and collection
+*/
+MongoSharedScanCoordinator* get_or_create_shared_scan_coordinator(const std::string &connection_string,
+                                                                  const std::string &database_name,
+                                                                  const std::string &collection_name);
+void cleanup_all_shared_scan_coordinators();
+
+#endif /* MONGODB_SHARED_SCAN_H */
@@ -21,34 +21,120 @@
 #include <mongoc/mongoc.h>
 #include <bson/bson.h>
 
+#include "mongodb_filter.h"
+
 // Forward declarations for MariaDB types (avoid complex header dependencies)
 class Item;
 class Item_func;
 class Item_cond;
-class String;
+class Field;
+class THD;
+struct TABLE;
+class MongoFilterPlanCache;
 
 /*
   Condition translation functions for cond_push implementation
+
+  The translator walks the Item tree handed to cond_push() and builds the
+  find() filter through the filter builder (mongodb_filter.h), one clause
+  per predicate. Failed conjuncts are dropped from an AND; an OR or NOT
+  must translate completely. A filter is exact when MongoDB decides the
+  condition the way MariaDB would; otherwise it only narrows the rows and
+  cond_push() hands the whole condition back for MariaDB to evaluate.
+
+  Values compare as the BSON types of the mapped columns: documents whose
+  values only reach the column through conversion (numbers held as
+  strings, strings longer than the column) are not matched by a pushed
+  predicate, and neither are arrays, which a row shows as a type tag but
+  MongoDB would match element by element. A BSON null reads as NULL, as
+  {field: null} matches it. String predicates follow the comparison collation; MongoDB
+  compares UTF-8 bytes, so comparisons and LIKE translate only under
+  binary collations, while REGEXP maps to $regex with the "i" option under
+  case-insensitive ones, as MariaDB's PCRE2 does.
+
+  Comparisons that are not a column against constants (a > b,
+  price * qty > 1000, COALESCE(x, y) = 5) become $expr aggregation
+  expressions over numeric and string columns: + - * in BIGINT or DOUBLE,
+  COALESCE/IFNULL, CONCAT, SUBSTRING and searched CASE. Columns holding
+  other BSON types read as null there, and each side is tested for null
+  where MongoDB's ordering would otherwise let it match.
+
+  JSON_VALUE, JSON_EXTRACT and JSON_UNQUOTE(JSON_EXTRACT) over the document
+  column, with a constant path and used directly or as a virtual column,
+  read the value at the dotted MongoDB path. MariaDB converts what they
+  return (numbers from strings, text from numbers and booleans), so their
+  filters keep every document that could match and are never exact.
+  JSON_CONTAINS and JSON_OVERLAPS of such a value (or of the document
+  column, with a path) and a constant candidate search arrays through
+  $all, $in and $elemMatch, again as supersets.
+
+  DATE, DATETIME and TIMESTAMP columns read BSON dates in the session time
+  zone. Comparisons with dates, DATE() and YEAR() of such a column become
+  Date ranges between the instants where the shown value changes, so
+  they stay on an index; constants such as NOW() - INTERVAL 1 DAY are
+  evaluated first. Near a change in the zone's offset the range is
+  widened by a day and MariaDB checks the rows. The _id_time column
+  (mongodb_row_convert.h) translates the same way to _id ranges between
+  ObjectIds of the bounding seconds.
+
+  translate_condition_cached() keeps the filters in a per-table plan cache
+  (mongodb_plan_cache.h) keyed by the condition's shape, where the values
+  of numeric constants are left out. A condition seen before with other
+  numbers gets the cached filter with its numbers written in place; one
+  whose filter depends on a number in another way (a date, a folded bound)
+  is translated every time.
+
+  An index condition (idx_cond_push) is translated for each lookup with
+  lookup set: columns of the tables read before this one then count as
+  constants holding the current row's values, so t2.b < t1.a + 10 sends
+  the bound for this row of t1.
 */
 namespace mongodb_translator {
 
-// Main translation entry point
-bool translate_condition_to_bson(const Item* item, bson_t* match_doc);
+struct MongoPlanRecording;
+
+/*
+  Translation state for one pushed condition
+*/
+struct MongoTranslateContext {
+  const TABLE *table;         // Table the condition was pushed to
+  THD *thd;                   // Session evaluating the constants
+  bool exact;                 // Cleared when the filter only narrows the rows
+  MongoPlanRecording *recording; // Numbers appended for a filter plan, or null
+  bool lookup;                // Columns of earlier tables are constants
+};
+
+// Main translation entry point; *exact tells whether MariaDB may skip the condition
+bool translate_condition_to_bson(const Item *cond, const TABLE *table, bson_t *match_doc,
+                                 bool *exact);
+
+// The same through a filter plan cache; plans may be null
+bool translate_condition_cached(const Item *cond, const TABLE *table, bool lookup,
+                                MongoFilterPlanCache *plans, bson_t *match_doc, bool *exact);
+
+// Equality of a stored column with the value set in it, for key lookups;
+// false where the clause would not be exact
+bool translate_key_equality(Field *field, bson_t *match_doc);
 
-// Function and condition translators  
-bool translate_function_item(const Item_func* func, bson_t* match_doc);
-bool translate_condition_item(const Item_cond* cond, bson_t* match_doc);
+// Function and condition translators - each fills an empty match_doc
+bool translate_item(MongoTranslateContext *ctx, Item *item, bson_t *match_doc);
+bool translate_function_item(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc);
+bool translate_condition_item(MongoTranslateContext *ctx, Item_cond *cond, bson_t *match_doc);
 
 // Specific condition types
-bool translate_equality(const Item_func* func, bson_t* match_doc);
-bool translate_comparison(const Item_func* func, bson_t* match_doc, const char* mongodb_op);
-bool translate_in_condition(const Item_func* func, bson_t* match_doc);
-bool translate_and_condition(const Item_cond* cond, bson_t* match_doc);
-bool translate_or_condition(const Item_cond* cond, bson_t* match_doc);
-
-// Helper functions
-bool convert_sql_field_to_mongodb(const char* sql_field, String* mongodb_field);
-bool add_value_to_bson(bson_t* doc, const char* key, Item* value_item);
+bool translate_comparison(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc,
+                          MongoFilterOp op);
+bool translate_between(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc);
+bool translate_in_condition(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc);
+bool translate_null_test(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc,
+                         bool is_null);
+bool translate_like(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc);
+bool translate_regexp(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc,
+                      bool negated);
+bool translate_json_contains(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc);
+bool translate_json_overlaps(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc);
+bool translate_not(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc);
+bool translate_multiple_equality(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc);
 
 } // namespace mongodb_translator
 
@@ -12,7 +12,6 @@
   - Database and collection specification
 */
 
-#include "my_global.h"
 #include <string>
 #include <vector>
 #include <map>
@@ -24,6 +24,15 @@
 // Project headers
 #include "mongodb_connection.h"
 #include "mongodb_schema.h"
+#include "mongodb_change_stream.h"
+#include "mongodb_result_cache.h"
+#include "mongodb_mirror.h"
+#include "mongodb_point_cache.h"
+#include "mongodb_plan_cache.h"
+#include "mongodb_shared_scan.h"
+#include "mongodb_key_fetch.h"
+#include "mongodb_distinct.h"
+#include "mongodb_memory.h"
 
 // MongoDB C driver (after MariaDB headers)
 #include <mongoc/mongoc.h>
@@ -42,9 +51,17 @@ static HASH mongodb_open_servers;
 */
 static int mongodb_connection_timeout = 30;  // seconds (int for MYSQL_SYSVAR_INT)
 static int mongodb_max_connections = 10;     // per server (int for MYSQL_SYSVAR_INT)
-static my_bool mongodb_enable_aggregation_pushdown = TRUE;
+my_bool mongodb_enable_aggregation_pushdown = TRUE;  // read by mongodb_create_group_by()
 static my_bool mongodb_enable_schema_cache = TRUE;
 static int mongodb_schema_cache_ttl = 300;   // seconds (int for MYSQL_SYSVAR_INT)
+my_bool mongodb_enable_change_streams = FALSE; // read by the handler in open()
+ulonglong mongodb_result_cache_size = 0;       // bytes, 0 disables the result cache
+int mongodb_result_cache_ttl = MONGODB_DEFAULT_RESULT_CACHE_TTL_SECONDS;
+ulonglong mongodb_rescan_cache_size = 0;       // bytes per handler and statement, 0 disables
+ulonglong mongodb_point_cache_size = 0;        // bytes per collection, 0 disables point caching
+int mongodb_point_cache_ttl = MONGODB_DEFAULT_POINT_CACHE_TTL_SECONDS;
+my_bool mongodb_shared_scans = FALSE;          // read by the handler in rnd_init()
+static ulonglong mongodb_memory_thread_cache_size = MONGODB_DEFAULT_THREAD_CACHE_BYTES;
 
 /*
   Status variables for monitoring
@@ -56,6 +73,62 @@ static long long mongodb_schema_cache_misses = 0;
 static long long mongodb_documents_scanned = 0;
 static long long mongodb_rows_returned = 0;
 
+/*
+  Snapshots of counters maintained by background threads (std::atomic),
+  refreshed each time the status variables are read
+*/
+static long long mongodb_change_stream_events = 0;
+static long long mongodb_change_stream_invalidations = 0;
+static long long mongodb_change_stream_errors = 0;
+static long long mongodb_change_stream_watchers = 0;
+static long long mongodb_result_cache_hits = 0;
+static long long mongodb_result_cache_misses = 0;
+static long long mongodb_result_cache_inserts = 0;
+static long long mongodb_result_cache_evictions = 0;
+static long long mongodb_result_cache_invalidations = 0;
+static long long mongodb_result_cache_bytes = 0;
+static long long mongodb_result_cache_rescan_hits = 0;
+static long long mongodb_result_cache_rescan_inserts = 0;
+static long long mongodb_point_cache_hits = 0;
+static long long mongodb_point_cache_misses = 0;
+static long long mongodb_point_cache_inserts = 0;
+static long long mongodb_point_cache_evictions = 0;
+static long long mongodb_point_cache_invalidations = 0;
+static long long mongodb_point_cache_bytes = 0;
+static long long mongodb_filter_plan_hits = 0;
+static long long mongodb_filter_plan_misses = 0;
+static long long mongodb_filter_plan_inserts = 0;
+static long long mongodb_filter_plan_evictions = 0;
+static long long mongodb_mirror_ready = 0;
+static long long mongodb_mirror_bootstraps = 0;
+static long long mongodb_mirror_events_applied = 0;
+static long long mongodb_mirror_compactions = 0;
+static long long mongodb_mirror_local_scans = 0;
+static long long mongodb_mirror_remote_fallbacks = 0;
+static long long mongodb_mirror_stream_errors = 0;
+static long long mongodb_mirror_rows = 0;
+static long long mongodb_mirror_bytes = 0;
+static long long mongodb_mirror_freshness_lag_ms = 0;
+static long long mongodb_shared_scan_started = 0;
+static long long mongodb_shared_scan_joined = 0;
+static long long mongodb_shared_scan_detached = 0;
+static long long mongodb_shared_scan_batches_produced = 0;
+static long long mongodb_shared_scan_batches_consumed = 0;
+static long long mongodb_memory_current_bytes = 0;
+static long long mongodb_memory_peak_bytes = 0;
+static long long mongodb_memory_cached_bytes = 0;
+static long long mongodb_memory_allocations = 0;
+static long long mongodb_memory_cache_hits = 0;
+static long long mongodb_key_fetch_reads = 0;
+static long long mongodb_key_fetch_keys = 0;
+static long long mongodb_key_fetch_chunks = 0;
+static long long mongodb_key_fetch_documents = 0;
+static long long mongodb_distinct_commands = 0;
+static long long mongodb_distinct_pipelines = 0;
+static long long mongodb_distinct_counts = 0;
+static long long mongodb_distinct_fallbacks = 0;
+static long long mongodb_distinct_values = 0;
+
 /*
   Forward declarations
 */
@@ -71,6 +144,15 @@ static const char *ha_mongodb_exts[] = {
   NullS
 };
 
+/*
+  Engine-defined table options (see ha_table_option_struct)
+*/
+static ha_create_table_option mongodb_table_option_list[] = {
+  HA_TOPTION_BOOL("RESULT_CACHE", result_cache, 0),
+  HA_TOPTION_BOOL("LOCAL_MIRROR", local_mirror, 0),
+  HA_TOPTION_END
+};
+
 /*
   Plugin registration structure - must be global for plugin loading
 */
@@ -106,18 +188,315 @@ static MYSQL_SYSVAR_INT(schema_cache_ttl, mongodb_schema_cache_ttl,
   "MongoDB schema cache TTL in seconds",
   nullptr, nullptr, 300, 60, 3600, 0);
 
+static MYSQL_SYSVAR_BOOL(enable_change_streams, mongodb_enable_change_streams,
+  PLUGIN_VAR_RQCMDARG,
+  "Watch each opened collection's change stream to maintain document counts "
+  "and field statistics and to invalidate cached schemas on drift",
+  nullptr, nullptr, FALSE);
+
+static void update_result_cache_size(THD *thd, struct st_mysql_sys_var *var,
+                                     void *var_ptr, const void *save)
+{
+  *static_cast<ulonglong*>(var_ptr) = *static_cast<const ulonglong*>(save);
+  mongodb_result_cache.set_capacity((size_t)mongodb_result_cache_size);
+}
+
+static MYSQL_SYSVAR_ULONGLONG(result_cache_size, mongodb_result_cache_size,
+  PLUGIN_VAR_RQCMDARG,
+  "Memory in bytes for caching rows of repeated identical scans on tables "
+  "created with RESULT_CACHE=YES (0 disables the cache)",
+  nullptr, update_result_cache_size, 0, 0, ULONGLONG_MAX, 0);
+
+static MYSQL_SYSVAR_INT(result_cache_ttl, mongodb_result_cache_ttl,
+  PLUGIN_VAR_RQCMDARG,
+  "Seconds a cached scan result may be replayed",
+  nullptr, nullptr, MONGODB_DEFAULT_RESULT_CACHE_TTL_SECONDS, 1, 86400, 0);
+
+static MYSQL_SYSVAR_ULONGLONG(rescan_cache_size, mongodb_rescan_cache_size,
+  PLUGIN_VAR_RQCMDARG,
+  "Memory in bytes per table and statement for replaying scans repeated "
+  "within the statement, such as dependent subqueries (0 disables)",
+  nullptr, nullptr, 0, 0, ULONGLONG_MAX, 0);
+
+static MYSQL_SYSVAR_ULONGLONG(point_cache_size, mongodb_point_cache_size,
+  PLUGIN_VAR_RQCMDARG,
+  "Memory in bytes per collection for caching documents read by exact "
+  "unique key lookups (0 disables the cache)",
+  nullptr, nullptr, 0, 0, ULONGLONG_MAX, 0);
+
+static MYSQL_SYSVAR_INT(point_cache_ttl, mongodb_point_cache_ttl,
+  PLUGIN_VAR_RQCMDARG,
+  "Seconds a cached point lookup may be served",
+  nullptr, nullptr, MONGODB_DEFAULT_POINT_CACHE_TTL_SECONDS, 1, 86400, 0);
+
+static MYSQL_SYSVAR_BOOL(shared_scans, mongodb_shared_scans,
+  PLUGIN_VAR_RQCMDARG,
+  "Let concurrent full scans of the same collection and filter share one "
+  "MongoDB cursor; late scans read the part they missed separately",
+  nullptr, nullptr, FALSE);
+
+static void update_memory_thread_cache_size(THD *thd, struct st_mysql_sys_var *var,
+                                            void *var_ptr, const void *save)
+{
+  *static_cast<ulonglong*>(var_ptr) = *static_cast<const ulonglong*>(save);
+  mongodb_memory_set_thread_cache_limit((size_t)mongodb_memory_thread_cache_size);
+}
+
+static MYSQL_SYSVAR_ULONGLONG(memory_thread_cache_size, mongodb_memory_thread_cache_size,
+  PLUGIN_VAR_RQCMDARG,
+  "Bytes of freed driver memory each thread keeps for reuse "
+  "(0 returns every block to the server allocator immediately)",
+  nullptr, update_memory_thread_cache_size, MONGODB_DEFAULT_THREAD_CACHE_BYTES,
+  0, ULONGLONG_MAX, 0);
+
 static struct st_mysql_sys_var* mongodb_system_variables[] = {
   MYSQL_SYSVAR(connection_timeout),
   MYSQL_SYSVAR(max_connections),
   MYSQL_SYSVAR(enable_aggregation_pushdown),
   MYSQL_SYSVAR(enable_schema_cache),
   MYSQL_SYSVAR(schema_cache_ttl),
+  MYSQL_SYSVAR(enable_change_streams),
+  MYSQL_SYSVAR(result_cache_size),
+  MYSQL_SYSVAR(result_cache_ttl),
+  MYSQL_SYSVAR(rescan_cache_size),
+  MYSQL_SYSVAR(point_cache_size),
+  MYSQL_SYSVAR(point_cache_ttl),
+  MYSQL_SYSVAR(shared_scans),
+  MYSQL_SYSVAR(memory_thread_cache_size),
   nullptr
 };
 
 /*
   Status variables declarations
 */
+static struct st_mysql_show_var mongodb_change_stream_status[] = {
+  {"events", (char*)&mongodb_change_stream_events, SHOW_LONGLONG},
+  {"schema_invalidations", (char*)&mongodb_change_stream_invalidations, SHOW_LONGLONG},
+  {"errors", (char*)&mongodb_change_stream_errors, SHOW_LONGLONG},
+  {"watchers", (char*)&mongodb_change_stream_watchers, SHOW_LONGLONG},
+  {nullptr, nullptr, SHOW_UNDEF}
+};
+
+static int show_mongodb_change_stream_vars(THD *thd, SHOW_VAR *var, void *buff,
+                                           struct system_status_var *status_var,
+                                           enum enum_var_type var_type)
+{
+  mongodb_change_stream_events = (long long)change_stream_counters.events_processed.load();
+  mongodb_change_stream_invalidations = (long long)change_stream_counters.schema_invalidations.load();
+  mongodb_change_stream_errors = (long long)change_stream_counters.stream_errors.load();
+  mongodb_change_stream_watchers = (long long)change_stream_counters.watchers_running.load();
+  
+  var->type = SHOW_ARRAY;
+  var->value = (char*)&mongodb_change_stream_status;
+  return 0;
+}
+
+static struct st_mysql_show_var mongodb_result_cache_status[] = {
+  {"hits", (char*)&mongodb_result_cache_hits, SHOW_LONGLONG},
+  {"misses", (char*)&mongodb_result_cache_misses, SHOW_LONGLONG},
+  {"inserts", (char*)&mongodb_result_cache_inserts, SHOW_LONGLONG},
+  {"evictions", (char*)&mongodb_result_cache_evictions, SHOW_LONGLONG},
+  {"invalidations", (char*)&mongodb_result_cache_invalidations, SHOW_LONGLONG},
+  {"bytes", (char*)&mongodb_result_cache_bytes, SHOW_LONGLONG},
+  {"rescan_hits", (char*)&mongodb_result_cache_rescan_hits, SHOW_LONGLONG},
+  {"rescan_inserts", (char*)&mongodb_result_cache_rescan_inserts, SHOW_LONGLONG},
+  {nullptr, nullptr, SHOW_UNDEF}
+};
+
+static int show_mongodb_result_cache_vars(THD *thd, SHOW_VAR *var, void *buff,
+                                          struct system_status_var *status_var,
+                                          enum enum_var_type var_type)
+{
+  mongodb_result_cache_hits = (long long)mongodb_result_cache.hits.load();
+  mongodb_result_cache_misses = (long long)mongodb_result_cache.misses.load();
+  mongodb_result_cache_inserts = (long long)mongodb_result_cache.inserts.load();
+  mongodb_result_cache_evictions = (long long)mongodb_result_cache.evictions.load();
+  mongodb_result_cache_invalidations = (long long)mongodb_result_cache.invalidations.load();
+  mongodb_result_cache_bytes = (long long)mongodb_result_cache.get_used_bytes();
+  mongodb_result_cache_rescan_hits = (long long)mongodb_result_cache.rescan_hits.load();
+  mongodb_result_cache_rescan_inserts = (long long)mongodb_result_cache.rescan_inserts.load();
+  
+  var->type = SHOW_ARRAY;
+  var->value = (char*)&mongodb_result_cache_status;
+  return 0;
+}
+
+static struct st_mysql_show_var mongodb_point_cache_status[] = {
+  {"hits", (char*)&mongodb_point_cache_hits, SHOW_LONGLONG},
+  {"misses", (char*)&mongodb_point_cache_misses, SHOW_LONGLONG},
+  {"inserts", (char*)&mongodb_point_cache_inserts, SHOW_LONGLONG},
+  {"evictions", (char*)&mongodb_point_cache_evictions, SHOW_LONGLONG},
+  {"invalidations", (char*)&mongodb_point_cache_invalidations, SHOW_LONGLONG},
+  {"bytes", (char*)&mongodb_point_cache_bytes, SHOW_LONGLONG},
+  {nullptr, nullptr, SHOW_UNDEF}
+};
+
+static int show_mongodb_point_cache_vars(THD *thd, SHOW_VAR *var, void *buff,
+                                         struct system_status_var *status_var,
+                                         enum enum_var_type var_type)
+{
+  mongodb_point_cache_hits = (long long)point_cache_counters.hits.load();
+  mongodb_point_cache_misses = (long long)point_cache_counters.misses.load();
+  mongodb_point_cache_inserts = (long long)point_cache_counters.inserts.load();
+  mongodb_point_cache_evictions = (long long)point_cache_counters.evictions.load();
+  mongodb_point_cache_invalidations = (long long)point_cache_counters.invalidations.load();
+  mongodb_point_cache_bytes = (long long)mongodb_point_cache_total_bytes();
+  
+  var->type = SHOW_ARRAY;
+  var->value = (char*)&mongodb_point_cache_status;
+  return 0;
+}
+
+static struct st_mysql_show_var mongodb_filter_plan_status[] = {
+  {"hits", (char*)&mongodb_filter_plan_hits, SHOW_LONGLONG},
+  {"misses", (char*)&mongodb_filter_plan_misses, SHOW_LONGLONG},
+  {"inserts", (char*)&mongodb_filter_plan_inserts, SHOW_LONGLONG},
+  {"evictions", (char*)&mongodb_filter_plan_evictions, SHOW_LONGLONG},
+  {nullptr, nullptr, SHOW_UNDEF}
+};
+
+static int show_mongodb_filter_plan_vars(THD *thd, SHOW_VAR *var, void *buff,
+                                         struct system_status_var *status_var,
+                                         enum enum_var_type var_type)
+{
+  mongodb_filter_plan_hits = (long long)filter_plan_counters.hits.load();
+  mongodb_filter_plan_misses = (long long)filter_plan_counters.misses.load();
+  mongodb_filter_plan_inserts = (long long)filter_plan_counters.inserts.load();
+  mongodb_filter_plan_evictions = (long long)filter_plan_counters.evictions.load();
+  
+  var->type = SHOW_ARRAY;
+  var->value = (char*)&mongodb_filter_plan_status;
+  return 0;
+}
+
+static struct st_mysql_show_var mongodb_mirror_status[] = {
+  {"ready", (char*)&mongodb_mirror_ready, SHOW_LONGLONG},
+  {"bootstraps", (char*)&mongodb_mirror_bootstraps, SHOW_LONGLONG},
+  {"events_applied", (char*)&mongodb_mirror_events_applied, SHOW_LONGLONG},
+  {"compactions", (char*)&mongodb_mirror_compactions, SHOW_LONGLONG},
+  {"local_scans", (char*)&mongodb_mirror_local_scans, SHOW_LONGLONG},
+  {"remote_fallbacks", (char*)&mongodb_mirror_remote_fallbacks, SHOW_LONGLONG},
+  {"stream_errors", (char*)&mongodb_mirror_stream_errors, SHOW_LONGLONG},
+  {"rows", (char*)&mongodb_mirror_rows, SHOW_LONGLONG},
+  {"bytes", (char*)&mongodb_mirror_bytes, SHOW_LONGLONG},
+  {"freshness_lag_ms", (char*)&mongodb_mirror_freshness_lag_ms, SHOW_LONGLONG},
+  {nullptr, nullptr, SHOW_UNDEF}
+};
+
+static int show_mongodb_mirror_vars(THD *thd, SHOW_VAR *var, void *buff,
+                                    struct system_status_var *status_var,
+                                    enum enum_var_type var_type)
+{
+  mongodb_mirror_ready = (long long)mirror_counters.mirrors_ready.load();
+  mongodb_mirror_bootstraps = (long long)mirror_counters.bootstraps.load();
+  mongodb_mirror_events_applied = (long long)mirror_counters.events_applied.load();
+  mongodb_mirror_compactions = (long long)mirror_counters.compactions.load();
+  mongodb_mirror_local_scans = (long long)mirror_counters.local_scans.load();
+  mongodb_mirror_remote_fallbacks = (long long)mirror_counters.remote_fallbacks.load();
+  mongodb_mirror_stream_errors = (long long)mirror_counters.stream_errors.load();
+  mongodb_mirror_rows = (long long)mongodb_mirror_total_rows();
+  mongodb_mirror_bytes = (long long)mongodb_mirror_total_bytes();
+  mongodb_mirror_freshness_lag_ms = (long long)mongodb_mirror_max_freshness_lag_ms();
+  
+  var->type = SHOW_ARRAY;
+  var->value = (char*)&mongodb_mirror_status;
+  return 0;
+}
+
+static struct st_mysql_show_var mongodb_shared_scan_status[] = {
+  {"started", (char*)&mongodb_shared_scan_started, SHOW_LONGLONG},
+  {"joined", (char*)&mongodb_shared_scan_joined, SHOW_LONGLONG},
+  {"detached", (char*)&mongodb_shared_scan_detached, SHOW_LONGLONG},
+  {"batches_produced", (char*)&mongodb_shared_scan_batches_produced, SHOW_LONGLONG},
+  {"batches_consumed", (char*)&mongodb_shared_scan_batches_consumed, SHOW_LONGLONG},
+  {nullptr, nullptr, SHOW_UNDEF}
+};
+
+static int show_mongodb_shared_scan_vars(THD *thd, SHOW_VAR *var, void *buff,
+                                         struct system_status_var *status_var,
+                                         enum enum_var_type var_type)
+{
+  mongodb_shared_scan_started = (long long)shared_scan_counters.scans_started.load();
+  mongodb_shared_scan_joined = (long long)shared_scan_counters.readers_joined.load();
+  mongodb_shared_scan_detached = (long long)shared_scan_counters.readers_detached.load();
+  mongodb_shared_scan_batches_produced = (long long)shared_scan_counters.batches_produced.load();
+  mongodb_shared_scan_batches_consumed = (long long)shared_scan_counters.batches_consumed.load();
+  
+  var->type = SHOW_ARRAY;
+  var->value = (char*)&mongodb_shared_scan_status;
+  return 0;
+}
+
+static struct st_mysql_show_var mongodb_memory_status[] = {
+  {"current_bytes", (char*)&mongodb_memory_current_bytes, SHOW_LONGLONG},
+  {"peak_bytes", (char*)&mongodb_memory_peak_bytes, SHOW_LONGLONG},
+  {"cached_bytes", (char*)&mongodb_memory_cached_bytes, SHOW_LONGLONG},
+  {"allocations", (char*)&mongodb_memory_allocations, SHOW_LONGLONG},
+  {"cache_hits", (char*)&mongodb_memory_cache_hits, SHOW_LONGLONG},
+  {nullptr, nullptr, SHOW_UNDEF}
+};
+
+static int show_mongodb_memory_vars(THD *thd, SHOW_VAR *var, void *buff,
+                                    struct system_status_var *status_var,
+                                    enum enum_var_type var_type)
+{
+  mongodb_memory_current_bytes = (long long)memory_counters.current_bytes.load();
+  mongodb_memory_peak_bytes = (long long)memory_counters.peak_bytes.load();
+  mongodb_memory_cached_bytes = (long long)memory_counters.cached_bytes.load();
+  mongodb_memory_allocations = (long long)memory_counters.allocations.load();
+  mongodb_memory_cache_hits = (long long)memory_counters.cache_hits.load();
+  
+  var->type = SHOW_ARRAY;
+  var->value = (char*)&mongodb_memory_status;
+  return 0;
+}
+
+static struct st_mysql_show_var mongodb_key_fetch_status[] = {
+  {"reads", (char*)&mongodb_key_fetch_reads, SHOW_LONGLONG},
+  {"keys", (char*)&mongodb_key_fetch_keys, SHOW_LONGLONG},
+  {"chunks", (char*)&mongodb_key_fetch_chunks, SHOW_LONGLONG},
+  {"documents", (char*)&mongodb_key_fetch_documents, SHOW_LONGLONG},
+  {nullptr, nullptr, SHOW_UNDEF}
+};
+
+static int show_mongodb_key_fetch_vars(THD *thd, SHOW_VAR *var, void *buff,
+                                       struct system_status_var *status_var,
+                                       enum enum_var_type var_type)
+{
+  mongodb_key_fetch_reads = (long long)key_fetch_counters.reads.load();
+  mongodb_key_fetch_keys = (long long)key_fetch_counters.keys.load();
+  mongodb_key_fetch_chunks = (long long)key_fetch_counters.chunks.load();
+  mongodb_key_fetch_documents = (long long)key_fetch_counters.documents.load();
+  
+  var->type = SHOW_ARRAY;
+  var->value = (char*)&mongodb_key_fetch_status;
+  return 0;
+}
+
+static struct st_mysql_show_var mongodb_distinct_status[] = {
+  {"commands", (char*)&mongodb_distinct_commands, SHOW_LONGLONG},
+  {"pipelines", (char*)&mongodb_distinct_pipelines, SHOW_LONGLONG},
+  {"counts", (char*)&mongodb_distinct_counts, SHOW_LONGLONG},
+  {"fallbacks", (char*)&mongodb_distinct_fallbacks, SHOW_LONGLONG},
+  {"values", (char*)&mongodb_distinct_values, SHOW_LONGLONG},
+  {nullptr, nullptr, SHOW_UNDEF}
+};
+
+static int show_mongodb_distinct_vars(THD *thd, SHOW_VAR *var, void *buff,
+                                      struct system_status_var *status_var,
+                                      enum enum_var_type var_type)
+{
+  mongodb_distinct_commands = (long long)distinct_counters.commands.load();
+  mongodb_distinct_pipelines = (long long)distinct_counters.pipelines.load();
+  mongodb_distinct_counts = (long long)distinct_counters.counts.load();
+  mongodb_distinct_fallbacks = (long long)distinct_counters.fallbacks.load();
+  mongodb_distinct_values = (long long)distinct_counters.values.load();
+  
+  var->type = SHOW_ARRAY;
+  var->value = (char*)&mongodb_distinct_status;
+  return 0;
+}
+
 static struct st_mysql_show_var mongodb_status_variables[] = {
   {"mongodb_queries_translated", (char*)&mongodb_queries_translated, SHOW_LONGLONG},
   {"mongodb_connections_active", (char*)&mongodb_connections_active, SHOW_LONGLONG},
@@ -125,6 +504,15 @@ static struct st_mysql_show_var mongodb_status_variables[] = {
   {"mongodb_schema_cache_misses", (char*)&mongodb_schema_cache_misses, SHOW_LONGLONG},
   {"mongodb_documents_scanned", (char*)&mongodb_documents_scanned, SHOW_LONGLONG},
   {"mongodb_rows_returned", (char*)&mongodb_rows_returned, SHOW_LONGLONG},
+  {"mongodb_change_stream", (char*)&show_mongodb_change_stream_vars, SHOW_FUNC},
+  {"mongodb_result_cache", (char*)&show_mongodb_result_cache_vars, SHOW_FUNC},
+  {"mongodb_mirror", (char*)&show_mongodb_mirror_vars, SHOW_FUNC},
+  {"mongodb_point_cache", (char*)&show_mongodb_point_cache_vars, SHOW_FUNC},
+  {"mongodb_filter_plans", (char*)&show_mongodb_filter_plan_vars, SHOW_FUNC},
+  {"mongodb_shared_scan", (char*)&show_mongodb_shared_scan_vars, SHOW_FUNC},
+  {"mongodb_memory", (char*)&show_mongodb_memory_vars, SHOW_FUNC},
+  {"mongodb_key_fetch", (char*)&show_mongodb_key_fetch_vars, SHOW_FUNC},
+  {"mongodb_distinct", (char*)&show_mongodb_distinct_vars, SHOW_FUNC},
   {nullptr, nullptr, SHOW_UNDEF}
 };
 
@@ -162,6 +550,12 @@ static int mongodb_init_func(void *p)
 {
   DBUG_ENTER("mongodb_init_func");
   
+  // Route driver allocations through the engine allocator before anything allocates
+  mongodb_memory_set_thread_cache_limit((size_t)mongodb_memory_thread_cache_size);
+  if (!mongodb_memory_install()) {
+    sql_print_warning("MongoDB: could not install driver allocator, using libbson defaults");
+  }
+  
   // Initialize MongoDB C driver
   mongoc_init();
   
@@ -171,6 +565,11 @@ static int mongodb_init_func(void *p)
   mongodb_hton->create = mongodb_create_handler;
   mongodb_hton->flags = HTON_CAN_RECREATE;
   mongodb_hton->tablefile_extensions = ha_mongodb_exts;
+  mongodb_hton->table_options = mongodb_table_option_list;
+  mongodb_hton->create_group_by = mongodb_create_group_by;
+  
+  // Apply startup value of mongodb_result_cache_size
+  mongodb_result_cache.set_capacity((size_t)mongodb_result_cache_size);
   
   sql_print_information("MongoDB storage engine initialized successfully");
   DBUG_RETURN(0);
@@ -183,8 +582,17 @@ static int mongodb_done_func(void *p)
 {
   DBUG_ENTER("mongodb_done_func");
   
+  // Stop background watchers while the driver is still initialized
+  cleanup_all_change_stream_watchers();
+  cleanup_all_collection_mirrors();
+  cleanup_all_shared_scan_coordinators();
+  cleanup_all_point_caches();
+  mongodb_result_cache.clear();
+  cleanup_all_connection_pools();
+  
   // Cleanup MongoDB C driver
   mongoc_cleanup();
+  mongodb_memory_uninstall();
   
   sql_print_information("MongoDB storage engine shut down successfully");
   DBUG_RETURN(0);
@@ -204,8 +612,8 @@ maria_declare_plugin(mongodb)
   mongodb_init_func,                /* Plugin Init */
   mongodb_done_func,                /* Plugin Deinit */
   0x0100,                          /* Version: 1.0 (simple) */
-  NULL,                            /* Status variables */
-  NULL,                            /* System variables */
+  mongodb_status_variables,        /* Status variables */
+  mongodb_system_variables,        /* System variables */
   "1.0",                           /* Version string */
   MariaDB_PLUGIN_MATURITY_STABLE   /* Maturity level */
 }
@@ -0,0 +1,263 @@
+/*
+  MongoDB DISTINCT pushdown - group by handler (see ha_mongodb_distinct.h)
+*/
+
+#define MYSQL_SERVER 1
+#include "my_global.h"
+#include "sql_class.h"
+#include "item.h"
+#include "item_sum.h"
+#include "group_by_handler.h"
+#include "ha_mongodb.h"
+#include "ha_mongodb_distinct.h"
+#include "mongodb_translator.h"
+
+/*
+  Columns whose COUNT(DISTINCT) MongoDB can count, with the BSON values
+  they show unchanged (mongodb_distinct.h): integers in the column's
+  range, doubles, and UTF-8 strings that fit, for utf8mb4 binary NO PAD
+  and binary columns. Other collations and fixed-length CHAR (it strips
+  trailing spaces) never qualify.
+*/
+static bool countable_column(Field *field, MongoDistinctDomain *domain)
+{
+  CHARSET_INFO *cs = field->charset();
+  bool is_unsigned = field->is_unsigned();
+  domain->kind = MONGODB_DISTINCT_INTEGER;
+  domain->max_length = 0;
+  domain->length_in_bytes = false;
+  switch (field->type()) {
+    case MYSQL_TYPE_TINY:
+      domain->min = is_unsigned ? 0 : INT8_MIN;
+      domain->max = is_unsigned ? UINT8_MAX : INT8_MAX;
+      return true;
+    case MYSQL_TYPE_SHORT:
+      domain->min = is_unsigned ? 0 : INT16_MIN;
+      domain->max = is_unsigned ? UINT16_MAX : INT16_MAX;
+      return true;
+    case MYSQL_TYPE_INT24:
+      domain->min = is_unsigned ? 0 : -8388608;
+      domain->max = is_unsigned ? 16777215 : 8388607;
+      return true;
+    case MYSQL_TYPE_LONG:
+      domain->min = is_unsigned ? 0 : INT32_MIN;
+      domain->max = is_unsigned ? UINT32_MAX : INT32_MAX;
+      return true;
+    case MYSQL_TYPE_LONGLONG:
+      domain->min = is_unsigned ? 0 : INT64_MIN;
+      domain->max = INT64_MAX;
+      return true;
+    case MYSQL_TYPE_DOUBLE:
+      domain->kind = MONGODB_DISTINCT_DOUBLE;
+      return true;
+    case MYSQL_TYPE_VARCHAR:
+    case MYSQL_TYPE_TINY_BLOB:
+    case MYSQL_TYPE_BLOB:
+    case MYSQL_TYPE_MEDIUM_BLOB:
+    case MYSQL_TYPE_LONG_BLOB:
+      // Other charsets convert, and may collapse, what they store
+      if (cs != &my_charset_bin &&
+          !(cs->mbminlen == 1 && cs->mbmaxlen == 4 && (cs->state & MY_CS_UNICODE) &&
+            (cs->state & MY_CS_BINSORT) && (cs->state & MY_CS_NOPAD))) {
+        return false;
+      }
+      // Longer strings are cut to the column and may then collide
+      domain->kind = MONGODB_DISTINCT_STRING;
+      domain->length_in_bytes = cs == &my_charset_bin || field->type() != MYSQL_TYPE_VARCHAR;
+      domain->max_length = domain->length_in_bytes ? field->field_length : field->char_length();
+      return true;
+    default:
+      return false;
+  }
+}
+
+// The column of table behind item, or null
+static Field *table_column(Item *item, TABLE *table)
+{
+  Item *real = item->real_item();
+  if (real->type() != Item::FIELD_ITEM) {
+    return nullptr;
+  }
+  Field *field = static_cast<Item_field*>(real)->field;
+  return field && field->table == table && !field->vcol_info ? field : nullptr;
+}
+
+group_by_handler *mongodb_create_group_by(THD *thd, Query *query)
+{
+  DBUG_ENTER("mongodb_create_group_by");
+
+  if (!mongodb_enable_aggregation_pushdown || !query->from || query->from->next_local ||
+      !query->from->table || query->group_by || query->having) {
+    DBUG_RETURN(nullptr);
+  }
+  TABLE *table = query->from->table;
+  // The file of a partitioned MONGODB table is an ha_partition
+  if (table->file->ht != mongodb_hton) {
+    DBUG_RETURN(nullptr);
+  }
+
+  // Every select item a column (DISTINCT), or the one COUNT(DISTINCT column)
+  std::vector<Field*> fields;
+  bool count_only = false;
+  MongoDistinctDomain domain = {};
+  List_iterator_fast<Item> it(*query->select);
+  for (Item *item = it++; item; item = it++) {
+    Field *field = table_column(item, table);
+    if (!field && item->type() == Item::SUM_FUNC_ITEM && query->select->elements == 1) {
+      Item_sum *sum = static_cast<Item_sum*>(item);
+      if (sum->sum_func() == Item_sum::COUNT_DISTINCT_FUNC && sum->get_arg_count() == 1) {
+        field = table_column(sum->get_arg(0), table);
+        count_only = field && countable_column(field, &domain);
+        if (!count_only) {
+          field = nullptr;
+        }
+      }
+    }
+    if (!field) {
+      DBUG_RETURN(nullptr);
+    }
+    fields.push_back(field);
+  }
+  if (fields.empty() || (!count_only && !query->distinct)) {
+    DBUG_RETURN(nullptr);
+  }
+
+  // Only fields of the documents, by names the pipelines can refer to
+  std::vector<std::string> names;
+  for (Field *field : fields) {
+    names.push_back(field->field_name.str);
+  }
+  std::vector<MongoColumn> columns = mongodb_row_columns(names);
+  for (const MongoColumn &column : columns) {
+    if ((column.kind != MONGODB_COLUMN_FIELD && column.kind != MONGODB_COLUMN_ID) ||
+        !mongodb_distinct_field(column.name)) {
+      DBUG_RETURN(nullptr);
+    }
+  }
+
+  // MongoDB sees every row, so the WHERE clause must translate whole
+  bson_t *filter = nullptr;
+  if (query->where) {
+    MONGODB_SHARE *share = static_cast<ha_mongodb*>(table->file)->share;
+    bool exact = false;
+    filter = bson_new();
+    if (!mongodb_translator::translate_condition_cached(query->where, table, false,
+                                                        share ? share->filter_plans : nullptr,
+                                                        filter, &exact) || !exact) {
+      bson_destroy(filter);
+      DBUG_RETURN(nullptr);
+    }
+  }
+
+  // MongoDB counts BSON values: a document holding one the column shows
+  // otherwise would make its count disagree with the column's
+  if (count_only) {
+    ha_mongodb *file = static_cast<ha_mongodb*>(table->file);
+    bool outside = true;
+    bson_error_t error;
+    if ((!file->collection && file->connect_to_mongodb()) ||
+        !mongodb_distinct_outside_domain(file->collection, columns[0].name, domain, filter,
+                                         &outside, &error) || outside) {
+      fprintf(stderr, "DISTINCT: COUNT(DISTINCT) left to MariaDB, values outside the column type\n");
+      if (filter) {
+        bson_destroy(filter);
+      }
+      DBUG_RETURN(nullptr);
+    }
+  }
+
+  fprintf(stderr, "DISTINCT: %s pushed down (%zu columns)\n",
+          count_only ? "COUNT(DISTINCT)" : "DISTINCT", columns.size());
+  DBUG_RETURN(new ha_mongodb_distinct(thd, mongodb_hton, static_cast<ha_mongodb*>(table->file),
+                                      columns, count_only, domain, filter));
+}
+
+ha_mongodb_distinct::ha_mongodb_distinct(THD *thd_arg, handlerton *hton, ha_mongodb *file_arg,
+                                         const std::vector<MongoColumn> &columns_arg,
+                                         bool count_arg, const MongoDistinctDomain &domain_arg,
+                                         bson_t *filter_arg)
+  : group_by_handler(thd_arg, hton),
+    file(file_arg),
+    columns(columns_arg),
+    count_only(count_arg),
+    count_returned(false),
+    domain(domain_arg),
+    filter(filter_arg)
+{
+}
+
+ha_mongodb_distinct::~ha_mongodb_distinct()
+{
+  if (filter) {
+    bson_destroy(filter);
+  }
+}
+
+int ha_mongodb_distinct::init_scan()
+{
+  DBUG_ENTER("ha_mongodb_distinct::init_scan");
+
+  if (!file->collection && file->connect_to_mongodb()) {
+    DBUG_RETURN(HA_ERR_INTERNAL_ERROR);
+  }
+  count_returned = false;
+
+  if (!count_only) {
+    std::vector<std::string> names;
+    for (const MongoColumn &column : columns) {
+      names.push_back(column.name);
+    }
+    if (!reader.open(file->collection, names, filter)) {
+      fprintf(stderr, "DISTINCT: Failed to read distinct values: %s\n",
+              reader.last_error().message);
+      DBUG_RETURN(HA_ERR_INTERNAL_ERROR);
+    }
+  }
+  DBUG_RETURN(0);
+}
+
+int ha_mongodb_distinct::next_row()
+{
+  DBUG_ENTER("ha_mongodb_distinct::next_row");
+
+  // The single row of COUNT(DISTINCT), 0 when nothing matches
+  if (count_only) {
+    if (count_returned) {
+      DBUG_RETURN(HA_ERR_END_OF_FILE);
+    }
+    int64_t count;
+    bson_error_t error;
+    if (!mongodb_count_distinct(file->collection, columns[0].name, domain, filter, &count,
+                                &error)) {
+      fprintf(stderr, "DISTINCT: COUNT(DISTINCT) failed: %s\n", error.message);
+      DBUG_RETURN(HA_ERR_INTERNAL_ERROR);
+    }
+    count_returned = true;
+    Field *field = table->field[0];
+    field->set_notnull();
+    field->store((longlong)count, false);
+    DBUG_RETURN(0);
+  }
+
+  const bson_t *doc;
+  switch (reader.next(&doc)) {
+    case MONGO_DISTINCT_ROW:
+      break;
+    case MONGO_DISTINCT_END:
+      DBUG_RETURN(HA_ERR_END_OF_FILE);
+    default:
+      fprintf(stderr, "DISTINCT: Reading distinct values failed: %s\n",
+              reader.last_error().message);
+      DBUG_RETURN(HA_ERR_INTERNAL_ERROR);
+  }
+
+  // Temporary table fields follow the select list
+  DBUG_RETURN(file->convert_document_to_fields(doc, table, columns));
+}
+
+int ha_mongodb_distinct::end_scan()
+{
+  DBUG_ENTER("ha_mongodb_distinct::end_scan");
+  reader.close();
+  DBUG_RETURN(0);
+}
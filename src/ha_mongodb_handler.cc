@@ -9,6 +9,7 @@
 #include "my_global.h"
 #include "field.h"
 #include "table.h"
+#include "key.h"
 // TODO: Fix complex header dependencies for Item class 
 // Forward declaration to avoid complex SQL layer includes
 class Item;
@@ -17,6 +18,14 @@ typedef Item COND;  // COND is typedef for Item in MariaDB
 #include "mongodb_connection.h"
 #include "mongodb_schema.h"
 #include "mongodb_translator.h"
+#include "mongodb_change_stream.h"
+#include "mongodb_result_cache.h"
+#include "mongodb_mirror.h"
+#include "mongodb_point_cache.h"
+#include "mongodb_plan_cache.h"
+#include "mongodb_shared_scan.h"
+#include "mongodb_key_fetch.h"
+#include "mongodb_row_convert.h"
 
 /* 
    Constructor - Initialize a new handler instance
@@ -33,6 +42,7 @@ ha_mongodb::ha_mongodb(handlerton *hton, TABLE_SHARE *table_arg)
                    HA_FILE_BASED | HA_REC_NOT_IN_SEQ | HA_AUTO_PART_KEY | 
                    HA_CAN_INDEX_BLOBS | HA_NULL_IN_KEY | HA_STATS_RECORDS_IS_EXACT),
     pushed_condition(nullptr),
+    condition_buffer(nullptr),
     key_read_mode(false),
     count_mode(false),
     active_index(0),
@@ -43,7 +53,25 @@ ha_mongodb::ha_mongodb(handlerton *hton, TABLE_SHARE *table_arg)
     // PHASE 3A: Initialize performance tracking variables
     documents_scanned(0),
     optimized_count_operations(0),
-    count_performance_tracking(false)
+    count_performance_tracking(false),
+    result_builder_limit(0),
+    cached_row_index(0),
+    result_scan_complete(false),
+    capture_shared(false),
+    capture_rescan(false),
+    rescan_bytes(0),
+    shared_sequence(0),
+    shared_batch_offset(0),
+    shared_last_offset(0),
+    shared_joined_late(false),
+    shared_filter(nullptr),
+    shared_doc_view(nullptr),
+    positions_by_id(false),
+    mrr_batched(false),
+    mrr_associate(false),
+    mrr_key_length(0),
+    mrr_batch_offset(0),
+    mrr_doc_view(nullptr)
 {
   fprintf(stderr, "ha_mongodb::ha_mongodb() CONSTRUCTOR called, int_table_flags=0x%llx\n", int_table_flags);}
 
@@ -53,6 +81,22 @@ ha_mongodb::ha_mongodb(handlerton *hton, TABLE_SHARE *table_arg)
 ha_mongodb::~ha_mongodb()
 {
   // Cleanup resources - don't call close() to avoid recursion
+  
+  // Only ever initialized with bson_init_static(), so never bson_destroy()ed
+  bson_free(shared_doc_view);
+  key_fetch.reset();
+  bson_free(mrr_doc_view);
+  
+  // Reusable filter buffers
+  if (pushed_condition) {
+    bson_destroy(pushed_condition);
+  }
+  if (condition_buffer) {
+    bson_destroy(condition_buffer);
+  }
+  if (shared_filter) {
+    bson_destroy(shared_filter);
+  }
 }
 
 /*
@@ -87,6 +131,47 @@ int ha_mongodb::open(const char *name, int mode, uint test_if_locked)
     fprintf(stderr, "OPEN: Connection string parsed successfully\n");
   }
   
+  // Optional change stream watcher keeps counts and schema current
+  if (mongodb_enable_change_streams && !share->change_watcher &&
+      share->mongo_connection_string && share->database_name && share->collection_name)
+  {
+    share->change_watcher = get_or_create_change_stream_watcher(
+      share->mongo_connection_string, share->database_name, share->collection_name);
+  }
+  
+  // Unique key lookups go through the collection's point cache
+  if (!share->point_cache && share->mongo_connection_string && share->collection_name)
+  {
+    share->point_cache = get_or_create_point_cache(share->mongo_connection_string,
+                                                   share->collection_name);
+  }
+  
+  // Pushed conditions of a repeated shape reuse their translated filter,
+  // whichever handler of the table translated it
+  share->filter_plans = &get_table_share()->filter_plans;
+  
+  // Concurrent full scans of the collection can share one cursor
+  if (!share->shared_scans && share->mongo_connection_string &&
+      share->database_name && share->collection_name)
+  {
+    share->shared_scans = get_or_create_shared_scan_coordinator(
+      share->mongo_connection_string, share->database_name, share->collection_name);
+  }
+  
+  // LOCAL_MIRROR tables keep a columnar copy of their mapped columns
+  if (table->s->option_struct && table->s->option_struct->local_mirror && !share->mirror &&
+      share->mongo_connection_string && share->database_name && share->collection_name)
+  {
+    std::vector<std::string> columns;
+    for (Field **field_ptr = table->field; *field_ptr; field_ptr++) {
+      const char *field_name = (*field_ptr)->field_name.str;
+      // The document column renders the whole document
+      columns.push_back(strcmp(field_name, "document") == 0 ? MONGODB_MIRROR_ROOT_COLUMN : field_name);
+    }
+    share->mirror = get_or_create_collection_mirror(
+      share->mongo_connection_string, share->database_name, share->collection_name, columns);
+  }
+  
   // Set ref_length for position-based access (match MariaDB expectation = 8 bytes)
   ref_length = 8;
   
@@ -106,6 +191,19 @@ int ha_mongodb::close(void)
   // Clean up MongoDB resources
   disconnect_from_mongodb();
   
+  // Release result cache and mirror scan state
+  cached_result.reset();
+  result_builder.reset();
+  result_cache_key.clear();
+  rescan_results.clear();
+  rescan_bytes = 0;
+  mirror_snapshot.reset();
+  mirror_rows.clear();
+  shared_scan_end();
+  mrr_end();
+  positioned_ids.clear();
+  positions_by_id = false;
+  
   // Free the shared table metadata
   if (share)
   {
@@ -123,21 +221,27 @@ int ha_mongodb::rnd_init(bool scan)
 {
   DBUG_ENTER("ha_mongodb::rnd_init");
   
-  // Reset row counter for new scan
-  static ha_rows *row_counter_ptr = nullptr;
-  if (!row_counter_ptr) {
-    static ha_rows global_row_counter = 0;
-    row_counter_ptr = &global_row_counter;
-  }
-  *row_counter_ptr = 0;
-  
-  fprintf(stderr, "RND_INIT CALLED! scan=%d, table=%p, reset row counter\n", scan, table);
+  fprintf(stderr, "RND_INIT CALLED! scan=%d, table=%p\n", scan, table);
   
   // CRITICAL: Reset optimization state for each new scan to prevent persistence
   lightweight_count_mode = false;
   consecutive_rnd_next_calls = 0;
   fprintf(stderr, "RND_INIT: Reset lightweight optimization state\n");
   
+  // Drop the previous scan's result cache state
+  cached_result.reset();
+  result_builder.reset();
+  result_cache_key.clear();
+  result_scan_complete = false;
+  
+  // A new scan detaches from any shared scan; rnd_init(false) before
+  // positioned reads keeps the stored _ids
+  if (scan) {
+    shared_scan_end();
+    positioned_ids.clear();
+    positions_by_id = false;
+  }
+  
   // CRITICAL: Reset count_mode at start of each scan
   // Operation 46 is called for many non-COUNT queries, so we can't rely on it
   if (scan) {  // Reset for table scans
@@ -145,17 +249,6 @@ int ha_mongodb::rnd_init(bool scan)
     count_mode = false;
     mongo_count_result = 0;
     mongo_count_returned = 0;
-    
-    // CRITICAL: Also reset any persistent pushed_condition that might be stuck
-    // This prevents previous WHERE clauses from affecting new queries
-    if (pushed_condition) {
-      fprintf(stderr, "RND_INIT: WARNING - Found persistent pushed_condition, cleaning up\n");
-      char* old_filter = bson_as_canonical_extended_json(pushed_condition, nullptr);
-      fprintf(stderr, "RND_INIT: Removing stuck filter: %s\n", old_filter);
-      bson_free(old_filter);
-      bson_destroy(pushed_condition);
-      pushed_condition = nullptr;
-    }
   }
   
   fprintf(stderr, "RND_INIT: count_mode=%d, key_read_mode=%d\n", count_mode, key_read_mode);
@@ -197,7 +290,7 @@ int ha_mongodb::rnd_init(bool scan)
     fprintf(stderr, "RND_INIT: collection=%p, database=%s, collection_name=%s\n", 
             collection, share ? share->database_name : "NULL", share ? share->collection_name : "NULL");
     
-    bson_t *query = pushed_condition ? bson_copy(pushed_condition) : bson_new();
+    const bson_t *query = scan_filter();
     
     // Debug: show the exact query being sent to MongoDB
     char *query_str = bson_as_canonical_extended_json(query, nullptr);
@@ -207,7 +300,6 @@ int ha_mongodb::rnd_init(bool scan)
     bson_error_t error;
     
     int64_t count = mongoc_collection_count_documents(collection, query, nullptr, nullptr, nullptr, &error);
-    bson_destroy(query);
     
     if (count < 0) {
       fprintf(stderr, "RND_INIT: MongoDB count error: %s\n", error.message);
@@ -224,13 +316,16 @@ int ha_mongodb::rnd_init(bool scan)
     DBUG_RETURN(0);
   }
   
-  // Reset the static row counter for new scan
-  static ha_rows current_scan_counter = 0;
-  current_scan_counter = 0;  // Reset for each new scan
-  
   // Reset scan position for position-based access
   scan_position = 0;
   
+  // LOCAL_MIRROR tables scan the local copy whenever it can answer the filter
+  if (mirror_scan_begin(scan)) {
+    current_doc = nullptr;
+    fprintf(stderr, "RND_INIT: Scanning local mirror (%zu rows)\n", mirror_rows.size());
+    DBUG_RETURN(0);
+  }
+  
   // SOLUTION: MongoDB ORDER BY Pushdown
   // Instead of letting MariaDB handle ORDER BY through external sorting,
   // implement MongoDB-level sorting which is more efficient
@@ -254,19 +349,39 @@ int ha_mongodb::rnd_init(bool scan)
     fprintf(stderr, "RND_INIT: MongoDB sorting not yet implemented - falling back to MariaDB sorting\n");
     
     // For now, fall back to simple cursor
-    bson_t *query = pushed_condition ? bson_copy(pushed_condition) : bson_new();
-    cursor = mongoc_collection_find_with_opts(collection, query, nullptr, nullptr);
-    bson_destroy(query);
+    cursor = mongoc_collection_find_with_opts(collection, scan_filter(), nullptr, nullptr);
     fprintf(stderr, "RND_INIT: Created cursor with condition filter\n");
   } else {
     // PHASE 3A: MongoDB Cursor Optimization for COUNT Operations
     // CRITICAL COUNT OPTIMIZATION: If we have a pushed condition, this could be COUNT with WHERE
     // Since MariaDB chooses table scanning for COUNT with WHERE, intercept and optimize
     
-    bson_t *query = pushed_condition ? bson_copy(pushed_condition) : bson_new();
+    // The pushed filter is passed by reference; options are built on the stack
+    const bson_t *query = scan_filter();
+    
+    // A filtered scan that reads no column but _id (COUNT with a pushed
+    // condition) fetches _id alone
+    bool id_only = pushed_condition && scan && reads_only_id();
+    
+    // Repeated identical scan - replay rows from the result cache
+    if (result_cache_lookup(query, id_only ? "_id" : "*")) {
+      current_doc = nullptr;
+      fprintf(stderr, "RND_INIT: Result cache hit - replaying %llu rows\n",
+              (unsigned long long)cached_result->row_count);
+      DBUG_RETURN(0);
+    }
+    result_cache_begin();
+    
+    // Full scan - join an in-flight scan of the same filter, or start one
+    if (!(pushed_condition && scan) && shared_scan_begin(query, scan)) {
+      current_doc = nullptr;
+      fprintf(stderr, "RND_INIT: Reading shared scan from batch %llu%s\n",
+              (unsigned long long)shared_sequence, shared_joined_late ? " (joined late)" : "");
+      DBUG_RETURN(0);
+    }
     
     // INTELLIGENT COUNT DETECTION: For scans with WHERE conditions, try COUNT first
-    if (pushed_condition && scan) {
+    if (id_only) {
       fprintf(stderr, "RND_INIT: SCAN + WHERE condition detected - attempting COUNT optimization\n");
       
       // Try MongoDB native count with the condition
@@ -285,41 +400,45 @@ int ha_mongodb::rnd_init(bool scan)
         // This allows MariaDB's scanning loop to work but with minimal data transfer
         
         // Use projection to fetch only _id field for minimal data transfer
-        bson_t *opts = bson_new();
-        bson_t *projection = bson_new();
-        bson_append_int32(projection, "_id", 3, 1);  // Only fetch _id field
-        bson_append_document(opts, "projection", 10, projection);
-        bson_append_int32(opts, "batchSize", 9, 100);  // Small batches for counting
+        bson_t opts, projection;
+        bson_init(&opts);
+        BSON_APPEND_DOCUMENT_BEGIN(&opts, "projection", &projection);
+        bson_append_int32(&projection, "_id", 3, 1);  // Only fetch _id field
+        bson_append_document_end(&opts, &projection);
+        bson_append_int32(&opts, "batchSize", 9, 100);  // Small batches for counting
         
-        cursor = mongoc_collection_find_with_opts(collection, query, opts, nullptr);
+        cursor = mongoc_collection_find_with_opts(collection, query, &opts, nullptr);
         
-        bson_destroy(projection);
-        bson_destroy(opts);
+        bson_destroy(&opts);
         
         fprintf(stderr, "RND_INIT: Created COUNT-optimized cursor with minimal projection\n");
       } else {
         fprintf(stderr, "RND_INIT: MongoDB count failed: %s, using normal cursor\n", count_error.message);
         
+        // Rows no longer match the cache key's projection
+        result_builder.reset();
+        result_cache_key.clear();
+        
         // Fall back to normal cursor
-        bson_t *opts = bson_new();
-        bson_append_int32(opts, "batchSize", 9, 1000);
-        bson_append_bool(opts, "noCursorTimeout", 15, true);
+        bson_t opts;
+        bson_init(&opts);
+        bson_append_int32(&opts, "batchSize", 9, 1000);
+        bson_append_bool(&opts, "noCursorTimeout", 15, true);
         
-        cursor = mongoc_collection_find_with_opts(collection, query, opts, nullptr);
-        bson_destroy(opts);
+        cursor = mongoc_collection_find_with_opts(collection, query, &opts, nullptr);
+        bson_destroy(&opts);
       }
     } else {
-      // Normal scan without WHERE condition
-      bson_t *opts = bson_new();
-      bson_append_int32(opts, "batchSize", 9, 1000);
-      bson_append_bool(opts, "noCursorTimeout", 15, true);
+      // Normal scan, filtered by any pushed condition
+      bson_t opts;
+      bson_init(&opts);
+      bson_append_int32(&opts, "batchSize", 9, 1000);
+      bson_append_bool(&opts, "noCursorTimeout", 15, true);
       
-      cursor = mongoc_collection_find_with_opts(collection, query, opts, nullptr);
-      bson_destroy(opts);
+      cursor = mongoc_collection_find_with_opts(collection, query, &opts, nullptr);
+      bson_destroy(&opts);
       fprintf(stderr, "RND_INIT: Created normal cursor\n");
     }
-    
-    bson_destroy(query);  // Clean up query in all cases
   }
   
   if (!cursor)
@@ -380,13 +499,52 @@ int ha_mongodb::rnd_next(uchar *buf)
     // From this point forward, minimize document processing overhead
   }
   
+  // Local mirror scan - rows come from the columnar snapshot
+  if (mirror_snapshot)
+  {
+    int rc = mirror_read_row(buf, scan_position);
+    if (rc == 0) {
+      scan_position++;
+    }
+    DBUG_RETURN(rc);
+  }
+  
+  // Result cache hit - replay rows without touching MongoDB
+  if (cached_result)
+  {
+    int rc = result_cache_replay_row(buf, cached_row_index);
+    if (rc == 0) {
+      cached_row_index++;
+      scan_position++;
+    }
+    DBUG_RETURN(rc);
+  }
+  
+  // Shared scan - documents come from the producer's batches until the
+  // reader finishes or detaches, then from a private remainder cursor
+  bool shared_document = false;
+  if (shared_scan)
+  {
+    const uint8_t *data;
+    uint32_t length;
+    int rc = shared_scan_next(&data, &length);
+    if (rc > 0) {
+      DBUG_RETURN(rc);
+    }
+    if (rc == 0) {
+      bson_init_static(shared_doc_view, data, length);
+      current_doc = shared_doc_view;
+      shared_document = true;
+    }
+  }
+  
   // Normal document fetching mode
-  if (!cursor)
+  if (!shared_document && !cursor)
   {
     DBUG_RETURN(HA_ERR_END_OF_FILE);
   }
   
-  if (!mongoc_cursor_next(cursor, &current_doc))
+  if (!shared_document && !mongoc_cursor_next(cursor, &current_doc))
   {
     // Check for errors
     bson_error_t error;
@@ -415,6 +573,7 @@ int ha_mongodb::rnd_next(uchar *buf)
     }
     
     // No more documents
+    result_scan_complete = true;
     DBUG_RETURN(HA_ERR_END_OF_FILE);
   }
   
@@ -444,6 +603,9 @@ int ha_mongodb::rnd_next(uchar *buf)
     // Minimal row setup - just ensure the buffer is valid for MariaDB
     memset(buf, 0, table->s->reclength);
     
+    // Empty rows must not be cached
+    result_builder.reset();
+    
     // Advance position tracking
     scan_position++;
     
@@ -463,6 +625,11 @@ int ha_mongodb::rnd_next(uchar *buf)
     DBUG_RETURN(HA_ERR_INTERNAL_ERROR);
   }
   
+  // Capture the converted row for the result cache
+  if (result_builder) {
+    result_cache_capture_row(buf);
+  }
+  
   // Increment scan position for position tracking
   scan_position++;
 
@@ -506,6 +673,13 @@ int ha_mongodb::rnd_end()
   consecutive_rnd_next_calls = 0;
   lightweight_count_mode = false;
   
+  // Publish a fully read scan; a replayed entry stays referenced until the
+  // next rnd_init() because blob fields still point into it
+  result_cache_finish();
+  
+  // Let the producer stop early if this was its last reader
+  shared_scan_end();
+  
   // Clean up cursor
   if (cursor)
   {
@@ -550,29 +724,25 @@ int ha_mongodb::info(uint flag)
     
     // Get document count from MongoDB - use pushed condition if available for COUNT with WHERE
     bson_error_t error;
-    bson_t *filter;
+    const bson_t *filter = scan_filter();
     
     if (pushed_condition) {
       // Use the pushed condition for COUNT with WHERE optimization
-      filter = bson_copy(pushed_condition);
       fprintf(stderr, "INFO: Using pushed condition for COUNT with WHERE optimization\n");
     } else {
       // Empty filter for simple COUNT(*)
-      filter = bson_new(); 
       fprintf(stderr, "INFO: Using empty filter for simple COUNT(*)\n");
     }
     
     int64_t doc_count = mongoc_collection_count_documents(
       collection,
-      filter,     // Empty filter
+      filter,     // Pushed or empty filter
       NULL,       // No options
       NULL,       // No read prefs
       NULL,       // No reply
       &error
     );
     
-    bson_destroy(filter);
-    
     if (doc_count >= 0)
     {
       stats.records = (ha_rows)doc_count;
@@ -629,6 +799,18 @@ void ha_mongodb::position(const uchar *record)
   
   fprintf(stderr, "POSITION CALLED! record=%p, ref_length=%u\n", record, ref_length);
   
+  // Shared scans return rows in no fixed order, remember the _id instead
+  if (positions_by_id) {
+    std::string encoded_id;
+    if (current_doc && mongodb_shared_scan_document_id(current_doc, &encoded_id)) {
+      positioned_ids.push_back(encoded_id);
+      my_store_ptr(ref, ref_length, (my_off_t)(positioned_ids.size() - 1));
+    } else {
+      my_store_ptr(ref, ref_length, (my_off_t)positioned_ids.size());
+    }
+    DBUG_VOID_RETURN;
+  }
+  
   // Use CONNECT engine approach: store simple record position/offset
   // Store the CURRENT position (scan_position is already incremented by rnd_next)
   my_off_t current_position = (my_off_t)(scan_position - 1); // Position of the record we just read
@@ -661,6 +843,55 @@ int ha_mongodb::rnd_pos(uchar *buf, uchar *pos)
   
   fprintf(stderr, "RND_POS: Seeking to position %llu\n", (unsigned long long)target_position);
   
+  // Positions of a mirror scan index its selected rows
+  if (mirror_snapshot) {
+    int rc = mirror_read_row(buf, (ha_rows)target_position);
+    if (rc == 0) {
+      scan_position = target_position + 1;
+    }
+    DBUG_RETURN(rc == HA_ERR_END_OF_FILE ? HA_ERR_KEY_NOT_FOUND : rc);
+  }
+  
+  // Positions of a replayed scan index the cached rows directly
+  if (cached_result) {
+    int rc = result_cache_replay_row(buf, (ha_rows)target_position);
+    if (rc == 0) {
+      scan_position = target_position + 1;
+    }
+    DBUG_RETURN(rc == HA_ERR_END_OF_FILE ? HA_ERR_KEY_NOT_FOUND : rc);
+  }
+  
+  // Positions of a shared scan index the stored _ids
+  if (positions_by_id) {
+    if (target_position >= positioned_ids.size()) {
+      DBUG_RETURN(HA_ERR_KEY_NOT_FOUND);
+    }
+    
+    bson_t filter, opts;
+    bson_init(&filter);
+    bson_init(&opts);
+    mongodb_shared_scan_id_filter(positioned_ids[(size_t)target_position], &filter);
+    BSON_APPEND_INT64(&opts, "limit", 1);
+    mongoc_cursor_t *lookup = mongoc_collection_find_with_opts(collection, &filter, &opts, nullptr);
+    bson_destroy(&opts);
+    bson_destroy(&filter);
+    
+    const bson_t *doc;
+    int rc = HA_ERR_KEY_NOT_FOUND;
+    if (mongoc_cursor_next(lookup, &doc)) {
+      memset(buf, 0, table->s->reclength);
+      rc = convert_document_to_row(doc, buf) ? HA_ERR_INTERNAL_ERROR : 0;
+    } else {
+      bson_error_t error;
+      if (mongoc_cursor_error(lookup, &error)) {
+        fprintf(stderr, "RND_POS: _id lookup failed: %s\n", error.message);
+        rc = HA_ERR_INTERNAL_ERROR;
+      }
+    }
+    mongoc_cursor_destroy(lookup);
+    DBUG_RETURN(rc);
+  }
+  
   // Reset cursor to beginning and seek to target position
   if (!cursor) {
     fprintf(stderr, "RND_POS: No active cursor - reinitializing\n");
@@ -684,10 +915,9 @@ int ha_mongodb::rnd_pos(uchar *buf, uchar *pos)
       cursor = nullptr;
     }
     
-    // Create new cursor WITHOUT any sorting (let MariaDB handle ORDER BY)
-    bson_t *query = bson_new();  // Empty query = scan all
-    cursor = mongoc_collection_find_with_opts(collection, query, nullptr, nullptr);
-    bson_destroy(query);
+    // Create new cursor WITHOUT any sorting (let MariaDB handle ORDER BY);
+    // positions count rows of the filtered scan
+    cursor = mongoc_collection_find_with_opts(collection, scan_filter(), nullptr, nullptr);
     
     if (!cursor) {
       fprintf(stderr, "RND_POS: Failed to create cursor for rewind\n");
@@ -709,6 +939,10 @@ int ha_mongodb::rnd_pos(uchar *buf, uchar *pos)
     scan_position++;
   }
   
+  // Positioned reads are not a sequential scan, don't capture them
+  result_builder.reset();
+  result_cache_key.clear();
+  
   // Now call rnd_next to get the current document
   int rc = rnd_next(buf);
   if (rc == 0) {
@@ -756,13 +990,44 @@ int ha_mongodb::index_read_map(uchar *buf, const uchar *key, key_part_map keypar
     }
   }
   
+  // Exact match on a whole unique key - fetch exactly one document
+  if (find_flag == HA_READ_KEY_EXACT && !key_read_mode)
+  {
+    bool handled = false;
+    int rc = point_lookup(buf, key, keypart_map, &handled);
+    if (handled) {
+      DBUG_RETURN(rc);
+    }
+  }
+  
+  // An exact read sends its key, or checks rows against it, and the index
+  // condition this lookup's values of earlier tables, so such lookups
+  // start their own cursor
+  bool exact = find_flag == HA_READ_KEY_EXACT && active_index < table->s->keys;
+  bson_t key_filter;
+  bson_init(&key_filter);
+  bool keyed = exact && append_key_filter(key, keypart_map, &key_filter, nullptr);
+  checked_key.clear();
+  if (exact && !keyed) {
+    checked_key.assign((const char*)key, calculate_key_len(table, active_index, key, keypart_map));
+  }
+  if (cursor && (exact || index_condition_active()))
+  {
+    mongoc_cursor_destroy(cursor);
+    cursor = nullptr;
+  }
+  
   // Initialize cursor if needed (following FederatedX pattern)
   if (!cursor)
   {
     fprintf(stderr, "INDEX_READ_MAP: Initializing cursor for index operations\n");
-    bson_t *query = pushed_condition ? bson_copy(pushed_condition) : bson_new();
-    cursor = mongoc_collection_find_with_opts(collection, query, nullptr, nullptr);
-    bson_destroy(query);
+    bson_t filter;
+    bson_init(&filter);
+    if (lookup_filter(keyed ? &key_filter : nullptr, &filter, nullptr)) {
+      cursor = mongoc_collection_find_with_opts(collection, &filter, nullptr, nullptr);
+    }
+    bson_destroy(&filter);
+    bson_destroy(&key_filter);
     
     if (!cursor)
     {
@@ -772,47 +1037,13 @@ int ha_mongodb::index_read_map(uchar *buf, const uchar *key, key_part_map keypar
     current_doc = nullptr;
     scan_position = 0;
   }
-  
-  fprintf(stderr, "INDEX_READ_MAP: Proceeding with read operation\n");
-  
-  // Use the same logic as rnd_next to get the first document
-  if (!mongoc_cursor_next(cursor, &current_doc))
-  {
-    bson_error_t error;
-    if (mongoc_cursor_error(cursor, &error))
-    {
-      fprintf(stderr, "INDEX_READ_MAP: Cursor error: %s\n", error.message);
-      DBUG_RETURN(HA_ERR_INTERNAL_ERROR);
-    }
-    
-    fprintf(stderr, "INDEX_READ_MAP: No documents found\n");
-    DBUG_RETURN(HA_ERR_END_OF_FILE);
-  }
-  
-  // Check if we're in key-only mode (for COUNT operations)
-  if (key_read_mode)
-  {
-    fprintf(stderr, "INDEX_READ_MAP: Key-only mode - COUNT optimization\n");
-    // For key-only reads (COUNT), we just need to indicate we have a row
-    // MariaDB will count the successful returns without needing full data
-    memset(buf, 0, table->s->reclength);
-    // For PRIMARY KEY (_id), just set the key field if it exists
-    // This is sufficient for COUNT operations
-  }
   else
   {
-    fprintf(stderr, "INDEX_READ_MAP: Full row mode - converting document\n");
-    // Convert document to row for full reads
-    memset(buf, 0, table->s->reclength);
-    if (convert_document_to_row(current_doc, buf))
-    {
-      fprintf(stderr, "INDEX_READ_MAP: Document conversion failed\n");
-      DBUG_RETURN(HA_ERR_INTERNAL_ERROR);
-    }
+    bson_destroy(&key_filter);
   }
   
-  fprintf(stderr, "INDEX_READ_MAP: Successfully returned first row\n");
-  DBUG_RETURN(0);
+  fprintf(stderr, "INDEX_READ_MAP: Proceeding with read operation\n");
+  DBUG_RETURN(next_index_row(buf));
 }
 
 int ha_mongodb::index_read(uchar *buf, const uchar *key, uint key_len, enum ha_rkey_function find_flag)
@@ -844,39 +1075,85 @@ int ha_mongodb::index_next(uchar *buf)
   }
   
   // Continue iterating through the sorted cursor
-  if (!mongoc_cursor_next(cursor, &current_doc))
+  DBUG_RETURN(next_index_row(buf));
+}
+
+/*
+  Next row of an index read or range into buf. Rows failing the index
+  condition are skipped: idx_cond_push() took it over from MariaDB.
+*/
+int ha_mongodb::next_index_row(uchar *buf)
+{
+  for (;;)
   {
-    bson_error_t error;
-    if (mongoc_cursor_error(cursor, &error))
+    if (!mongoc_cursor_next(cursor, &current_doc))
     {
-      fprintf(stderr, "INDEX_NEXT: Cursor error: %s\n", error.message);
-      DBUG_RETURN(HA_ERR_INTERNAL_ERROR);
+      bson_error_t error;
+      if (mongoc_cursor_error(cursor, &error))
+      {
+        fprintf(stderr, "INDEX_READ: Cursor error: %s\n", error.message);
+        return HA_ERR_INTERNAL_ERROR;
+      }
+      return HA_ERR_END_OF_FILE;
     }
     
-    fprintf(stderr, "INDEX_NEXT: End of cursor reached\n");
-    DBUG_RETURN(HA_ERR_END_OF_FILE);
-  }
-  
-  // Check if we're in key-only mode (for COUNT operations)
-  if (key_read_mode)
-  {
-    fprintf(stderr, "INDEX_NEXT: Key-only mode - COUNT optimization\n");
-    // For key-only reads (COUNT), we just need to indicate we have a row
-    memset(buf, 0, table->s->reclength);
-  }
-  else
-  {
-    fprintf(stderr, "INDEX_NEXT: Full row mode - converting document\n");
-    // Convert document to row for full reads
     memset(buf, 0, table->s->reclength);
+    
+    // For key-only reads (COUNT), we just need to indicate we have a row
+    if (key_read_mode && checked_key.empty()) {
+      return 0;
+    }
+    
     if (convert_document_to_row(current_doc, buf))
     {
-      fprintf(stderr, "INDEX_NEXT: Document conversion failed\n");
-      DBUG_RETURN(HA_ERR_INTERNAL_ERROR);
+      fprintf(stderr, "INDEX_READ: Document conversion failed\n");
+      return HA_ERR_INTERNAL_ERROR;
+    }
+    
+    if (!checked_key.empty() && !row_matches_key(buf)) {
+      continue;
+    }
+    if (key_read_mode) {
+      return 0;
+    }
+    
+    int rc = check_index_condition();
+    if (rc != HA_ERR_KEY_NOT_FOUND) {
+      return rc;
+    }
+  }
+}
+
+/*
+  Whether the row in buf holds checked_key, the key of an exact read sent
+  without its predicate, compared as MariaDB compares the key's columns.
+  Virtual key parts are computed first when the row is in record[0];
+  elsewhere they cannot be checked and the row is kept.
+*/
+bool ha_mongodb::row_matches_key(uchar *buf)
+{
+  KEY *key_info = table->key_info + active_index;
+  bool virtual_parts = false;
+  for (uint i = 0; i < key_info->user_defined_key_parts; i++) {
+    virtual_parts |= key_info->key_part[i].field->vcol_info != nullptr;
+  }
+  if (virtual_parts) {
+    if (buf != table->record[0] || !table->vfield) {
+      return true;
     }
+    table->update_virtual_fields(this, VCOL_UPDATE_FOR_READ);
   }
   
-  DBUG_RETURN(0);
+  my_ptrdiff_t offset = (my_ptrdiff_t)(buf - table->record[0]);
+  for (uint i = 0; i < key_info->user_defined_key_parts; i++) {
+    key_info->key_part[i].field->move_field_offset(offset);
+  }
+  bool matches = key_cmp(key_info->key_part, (const uchar*)checked_key.data(),
+                         (uint)checked_key.size()) == 0;
+  for (uint i = 0; i < key_info->user_defined_key_parts; i++) {
+    key_info->key_part[i].field->move_field_offset(-offset);
+  }
+  return matches;
 }
 
 int ha_mongodb::index_end()
@@ -885,6 +1162,9 @@ int ha_mongodb::index_end()
   
   fprintf(stderr, "INDEX_END CALLED - cleaning up cursor\n");
   
+  mrr_end();
+  checked_key.clear();
+  
   // Clean up cursor (same as rnd_end)
   if (cursor)
   {
@@ -907,25 +1187,42 @@ int ha_mongodb::read_range_first(const key_range *start_key, const key_range *en
   fprintf(stderr, "READ_RANGE_FIRST CALLED! eq_range=%d, sorted=%d\n", eq_range, sorted);
   
   // For MongoDB, we don't have actual ranges like SQL databases
-  // We'll just initialize a cursor for the entire collection
-  // and let index_next() handle the iteration
+  // An equality range is read like an exact index lookup; others
+  // initialize a cursor for the collection and let index_next() iterate
+  
+  if (!collection && connect_to_mongodb()) {
+    return HA_ERR_INTERNAL_ERROR;
+  }
   
   if (cursor) {
     mongoc_cursor_destroy(cursor);
     cursor = nullptr;
   }
   
-  // Initialize cursor for entire collection (MongoDB doesn't have traditional ranges)
-  bson_t *query = bson_new();
+  // Other ranges are not sent; the pushed and index conditions narrow the
+  // collection (MongoDB doesn't have traditional ranges)
+  bson_t key_filter;
+  bson_init(&key_filter);
+  bool exact = eq_range && start_key && active_index < table->s->keys;
+  bool keyed = exact && append_key_filter(start_key->key, start_key->keypart_map, &key_filter,
+                                          nullptr);
+  checked_key.clear();
+  if (exact && !keyed) {
+    checked_key.assign((const char*)start_key->key, start_key->length);
+  }
+  bson_t query;
+  bson_init(&query);
   
   if (key_read_mode) {
     // For COUNT(*) operations, we only need to count documents
     fprintf(stderr, "READ_RANGE_FIRST: key_read_mode enabled, optimizing for COUNT\n");
   }
   
-  cursor = mongoc_collection_find_with_opts(collection, query, nullptr, nullptr);
-  
-  bson_destroy(query);
+  if (lookup_filter(keyed ? &key_filter : nullptr, &query, nullptr)) {
+    cursor = mongoc_collection_find_with_opts(collection, &query, nullptr, nullptr);
+  }
+  bson_destroy(&query);
+  bson_destroy(&key_filter);
   
   if (!cursor) {
     fprintf(stderr, "READ_RANGE_FIRST: Failed to create cursor\n");
@@ -933,7 +1230,7 @@ int ha_mongodb::read_range_first(const key_range *start_key, const key_range *en
   }
   
   fprintf(stderr, "READ_RANGE_FIRST: Success, cursor initialized\n");
-  return 0;
+  return next_index_row(table->record[0]);
 }
 
 int ha_mongodb::read_range_next()
@@ -945,103 +1242,434 @@ int ha_mongodb::read_range_next()
     return HA_ERR_END_OF_FILE;
   }
   
-  // Get next document from cursor
-  if (!mongoc_cursor_next(cursor, &current_doc)) {
-    bson_error_t error;
-    if (mongoc_cursor_error(cursor, &error)) {
-      fprintf(stderr, "READ_RANGE_NEXT: Cursor error: %s\n", error.message);
-      return HA_ERR_INTERNAL_ERROR;
-    }
-    fprintf(stderr, "READ_RANGE_NEXT: End of results\n");
-    return HA_ERR_END_OF_FILE;
-  }
-  
-  // For key_read_mode (COUNT operations), we don't need to fill the buffer
-  if (key_read_mode) {
-    fprintf(stderr, "READ_RANGE_NEXT: key_read_mode - counting document\n");
-    return 0;
-  }
-  
-  fprintf(stderr, "READ_RANGE_NEXT: Got document, would convert to row\n");
-  // Note: We don't have the buf parameter here, so we'll handle this in the actual read methods
-  return 0;
+  // Ranges read into record[0], as handler::read_range_next() does
+  return next_index_row(table->record[0]);
 }
 
-// Record counting - MongoDB native count pushdown
-ha_rows ha_mongodb::records()
+/*
+  Batched multi-range reads
+
+  Ranges that are all exact keys of one length (a batched key access join,
+  the key set of a materialized semi-join, a long IN list) are read by key
+  rather than one index lookup each: their distinct keys are sent in
+  chunks of MONGODB_KEY_FETCH_CHUNK as $in lists, and each row returned is
+  matched back to its ranges by normalized key image. Other ranges and
+  sorted reads use the default implementation, one read_range_first() per
+  range.
+*/
+int ha_mongodb::multi_range_read_init(RANGE_SEQ_IF *seq, void *seq_init_param, uint n_ranges,
+                                      uint mode, HANDLER_BUFFER *buf)
 {
-  fprintf(stderr, "*** RECORDS() CALLED - implementing MongoDB native count pushdown ***\n");
-  fflush(stderr);  // Force immediate output
-  
-  if (!collection) {
-    fprintf(stderr, "RECORDS: No collection available\n");
-    return 0;
-  }
-  
-  bson_error_t error;
-  bson_t *query = nullptr;
+  DBUG_ENTER("ha_mongodb::multi_range_read_init");
   
-  // Use pushed condition if available (for COUNT with WHERE clause)
-  if (pushed_condition) {
-    query = bson_copy(pushed_condition);  // Use already converted BSON filter
-    fprintf(stderr, "RECORDS: Using pushed condition for COUNT\n");
-  } else {
-    query = bson_new();  // Empty query for COUNT(*)
-    fprintf(stderr, "RECORDS: Using empty query for COUNT(*)\n");
-  }
-  
-  // Use MongoDB's native count operation
-  int64_t count = mongoc_collection_count_documents(collection, query, nullptr, nullptr, nullptr, &error);
-  
-  bson_destroy(query);
-  
-  if (count < 0) {
-    fprintf(stderr, "RECORDS: MongoDB count error: %s\n", error.message);
-    return 0;
+  mrr_end();
+  if (!(mode & HA_MRR_SORTED) && active_index < table->s->keys &&
+      (collection || !connect_to_mongodb()))
+  {
+    mrr_funcs = *seq;
+    mrr_iter = seq->init(seq_init_param, n_ranges, mode);
+    mrr_associate = !(mode & HA_MRR_NO_ASSOCIATION);
+    
+    std::vector<std::string> keys;
+    if (mrr_collect_keys(&keys))
+    {
+      fprintf(stderr, "MRR: %zu ranges read as %zu keys\n", mrr_ranges.size(), keys.size());
+      mrr_batched = true;
+      end_range = nullptr;
+      DBUG_RETURN(mrr_start(keys));
+    }
+    mrr_end();
   }
   
-  fprintf(stderr, "RECORDS: MongoDB native count returned: %lld documents\n", (long long)count);
-  return (ha_rows)count;
-}
-int ha_mongodb::write_row(const uchar *buf)
-{
-  DBUG_ENTER("ha_mongodb::write_row");
-  DBUG_RETURN(HA_ERR_WRONG_COMMAND);
+  DBUG_RETURN(handler::multi_range_read_init(seq, seq_init_param, n_ranges, mode, buf));
 }
 
-int ha_mongodb::update_row(const uchar *old_data, const uchar *new_data)
-{
-  DBUG_ENTER("ha_mongodb::update_row");
-  DBUG_RETURN(HA_ERR_WRONG_COMMAND);
-}
-
-int ha_mongodb::delete_row(const uchar *buf)
+/*
+  Read the range sequence into mrr_ranges and the key predicates of its
+  distinct keys into keys. False if a range is not an exact key of the
+  same length as the others, or its key is not a document field.
+*/
+bool ha_mongodb::mrr_collect_keys(std::vector<std::string> *keys)
 {
-  DBUG_ENTER("ha_mongodb::delete_row");
-  DBUG_RETURN(HA_ERR_WRONG_COMMAND);
+  KEY_MULTI_RANGE range;
+  bool first = true;
+  
+  while (!mrr_funcs.next(mrr_iter, &range))
+  {
+    if (!(range.range_flag & EQ_RANGE) || (range.range_flag & NULL_RANGE) ||
+        !range.start_key.key || (!first && range.start_key.length != mrr_key_length)) {
+      return false;
+    }
+    first = false;
+    mrr_key_length = range.start_key.length;
+    
+    std::string image((const char*)range.start_key.key, range.start_key.length);
+    mrr_normalize_key(&image);
+    bool seen = mrr_ranges.count(image) != 0;
+    mrr_ranges.emplace(image, range.ptr);
+    if (seen) {
+      continue;
+    }
+    
+    bson_t key_filter;
+    bson_init(&key_filter);
+    bool keyed = append_key_filter(range.start_key.key, range.start_key.keypart_map,
+                                   &key_filter, nullptr);
+    if (keyed) {
+      keys->emplace_back((const char*)bson_get_data(&key_filter), key_filter.len);
+    }
+    bson_destroy(&key_filter);
+    if (!keyed) {
+      return false;
+    }
+  }
+  mrr_key_image.assign(mrr_key_length, '\0');
+  return true;
 }
 
 /*
-   Statistics and metadata - implement reasonable defaults for optimizer
+  Rewrite a key image of mrr_key_length bytes into the one every equal key
+  has. MariaDB's range images keep whatever follows a VARCHAR's length and
+  the value of a NULL part; MongoDB also matches values differing in
+  trailing spaces under PAD SPACE collations, and -0.0 with 0.0. The key
+  is restored into key_record, those values are normalized and key_copy()
+  writes it back zero-filled.
 */
-ha_rows ha_mongodb::estimate_rows_upper_bound()
+void ha_mongodb::mrr_normalize_key(std::string *image)
 {
-  DBUG_ENTER("ha_mongodb::estimate_rows_upper_bound");
-  // Return a reasonable estimate instead of error
-  // Use the stats.records if available, otherwise default to 1000
-  if (stats.records > 0) {
-    DBUG_RETURN(stats.records);
+  KEY *key_info = table->key_info + active_index;
+  if (key_record.size() < table->s->rec_buff_length) {
+    key_record.assign(table->s->rec_buff_length, 0);
+  }
+  uchar *record = key_record.data();
+  key_restore(record, (const uchar*)image->data(), key_info, (uint)image->size());
+  
+  my_ptrdiff_t offset = (my_ptrdiff_t)(record - table->record[0]);
+  uint used = 0;
+  for (uint i = 0; i < key_info->user_defined_key_parts && used < image->size(); i++) {
+    KEY_PART_INFO *key_part = key_info->key_part + i;
+    Field *field = key_part->field;
+    used += key_part->store_length;
+    
+    field->move_field_offset(offset);
+    if (!field->is_null()) {
+      CHARSET_INFO *cs = field->charset();
+      if (field->cmp_type() == STRING_RESULT && !(cs->state & MY_CS_NOPAD) &&
+          cs->mbminlen == 1) {
+        StringBuffer<MAX_FIELD_WIDTH> buffer;
+        String *value = field->val_str(&buffer);
+        size_t length = value->length();
+        while (length && value->ptr()[length - 1] == ' ') {
+          length--;
+        }
+        if (length < value->length()) {
+          std::string trimmed(value->ptr(), length);
+          field->store(trimmed.data(), trimmed.size(), cs);
+        }
+      } else if (field->cmp_type() == REAL_RESULT && field->val_real() == 0.0) {
+        field->store(0.0);
+      }
+    }
+    field->move_field_offset(-offset);
   }
-  DBUG_RETURN(1000); // Reasonable default for MongoDB collections
+  
+  key_copy((uchar*)&(*image)[0], record, key_info, (uint)image->size(), true);
 }
 
-IO_AND_CPU_COST ha_mongodb::scan_time()
+/*
+  Send the chunks of keys: on the handler's cursor when there is one,
+  otherwise through a MongoKeyFetch that reads them ahead in parallel
+*/
+int ha_mongodb::mrr_start(const std::vector<std::string> &keys)
 {
-  DBUG_ENTER("ha_mongodb::scan_time");
-  IO_AND_CPU_COST cost;
-  
-  // Provide reasonable cost estimates for MongoDB table scans
-  // Base cost on estimated record count
+  if (cursor) {
+    mongoc_cursor_destroy(cursor);
+    cursor = nullptr;
+  }
+  current_doc = nullptr;
+  if (keys.empty()) {
+    return 0;
+  }
+  
+  bson_t base;
+  bson_init(&base);
+  if (!lookup_filter(nullptr, &base, nullptr)) {
+    bson_destroy(&base);
+    return HA_ERR_INTERNAL_ERROR;
+  }
+  const bson_t *base_filter = bson_empty(&base) ? nullptr : &base;
+  key_fetch_counters.reads++;
+  
+  bool ok = true;
+  if (keys.size() <= MONGODB_KEY_FETCH_CHUNK)
+  {
+    bson_t filter;
+    bson_init(&filter);
+    ok = mongodb_key_chunk_filter(base_filter, keys, 0, keys.size(), &filter);
+    if (ok) {
+      cursor = mongoc_collection_find_with_opts(collection, &filter, nullptr, nullptr);
+      ok = cursor != nullptr;
+    }
+    bson_destroy(&filter);
+  }
+  else
+  {
+    // Workers borrow clients from the pool of the table's CONNECTION string
+    const char *pool_connection = share->connection_string ? share->connection_string
+                                                           : share->mongo_connection_string;
+    key_fetch.reset(new MongoKeyFetch(pool_connection, share->mongo_connection_string,
+                                      share->database_name, share->collection_name));
+    for (size_t begin = 0; ok && begin < keys.size(); begin += MONGODB_KEY_FETCH_CHUNK)
+    {
+      size_t end = begin + MONGODB_KEY_FETCH_CHUNK < keys.size() ? begin + MONGODB_KEY_FETCH_CHUNK
+                                                                 : keys.size();
+      bson_t filter;
+      bson_init(&filter);
+      ok = mongodb_key_chunk_filter(base_filter, keys, begin, end, &filter) &&
+           key_fetch->add_chunk(&filter);
+      bson_destroy(&filter);
+    }
+    ok = ok && key_fetch->start();
+    
+    if (ok && !mrr_doc_view) {
+      mrr_doc_view = (bson_t*)bson_aligned_alloc0(BSON_ALIGNOF(bson_t), sizeof(bson_t));
+    }
+  }
+  bson_destroy(&base);
+  
+  if (!ok) {
+    fprintf(stderr, "MRR: Failed to start reading %zu keys\n", keys.size());
+    return HA_ERR_INTERNAL_ERROR;
+  }
+  return 0;
+}
+
+/*
+  Next document of a batched read: 0 with *doc set, HA_ERR_END_OF_FILE
+  after the last, or the error to stop with
+*/
+int ha_mongodb::mrr_next_document(const bson_t **doc)
+{
+  if (!key_fetch)
+  {
+    if (!cursor) {
+      return HA_ERR_END_OF_FILE;
+    }
+    if (mongoc_cursor_next(cursor, doc)) {
+      return 0;
+    }
+    bson_error_t error;
+    if (mongoc_cursor_error(cursor, &error)) {
+      fprintf(stderr, "MRR: Cursor error: %s\n", error.message);
+      return HA_ERR_INTERNAL_ERROR;
+    }
+    return HA_ERR_END_OF_FILE;
+  }
+  
+  while (!mrr_batch || mrr_batch_offset >= mrr_batch->data.size())
+  {
+    mrr_batch.reset();
+    mrr_batch_offset = 0;
+    switch (key_fetch->next_batch(&mrr_batch)) {
+      case MONGO_KEY_FETCH_BATCH:
+        break;
+      case MONGO_KEY_FETCH_END:
+        return HA_ERR_END_OF_FILE;
+      default:
+        return HA_ERR_INTERNAL_ERROR;
+    }
+  }
+  
+  const uint8_t *data = (const uint8_t*)mrr_batch->data.data() + mrr_batch_offset;
+  uint32_t length;
+  memcpy(&length, data, sizeof(length));
+  length = BSON_UINT32_FROM_LE(length);
+  mrr_batch_offset += length;
+  
+  // Only ever initialized with bson_init_static(); the batch owns the data
+  if (!bson_init_static(mrr_doc_view, data, length)) {
+    return HA_ERR_INTERNAL_ERROR;
+  }
+  *doc = mrr_doc_view;
+  return 0;
+}
+
+int ha_mongodb::multi_range_read_next(range_id_t *range_info)
+{
+  DBUG_ENTER("ha_mongodb::multi_range_read_next");
+  
+  if (!mrr_batched) {
+    DBUG_RETURN(handler::multi_range_read_next(range_info));
+  }
+  
+  for (;;)
+  {
+    // The current row, once for each range of its key
+    while (!mrr_owed.empty())
+    {
+      range_id_t range = mrr_owed.back();
+      mrr_owed.pop_back();
+      if ((mrr_funcs.skip_index_tuple && mrr_funcs.skip_index_tuple(mrr_iter, range)) ||
+          (mrr_funcs.skip_record && mrr_funcs.skip_record(mrr_iter, range, nullptr))) {
+        continue;
+      }
+      *range_info = range;
+      DBUG_RETURN(0);
+    }
+    
+    int rc = mrr_next_document(&current_doc);
+    if (rc) {
+      DBUG_RETURN(rc);
+    }
+    
+    // Key columns are needed to find the ranges, so key-only reads convert too
+    uchar *buf = table->record[0];
+    memset(buf, 0, table->s->reclength);
+    if (convert_document_to_row(current_doc, buf))
+    {
+      fprintf(stderr, "MRR: Document conversion failed\n");
+      DBUG_RETURN(HA_ERR_INTERNAL_ERROR);
+    }
+    rc = check_index_condition();
+    if (rc == HA_ERR_KEY_NOT_FOUND) {
+      continue;
+    }
+    if (rc || !mrr_associate) {
+      DBUG_RETURN(rc);
+    }
+    
+    key_copy((uchar*)&mrr_key_image[0], buf, table->key_info + active_index,
+             mrr_key_length, true);
+    mrr_normalize_key(&mrr_key_image);
+    auto matches = mrr_ranges.equal_range(mrr_key_image);
+    for (auto it = matches.first; it != matches.second; ++it) {
+      mrr_owed.push_back(it->second);
+    }
+  }
+}
+
+void ha_mongodb::mrr_end()
+{
+  if (key_fetch) {
+    key_fetch->stop();
+    key_fetch.reset();
+  }
+  if (current_doc && current_doc == mrr_doc_view) {
+    current_doc = nullptr;
+  }
+  mrr_batch.reset();
+  mrr_batch_offset = 0;
+  mrr_ranges.clear();
+  mrr_owed.clear();
+  mrr_key_length = 0;
+  mrr_batched = false;
+}
+
+/*
+  Claim exact-key range reads for multi_range_read_init(): the default
+  implementation is kept for sorted reads only, so a batched key access
+  join hands the engine its keys in batches
+*/
+ha_rows ha_mongodb::multi_range_read_info_const(uint keyno, RANGE_SEQ_IF *seq, void *seq_init_param,
+                                                uint n_ranges, uint *bufsz, uint *mrr_mode,
+                                                ha_rows limit, Cost_estimate *cost)
+{
+  ha_rows rows = handler::multi_range_read_info_const(keyno, seq, seq_init_param, n_ranges,
+                                                      bufsz, mrr_mode, limit, cost);
+  if (!(*mrr_mode & HA_MRR_SORTED)) {
+    *mrr_mode &= ~HA_MRR_USE_DEFAULT_IMPL;
+  }
+  return rows;
+}
+
+ha_rows ha_mongodb::multi_range_read_info(uint keyno, uint n_ranges, uint keys, uint key_parts,
+                                          uint *bufsz, uint *mrr_mode, Cost_estimate *cost)
+{
+  ha_rows rows = handler::multi_range_read_info(keyno, n_ranges, keys, key_parts,
+                                                bufsz, mrr_mode, cost);
+  if (!(*mrr_mode & HA_MRR_SORTED)) {
+    *mrr_mode &= ~HA_MRR_USE_DEFAULT_IMPL;
+  }
+  return rows;
+}
+
+// Record counting - MongoDB native count pushdown
+ha_rows ha_mongodb::records()
+{
+  fprintf(stderr, "*** RECORDS() CALLED - implementing MongoDB native count pushdown ***\n");
+  fflush(stderr);  // Force immediate output
+  
+  if (!collection) {
+    fprintf(stderr, "RECORDS: No collection available\n");
+    return 0;
+  }
+  
+  bson_error_t error;
+  
+  // Use pushed condition if available (for COUNT with WHERE clause)
+  if (pushed_condition) {
+    fprintf(stderr, "RECORDS: Using pushed condition for COUNT\n");
+  } else {
+    fprintf(stderr, "RECORDS: Using empty query for COUNT(*)\n");
+  }
+  
+  // Use MongoDB's native count operation
+  int64_t count = mongoc_collection_count_documents(collection, scan_filter(), nullptr, nullptr, nullptr, &error);
+  
+  if (count < 0) {
+    fprintf(stderr, "RECORDS: MongoDB count error: %s\n", error.message);
+    return 0;
+  }
+  
+  fprintf(stderr, "RECORDS: MongoDB native count returned: %lld documents\n", (long long)count);
+  return (ha_rows)count;
+}
+int ha_mongodb::write_row(const uchar *buf)
+{
+  DBUG_ENTER("ha_mongodb::write_row");
+  DBUG_RETURN(HA_ERR_WRONG_COMMAND);
+}
+
+int ha_mongodb::update_row(const uchar *old_data, const uchar *new_data)
+{
+  DBUG_ENTER("ha_mongodb::update_row");
+  DBUG_RETURN(HA_ERR_WRONG_COMMAND);
+}
+
+int ha_mongodb::delete_row(const uchar *buf)
+{
+  DBUG_ENTER("ha_mongodb::delete_row");
+  DBUG_RETURN(HA_ERR_WRONG_COMMAND);
+}
+
+/*
+   Statistics and metadata - implement reasonable defaults for optimizer
+*/
+ha_rows ha_mongodb::estimate_rows_upper_bound()
+{
+  DBUG_ENTER("ha_mongodb::estimate_rows_upper_bound");
+  // Return a reasonable estimate instead of error
+  // Use the stats.records if available, otherwise default to 1000
+  if (stats.records > 0) {
+    DBUG_RETURN(stats.records);
+  }
+  
+  // Change stream maintained estimate - no round trip needed
+  ha_rows estimate;
+  if (share && share->change_watcher &&
+      share->change_watcher->get_document_count_estimate(&estimate)) {
+    DBUG_RETURN(estimate);
+  }
+  DBUG_RETURN(1000); // Reasonable default for MongoDB collections
+}
+
+IO_AND_CPU_COST ha_mongodb::scan_time()
+{
+  DBUG_ENTER("ha_mongodb::scan_time");
+  IO_AND_CPU_COST cost;
+  
+  // Provide reasonable cost estimates for MongoDB table scans
+  // Base cost on estimated record count
   ha_rows records = (stats.records > 0) ? stats.records : 1000;
   
   cost.io = (double)records * 0.1;   // Assume 0.1 IO cost per record
@@ -1087,7 +1715,10 @@ ha_rows ha_mongodb::records_in_range(uint inx, const key_range *min_key, const k
 }
 
 /*
-   Condition pushdown - stub implementations
+  Condition pushdown
+
+  The pushed filter applies to every scan and index read of the statement
+  and is dropped in reset() when the statement ends.
 */
 const COND *ha_mongodb::cond_push(const COND *cond)
 {
@@ -1100,34 +1731,45 @@ const COND *ha_mongodb::cond_push(const COND *cond)
 
   fprintf(stderr, "COND_PUSH: Received condition (pointer: %p)\n", (void*)cond);
 
-  // Create BSON document for MongoDB filter
-  bson_t *match_filter = bson_new();
+  // Translate into the spare filter buffer, allocating only the first time
+  bson_t *match_filter = condition_buffer;
+  condition_buffer = nullptr;
+  if (match_filter) {
+    bson_reinit(match_filter);
+  } else {
+    match_filter = bson_new();
+  }
   if (!match_filter) {
     fprintf(stderr, "COND_PUSH: Failed to create BSON document\n");
     DBUG_RETURN(cond);
   }
 
-  // Translate the condition to MongoDB BSON filter
-  if (mongodb_translator::translate_condition_to_bson(cond, match_filter)) {
+  // Translate the condition to MongoDB BSON filter, or patch a cached one
+  bool exact = false;
+  if (mongodb_translator::translate_condition_cached(cond, table, false,
+                                                     share ? share->filter_plans : nullptr,
+                                                     match_filter, &exact)) {
     // Translation successful - store the filter for use in rnd_init/index_init
     if (pushed_condition) {
-      bson_destroy(pushed_condition);
+      recycle_condition(pushed_condition);
     }
     pushed_condition = match_filter;
     
     if (pushed_condition) {
       char *filter_str = bson_as_canonical_extended_json(pushed_condition, nullptr);
       if (filter_str) {
-        fprintf(stderr, "COND_PUSH: Successfully translated condition to MongoDB filter: %s\n", filter_str);
+        fprintf(stderr, "COND_PUSH: Successfully translated condition to MongoDB filter: %s (%s)\n",
+                filter_str, exact ? "exact" : "partial");
         bson_free(filter_str);
       }
     }
     
-    // Return nullptr to indicate we can handle this condition
-    DBUG_RETURN(nullptr);
+    // An exact filter decides the condition; a partial one only narrows
+    // the rows and MariaDB evaluates the whole condition again
+    DBUG_RETURN(exact ? nullptr : cond);
   } else {
     // Translation failed - cleanup and let MariaDB handle filtering
-    bson_destroy(match_filter);
+    recycle_condition(match_filter);
     fprintf(stderr, "COND_PUSH: Translation failed - returning condition for MariaDB filtering\n");
     DBUG_RETURN(cond);
   }
@@ -1140,13 +1782,137 @@ void ha_mongodb::cond_pop()
   // Clean up any pushed condition
   if (pushed_condition) {
     fprintf(stderr, "COND_POP: Cleaning up pushed condition\n");
-    bson_destroy(pushed_condition);
+    recycle_condition(pushed_condition);
     pushed_condition = nullptr;
   }
   
   DBUG_VOID_RETURN;
 }
 
+/*
+  Index condition pushdown
+
+  Unlike the pushed condition, an index condition may compare the index
+  columns with columns of tables read before this one. It is kept as an
+  Item and translated for every lookup, with those columns' current values
+  as constants (the filter plan cache reduces that to patching numbers),
+  and ANDed into the lookup's filter so MongoDB drops non-matching
+  documents. The filter may be partial, so the rows MongoDB returns are
+  checked with handler_index_cond_check() and MariaDB drops the condition.
+*/
+Item *ha_mongodb::idx_cond_push(uint keyno, Item *idx_cond)
+{
+  DBUG_ENTER("ha_mongodb::idx_cond_push");
+  
+  pushed_idx_cond = idx_cond;
+  pushed_idx_cond_keyno = keyno;
+  in_range_check_pushed_down = false;
+  
+  DBUG_RETURN(nullptr);
+}
+
+bool ha_mongodb::index_condition_active() const
+{
+  return pushed_idx_cond && pushed_idx_cond_keyno == active_index;
+}
+
+/*
+  Filter of one index lookup: the pushed condition, the key predicate (if
+  any) and the index condition ANDed into an empty filter. *indexed
+  tells whether the index condition translated into it.
+*/
+bool ha_mongodb::lookup_filter(const bson_t *key_filter, bson_t *filter, bool *indexed)
+{
+  const bson_t *clauses[3];
+  size_t count = 0;
+  bson_t index_filter;
+  bson_init(&index_filter);
+  
+  if (pushed_condition) {
+    clauses[count++] = pushed_condition;
+  }
+  if (key_filter) {
+    clauses[count++] = key_filter;
+  }
+  bool translated = index_condition_active() &&
+      mongodb_translator::translate_condition_cached(pushed_idx_cond, table, true,
+                                                     share ? share->filter_plans : nullptr,
+                                                     &index_filter, nullptr);
+  if (translated) {
+    clauses[count++] = &index_filter;
+  }
+  if (indexed) {
+    *indexed = translated;
+  }
+  
+  bool built = mongodb_filter_and(filter, clauses, count);
+  bson_destroy(&index_filter);
+  return built;
+}
+
+/*
+  Check the index condition on the row just read into record[0]: 0 to
+  return it, HA_ERR_KEY_NOT_FOUND to skip it, or the error to stop with
+*/
+int ha_mongodb::check_index_condition()
+{
+  if (key_read_mode || !index_condition_active()) {
+    return 0;
+  }
+  switch (handler_index_cond_check(this)) {
+    case CHECK_POS:
+      return 0;
+    case CHECK_NEG:
+      return HA_ERR_KEY_NOT_FOUND;
+    case CHECK_OUT_OF_RANGE:
+      return HA_ERR_END_OF_FILE;
+    case CHECK_ABORTED_BY_USER:
+      return HA_ERR_ABORTED_BY_USER;
+    default:
+      return HA_ERR_INTERNAL_ERROR;
+  }
+}
+
+/*
+  Reusable filter buffers
+
+  Filters are passed to the driver by reference: the pushed condition
+  itself, or a shared read-only empty document. cond_push() translates into
+  a spare buffer that is reset with bson_reinit(), so a handler allocates
+  its filter storage once instead of on every statement.
+*/
+static const bson_t mongodb_empty_filter = BSON_INITIALIZER;
+
+const bson_t *ha_mongodb::scan_filter() const
+{
+  return pushed_condition ? pushed_condition : &mongodb_empty_filter;
+}
+
+void ha_mongodb::recycle_condition(bson_t *condition)
+{
+  if (!condition_buffer) {
+    condition_buffer = condition;
+  } else {
+    bson_destroy(condition);
+  }
+}
+
+/*
+  True when the statement reads no column but _id (or _id_time, which is
+  derived from it), e.g. COUNT(*) with a fully pushed condition
+*/
+bool ha_mongodb::reads_only_id() const
+{
+  for (Field **field = table->field; *field; field++) {
+    if (bitmap_is_set(table->read_set, (*field)->field_index) &&
+        strcmp((*field)->field_name.str, "_id") != 0 &&
+        strcmp((*field)->field_name.str, MONGODB_ID_TIME_COLUMN) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
 /*
    Locking operations - stub implementations
 */
@@ -1225,6 +1991,19 @@ int ha_mongodb::extra(enum ha_extra_function operation)
 int ha_mongodb::reset()
 {
   DBUG_ENTER("ha_mongodb::reset");
+  
+  // End of statement - the next one pushes its own condition, if any
+  if (pushed_condition) {
+    recycle_condition(pushed_condition);
+    pushed_condition = nullptr;
+  }
+  
+  // Rows of this statement's scans may be stale for the next one; a
+  // replayed entry is only referenced through cached_result
+  rescan_results.clear();
+  rescan_bytes = 0;
+  mrr_end();
+  
   DBUG_RETURN(0);
 }
 
@@ -1258,6 +2037,23 @@ MONGODB_SHARE *ha_mongodb::get_share()
   DBUG_RETURN(share);
 }
 
+/*
+  The Mongo_table_share of the table definition, created by the first
+  handler opened on it
+*/
+Mongo_table_share *ha_mongodb::get_table_share()
+{
+  lock_shared_ha_data();
+  Mongo_table_share *table_share = static_cast<Mongo_table_share*>(get_ha_share_ptr());
+  if (!table_share)
+  {
+    table_share = new Mongo_table_share();
+    set_ha_share_ptr(table_share);
+  }
+  unlock_shared_ha_data();
+  return table_share;
+}
+
 int ha_mongodb::free_share()
 {
   DBUG_ENTER("ha_mongodb::free_share");
@@ -1398,293 +2194,114 @@ int ha_mongodb::stash_remote_error()
 }
 
 /*
-  Enhanced document-to-row conversion using virtual column approach
-  Strategy: Store _id and full document, use virtual columns for field extraction
+  Row sink writing converted values into a MariaDB row buffer
 */
-int ha_mongodb::convert_document_to_row(const bson_t *doc, uchar *buf)
-{
-  DBUG_ENTER("ha_mongodb::convert_document_to_row");
-  
-  if (!doc || !buf)
+class MongoRowFieldSink : public MongoFieldSink {
+private:
+  TABLE *table;
+  uchar *buf;
+  const std::vector<MongoColumn> &columns;
+
+  Field *field_at(size_t column)
   {
-    DBUG_RETURN(1);
+    Field *field = table->field[column];
+    field->ptr = buf + field->offset(table->record[0]);
+    return field;
   }
-  
-  Field **field_ptr;
-  
-  // Initialize all fields to NULL first
-  for (field_ptr = table->field; *field_ptr; field_ptr++)
+
+public:
+  MongoRowFieldSink(TABLE *table_arg, uchar *buf_arg, const std::vector<MongoColumn> &columns_arg)
+    : table(table_arg), buf(buf_arg), columns(columns_arg) {}
+
+  void set_null(size_t column) override
   {
-    (*field_ptr)->set_null();
+    field_at(column)->set_null();
   }
-  
-  // Strategy: Store only the document field as JSON
-  
-  fprintf(stderr, "DEBUG: Table has %u fields:\n", table->s->fields);
-  for (uint i = 0; i < table->s->fields; i++) {
-    Field *f = table->field[i];
-    fprintf(stderr, "  Field[%u]: name='%s', field_index=%u, null_bit=%u\n", 
-            i, f->field_name.str, f->field_index, f->null_bit);
+
+  void store_int(size_t column, int64_t value) override
+  {
+    Field *field = field_at(column);
+    field->set_notnull();
+    field->store((longlong)value, false);
   }
-  
-  uint field_array_index = 0;
-  for (field_ptr = table->field; *field_ptr; field_ptr++, field_array_index++)
+
+  void store_double(size_t column, double value) override
   {
-    Field *field = *field_ptr;
-    const char *field_name = field->field_name.str;
-    
-    fprintf(stderr, "DEBUG: Processing field_name='%s' (length=%lu) at array_index=%u\n", 
-            field_name ? field_name : "NULL", field_name ? strlen(field_name) : 0, field_array_index);
-    
-    if (strcmp(field_name, "_id") == 0)
-    {
-      // Handle _id field - extract ObjectId and convert to string
-      fprintf(stderr, "DEBUG: Matched _id field at array_index=%u\n", field_array_index);
-      
-      field->ptr = buf + field->offset(table->record[0]);
-      convert_mongodb_id_field(doc, field);
-    }
-    else if (strcmp(field_name, "document") == 0)
-    {
-      // Handle document field - convert full BSON to JSON and pack into buffer
-      fprintf(stderr, "DEBUG: Matched document field at array_index=%u - converting to JSON\n", field_array_index);
-      
-      // Convert BSON to JSON string using relaxed format (more readable)
-      char *json_str = bson_as_relaxed_extended_json(doc, nullptr);
-      if (!json_str) {
-        fprintf(stderr, "DEBUG: relaxed JSON failed, trying canonical\n");
-        // Fallback to canonical format
-        json_str = bson_as_canonical_extended_json(doc, nullptr);
-      }
-      
-      if (json_str) {
-        fprintf(stderr, "DEBUG: Successfully converted to JSON: %.200s...\n", json_str);
-        
-        // CRITICAL: Set field pointer to point to the row buffer location for this field
-        field->ptr = buf + field->offset(table->record[0]);
-        
-        // Store the JSON string in the field and pack into buffer
-        field->set_notnull();
-        CHARSET_INFO *field_charset = field->charset();
-        field->store(json_str, strlen(json_str), field_charset);
-        
-        fprintf(stderr, "DEBUG: JSON stored in field and packed into buffer at offset %lu\n", 
-                (unsigned long)field->offset(table->record[0]));
-        
-        bson_free(json_str);
-      } else {
-        fprintf(stderr, "DEBUG: JSON conversion failed\n");
-        // Store error message
-        field->ptr = buf + field->offset(table->record[0]);
-        field->set_notnull();
-        CHARSET_INFO *field_charset = field->charset();
-        field->store("{\"error\":\"Failed to convert BSON to JSON\"}", 37, field_charset);
-      }
-    }
-    else
-    {
-      // For any other field, extract from document
-      fprintf(stderr, "DEBUG: Extracting field='%s' from document\n", field_name);
-      
-      // Set field pointer to row buffer location
-      field->ptr = buf + field->offset(table->record[0]);
-      
-      convert_simple_field_from_document(doc, field, field_name);
-    }
+    Field *field = field_at(column);
+    field->set_notnull();
+    field->store(value);
   }
-  
-  DBUG_RETURN(0);
-}
 
-/*
-  Convert full MongoDB document to JSON field for virtual column processing
-*/
-int ha_mongodb::convert_full_document_field(const bson_t *doc, Field *field, uint array_index)
-{
-  DBUG_ENTER("ha_mongodb::convert_full_document_field");
-  
-  // EXPLICIT DEBUG
-  fprintf(stderr, "CONVERT_FULL_DOCUMENT_FIELD CALLED!\n");
-  
-  if (!doc || !field) {
-    fprintf(stderr, "CONVERT_FULL_DOCUMENT_FIELD: NULL doc or field!\n");
-    DBUG_RETURN(1);
-  }
-  
-  // Debug field information
-  fprintf(stderr, "Field name: %s, field_index: %u, array_index: %u, null_bit: %u\n", 
-          field->field_name.str, field->field_index, array_index, field->null_bit);
-  
-  // Convert BSON to JSON string using relaxed format (more readable)
-  char *json_str = bson_as_relaxed_extended_json(doc, nullptr);
-  if (!json_str) {
-    fprintf(stderr, "CONVERT_FULL_DOCUMENT_FIELD: relaxed JSON failed, trying canonical\n");
-    // Fallback to canonical format
-    json_str = bson_as_canonical_extended_json(doc, nullptr);
+  void store_string(size_t column, const char *value, size_t length) override
+  {
+    Field *field = field_at(column);
+    field->set_notnull();
+    // _id text is server generated, everything else follows the column
+    CHARSET_INFO *cs = columns[column].kind == MONGODB_COLUMN_ID ? system_charset_info
+                                                                  : field->charset();
+    field->store(value, length, cs);
   }
-  
-  if (json_str) {
-    fprintf(stderr, "CONVERT_FULL_DOCUMENT_FIELD: Successfully converted to JSON: %.200s...\n", json_str);
-    
-    // Clear any existing null flag and set the field
+
+  void store_time(size_t column, int64_t msec_since_epoch) override
+  {
+    Field *field = field_at(column);
     field->set_notnull();
-    
-    // Store the JSON string using field's charset
-    CHARSET_INFO *field_charset = field->charset();
-    int store_result = field->store(json_str, strlen(json_str), field_charset);
-    
-    fprintf(stderr, "Store result: %d, field->is_null(): %d\n", store_result, field->is_null());
-    
-    bson_free(json_str);
-    
-    fprintf(stderr, "CONVERT_FULL_DOCUMENT_FIELD: JSON conversion complete using array_index=%u\n", array_index);
-    
-    DBUG_RETURN(0);
+    int64_t seconds = msec_since_epoch / 1000;
+    int64_t msec = msec_since_epoch % 1000;
+    if (msec < 0) {
+      seconds--;
+      msec += 1000;
+    }
+    // Numeric columns hold epoch seconds; others show the instant in the
+    // session time zone
+    Item_result cmp = field->cmp_type();
+    if (cmp == INT_RESULT || cmp == REAL_RESULT || cmp == DECIMAL_RESULT)
+      field->store((longlong)seconds, false);
+    else
+      field->store_timestamp_dec(Timeval((my_time_t)seconds, (ulong)msec * 1000), 3);
   }
-  
-  // Fallback: store error message if JSON conversion fails
-  fprintf(stderr, "CONVERT_FULL_DOCUMENT_FIELD: JSON conversion failed, storing error\n");
-  field->set_notnull();
-  CHARSET_INFO *field_charset = field->charset();
-  field->store("{\"error\":\"Failed to convert BSON to JSON\"}", 37, field_charset);
-  DBUG_RETURN(0);
-}
+};
 
 /*
-  Convert simple field directly from MongoDB document
+  Convert a document into the row buffer (see mongodb_row_convert.h)
 */
-int ha_mongodb::convert_simple_field_from_document(const bson_t *doc, Field *field, const char *field_name)
+int ha_mongodb::convert_document_to_row(const bson_t *doc, uchar *buf)
 {
-  DBUG_ENTER("ha_mongodb::convert_simple_field_from_document");
-  
-  fprintf(stderr, "CONVERT_SIMPLE_FIELD CALLED for field: %s\n", field_name ? field_name : "NULL");
-  
-  bson_iter_t iter;
+  DBUG_ENTER("ha_mongodb::convert_document_to_row");
   
-  // Try to find field in document
-  if (!bson_iter_init(&iter, doc) || !bson_iter_find(&iter, field_name))
+  if (!doc || !buf)
   {
-    fprintf(stderr, "FIELD NOT FOUND: %s - leaving as NULL\n", field_name ? field_name : "NULL");
-    
-    // Field not found - stays NULL (already set in convert_document_to_row)
-    DBUG_RETURN(0);
+    DBUG_RETURN(1);
   }
   
-  fprintf(stderr, "FIELD FOUND: %s, type=%d\n", field_name ? field_name : "NULL", bson_iter_type(&iter));
-  
-  // Extract value based on BSON type
-  field->set_notnull();
-  
-  switch (bson_iter_type(&iter))
+  if (row_columns.size() != table->s->fields)
   {
-    case BSON_TYPE_INT32:
-    {
-      int32_t value = bson_iter_int32(&iter);
-      fprintf(stderr, "STORING INT32: %d for field %s\n", value, field_name);
-      field->store(value);
-      break;
-    }
-    case BSON_TYPE_INT64:
-    {
-      int64_t value = bson_iter_int64(&iter);
-      fprintf(stderr, "STORING INT64: %lld for field %s\n", (long long)value, field_name);
-      field->store(value);
-      break;
-    }
-    case BSON_TYPE_DOUBLE:
-    {
-      double value = bson_iter_double(&iter);
-      fprintf(stderr, "STORING DOUBLE: %f for field %s\n", value, field_name);
-      field->store(value);
-      break;
-    }
-    case BSON_TYPE_UTF8:
-    {
-      uint32_t len;
-      const char* value = bson_iter_utf8(&iter, &len);
-      fprintf(stderr, "STORING UTF8: '%.*s' for field %s\n", (int)len, value, field_name);
-      
-      // Use the field's charset instead of hardcoding
-      CHARSET_INFO *field_charset = field->charset();
-      field->store(value, len, field_charset);
-      break;
-    }
-    default:
-    {
-      // For other types, store a descriptive string
-      fprintf(stderr, "STORING UNSUPPORTED TYPE: %d for field %s\n", bson_iter_type(&iter), field_name);
-      
-      char type_desc[64];
-      snprintf(type_desc, sizeof(type_desc), "[BSON_TYPE_%d]", bson_iter_type(&iter));
-      
-      // Use the field's charset instead of hardcoding
-      CHARSET_INFO *field_charset = field->charset();
-      field->store(type_desc, strlen(type_desc), field_charset);
-      break;
-    }
+    std::vector<std::string> names;
+    for (Field **field_ptr = table->field; *field_ptr; field_ptr++)
+      names.push_back((*field_ptr)->field_name.str);
+    row_columns = mongodb_row_columns(names);
   }
   
-  DBUG_RETURN(0);
+  MongoRowFieldSink sink(table, buf, row_columns);
+  DBUG_RETURN(mongodb_convert_document(doc, row_columns, &sink));
 }
 
 /*
-  Convert MongoDB _id field to SQL field
+  Convert a document into the row of another table, such as the temporary
+  table of a pushed down DISTINCT (ha_mongodb_distinct.h)
 */
-int ha_mongodb::convert_mongodb_id_field(const bson_t *doc, Field *field)
+int ha_mongodb::convert_document_to_fields(const bson_t *doc, TABLE *dest,
+                                           const std::vector<MongoColumn> &columns)
 {
-  DBUG_ENTER("ha_mongodb::convert_mongodb_id_field");
-  
-  fprintf(stderr, "CONVERT_ID_FIELD CALLED!\n");
-  
-  bson_iter_t iter;
-  if (!bson_iter_init(&iter, doc) || !bson_iter_find(&iter, "_id"))
-  {
-    DBUG_RETURN(1); // No _id field found
-  }
+  DBUG_ENTER("ha_mongodb::convert_document_to_fields");
   
-  field->set_notnull();
-  
-  if (BSON_ITER_HOLDS_OID(&iter))
-  {
-    fprintf(stderr, "PROCESSING OBJECTID for _id field\n");
-    
-    // ObjectId - convert to string
-    const bson_oid_t *oid = bson_iter_oid(&iter);
-    char oid_str[25];
-    bson_oid_to_string(oid, oid_str);
-    field->store(oid_str, strlen(oid_str), system_charset_info);
-  }
-  else if (BSON_ITER_HOLDS_UTF8(&iter))
-  {
-    // String ID
-    uint32_t str_len;
-    const char *str_val = bson_iter_utf8(&iter, &str_len);
-    field->store(str_val, str_len, system_charset_info);
-  }
-  else if (BSON_ITER_HOLDS_INT32(&iter))
-  {
-    // Integer ID
-    int32_t int_val = bson_iter_int32(&iter);
-    field->store(int_val);
-  }
-  else if (BSON_ITER_HOLDS_INT64(&iter))
+  if (!doc || columns.size() > dest->s->fields)
   {
-    // Long ID
-    int64_t long_val = bson_iter_int64(&iter);
-    field->store(long_val);
-  }
-  else
-  {
-    // Convert other types to string representation
-    char *json_str = bson_as_canonical_extended_json(doc, nullptr);
-    if (json_str)
-    {
-      field->store(json_str, strlen(json_str), system_charset_info);
-      bson_free(json_str);
-    }
+    DBUG_RETURN(1);
   }
   
-  DBUG_RETURN(0);
+  MongoRowFieldSink sink(dest, dest->record[0], columns);
+  DBUG_RETURN(mongodb_convert_document(doc, columns, &sink));
 }
 
 /*
@@ -1802,15 +2419,16 @@ int ha_mongodb::convert_bson_value_to_field(bson_iter_t *iter, Field *field, Mon
       const bson_value_t *value = bson_iter_value(iter);
       if (value)
       {
-        bson_t *temp_doc = bson_new();
-        bson_append_value(temp_doc, "value", -1, value);
-        char *json_str = bson_as_canonical_extended_json(temp_doc, nullptr);
+        bson_t temp_doc;
+        bson_init(&temp_doc);
+        bson_append_value(&temp_doc, "value", -1, value);
+        char *json_str = bson_as_canonical_extended_json(&temp_doc, nullptr);
         if (json_str)
         {
           field->store(json_str, strlen(json_str), system_charset_info);
           bson_free(json_str);
         }
-        bson_destroy(temp_doc);
+        bson_destroy(&temp_doc);
       }
       break;
     }
@@ -1842,6 +2460,558 @@ int ha_mongodb::rollback(THD *thd, bool all)
 /*
   Index flags - specify what operations our indexes support
 */
+/*
+  Result cache helpers
+
+  A scan is cacheable when the table was created with RESULT_CACHE=YES and
+  mongodb_result_cache_size is non-zero. The key covers the collection, the
+  table definition version (row layout), the projection mode and the exact
+  BSON filter, so only byte-identical pushed-down queries share an entry.
+
+  Within a statement every scan is also remembered by that key, up to
+  mongodb_rescan_cache_size bytes per handler. The first scan of a key
+  only records it; a repeat (a dependent subquery re-executed per outer
+  row) captures its rows, and later ones replay them without count or
+  find round trips. reset() forgets them when the statement ends.
+*/
+bool ha_mongodb::result_cache_lookup(const bson_t *query, const char *projection_mode)
+{
+  capture_shared = mongodb_result_cache_size && share && share->mongo_connection_string &&
+                   share->collection_name && table->s->option_struct &&
+                   table->s->option_struct->result_cache;
+  capture_rescan = false;
+  if (!capture_shared && !mongodb_rescan_cache_size)
+  {
+    return false;
+  }
+  
+  result_cache_key.clear();
+  if (share && share->mongo_connection_string && share->collection_name) {
+    result_cache_key = mongodb_result_cache_table_id(share->mongo_connection_string,
+                                                     share->collection_name);
+  }
+  result_cache_key.push_back('\0');
+  result_cache_key.append((const char*)table->s->tabledef_version.str,
+                          table->s->tabledef_version.length);
+  result_cache_key.append(projection_mode);
+  result_cache_key.push_back('\0');
+  result_cache_key.append((const char*)bson_get_data(query), query->len);
+  cached_row_index = 0;
+  
+  if (mongodb_rescan_cache_size) {
+    auto it = rescan_results.find(result_cache_key);
+    if (it == rescan_results.end()) {
+      rescan_results.emplace(result_cache_key, nullptr);
+    } else if (it->second) {
+      cached_result = it->second;
+      mongodb_result_cache.rescan_hits++;
+      return true;
+    } else {
+      capture_rescan = rescan_bytes < mongodb_rescan_cache_size;
+    }
+  }
+  
+  if (capture_shared) {
+    cached_result = mongodb_result_cache.lookup(result_cache_key);
+    if (cached_result && capture_rescan) {
+      // Already in memory; later rescans need not ask the shared cache
+      rescan_results[result_cache_key] = cached_result;
+    }
+  }
+  return cached_result != nullptr;
+}
+
+/*
+  Start capturing rows on a cache miss. The table generation is taken before
+  the cursor is created so changes during the scan reject the insert.
+*/
+void ha_mongodb::result_cache_begin()
+{
+  if (result_cache_key.empty() || (!capture_shared && !capture_rescan)) {
+    return;
+  }
+  
+  result_builder.reset(new MongoCachedResult());
+  if (capture_shared) {
+    result_builder->table_id = mongodb_result_cache_table_id(share->mongo_connection_string,
+                                                             share->collection_name);
+    result_builder->generation = mongodb_result_cache.table_generation(result_builder->table_id);
+  }
+  result_builder->record_length = table->s->reclength;
+  result_builder->blob_count = table->s->blob_fields;
+  size_t shared_limit = capture_shared ? mongodb_result_cache.get_max_entry_size() : 0;
+  size_t rescan_limit = capture_rescan ? rescan_room() : 0;
+  result_builder_limit = shared_limit > rescan_limit ? shared_limit : rescan_limit;
+}
+
+size_t ha_mongodb::rescan_room() const
+{
+  return rescan_bytes < mongodb_rescan_cache_size ? (size_t)(mongodb_rescan_cache_size - rescan_bytes)
+                                                  : 0;
+}
+
+void ha_mongodb::result_cache_capture_row(const uchar *buf)
+{
+  MongoCachedResult *result = result_builder.get();
+  
+  result->records.insert(result->records.end(), buf, buf + result->record_length);
+  
+  // Blob payloads live in the fields' own buffers, copy them out of line.
+  // The fields point into record[0]; read them relative to buf
+  my_ptrdiff_t offset = (my_ptrdiff_t)(buf - table->record[0]);
+  for (uint i = 0; i < result->blob_count; i++) {
+    Field_blob *blob = (Field_blob*) table->field[table->s->blob_field[i]];
+    if (blob->is_null_in_record(buf)) {
+      result->blobs.emplace_back();
+      continue;
+    }
+    blob->move_field_offset(offset);
+    uint32 length = blob->get_length();
+    result->blobs.emplace_back((const char*) blob->get_ptr(), length);
+    blob->move_field_offset(-offset);
+    result->blob_bytes += length;
+  }
+  result->row_count++;
+  
+  // Too large for the cache - stop capturing
+  if (result->memory_size() > result_builder_limit) {
+    fprintf(stderr, "RESULT_CACHE: Scan exceeds %zu bytes, not caching\n", result_builder_limit);
+    result_builder.reset();
+    result_cache_key.clear();
+    // Rescans this large would only copy rows they then drop
+    if (capture_rescan) {
+      rescan_bytes = mongodb_rescan_cache_size;
+    }
+  }
+}
+
+void ha_mongodb::result_cache_finish()
+{
+  if (result_builder && result_scan_complete) {
+    result_builder->expires_at = std::chrono::steady_clock::now() +
+                                 std::chrono::seconds(mongodb_result_cache_ttl);
+    
+    size_t rows = result_builder->row_count;
+    std::shared_ptr<const MongoCachedResult> result(result_builder.release());
+    if (capture_rescan && result->memory_size() <= rescan_room()) {
+      rescan_results[result_cache_key] = result;
+      rescan_bytes += result->memory_size();
+      mongodb_result_cache.rescan_inserts++;
+      fprintf(stderr, "RESULT_CACHE: Kept %zu rows for rescans\n", rows);
+    }
+    if (capture_shared && mongodb_result_cache.insert(result_cache_key, result)) {
+      fprintf(stderr, "RESULT_CACHE: Cached %zu rows\n", rows);
+    }
+  }
+  
+  result_builder.reset();
+  result_scan_complete = false;
+}
+
+int ha_mongodb::result_cache_replay_row(uchar *buf, ha_rows row)
+{
+  const MongoCachedResult *result = cached_result.get();
+  
+  if (row >= result->row_count) {
+    return HA_ERR_END_OF_FILE;
+  }
+  
+  memcpy(buf, &result->records[row * result->record_length], result->record_length);
+  
+  // Point the blobs in buf at the cached payloads, leaving the fields on record[0]
+  const std::string *blobs = result->blobs.data() + row * result->blob_count;
+  my_ptrdiff_t offset = (my_ptrdiff_t)(buf - table->record[0]);
+  for (uint i = 0; i < result->blob_count; i++) {
+    Field_blob *blob = (Field_blob*) table->field[table->s->blob_field[i]];
+    if (blob->is_null_in_record(buf)) {
+      continue;
+    }
+    blob->move_field_offset(offset);
+    blob->set_ptr((uint32) blobs[i].length(), (uchar*) blobs[i].data());
+    blob->move_field_offset(-offset);
+  }
+  
+  return 0;
+}
+
+/*
+  Key predicate of an exact index read: for each key part in keypart_map,
+  the clause a pushed "column = value" translates to (see
+  mongodb_translator::translate_key_equality()), with the value decoded
+  from the key image through the field into key_record, so the row in
+  record[0] is left alone. cache_key, if given, receives the clauses.
+  Returns false for keys MongoDB cannot match the way MariaDB compares
+  them: the document column, prefix parts, virtual columns, FLOAT and
+  DECIMAL columns, which round what they read, and strings under
+  collations that ignore case or accents. filter is then incomplete and
+  must not be used; rows are checked against the key instead.
+*/
+bool ha_mongodb::append_key_filter(const uchar *key, key_part_map keypart_map, bson_t *filter,
+                                   std::string *cache_key)
+{
+  KEY *key_info = table->key_info + active_index;
+  const uchar *key_ptr = key;
+  
+  if (key_record.size() < table->s->rec_buff_length) {
+    key_record.assign(table->s->rec_buff_length, 0);
+  }
+  my_ptrdiff_t offset = (my_ptrdiff_t)(key_record.data() - table->record[0]);
+  
+  for (uint i = 0; i < key_info->user_defined_key_parts && (keypart_map & ((key_part_map)1 << i)); i++) {
+    KEY_PART_INFO *key_part = key_info->key_part + i;
+    Field *field = key_part->field;
+    if (key_part->key_part_flag & HA_PART_KEY_SEG) {
+      return false;
+    }
+    
+    const uchar *value_ptr = key_ptr;
+    key_ptr += key_part->store_length;
+    
+    bson_t clause;
+    bson_init(&clause);
+    bool translated;
+    if (key_part->null_bit && *value_ptr++) {
+      // A NULL key part matches null or missing fields, as rows show them,
+      // but not arrays holding a null; _id_time is NULL for _id values
+      // other than ObjectIds
+      const char *field_name = field->field_name.str;
+      translated = strcmp(field_name, "document") != 0 &&
+                   strcmp(field_name, MONGODB_ID_TIME_COLUMN) != 0 && !field->vcol_info &&
+                   BSON_APPEND_NULL(&clause, field_name) &&
+                   mongodb_filter_scalar(&clause, field_name);
+    } else {
+      field->move_field_offset(offset);
+      field->set_key_image(value_ptr, key_part->length);
+      translated = mongodb_translator::translate_key_equality(field, &clause);
+      field->move_field_offset(-offset);
+    }
+    
+    if (translated && cache_key) {
+      cache_key->append((const char*)bson_get_data(&clause), clause.len);
+    }
+    translated = translated && bson_concat(filter, &clause);
+    bson_destroy(&clause);
+    if (!translated) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+  Unique key point lookups
+
+  Handles HA_READ_KEY_EXACT on a single-column unique key. The document is
+  fetched with a one-document find (ANDed with any pushed and index
+  condition) and, without those, cached in the collection's point cache.
+  Sets *handled to false for keys that need the regular index path.
+*/
+int ha_mongodb::point_lookup(uchar *buf, const uchar *key, key_part_map keypart_map, bool *handled)
+{
+  *handled = false;
+  
+  if (active_index >= table->s->keys) {
+    return 0;
+  }
+  
+  KEY *key_info = table->key_info + active_index;
+  if (!(key_info->flags & HA_NOSAME) || key_info->user_defined_key_parts != 1 ||
+      !(keypart_map & 1)) {
+    return 0;
+  }
+  
+  KEY_PART_INFO *key_part = key_info->key_part;
+  const char *field_name = key_part->field->field_name.str;
+  if (strcmp(field_name, "document") == 0) {
+    return 0;
+  }
+  
+  // NULL never equals a unique key value
+  bool null_key = key_part->null_bit && *key;
+  bson_t key_filter;
+  bson_init(&key_filter);
+  std::string cache_key(field_name);
+  cache_key.push_back('\0');
+  if (!null_key && !append_key_filter(key, 1, &key_filter, &cache_key)) {
+    bson_destroy(&key_filter);
+    return 0;
+  }
+  
+  *handled = true;
+  
+  // Any previous cursor must not be continued by index_next()
+  if (cursor) {
+    mongoc_cursor_destroy(cursor);
+    cursor = nullptr;
+  }
+  current_doc = nullptr;
+  
+  if (null_key) {
+    bson_destroy(&key_filter);
+    return HA_ERR_KEY_NOT_FOUND;
+  }
+  
+  bson_t filter;
+  bson_init(&filter);
+  bool indexed = false;
+  bool built = lookup_filter(&key_filter, &filter, &indexed);
+  bson_destroy(&key_filter);
+  if (!built) {
+    bson_destroy(&filter);
+    return HA_ERR_INTERNAL_ERROR;
+  }
+  
+  // Pushed and index conditions make the result query specific - don't cache those
+  MongoPointCache *cache = (mongodb_point_cache_size && share && share->point_cache &&
+                            !pushed_condition && !indexed) ? share->point_cache : nullptr;
+  
+  if (cache) {
+    std::shared_ptr<const std::string> cached = cache->lookup(cache_key);
+    if (cached) {
+      bson_t doc;
+      bson_destroy(&filter);
+      if (!bson_init_static(&doc, (const uint8_t*)cached->data(), cached->size())) {
+        return HA_ERR_INTERNAL_ERROR;
+      }
+      memset(buf, 0, table->s->reclength);
+      if (convert_document_to_row(&doc, buf)) {
+        return HA_ERR_INTERNAL_ERROR;
+      }
+      return check_index_condition();
+    }
+  }
+  
+  // Read the generation before fetching so a racing change rejects the insert
+  uint64_t generation = cache ? cache->get_generation() : 0;
+  
+  bson_t opts;
+  bson_init(&opts);
+  BSON_APPEND_INT64(&opts, "limit", 1);
+  BSON_APPEND_BOOL(&opts, "singleBatch", true);
+  
+  mongoc_cursor_t *lookup_cursor = mongoc_collection_find_with_opts(collection, &filter, &opts, nullptr);
+  bson_destroy(&opts);
+  bson_destroy(&filter);
+  
+  const bson_t *doc;
+  int rc = 0;
+  if (mongoc_cursor_next(lookup_cursor, &doc)) {
+    memset(buf, 0, table->s->reclength);
+    rc = convert_document_to_row(doc, buf) ? HA_ERR_INTERNAL_ERROR : 0;
+    if (!rc && cache) {
+      cache->insert(cache_key, doc, generation, (size_t)mongodb_point_cache_size,
+                    (uint32_t)mongodb_point_cache_ttl);
+    }
+    if (!rc) {
+      rc = check_index_condition();
+    }
+  } else {
+    bson_error_t error;
+    if (mongoc_cursor_error(lookup_cursor, &error)) {
+      fprintf(stderr, "POINT_LOOKUP: Cursor error: %s\n", error.message);
+      rc = HA_ERR_INTERNAL_ERROR;
+    } else {
+      rc = HA_ERR_KEY_NOT_FOUND;
+    }
+  }
+  mongoc_cursor_destroy(lookup_cursor);
+  
+  return rc;
+}
+
+/*
+  Local mirror helpers
+
+  A new scan takes the current snapshot and selects its rows up front.
+  rnd_init(false) before positioned reads (e.g. after filesort) keeps the
+  previous snapshot so stored positions stay valid.
+*/
+bool ha_mongodb::mirror_scan_begin(bool scan)
+{
+  if (!scan && mirror_snapshot) {
+    return true;
+  }
+  
+  mirror_snapshot.reset();
+  mirror_rows.clear();
+  
+  if (!share || !share->mirror) {
+    return false;
+  }
+  
+  std::shared_ptr<const MongoMirrorSnapshot> snapshot = share->mirror->get_snapshot();
+  if (!snapshot || !mongodb_mirror_select_rows(*snapshot, pushed_condition, &mirror_rows)) {
+    fprintf(stderr, "MIRROR: %s not usable for this scan, querying MongoDB\n",
+            snapshot ? "Filter" : "Mirror");
+    mirror_rows.clear();
+    mirror_counters.remote_fallbacks++;
+    return false;
+  }
+  
+  mirror_snapshot = snapshot;
+  mirror_counters.local_scans++;
+  return true;
+}
+
+int ha_mongodb::mirror_read_row(uchar *buf, ha_rows row)
+{
+  if (row >= mirror_rows.size()) {
+    return HA_ERR_END_OF_FILE;
+  }
+  
+  bson_t doc;
+  bson_init(&doc);
+  mongodb_mirror_build_document(*mirror_snapshot, mirror_rows[row], &doc);
+  
+  memset(buf, 0, table->s->reclength);
+  int rc = convert_document_to_row(&doc, buf);
+  bson_destroy(&doc);
+  
+  return rc ? HA_ERR_INTERNAL_ERROR : 0;
+}
+
+/*
+  Shared scan helpers
+
+  A reader first consumes the producer's batches. When the producer ends,
+  a late reader still has to read the _ids below the first one it saw; a
+  reader that fell out of the window (or whose producer failed) reads
+  everything past the last _id it returned. Either way the rest comes from
+  a private cursor with the same filter.
+*/
+bool ha_mongodb::shared_scan_begin(const bson_t *query, bool scan)
+{
+  if (!scan || !mongodb_shared_scans || !share || !share->shared_scans) {
+    return false;
+  }
+  
+  shared_scan = share->shared_scans->attach(query, &shared_sequence);
+  shared_joined_late = shared_sequence > 0;
+  shared_batch_offset = 0;
+  shared_first_id.clear();
+  // Kept for the remainder cursor in a buffer reused across scans
+  if (shared_filter) {
+    bson_reinit(shared_filter);
+  } else {
+    shared_filter = bson_new();
+  }
+  bson_concat(shared_filter, query);
+  positions_by_id = true;
+  
+  if (!shared_doc_view) {
+    shared_doc_view = (bson_t*)bson_aligned_alloc0(BSON_ALIGNOF(bson_t), sizeof(bson_t));
+  }
+  return true;
+}
+
+/*
+  Returns 0 with the next shared document, -1 when rows now come from
+  `cursor`, or a handler error (HA_ERR_END_OF_FILE when nothing is left)
+*/
+int ha_mongodb::shared_scan_next(const uint8_t **data, uint32_t *length)
+{
+  while (shared_scan) {
+    if (shared_batch && shared_batch_offset < shared_batch->data.size()) {
+      const uint8_t *doc = (const uint8_t*)shared_batch->data.data() + shared_batch_offset;
+      uint32_t doc_length;
+      memcpy(&doc_length, doc, sizeof(doc_length));
+      doc_length = BSON_UINT32_FROM_LE(doc_length);
+      
+      shared_last_batch = shared_batch;
+      shared_last_offset = shared_batch_offset;
+      shared_batch_offset += doc_length;
+      
+      if (shared_joined_late && shared_first_id.empty()) {
+        bson_t first;
+        bson_init_static(&first, doc, doc_length);
+        mongodb_shared_scan_document_id(&first, &shared_first_id);
+      }
+      
+      *data = doc;
+      *length = doc_length;
+      return 0;
+    }
+    
+    if (shared_batch) {
+      shared_batch.reset();
+      shared_sequence++;
+      shared_scan_counters.batches_consumed++;
+    }
+    
+    std::shared_ptr<const MongoScanBatch> batch;
+    switch (shared_scan->next_batch(shared_sequence, &batch)) {
+    case MONGO_SHARED_SCAN_BATCH:
+      shared_batch = batch;
+      shared_batch_offset = 0;
+      break;
+    case MONGO_SHARED_SCAN_END:
+      return shared_scan_start_remainder(false);
+    case MONGO_SHARED_SCAN_DETACHED:
+      fprintf(stderr, "SHARED_SCAN: Reader fell behind at batch %llu, continuing privately\n",
+              (unsigned long long)shared_sequence);
+      shared_scan_counters.readers_detached++;
+      return shared_scan_start_remainder(true);
+    case MONGO_SHARED_SCAN_ERROR:
+      return shared_scan_start_remainder(true);
+    }
+  }
+  
+  return -1;
+}
+
+int ha_mongodb::shared_scan_start_remainder(bool detached)
+{
+  std::string last_id;
+  if (detached && shared_last_batch) {
+    bson_t last;
+    const uint8_t *doc = (const uint8_t*)shared_last_batch->data.data() + shared_last_offset;
+    uint32_t doc_length;
+    memcpy(&doc_length, doc, sizeof(doc_length));
+    bson_init_static(&last, doc, BSON_UINT32_FROM_LE(doc_length));
+    mongodb_shared_scan_document_id(&last, &last_id);
+  }
+  
+  bson_t *remainder = mongodb_shared_scan_remainder_filter(shared_filter, shared_first_id, last_id);
+  
+  // Nothing was read from the shared scan - read the whole filter
+  bool read_all = !remainder && (detached || shared_joined_late);
+  
+  shared_scan->detach();
+  shared_scan.reset();
+  shared_batch.reset();
+  
+  if (!remainder && !read_all) {
+    result_scan_complete = true;
+    return HA_ERR_END_OF_FILE;
+  }
+  
+  bson_t opts;
+  bson_init(&opts);
+  bson_append_int32(&opts, "batchSize", 9, 1000);
+  cursor = mongoc_collection_find_with_opts(collection, remainder ? remainder : shared_filter,
+                                            &opts, nullptr);
+  bson_destroy(&opts);
+  if (remainder) {
+    bson_destroy(remainder);
+  }
+  
+  return cursor ? -1 : HA_ERR_INTERNAL_ERROR;
+}
+
+void ha_mongodb::shared_scan_end()
+{
+  if (shared_scan) {
+    shared_scan->detach();
+    shared_scan.reset();
+  }
+  shared_batch.reset();
+  shared_last_batch.reset();
+  shared_first_id.clear();
+  if (current_doc && current_doc == shared_doc_view) {
+    current_doc = nullptr;
+  }
+}
+
 /*
   Helper method implementations
 */
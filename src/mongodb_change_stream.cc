@@ -0,0 +1,449 @@
+/*
+  MongoDB Change Stream Watcher Implementation
+
+  Tails a collection's change stream on a background thread, keeps the
+  document count estimate current, and invalidates the cached schema when
+  documents show new paths or types.
+*/
+
+#include "mongodb_change_stream.h"
+#include "mongodb_result_cache.h"
+#include "mongodb_point_cache.h"
+#include "mongodb_registry.h"
+#include <algorithm>
+#include <cctype>
+#include <vector>
+
+// Global watcher storage
+static MongoRegistry<MongoChangeStreamWatcher> global_change_stream_watchers;
+
+MongoChangeStreamCounters change_stream_counters;
+
+/*
+  Drop positional components from an update path ("items.3.sku" -> "items.sku")
+  so it matches the array-transparent paths produced by schema inference
+*/
+static std::string canonical_field_path(const char *path)
+{
+  std::string canonical;
+  const char *component = path;
+
+  while (component && *component) {
+    const char *dot = strchr(component, '.');
+    size_t len = dot ? (size_t)(dot - component) : strlen(component);
+
+    bool positional = len > 0;
+    for (size_t i = 0; i < len; i++) {
+      if (!isdigit((unsigned char)component[i])) {
+        positional = false;
+        break;
+      }
+    }
+
+    if (!positional) {
+      if (!canonical.empty()) {
+        canonical += '.';
+      }
+      canonical.append(component, len);
+    }
+
+    component = dot ? dot + 1 : nullptr;
+  }
+
+  return canonical;
+}
+
+static uint64_t wall_clock_ms()
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/*
+  Constructor - the watcher is idle until start() is called
+*/
+MongoChangeStreamWatcher::MongoChangeStreamWatcher(const std::string &connection_str,
+                                                   const std::string &database,
+                                                   const std::string &collection)
+  : connection_string(connection_str),
+    database_name(database),
+    collection_name(collection),
+    table_key(database + "." + collection),
+    stop_requested(false),
+    document_count_estimate(0),
+    count_estimate_valid(false),
+    last_event_time_ms(0),
+    resume_token(nullptr)
+{
+}
+
+MongoChangeStreamWatcher::~MongoChangeStreamWatcher()
+{
+  stop();
+
+  if (resume_token) {
+    bson_destroy(resume_token);
+  }
+}
+
+bool MongoChangeStreamWatcher::start()
+{
+  if (worker.joinable()) {
+    return true;
+  }
+
+  stop_requested = false;
+  worker = std::thread(&MongoChangeStreamWatcher::run, this);
+  return true;
+}
+
+void MongoChangeStreamWatcher::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(wait_mutex);
+    stop_requested = true;
+  }
+  wait_cond.notify_all();
+
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+/*
+  Sleep between reconnect attempts, waking up early on stop()
+*/
+void MongoChangeStreamWatcher::wait_for_retry()
+{
+  std::unique_lock<std::mutex> lock(wait_mutex);
+  wait_cond.wait_for(lock, std::chrono::milliseconds(MONGODB_CHANGE_STREAM_RETRY_MS),
+                     [this] { return stop_requested.load(); });
+}
+
+/*
+  Seed the count from collection metadata; events adjust it from there
+*/
+bool MongoChangeStreamWatcher::seed_document_count(mongoc_collection_t *collection)
+{
+  bson_error_t error;
+  int64_t count = mongoc_collection_estimated_document_count(
+    collection, nullptr, nullptr, nullptr, &error);
+
+  if (count < 0) {
+    fprintf(stderr, "CHANGE_STREAM: Failed to seed document count for %s: %s\n",
+            table_key.c_str(), error.message);
+    count_estimate_valid = false;
+    return false;
+  }
+
+  document_count_estimate = count;
+  count_estimate_valid = true;
+  return true;
+}
+
+/*
+  Worker thread main loop
+*/
+void MongoChangeStreamWatcher::run()
+{
+  MongoSchemaRegistry *registry = get_or_create_schema_registry(connection_string);
+
+  change_stream_counters.watchers_running++;
+  uint32_t consecutive_failures = 0;
+
+  while (!stop_requested.load()) {
+    // Repeated failures usually mean the resume token fell off the oplog:
+    // start over, which reseeds the count and re-infers the schema
+    if (consecutive_failures > 1 && resume_token) {
+      bson_destroy(resume_token);
+      resume_token = nullptr;
+    }
+
+    mongoc_client_t *client = mongoc_client_new(connection_string.c_str());
+    if (!client) {
+      change_stream_counters.stream_errors++;
+      wait_for_retry();
+      continue;
+    }
+
+    mongoc_collection_t *collection = mongoc_client_get_collection(
+      client, database_name.c_str(), collection_name.c_str());
+
+    // Only the fields needed for counting and drift detection are shipped;
+    // _id must stay, it is the resume token
+    bson_t *pipeline = BCON_NEW(
+      "pipeline", "[",
+        "{", "$project", "{",
+          "operationType", BCON_INT32(1),
+          "fullDocument", BCON_INT32(1),
+          "updateDescription.updatedFields", BCON_INT32(1),
+        "}", "}",
+      "]");
+
+    bson_t opts;
+    bson_init(&opts);
+    BSON_APPEND_INT64(&opts, "maxAwaitTimeMS", MONGODB_CHANGE_STREAM_MAX_AWAIT_MS);
+    if (resume_token) {
+      BSON_APPEND_DOCUMENT(&opts, "resumeAfter", resume_token);
+    } else {
+      seed_document_count(collection);
+    }
+
+    mongoc_change_stream_t *stream = mongoc_collection_watch(collection, pipeline, &opts);
+    bson_destroy(&opts);
+    bson_destroy(pipeline);
+
+    // A fresh stream may have missed events - force the next lookup to re-infer
+    if (!resume_token) {
+      invalidate_schema();
+    }
+    registry->set_table_watched(table_key, true);
+
+    bool stream_failed = false;
+    while (!stop_requested.load()) {
+      const bson_t *event;
+
+      if (mongoc_change_stream_next(stream, &event)) {
+        handle_event(event);
+        consecutive_failures = 0;
+      } else {
+        bson_error_t error;
+        const bson_t *error_doc;
+        if (mongoc_change_stream_error_document(stream, &error, &error_doc)) {
+          fprintf(stderr, "CHANGE_STREAM: Stream error on %s: %s\n",
+                  table_key.c_str(), error.message);
+          change_stream_counters.stream_errors++;
+          stream_failed = true;
+          break;
+        }
+        // No event within maxAwaitTimeMS - loop to check for stop
+      }
+
+      const bson_t *token = mongoc_change_stream_get_resume_token(stream);
+      if (token) {
+        if (resume_token) {
+          bson_destroy(resume_token);
+        }
+        resume_token = bson_copy(token);
+      }
+    }
+
+    mongoc_change_stream_destroy(stream);
+    mongoc_collection_destroy(collection);
+    mongoc_client_destroy(client);
+
+    if (stream_failed) {
+      // Events may be lost until the stream is back - fall back to TTL expiry
+      registry->set_table_watched(table_key, false);
+      consecutive_failures++;
+      if (consecutive_failures > 1) {
+        count_estimate_valid = false;
+      }
+      wait_for_retry();
+    }
+  }
+
+  registry->set_table_watched(table_key, false);
+  change_stream_counters.watchers_running--;
+}
+
+/*
+  Apply one change event to the maintained statistics
+*/
+void MongoChangeStreamWatcher::handle_event(const bson_t *event)
+{
+  bson_iter_t iter;
+  if (!bson_iter_init_find(&iter, event, "operationType") || !BSON_ITER_HOLDS_UTF8(&iter)) {
+    return;
+  }
+
+  const char *operation = bson_iter_utf8(&iter, nullptr);
+  change_stream_counters.events_processed++;
+  last_event_time_ms = wall_clock_ms();
+  
+  // Any change makes cached scan results of this collection stale
+  mongodb_result_cache.invalidate_table(
+    mongodb_result_cache_table_id(connection_string, collection_name));
+  invalidate_point_cache(connection_string, collection_name);
+
+  MongoSchemaRegistry *registry = get_or_create_schema_registry(connection_string);
+  std::shared_ptr<const MongoSchemaCache> schema = registry->get_schema(table_key);
+  const MongoSchemaCache *current = (schema && schema->is_valid) ? schema.get() : nullptr;
+  bool drift = false;
+
+  if (strcmp(operation, "insert") == 0 || strcmp(operation, "replace") == 0) {
+    if (operation[0] == 'i') {
+      document_count_estimate++;
+    }
+
+    bson_iter_t doc_iter;
+    if (bson_iter_init_find(&doc_iter, event, "fullDocument") && BSON_ITER_HOLDS_DOCUMENT(&doc_iter)) {
+      const uint8_t *data;
+      uint32_t len;
+      bson_t full_document;
+      bson_iter_document(&doc_iter, &len, &data);
+      if (bson_init_static(&full_document, data, len)) {
+        drift = observe_paths(&full_document, std::string(), 0, current);
+      }
+    }
+  } else if (strcmp(operation, "update") == 0) {
+    bson_iter_t fields;
+    bson_iter_t field;
+    if (bson_iter_init(&iter, event) &&
+        bson_iter_find_descendant(&iter, "updateDescription.updatedFields", &fields) &&
+        BSON_ITER_HOLDS_DOCUMENT(&fields) && bson_iter_recurse(&fields, &field)) {
+      while (bson_iter_next(&field)) {
+        std::string path = canonical_field_path(bson_iter_key(&field));
+        bson_type_t type = bson_iter_type(&field);
+
+        if (observe_path(path, type, current)) {
+          drift = true;
+        }
+
+        // A whole subdocument was set - its fields may be new too
+        if (type == BSON_TYPE_DOCUMENT) {
+          const uint8_t *data;
+          uint32_t len;
+          bson_t subdoc;
+          bson_iter_document(&field, &len, &data);
+          uint32_t depth = (uint32_t)std::count(path.begin(), path.end(), '.') + 1;
+          if (bson_init_static(&subdoc, data, len) &&
+              observe_paths(&subdoc, path, depth, current)) {
+            drift = true;
+          }
+        }
+      }
+    }
+  } else if (strcmp(operation, "delete") == 0) {
+    document_count_estimate--;
+  } else if (strcmp(operation, "drop") == 0 || strcmp(operation, "rename") == 0 ||
+             strcmp(operation, "dropDatabase") == 0 || strcmp(operation, "invalidate") == 0) {
+    // The collection is gone or replaced - nothing we know still holds
+    count_estimate_valid = false;
+    drift = true;
+  }
+
+  if (drift) {
+    invalidate_schema();
+  }
+}
+
+/*
+  Check every path of a document; returns true if any path or type is
+  not part of the cached schema
+*/
+bool MongoChangeStreamWatcher::observe_paths(const bson_t *doc, const std::string &prefix,
+                                             uint32_t depth, const MongoSchemaCache *schema)
+{
+  bson_iter_t iter;
+  bool drift = false;
+
+  if (!bson_iter_init(&iter, doc)) {
+    return false;
+  }
+
+  while (bson_iter_next(&iter)) {
+    const char *key = bson_iter_key(&iter);
+    bson_type_t type = bson_iter_type(&iter);
+    std::string path = prefix.empty() ? std::string(key) : prefix + "." + key;
+
+    if (observe_path(path, type, schema)) {
+      drift = true;
+    }
+
+    if (depth + 1 >= MONGODB_SCHEMA_MAX_DEPTH) {
+      continue;
+    }
+
+    if (type == BSON_TYPE_DOCUMENT) {
+      const uint8_t *data;
+      uint32_t len;
+      bson_t subdoc;
+      bson_iter_document(&iter, &len, &data);
+      if (bson_init_static(&subdoc, data, len) && observe_paths(&subdoc, path, depth + 1, schema)) {
+        drift = true;
+      }
+    } else if (type == BSON_TYPE_ARRAY) {
+      bson_iter_t element;
+      if (!bson_iter_recurse(&iter, &element)) {
+        continue;
+      }
+      while (bson_iter_next(&element)) {
+        if (bson_iter_type(&element) != BSON_TYPE_DOCUMENT) {
+          continue;
+        }
+        const uint8_t *data;
+        uint32_t len;
+        bson_t subdoc;
+        bson_iter_document(&element, &len, &data);
+        if (bson_init_static(&subdoc, data, len) && observe_paths(&subdoc, path, depth + 1, schema)) {
+          drift = true;
+        }
+      }
+    }
+  }
+
+  return drift;
+}
+
+/*
+  Compare one observed value against the cached schema. Nothing is kept
+  per path: update paths such as "scores.<userId>" are unbounded.
+*/
+bool MongoChangeStreamWatcher::observe_path(const std::string &path, bson_type_t type,
+                                            const MongoSchemaCache *schema)
+{
+  if (!schema || type == BSON_TYPE_NULL) {
+    return false; // Nothing to compare against, or NULL fits any column
+  }
+
+  auto it = schema->field_stats.find(path);
+  if (it == schema->field_stats.end()) {
+    // Paths deeper than inference looks are not drift
+    uint32_t depth = (uint32_t)std::count(path.begin(), path.end(), '.');
+    return depth < MONGODB_SCHEMA_MAX_DEPTH;
+  }
+
+  return it->second.type_counts.count(type) == 0;
+}
+
+void MongoChangeStreamWatcher::invalidate_schema()
+{
+  MongoSchemaRegistry *registry = get_or_create_schema_registry(connection_string);
+  registry->invalidate_cache(table_key);
+  change_stream_counters.schema_invalidations++;
+}
+
+bool MongoChangeStreamWatcher::get_document_count_estimate(ha_rows *count) const
+{
+  if (!count_estimate_valid.load()) {
+    return false;
+  }
+
+  int64_t estimate = document_count_estimate.load();
+  *count = estimate > 0 ? (ha_rows)estimate : 0;
+  return true;
+}
+
+/*
+  Global helper functions
+*/
+MongoChangeStreamWatcher* get_or_create_change_stream_watcher(const std::string &connection_string,
+                                                              const std::string &database_name,
+                                                              const std::string &collection_name)
+{
+  return global_change_stream_watchers.get_or_create(connection_string + "/" + collection_name, [&] {
+    auto watcher = std::make_shared<MongoChangeStreamWatcher>(
+      connection_string, database_name, collection_name);
+    watcher->start();
+    return watcher;
+  });
+}
+
+void cleanup_all_change_stream_watchers()
+{
+  // Join worker threads outside the registry lock
+  for (auto &watcher : global_change_stream_watchers.take_all()) {
+    watcher->stop();
+  }
+}
@@ -5,12 +5,9 @@
 */
 
 #include "mongodb_connection.h"
-#include "my_global.h"
-// Skip problematic sql_class.h for now
 
 // Global connection pool storage
-std::mutex global_pool_mutex;
-std::map<std::string, std::shared_ptr<MongoConnectionPool>> global_connection_pools;
+MongoRegistry<MongoConnectionPool> global_connection_pools;
 
 /*
   MongoConnectionPool implementation
@@ -233,23 +230,14 @@ void MongoConnectionPool::set_idle_timeout(std::chrono::seconds timeout)
 */
 MongoConnectionPool* get_or_create_connection_pool(const std::string& connection_string)
 {
-  std::lock_guard<std::mutex> lock(global_pool_mutex);
-  
-  auto it = global_connection_pools.find(connection_string);
-  if (it != global_connection_pools.end())
-  {
-    return it->second.get();
-  }
-  
-  auto pool = std::make_shared<MongoConnectionPool>(connection_string);
-  global_connection_pools[connection_string] = pool;
-  return pool.get();
+  return global_connection_pools.get_or_create(connection_string, [&] {
+    return std::make_shared<MongoConnectionPool>(connection_string);
+  });
 }
 
 void cleanup_all_connection_pools()
 {
-  std::lock_guard<std::mutex> lock(global_pool_mutex);
-  global_connection_pools.clear();
+  global_connection_pools.take_all();
 }
 
 bool test_mongodb_connection(const std::string& connection_string)
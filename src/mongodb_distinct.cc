@@ -0,0 +1,447 @@
+/*
+  MongoDB Distinct Values Implementation
+
+  A distinct command that fails (its reply is limited to 16MB) is retried
+  as the $group pipeline, which spills to disk on the server instead.
+*/
+
+#include "mongodb_distinct.h"
+#include "mongodb_filter.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+MongoDistinctCounters distinct_counters;
+
+bool mongodb_distinct_field(const std::string &name)
+{
+  return !name.empty() && name[0] != '$' && name.find('.') == std::string::npos &&
+         name.find('\0') == std::string::npos;
+}
+
+// filter ANDed with clause into out; either may be null
+static bool and_filter(bson_t *out, const bson_t *filter, const bson_t *clause)
+{
+  const bson_t *clauses[2];
+  size_t count = 0;
+  if (filter && !bson_empty(filter)) {
+    clauses[count++] = filter;
+  }
+  if (clause) {
+    clauses[count++] = clause;
+  }
+  return mongodb_filter_and(out, clauses, count);
+}
+
+// {$match: filter} as the first stage, unless there is nothing to match
+static bool append_match(bson_t *pipeline, uint32_t *stage, const bson_t *filter)
+{
+  if (!filter || bson_empty(filter)) {
+    return true;
+  }
+  char buf[16];
+  const char *key;
+  size_t key_len = bson_uint32_to_string((*stage)++, &key, buf, sizeof(buf));
+  bson_t match;
+  return bson_append_document_begin(pipeline, key, (int)key_len, &match) &&
+         BSON_APPEND_DOCUMENT(&match, "$match", filter) &&
+         bson_append_document_end(pipeline, &match);
+}
+
+static bool append_stage(bson_t *pipeline, uint32_t *stage, const bson_t *doc)
+{
+  char buf[16];
+  const char *key;
+  size_t key_len = bson_uint32_to_string((*stage)++, &key, buf, sizeof(buf));
+  return bson_append_document(pipeline, key, (int)key_len, doc);
+}
+
+bool mongodb_distinct_command(const char *collection, const std::string &field,
+                              const bson_t *filter, bson_t *command)
+{
+  if (!collection || !mongodb_distinct_field(field)) {
+    return false;
+  }
+  bool ok = BSON_APPEND_UTF8(command, "distinct", collection) &&
+            bson_append_utf8(command, "key", 3, field.data(), (int)field.size());
+  if (ok && filter && !bson_empty(filter)) {
+    ok = BSON_APPEND_DOCUMENT(command, "query", filter);
+  }
+  return ok;
+}
+
+bool mongodb_distinct_pipeline(const std::vector<std::string> &fields, const bson_t *filter,
+                               bson_t *pipeline)
+{
+  if (fields.empty()) {
+    return false;
+  }
+
+  // {$group: {_id: {a: {$ifNull: ["$a", null]}, ...}}}: missing and null
+  // fields group together, as both read as NULL
+  bson_t group, group_ops, id, value, args;
+  bson_init(&group);
+  bool ok = BSON_APPEND_DOCUMENT_BEGIN(&group, "$group", &group_ops) &&
+            BSON_APPEND_DOCUMENT_BEGIN(&group_ops, "_id", &id);
+  for (size_t i = 0; ok && i < fields.size(); i++) {
+    if (!mongodb_distinct_field(fields[i])) {
+      ok = false;
+      break;
+    }
+    std::string path = "$" + fields[i];
+    ok = bson_append_document_begin(&id, fields[i].data(), (int)fields[i].size(), &value) &&
+         BSON_APPEND_ARRAY_BEGIN(&value, "$ifNull", &args) &&
+         bson_append_utf8(&args, "0", 1, path.data(), (int)path.size()) &&
+         bson_append_null(&args, "1", 1) &&
+         bson_append_array_end(&value, &args) &&
+         bson_append_document_end(&id, &value);
+  }
+  ok = ok && bson_append_document_end(&group_ops, &id) &&
+       bson_append_document_end(&group, &group_ops);
+
+  bson_t *replace = BCON_NEW("$replaceRoot", "{", "newRoot", BCON_UTF8("$_id"), "}");
+  uint32_t stage = 0;
+  ok = ok && append_match(pipeline, &stage, filter) &&
+       append_stage(pipeline, &stage, &group) &&
+       append_stage(pipeline, &stage, replace);
+  bson_destroy(replace);
+  bson_destroy(&group);
+  return ok;
+}
+
+// Largest integer every smaller one is exact below as a double
+#define MONGODB_DOUBLE_EXACT_INT 9007199254740992LL
+
+bool mongodb_distinct_domain_filter(const std::string &field, const MongoDistinctDomain &domain,
+                                    bson_t *clause)
+{
+  if (!mongodb_distinct_field(field)) {
+    return false;
+  }
+  const char *name = field.c_str();
+  std::string path = "$" + field;
+  bson_t *in_domain = nullptr;
+
+  // Range operators and $type also match array elements, so arrays are
+  // excluded on their own
+  switch (domain.kind) {
+    case MONGODB_DISTINCT_INTEGER:
+      in_domain = BCON_NEW("$and", "[",
+                             "{", name, "{", "$not", "{", "$type", BCON_UTF8("array"), "}", "}", "}",
+                             "{", name, "{", "$type", "[", BCON_UTF8("int"), BCON_UTF8("long"), "]",
+                                             "$gte", BCON_INT64(domain.min),
+                                             "$lte", BCON_INT64(domain.max), "}", "}",
+                           "]");
+      break;
+    case MONGODB_DISTINCT_DOUBLE:
+      in_domain = BCON_NEW("$and", "[",
+                             "{", name, "{", "$not", "{", "$type", BCON_UTF8("array"), "}", "}", "}",
+                             "{", "$or", "[",
+                               "{", name, "{", "$type", BCON_UTF8("int"), "}", "}",
+                               "{", name, "{", "$type", BCON_UTF8("double"),
+                                               "$gt", BCON_DOUBLE(-HUGE_VAL),
+                                               "$lt", BCON_DOUBLE(HUGE_VAL), "}", "}",
+                               "{", name, "{", "$type", BCON_UTF8("long"),
+                                               "$gte", BCON_INT64(-MONGODB_DOUBLE_EXACT_INT),
+                                               "$lte", BCON_INT64(MONGODB_DOUBLE_EXACT_INT), "}", "}",
+                             "]", "}",
+                           "]");
+      break;
+    case MONGODB_DISTINCT_STRING:
+      // $and short-circuits, so the length is only taken of strings
+      in_domain = BCON_NEW(name, "{", "$type", BCON_UTF8("string"), "}",
+                           "$expr", "{", "$and", "[",
+                             "{", "$eq", "[", "{", "$type", BCON_UTF8(path.c_str()), "}",
+                                              BCON_UTF8("string"), "]", "}",
+                             "{", "$lte", "[",
+                               "{", domain.length_in_bytes ? "$strLenBytes" : "$strLenCP",
+                                    BCON_UTF8(path.c_str()), "}",
+                               BCON_INT64((int64_t)domain.max_length), "]", "}",
+                           "]", "}");
+      break;
+  }
+  bool ok = in_domain && bson_concat(clause, in_domain);
+  if (in_domain) {
+    bson_destroy(in_domain);
+  }
+  return ok;
+}
+
+bool mongodb_count_distinct_pipeline(const std::string &field, const MongoDistinctDomain &domain,
+                                     const bson_t *filter, bson_t *pipeline)
+{
+  // COUNT(DISTINCT) leaves out NULLs, the documents where the field is
+  // missing or null; the caller made sure no other one is outside the domain
+  bson_t in_domain, match;
+  bson_init(&in_domain);
+  bson_init(&match);
+  bool ok = mongodb_distinct_domain_filter(field, domain, &in_domain) &&
+            and_filter(&match, filter, &in_domain);
+
+  std::string path = "$" + field;
+  bson_t *group = BCON_NEW("$group", "{", "_id", BCON_UTF8(path.c_str()), "}");
+  bson_t *count = BCON_NEW("$count", BCON_UTF8("count"));
+  uint32_t stage = 0;
+  ok = ok && append_match(pipeline, &stage, &match) &&
+       append_stage(pipeline, &stage, group) &&
+       append_stage(pipeline, &stage, count);
+  bson_destroy(count);
+  bson_destroy(group);
+  bson_destroy(&match);
+  bson_destroy(&in_domain);
+  return ok;
+}
+
+MongoDistinctReader::MongoDistinctReader()
+  : cursor(nullptr),
+    have_reply(false),
+    reading_values(false),
+    next_probe(0),
+    value_doc(nullptr)
+{
+  memset(&error, 0, sizeof(error));
+}
+
+MongoDistinctReader::~MongoDistinctReader()
+{
+  close();
+}
+
+void MongoDistinctReader::close()
+{
+  if (cursor) {
+    mongoc_cursor_destroy(cursor);
+    cursor = nullptr;
+  }
+  if (have_reply) {
+    bson_destroy(&reply);
+    have_reply = false;
+  }
+  for (bson_t *probe : probes) {
+    bson_destroy(probe);
+  }
+  probes.clear();
+  next_probe = 0;
+  reading_values = false;
+  if (value_doc) {
+    bson_destroy(value_doc);
+    value_doc = nullptr;
+  }
+}
+
+bool MongoDistinctReader::open(mongoc_collection_t *collection,
+                               const std::vector<std::string> &fields_arg,
+                               const bson_t *filter)
+{
+  close();
+  fields = fields_arg;
+  if (!collection || fields.empty()) {
+    return false;
+  }
+
+  if (fields.size() == 1 && run_command(collection, filter)) {
+    return true;
+  }
+  if (fields.size() == 1) {
+    fprintf(stderr, "DISTINCT: distinct command failed (%s), using $group\n", error.message);
+    distinct_counters.fallbacks++;
+    close();
+  }
+  return run_pipeline(collection, filter);
+}
+
+/*
+  distinct over the documents holding a scalar, then the probes for the
+  rows it cannot list: one with the field missing or null (NULL) and one
+  array
+*/
+bool MongoDistinctReader::run_command(mongoc_collection_t *collection, const bson_t *filter)
+{
+  const std::string &field = fields[0];
+  bson_t scalar, query, command;
+  bson_init(&scalar);
+  bson_init(&query);
+  bson_init(&command);
+
+  const char *array_type[] = { "array" };
+  bool ok = mongodb_filter_type(&scalar, field.c_str(), array_type, 1, true) &&
+            and_filter(&query, filter, &scalar) &&
+            mongodb_distinct_command(mongoc_collection_get_name(collection), field,
+                                     &query, &command);
+  if (ok) {
+    // The driver initializes reply, even when the command fails
+    bson_iter_t list;
+    distinct_counters.commands++;
+    ok = mongoc_collection_read_command_with_opts(collection, &command, nullptr, nullptr,
+                                                  &reply, &error);
+    have_reply = true;
+    ok = ok && bson_iter_init_find(&list, &reply, "values") && BSON_ITER_HOLDS_ARRAY(&list) &&
+         bson_iter_recurse(&list, &values);
+  }
+  bson_destroy(&command);
+  bson_destroy(&query);
+  bson_destroy(&scalar);
+  if (!ok) {
+    return false;
+  }
+  reading_values = true;
+  value_doc = bson_new();
+
+  // _id is never missing nor an array
+  if (field == "_id") {
+    return true;
+  }
+  bson_t missing, array;
+  bson_init(&missing);
+  bson_init(&array);
+  ok = mongodb_filter_null(&missing, field.c_str(), true) &&
+       mongodb_filter_scalar(&missing, field.c_str()) &&
+       run_probe(collection, filter, &missing) &&
+       mongodb_filter_type(&array, field.c_str(), array_type, 1, false) &&
+       run_probe(collection, filter, &array);
+  bson_destroy(&array);
+  bson_destroy(&missing);
+  return ok;
+}
+
+// Keep the first document matching filter and clause, if any
+bool MongoDistinctReader::run_probe(mongoc_collection_t *collection, const bson_t *filter,
+                                    const bson_t *clause)
+{
+  bson_t query;
+  bson_init(&query);
+  bson_t *opts = BCON_NEW("limit", BCON_INT64(1),
+                          "projection", "{", "_id", BCON_INT32(0),
+                                             fields[0].c_str(), BCON_INT32(1), "}");
+  bool ok = and_filter(&query, filter, clause);
+  if (ok) {
+    mongoc_cursor_t *probe = mongoc_collection_find_with_opts(collection, &query, opts, nullptr);
+    const bson_t *doc;
+    if (mongoc_cursor_next(probe, &doc)) {
+      probes.push_back(bson_copy(doc));
+    }
+    ok = !mongoc_cursor_error(probe, &error);
+    mongoc_cursor_destroy(probe);
+  }
+  bson_destroy(opts);
+  bson_destroy(&query);
+  return ok;
+}
+
+bool MongoDistinctReader::run_pipeline(mongoc_collection_t *collection, const bson_t *filter)
+{
+  bson_t pipeline;
+  bson_init(&pipeline);
+  bool ok = mongodb_distinct_pipeline(fields, filter, &pipeline);
+  if (ok) {
+    bson_t *opts = BCON_NEW("allowDiskUse", BCON_BOOL(true),
+                            "batchSize", BCON_INT32(MONGODB_DISTINCT_BATCH_DOCS));
+    distinct_counters.pipelines++;
+    cursor = mongoc_collection_aggregate(collection, MONGOC_QUERY_NONE, &pipeline, opts, nullptr);
+    ok = cursor != nullptr;
+    bson_destroy(opts);
+  }
+  bson_destroy(&pipeline);
+  return ok;
+}
+
+mongo_distinct_status MongoDistinctReader::next(const bson_t **doc)
+{
+  if (cursor) {
+    if (mongoc_cursor_next(cursor, doc)) {
+      distinct_counters.values++;
+      return MONGO_DISTINCT_ROW;
+    }
+    return mongoc_cursor_error(cursor, &error) ? MONGO_DISTINCT_ERROR : MONGO_DISTINCT_END;
+  }
+
+  while (reading_values && bson_iter_next(&values)) {
+    // Read as NULL, which the probe returns once
+    if (BSON_ITER_HOLDS_NULL(&values)) {
+      continue;
+    }
+    bson_reinit(value_doc);
+    if (!bson_append_iter(value_doc, fields[0].data(), (int)fields[0].size(), &values)) {
+      return MONGO_DISTINCT_ERROR;
+    }
+    distinct_counters.values++;
+    *doc = value_doc;
+    return MONGO_DISTINCT_ROW;
+  }
+  reading_values = false;
+
+  if (next_probe < probes.size()) {
+    distinct_counters.values++;
+    *doc = probes[next_probe++];
+    return MONGO_DISTINCT_ROW;
+  }
+  return MONGO_DISTINCT_END;
+}
+
+bool mongodb_distinct_outside_domain(mongoc_collection_t *collection, const std::string &field,
+                                     const MongoDistinctDomain &domain, const bson_t *filter,
+                                     bool *outside, bson_error_t *error)
+{
+  bson_t null, not_null, in_domain, not_in_domain, query;
+  bson_init(&null);
+  bson_init(&not_null);
+  bson_init(&in_domain);
+  bson_init(&not_in_domain);
+  bson_init(&query);
+  const bson_t *clauses[3] = { &not_null, &not_in_domain, filter };
+  size_t count = filter && !bson_empty(filter) ? 3 : 2;
+  // Missing and null fields read as NULL, which COUNT(DISTINCT) skips
+  bool ok = mongodb_filter_null(&null, field.c_str(), true) &&
+            mongodb_filter_scalar(&null, field.c_str()) &&
+            mongodb_filter_not(&not_null, &null) &&
+            mongodb_distinct_domain_filter(field, domain, &in_domain) &&
+            mongodb_filter_not(&not_in_domain, &in_domain) &&
+            mongodb_filter_and(&query, clauses, count);
+
+  *outside = false;
+  if (ok) {
+    bson_t *opts = BCON_NEW("limit", BCON_INT64(1), "projection", "{", "_id", BCON_INT32(1), "}");
+    mongoc_cursor_t *probe = mongoc_collection_find_with_opts(collection, &query, opts, nullptr);
+    const bson_t *doc;
+    *outside = mongoc_cursor_next(probe, &doc);
+    ok = !mongoc_cursor_error(probe, error);
+    mongoc_cursor_destroy(probe);
+    bson_destroy(opts);
+  }
+  bson_destroy(&query);
+  bson_destroy(&not_in_domain);
+  bson_destroy(&in_domain);
+  bson_destroy(&not_null);
+  bson_destroy(&null);
+  return ok;
+}
+
+bool mongodb_count_distinct(mongoc_collection_t *collection, const std::string &field,
+                            const MongoDistinctDomain &domain, const bson_t *filter,
+                            int64_t *count, bson_error_t *error)
+{
+  bson_t pipeline;
+  bson_init(&pipeline);
+  if (!mongodb_count_distinct_pipeline(field, domain, filter, &pipeline)) {
+    bson_destroy(&pipeline);
+    return false;
+  }
+
+  bson_t *opts = BCON_NEW("allowDiskUse", BCON_BOOL(true));
+  distinct_counters.counts++;
+  mongoc_cursor_t *cursor = mongoc_collection_aggregate(collection, MONGOC_QUERY_NONE,
+                                                        &pipeline, opts, nullptr);
+  const bson_t *doc;
+  bson_iter_t iter;
+  *count = 0;
+  if (mongoc_cursor_next(cursor, &doc) && bson_iter_init_find(&iter, doc, "count") &&
+      (BSON_ITER_HOLDS_INT32(&iter) || BSON_ITER_HOLDS_INT64(&iter))) {
+    *count = bson_iter_as_int64(&iter);
+  }
+  bool ok = !mongoc_cursor_error(cursor, error);
+
+  mongoc_cursor_destroy(cursor);
+  bson_destroy(opts);
+  bson_destroy(&pipeline);
+  return ok;
+}
@@ -0,0 +1,1016 @@
+/*
+  MongoDB Filter Builder Implementation
+*/
+
+#include "mongodb_filter.h"
+#include <cstring>
+#include <vector>
+
+#define MONGODB_REGEX_METACHARACTERS "\\^$.|?*+()[]{}"
+
+static const char *const filter_operators[] = {
+  "$eq", "$ne", "$lt", "$lte", "$gt", "$gte"
+};
+
+bson_value_t mongodb_value_int64(int64_t value)
+{
+  bson_value_t v;
+  v.value_type = BSON_TYPE_INT64;
+  v.value.v_int64 = value;
+  return v;
+}
+
+bson_value_t mongodb_value_double(double value)
+{
+  bson_value_t v;
+  v.value_type = BSON_TYPE_DOUBLE;
+  v.value.v_double = value;
+  return v;
+}
+
+bson_value_t mongodb_value_utf8(const char *value, size_t length)
+{
+  bson_value_t v;
+  v.value_type = BSON_TYPE_UTF8;
+  v.value.v_utf8.str = const_cast<char*>(value);
+  v.value.v_utf8.len = (uint32_t)length;
+  return v;
+}
+
+bson_value_t mongodb_value_bool(bool value)
+{
+  bson_value_t v;
+  v.value_type = BSON_TYPE_BOOL;
+  v.value.v_bool = value;
+  return v;
+}
+
+bson_value_t mongodb_value_date_time(int64_t msec_since_epoch)
+{
+  bson_value_t v;
+  v.value_type = BSON_TYPE_DATE_TIME;
+  v.value.v_datetime = msec_since_epoch;
+  return v;
+}
+
+bson_value_t mongodb_value_oid(const bson_oid_t *oid)
+{
+  bson_value_t v;
+  v.value_type = BSON_TYPE_OID;
+  v.value.v_oid = *oid;
+  return v;
+}
+
+bson_value_t mongodb_value_regex(const char *pattern, const char *options)
+{
+  bson_value_t v;
+  v.value_type = BSON_TYPE_REGEX;
+  v.value.v_regex.regex = const_cast<char*>(pattern);
+  v.value.v_regex.options = const_cast<char*>(options ? options : "");
+  return v;
+}
+
+/*
+  Values a bare {path: value} would not compare by equality
+*/
+static bool needs_explicit_eq(const bson_value_t *value)
+{
+  return value->value_type == BSON_TYPE_DOCUMENT ||
+         value->value_type == BSON_TYPE_ARRAY ||
+         value->value_type == BSON_TYPE_REGEX;
+}
+
+bool mongodb_filter_compare(bson_t *clause, const char *path, MongoFilterOp op,
+                            const bson_value_t *value)
+{
+  if (!clause || !path || !value)
+    return false;
+
+  // SQL comparisons with NULL are never true
+  if (value->value_type == BSON_TYPE_NULL)
+    return false;
+
+  if (op == MONGODB_FILTER_EQ && !needs_explicit_eq(value))
+    return bson_append_value(clause, path, -1, value);
+
+  bson_t ops;
+  if (!bson_append_document_begin(clause, path, -1, &ops))
+    return false;
+
+  if (op == MONGODB_FILTER_NE) {
+    // $ne alone also matches null and missing fields
+    bson_t list;
+    bson_append_array_begin(&ops, "$nin", -1, &list);
+    bson_append_value(&list, "0", -1, value);
+    bson_append_null(&list, "1", -1);
+    bson_append_array_end(&ops, &list);
+  } else {
+    bson_append_value(&ops, filter_operators[op], -1, value);
+  }
+
+  return bson_append_document_end(clause, &ops);
+}
+
+bool mongodb_filter_range(bson_t *clause, const char *path,
+                          const bson_value_t *low, bool low_inclusive,
+                          const bson_value_t *high, bool high_inclusive)
+{
+  if (!clause || !path || (!low && !high))
+    return false;
+  if ((low && low->value_type == BSON_TYPE_NULL) ||
+      (high && high->value_type == BSON_TYPE_NULL))
+    return false;
+
+  bson_t ops;
+  if (!bson_append_document_begin(clause, path, -1, &ops))
+    return false;
+  if (low)
+    bson_append_value(&ops, low_inclusive ? "$gte" : "$gt", -1, low);
+  if (high)
+    bson_append_value(&ops, high_inclusive ? "$lte" : "$lt", -1, high);
+  return bson_append_document_end(clause, &ops);
+}
+
+bool mongodb_filter_in(bson_t *clause, const char *path,
+                       const bson_value_t *values, size_t count, bool negated)
+{
+  if (!clause || !path || (!values && count))
+    return false;
+
+  // NOT IN (..., NULL) is never true; IN ignores the NULL
+  if (negated) {
+    for (size_t i = 0; i < count; i++) {
+      if (values[i].value_type == BSON_TYPE_NULL)
+        return false;
+    }
+  }
+
+  bson_t ops, list;
+  if (!bson_append_document_begin(clause, path, -1, &ops))
+    return false;
+  bson_append_array_begin(&ops, negated ? "$nin" : "$in", -1, &list);
+
+  uint32_t index = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (values[i].value_type == BSON_TYPE_NULL)
+      continue;
+    char key_buf[16];
+    const char *key;
+    size_t key_len = bson_uint32_to_string(index++, &key, key_buf, sizeof(key_buf));
+    bson_append_value(&list, key, (int)key_len, &values[i]);
+  }
+
+  if (negated) {
+    // Like <>, NOT IN must not match null or missing fields
+    char key_buf[16];
+    const char *key;
+    size_t key_len = bson_uint32_to_string(index, &key, key_buf, sizeof(key_buf));
+    bson_append_null(&list, key, (int)key_len);
+  }
+
+  bson_append_array_end(&ops, &list);
+  return bson_append_document_end(clause, &ops);
+}
+
+bool mongodb_filter_null(bson_t *clause, const char *path, bool is_null)
+{
+  if (!clause || !path)
+    return false;
+
+  if (is_null)
+    return bson_append_null(clause, path, -1);
+
+  bson_t ops;
+  if (!bson_append_document_begin(clause, path, -1, &ops))
+    return false;
+  bson_append_null(&ops, "$ne", -1);
+  return bson_append_document_end(clause, &ops);
+}
+
+bool mongodb_filter_regex(bson_t *clause, const char *path, const char *pattern,
+                          const char *options, bool negated)
+{
+  if (!clause || !path || !pattern)
+    return false;
+
+  if (!negated)
+    return bson_append_regex(clause, path, -1, pattern, options ? options : "");
+
+  bson_t ops;
+  if (!bson_append_document_begin(clause, path, -1, &ops))
+    return false;
+  bson_append_regex(&ops, "$not", -1, pattern, options ? options : "");
+  bson_append_null(&ops, "$ne", -1);
+  return bson_append_document_end(clause, &ops);
+}
+
+bool mongodb_filter_type(bson_t *clause, const char *path, const char *const *types,
+                         size_t count, bool negated)
+{
+  if (!clause || !path || !types || !count)
+    return false;
+
+  bson_t ops, type_ops, list;
+  if (!bson_append_document_begin(clause, path, -1, &ops))
+    return false;
+
+  bson_t *target = &ops;
+  if (negated) {
+    bson_append_bool(&ops, "$exists", -1, true);
+    bson_append_document_begin(&ops, "$not", -1, &type_ops);
+    target = &type_ops;
+  }
+
+  bson_append_array_begin(target, "$type", -1, &list);
+  for (size_t i = 0; i < count; i++) {
+    char key_buf[16];
+    const char *key;
+    size_t key_len = bson_uint32_to_string((uint32_t)i, &key, key_buf, sizeof(key_buf));
+    bson_append_utf8(&list, key, (int)key_len, types[i], -1);
+  }
+  bson_append_array_end(target, &list);
+
+  if (negated)
+    bson_append_document_end(&ops, &type_ops);
+  return bson_append_document_end(clause, &ops);
+}
+
+bool mongodb_filter_exists(bson_t *clause, const char *path, bool exists)
+{
+  if (!clause || !path)
+    return false;
+
+  bson_t ops;
+  if (!bson_append_document_begin(clause, path, -1, &ops))
+    return false;
+  bson_append_bool(&ops, "$exists", -1, exists);
+  return bson_append_document_end(clause, &ops);
+}
+
+static bool append_not_array(bson_t *ops)
+{
+  bson_t not_ops;
+  return bson_append_document_begin(ops, "$not", -1, &not_ops) &&
+         bson_append_utf8(&not_ops, "$type", -1, "array", -1) &&
+         bson_append_document_end(ops, &not_ops);
+}
+
+/*
+  The operators of a clause holding only path, a bare value becoming $eq
+  (or $regex); false for other clauses and for operators that already
+  hold a $not
+*/
+static bool single_path_operators(const bson_t *clause, const char *path, bson_t *ops)
+{
+  bson_iter_t iter;
+  if (bson_count_keys(clause) != 1 || !bson_iter_init(&iter, clause) ||
+      !bson_iter_next(&iter) || strcmp(bson_iter_key(&iter), path) != 0)
+    return false;
+
+  switch (bson_iter_type(&iter)) {
+    case BSON_TYPE_ARRAY:
+      return false;
+    case BSON_TYPE_REGEX:
+      return bson_append_iter(ops, "$regex", -1, &iter);
+    case BSON_TYPE_DOCUMENT:
+    {
+      bson_iter_t child;
+      bool any = false;
+      if (!bson_iter_recurse(&iter, &child))
+        return false;
+      while (bson_iter_next(&child)) {
+        const char *key = bson_iter_key(&child);
+        if (key[0] != '$' || strcmp(key, "$not") == 0 || !bson_append_iter(ops, nullptr, 0, &child))
+          return false;
+        any = true;
+      }
+      return any;
+    }
+    default:
+      return bson_append_iter(ops, "$eq", -1, &iter);
+  }
+}
+
+bool mongodb_filter_scalar(bson_t *clause, const char *path)
+{
+  if (!clause || !path)
+    return false;
+
+  bson_t ops, out;
+  bson_init(&ops);
+  bson_init(&out);
+  bool ok;
+  if (single_path_operators(clause, path, &ops)) {
+    ok = append_not_array(&ops) && bson_append_document(&out, path, -1, &ops);
+  } else {
+    bson_t restriction;
+    bson_init(&restriction);
+    bson_reinit(&ops);
+    const bson_t *clauses[2] = {clause, &restriction};
+    ok = append_not_array(&ops) && bson_append_document(&restriction, path, -1, &ops) &&
+         mongodb_filter_and(&out, clauses, 2);
+    bson_destroy(&restriction);
+  }
+
+  if (ok) {
+    bson_reinit(clause);
+    ok = bson_concat(clause, &out);
+  }
+  bson_destroy(&out);
+  bson_destroy(&ops);
+  return ok;
+}
+
+bool mongodb_regex_append_literal(std::string *regex, const char *value, size_t length)
+{
+  for (size_t i = 0; i < length; i++) {
+    char c = value[i];
+    // Regexes are C strings in BSON
+    if (c == '\0')
+      return false;
+    if (strchr(MONGODB_REGEX_METACHARACTERS, c))
+      regex->push_back('\\');
+    regex->push_back(c);
+  }
+  return true;
+}
+
+bool mongodb_regex_pad_space(std::string *regex, const char *value, size_t length)
+{
+  while (length && value[length - 1] == ' ')
+    length--;
+  regex->assign("^");
+  if (!mongodb_regex_append_literal(regex, value, length))
+    return false;
+  regex->append(" *\\z");
+  return true;
+}
+
+enum MongoLikeToken {
+  MONGODB_LIKE_LITERAL,
+  MONGODB_LIKE_ONE,           // _
+  MONGODB_LIKE_ANY            // %
+};
+
+bool mongodb_filter_like(bson_t *clause, const char *path, const char *pattern,
+                         size_t length, int escape, bool negated)
+{
+  if (!clause || !path || !pattern || escape < 0 || escape > 127)
+    return false;
+
+  // An escape character quotes the next byte; a trailing one is literal.
+  // Multibyte characters pass through as literal bytes, since UTF-8 never
+  // reuses ASCII bytes inside a sequence.
+  std::vector<std::pair<MongoLikeToken, char>> tokens;
+  std::string literal;
+  bool wildcards = false;
+  tokens.reserve(length);
+
+  for (size_t i = 0; i < length; i++) {
+    char c = pattern[i];
+    if (escape && c == (char)escape && i + 1 < length) {
+      c = pattern[++i];
+    } else if (c == '%' || c == '_') {
+      tokens.emplace_back(c == '%' ? MONGODB_LIKE_ANY : MONGODB_LIKE_ONE, c);
+      wildcards = true;
+      continue;
+    }
+    tokens.emplace_back(MONGODB_LIKE_LITERAL, c);
+    literal.push_back(c);
+  }
+
+  if (!wildcards) {
+    bson_value_t value = mongodb_value_utf8(literal.data(), literal.size());
+    return mongodb_filter_compare(clause, path, negated ? MONGODB_FILTER_NE : MONGODB_FILTER_EQ,
+                                  &value);
+  }
+
+  // Leading and trailing % leave that end unanchored
+  size_t begin = 0, end = tokens.size();
+  while (begin < end && tokens[begin].first == MONGODB_LIKE_ANY)
+    begin++;
+  while (end > begin && tokens[end - 1].first == MONGODB_LIKE_ANY)
+    end--;
+
+  // Only %: any non-NULL value
+  if (begin == end)
+    return negated ? false : mongodb_filter_null(clause, path, false);
+
+  std::string regex = begin == 0 ? "^" : "";
+  bool uses_dot = false;
+  for (size_t i = begin; i < end; i++) {
+    switch (tokens[i].first) {
+      case MONGODB_LIKE_LITERAL:
+        if (!mongodb_regex_append_literal(&regex, &tokens[i].second, 1))
+          return false;
+        break;
+      case MONGODB_LIKE_ONE:
+        regex.push_back('.');
+        uses_dot = true;
+        break;
+      case MONGODB_LIKE_ANY:
+        if (tokens[i - 1].first != MONGODB_LIKE_ANY)
+          regex.append(".*");
+        uses_dot = true;
+        break;
+    }
+  }
+  // $ would also match before a final newline
+  if (end == tokens.size())
+    regex.append("\\z");
+
+  // _ and % match newlines too
+  return mongodb_filter_regex(clause, path, regex.c_str(), uses_dot ? "s" : "", negated);
+}
+
+static bool valid_path_key(const std::string &key)
+{
+  return !key.empty() && key[0] != '$' && key.find_first_of(".*", 0) == std::string::npos &&
+         key.find('\0') == std::string::npos;
+}
+
+bool mongodb_filter_json_path(const char *json_path, size_t length, std::string *path)
+{
+  if (!json_path || !path)
+    return false;
+
+  size_t i = 0;
+  while (i < length && json_path[i] == ' ')
+    i++;
+  if (i >= length || json_path[i++] != '$')
+    return false;
+
+  path->clear();
+  while (i < length) {
+    if (json_path[i] == '.') {
+      std::string key;
+      i++;
+      if (i < length && json_path[i] == '"') {
+        // Quoted key; escapes are not worth decoding here
+        for (i++; i < length && json_path[i] != '"'; i++) {
+          if (json_path[i] == '\\')
+            return false;
+          key.push_back(json_path[i]);
+        }
+        if (i++ >= length)
+          return false;
+      } else {
+        while (i < length && json_path[i] != '.' && json_path[i] != '[' && json_path[i] != ' ')
+          key.push_back(json_path[i++]);
+      }
+      if (!valid_path_key(key))
+        return false;
+      if (!path->empty())
+        path->push_back('.');
+      path->append(key);
+    } else if (json_path[i] == '[') {
+      size_t start = ++i;
+      while (i < length && json_path[i] >= '0' && json_path[i] <= '9')
+        i++;
+      // The document itself is never an array
+      if (i == start || i >= length || json_path[i] != ']' || path->empty())
+        return false;
+      path->push_back('.');
+      path->append(json_path + start, i - start);
+      i++;
+    } else if (json_path[i] == ' ') {
+      // Trailing spaces only
+      while (i < length && json_path[i] == ' ')
+        i++;
+      if (i < length)
+        return false;
+    } else {
+      return false;
+    }
+  }
+
+  return !path->empty();
+}
+
+/*
+  JSON containment and overlap
+*/
+static std::string join_path(const std::string &prefix, const char *key)
+{
+  return prefix.empty() ? std::string(key) : prefix + "." + key;
+}
+
+// Values MongoDB equality compares the way MariaDB's JSON functions do
+static bool json_scalar(const bson_iter_t *iter)
+{
+  switch (bson_iter_type(iter)) {
+    case BSON_TYPE_DOUBLE:
+    case BSON_TYPE_UTF8:
+    case BSON_TYPE_OID:
+    case BSON_TYPE_BOOL:
+    case BSON_TYPE_DATE_TIME:
+    case BSON_TYPE_NULL:
+    case BSON_TYPE_INT32:
+    case BSON_TYPE_INT64:
+    case BSON_TYPE_DECIMAL128:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Candidates are parsed as extended JSON, as the document column renders them
+static bson_t *parse_json_value(const char *json, size_t length, bson_iter_t *value)
+{
+  std::string wrapped("{\"v\":");
+  wrapped.append(json, length);
+  wrapped.push_back('}');
+
+  bson_error_t error;
+  bson_t *parsed = bson_new_from_json((const uint8_t *)wrapped.data(), (ssize_t)wrapped.size(),
+                                      &error);
+  if (parsed && !bson_iter_init_find(value, parsed, "v")) {
+    bson_destroy(parsed);
+    parsed = nullptr;
+  }
+  return parsed;
+}
+
+// {path: {op: [values]}}
+static bool append_value_list(bson_t *clause, const char *path, const char *op,
+                              const std::vector<bson_value_t> &values)
+{
+  bson_t ops, list;
+  if (!bson_append_document_begin(clause, path, -1, &ops))
+    return false;
+  bson_append_array_begin(&ops, op, -1, &list);
+  for (size_t i = 0; i < values.size(); i++) {
+    char key_buf[16];
+    const char *key;
+    size_t key_len = bson_uint32_to_string((uint32_t)i, &key, key_buf, sizeof(key_buf));
+    bson_append_value(&list, key, (int)key_len, &values[i]);
+  }
+  bson_append_array_end(&ops, &list);
+  return bson_append_document_end(clause, &ops);
+}
+
+// {path: {$type: type}}
+static bool append_type(bson_t *clause, const char *path, const char *type)
+{
+  bson_t ops;
+  if (!bson_append_document_begin(clause, path, -1, &ops))
+    return false;
+  bson_append_utf8(&ops, "$type", -1, type, -1);
+  return bson_append_document_end(clause, &ops);
+}
+
+// {path: {operator: {$type: type}}}
+static bool append_typed(bson_t *clause, const char *path, const char *op, const char *type)
+{
+  bson_t ops, condition;
+  if (!bson_append_document_begin(clause, path, -1, &ops))
+    return false;
+  bson_append_document_begin(&ops, op, -1, &condition);
+  bson_append_utf8(&condition, "$type", -1, type, -1);
+  bson_append_document_end(&ops, &condition);
+  return bson_append_document_end(clause, &ops);
+}
+
+static bool combine(bson_t *out, bool is_and, std::vector<bson_t*> &clauses, bool built)
+{
+  built = built && !clauses.empty() &&
+          (is_and ? mongodb_filter_and(out, clauses.data(), clauses.size())
+                  : mongodb_filter_or(out, clauses.data(), clauses.size()));
+  for (bson_t *clause : clauses)
+    bson_destroy(clause);
+  clauses.clear();
+  return built;
+}
+
+/*
+  MariaDB searches arrays nested in a target array too, which dotted
+  equality does not: documents holding one are kept. Takes match.
+*/
+static bool or_nested_arrays(bson_t *clause, const char *path, bson_t *match)
+{
+  std::vector<bson_t*> alternatives;
+  alternatives.push_back(match);
+  alternatives.push_back(bson_new());
+  return combine(clause, false, alternatives,
+                 append_typed(alternatives.back(), path, "$elemMatch", "array"));
+}
+
+static bool json_contains(bson_t *clause, const std::string &path, const bson_iter_t *candidate);
+
+// Each key of an object candidate contained below prefix
+static bool json_contains_keys(bson_t *clause, const std::string &prefix,
+                               const bson_iter_t *object)
+{
+  bson_iter_t child;
+  if (!bson_iter_recurse(object, &child))
+    return false;
+
+  std::vector<bson_t*> clauses;
+  bool built = true;
+  while (built && bson_iter_next(&child)) {
+    std::string key(bson_iter_key(&child), bson_iter_key_len(&child));
+    clauses.push_back(bson_new());
+    built = valid_path_key(key) && json_contains(clauses.back(), join_path(prefix, key.c_str()),
+                                                 &child);
+  }
+  return combine(clause, true, clauses, built);
+}
+
+/*
+  An object is contained in an object holding its keys, or in any element
+  of an array: $elemMatch keeps the keys on one element
+*/
+static bool json_contains_object(bson_t *clause, const std::string &path,
+                                 const bson_iter_t *candidate)
+{
+  if (path.empty())
+    return json_contains_keys(clause, path, candidate);
+
+  std::vector<bson_t*> alternatives;
+  bson_t within, direct, not_array;
+  bson_init(&within);
+  bson_init(&direct);
+  bson_init(&not_array);
+
+  bool built = json_contains_keys(&within, "", candidate) &&
+               json_contains_keys(&direct, path, candidate) &&
+               append_typed(&not_array, path.c_str(), "$not", "array");
+  if (built) {
+    bson_t ops;
+    alternatives.push_back(bson_new());
+    bson_append_document_begin(alternatives.back(), path.c_str(), -1, &ops);
+    bson_append_document(&ops, "$elemMatch", -1, &within);
+    bson_append_document_end(alternatives.back(), &ops);
+
+    alternatives.push_back(bson_new());
+    built = append_typed(alternatives.back(), path.c_str(), "$elemMatch", "array");
+
+    const bson_t *guarded[2] = {&not_array, &direct};
+    alternatives.push_back(bson_new());
+    built = built && mongodb_filter_and(alternatives.back(), guarded, 2);
+  }
+
+  bson_destroy(&within);
+  bson_destroy(&direct);
+  bson_destroy(&not_array);
+  return combine(clause, false, alternatives, built);
+}
+
+static bool json_contains(bson_t *clause, const std::string &path, const bson_iter_t *candidate)
+{
+  if (bson_iter_type(candidate) == BSON_TYPE_DOCUMENT)
+    return json_contains_object(clause, path, candidate);
+
+  // The document itself is an object
+  if (path.empty())
+    return false;
+
+  if (json_scalar(candidate)) {
+    bson_t *match = bson_new();
+    bson_append_value(match, path.c_str(), -1, bson_iter_value((bson_iter_t *)candidate));
+    return or_nested_arrays(clause, path.c_str(), match);
+  }
+  if (bson_iter_type(candidate) != BSON_TYPE_ARRAY)
+    return false;
+
+  // Every element in some element of the target: $all for scalars
+  bson_iter_t element;
+  std::vector<bson_value_t> scalars;
+  std::vector<bson_t*> parts;
+  bool built = bson_iter_recurse(candidate, &element);
+  while (built && bson_iter_next(&element)) {
+    if (json_scalar(&element)) {
+      scalars.push_back(*bson_iter_value(&element));
+    } else if (bson_iter_type(&element) == BSON_TYPE_DOCUMENT) {
+      parts.push_back(bson_new());
+      built = json_contains_object(parts.back(), path, &element);
+    } else {
+      built = false;
+    }
+  }
+
+  // [] is contained in any array
+  if (built && scalars.empty() && parts.empty())
+    return append_type(clause, path.c_str(), "array");
+
+  if (built && !scalars.empty()) {
+    parts.push_back(bson_new());
+    built = append_value_list(parts.back(), path.c_str(), "$all", scalars);
+  }
+
+  bson_t *match = bson_new();
+  if (!combine(match, true, parts, built)) {
+    bson_destroy(match);
+    return false;
+  }
+  return or_nested_arrays(clause, path.c_str(), match);
+}
+
+bool mongodb_filter_json_contains(bson_t *clause, const char *path, const char *candidate,
+                                  size_t length)
+{
+  if (!clause || !path || !candidate)
+    return false;
+
+  bson_iter_t value;
+  bson_t *parsed = parse_json_value(candidate, length, &value);
+  if (!parsed)
+    return false;
+
+  bool built = json_contains(clause, path, &value);
+  bson_destroy(parsed);
+  return built;
+}
+
+bool mongodb_filter_json_overlaps(bson_t *clause, const char *path, const char *candidate,
+                                  size_t length)
+{
+  if (!clause || !path || !candidate)
+    return false;
+
+  bson_iter_t value, element;
+  bson_t *parsed = parse_json_value(candidate, length, &value);
+  if (!parsed)
+    return false;
+
+  std::vector<bson_t*> alternatives;
+  std::vector<bson_value_t> scalars;
+  bool built = true;
+
+  if (bson_iter_type(&value) == BSON_TYPE_DOCUMENT) {
+    // Objects overlap on a shared key and value; an array may hold the object
+    built = bson_iter_recurse(&value, &element);
+    while (built && bson_iter_next(&element)) {
+      std::string key(bson_iter_key(&element), bson_iter_key_len(&element));
+      built = valid_path_key(key) && json_scalar(&element);
+      if (built) {
+        alternatives.push_back(bson_new());
+        bson_append_value(alternatives.back(), join_path(path, key.c_str()).c_str(), -1,
+                          bson_iter_value(&element));
+      }
+    }
+    if (built && path[0]) {
+      alternatives.push_back(bson_new());
+      built = append_type(alternatives.back(), path, "array");
+    }
+    built = combine(clause, false, alternatives, built);
+  } else if (!path[0]) {
+    built = false;
+  } else {
+    // Scalars, or arrays of them, overlap an array sharing an element
+    if (json_scalar(&value)) {
+      scalars.push_back(*bson_iter_value(&value));
+    } else if (bson_iter_type(&value) == BSON_TYPE_ARRAY) {
+      built = bson_iter_recurse(&value, &element);
+      while (built && bson_iter_next(&element)) {
+        built = json_scalar(&element);
+        if (built)
+          scalars.push_back(*bson_iter_value(&element));
+      }
+    } else {
+      built = false;
+    }
+
+    if (built && !scalars.empty()) {
+      bson_t *match = bson_new();
+      built = append_value_list(match, path, "$in", scalars) &&
+              or_nested_arrays(clause, path, match);
+    } else {
+      built = false;
+    }
+  }
+
+  bson_destroy(parsed);
+  return built;
+}
+
+/*
+  Aggregation expressions
+*/
+#define MONGODB_EXPR_KEY "e"
+
+// Copy the expression held in operand into parent under key
+static bool append_expr(bson_t *parent, const char *key, int key_len, const bson_t *operand)
+{
+  bson_iter_t iter;
+  return operand && bson_iter_init(&iter, operand) && bson_iter_next(&iter) &&
+         bson_append_iter(parent, key, key_len, &iter);
+}
+
+static bool append_expr_list(bson_t *parent, const char *key, const bson_t *const *args,
+                             size_t count)
+{
+  bson_t list;
+  if (!bson_append_array_begin(parent, key, -1, &list))
+    return false;
+
+  bool built = true;
+  for (size_t i = 0; i < count && built; i++) {
+    char key_buf[16];
+    const char *index;
+    size_t index_len = bson_uint32_to_string((uint32_t)i, &index, key_buf, sizeof(key_buf));
+    built = append_expr(&list, index, (int)index_len, args[i]);
+  }
+  return bson_append_array_end(parent, &list) && built;
+}
+
+bool mongodb_expr_field(bson_t *expr, const char *path, MongoExprType type)
+{
+  if (!expr || !path || !*path)
+    return false;
+
+  static const char *const number_types[] = {"int", "long", "double"};
+  static const char *const string_types[] = {"string"};
+  const char *const *types = type == MONGODB_EXPR_NUMBER ? number_types : string_types;
+  size_t type_count = type == MONGODB_EXPR_NUMBER ? 3 : 1;
+  std::string ref = std::string("$") + path;
+
+  // {$cond: [{$in: [{$type: ref}, [types]]}, ref, null]}
+  bson_t cond, branches, test, in_args, type_of, list;
+  bson_append_document_begin(expr, MONGODB_EXPR_KEY, -1, &cond);
+  bson_append_array_begin(&cond, "$cond", -1, &branches);
+  bson_append_document_begin(&branches, "0", -1, &test);
+  bson_append_array_begin(&test, "$in", -1, &in_args);
+  bson_append_document_begin(&in_args, "0", -1, &type_of);
+  bson_append_utf8(&type_of, "$type", -1, ref.c_str(), -1);
+  bson_append_document_end(&in_args, &type_of);
+  bson_append_array_begin(&in_args, "1", -1, &list);
+  for (size_t i = 0; i < type_count; i++) {
+    char key_buf[16];
+    const char *key;
+    size_t key_len = bson_uint32_to_string((uint32_t)i, &key, key_buf, sizeof(key_buf));
+    bson_append_utf8(&list, key, (int)key_len, types[i], -1);
+  }
+  bson_append_array_end(&in_args, &list);
+  bson_append_array_end(&test, &in_args);
+  bson_append_document_end(&branches, &test);
+  bson_append_utf8(&branches, "1", -1, ref.c_str(), -1);
+  bson_append_null(&branches, "2", -1);
+  bson_append_array_end(&cond, &branches);
+  return bson_append_document_end(expr, &cond);
+}
+
+bool mongodb_expr_literal(bson_t *expr, const bson_value_t *value)
+{
+  if (!expr || !value)
+    return false;
+
+  bson_t literal;
+  if (!bson_append_document_begin(expr, MONGODB_EXPR_KEY, -1, &literal))
+    return false;
+  bson_append_value(&literal, "$literal", -1, value);
+  return bson_append_document_end(expr, &literal);
+}
+
+bool mongodb_expr_operator(bson_t *expr, const char *op, const bson_t *const *args,
+                           size_t count)
+{
+  if (!expr || !op || (!args && count))
+    return false;
+
+  bson_t call;
+  if (!bson_append_document_begin(expr, MONGODB_EXPR_KEY, -1, &call))
+    return false;
+  bool built = append_expr_list(&call, op, args, count);
+  return bson_append_document_end(expr, &call) && built;
+}
+
+bool mongodb_expr_compare(bson_t *expr, MongoFilterOp op, const bson_t *left,
+                          const bson_t *right)
+{
+  const bson_t *args[2] = {left, right};
+  return mongodb_expr_operator(expr, filter_operators[op], args, 2);
+}
+
+bool mongodb_expr_not_null(bson_t *expr, const bson_t *operand)
+{
+  if (!expr || !operand)
+    return false;
+
+  // Missing and null are the lowest values $gt sees
+  bson_t call, args;
+  bson_append_document_begin(expr, MONGODB_EXPR_KEY, -1, &call);
+  bson_append_array_begin(&call, "$gt", -1, &args);
+  bool built = append_expr(&args, "0", -1, operand);
+  bson_append_null(&args, "1", -1);
+  bson_append_array_end(&call, &args);
+  return bson_append_document_end(expr, &call) && built;
+}
+
+bool mongodb_expr_switch(bson_t *expr, const bson_t *const *cases, const bson_t *const *values,
+                         size_t count, const bson_t *otherwise)
+{
+  if (!expr || !cases || !values || !count)
+    return false;
+
+  bson_t call, spec, branches;
+  bson_append_document_begin(expr, MONGODB_EXPR_KEY, -1, &call);
+  bson_append_document_begin(&call, "$switch", -1, &spec);
+  bson_append_array_begin(&spec, "branches", -1, &branches);
+  bool built = true;
+  for (size_t i = 0; i < count && built; i++) {
+    char key_buf[16];
+    const char *key;
+    size_t key_len = bson_uint32_to_string((uint32_t)i, &key, key_buf, sizeof(key_buf));
+    bson_t branch;
+    bson_append_document_begin(&branches, key, (int)key_len, &branch);
+    built = append_expr(&branch, "case", -1, cases[i]) &&
+            append_expr(&branch, "then", -1, values[i]);
+    bson_append_document_end(&branches, &branch);
+  }
+  bson_append_array_end(&spec, &branches);
+  // Without a default, $switch fails when no case is true
+  if (otherwise)
+    built = built && append_expr(&spec, "default", -1, otherwise);
+  else
+    bson_append_null(&spec, "default", -1);
+  bson_append_document_end(&call, &spec);
+  return bson_append_document_end(expr, &call) && built;
+}
+
+bool mongodb_filter_expr(bson_t *clause, const bson_t *expr)
+{
+  return clause && append_expr(clause, "$expr", -1, expr);
+}
+
+// Exact top-level key match (bson_has_field would treat dots as a path)
+static bool has_key(const bson_t *doc, const char *key)
+{
+  bson_iter_t iter;
+  return bson_iter_init_find(&iter, doc, key);
+}
+
+/*
+  True when no top-level key appears twice among out and the clauses, so
+  the clauses can be merged into out instead of an $and list
+*/
+static bool clauses_disjoint(const bson_t *out, const bson_t *const *clauses, size_t count)
+{
+  for (size_t i = 0; i < count; i++) {
+    bson_iter_t iter;
+    if (!bson_iter_init(&iter, clauses[i]))
+      return false;
+    while (bson_iter_next(&iter)) {
+      const char *key = bson_iter_key(&iter);
+      if (has_key(out, key))
+        return false;
+      for (size_t j = i + 1; j < count; j++) {
+        if (has_key(clauses[j], key))
+          return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool append_clause_list(bson_t *out, const char *op,
+                               const bson_t *const *clauses, size_t count)
+{
+  bson_t list;
+  if (!bson_append_array_begin(out, op, -1, &list))
+    return false;
+
+  for (size_t i = 0; i < count; i++) {
+    char key_buf[16];
+    const char *key;
+    size_t key_len = bson_uint32_to_string((uint32_t)i, &key, key_buf, sizeof(key_buf));
+    bson_append_document(&list, key, (int)key_len, clauses[i]);
+  }
+
+  return bson_append_array_end(out, &list);
+}
+
+bool mongodb_filter_and(bson_t *out, const bson_t *const *clauses, size_t count)
+{
+  if (!out || (!clauses && count))
+    return false;
+
+  if (clauses_disjoint(out, clauses, count)) {
+    for (size_t i = 0; i < count; i++) {
+      if (!bson_concat(out, clauses[i]))
+        return false;
+    }
+    return true;
+  }
+
+  return append_clause_list(out, "$and", clauses, count);
+}
+
+bool mongodb_filter_or(bson_t *out, const bson_t *const *clauses, size_t count)
+{
+  if (!out || !clauses || !count)
+    return false;
+
+  if (count == 1)
+    return bson_concat(out, clauses[0]);
+
+  return append_clause_list(out, "$or", clauses, count);
+}
+
+bool mongodb_filter_not(bson_t *out, const bson_t *clause)
+{
+  if (!out || !clause)
+    return false;
+
+  return append_clause_list(out, "$nor", &clause, 1);
+}
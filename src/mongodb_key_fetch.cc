@@ -0,0 +1,306 @@
+/*
+  MongoDB Batched Key Fetches Implementation
+
+  Workers take the next unread chunk until none is left, each on its own
+  client: one of the pool's when free, otherwise a private one. A worker
+  waits while the reader is MONGODB_KEY_FETCH_WINDOW batches behind, and
+  all of them stop when the reader does.
+*/
+
+#include "mongodb_key_fetch.h"
+#include "mongodb_connection.h"
+#include "mongodb_filter.h"
+#include <cstdio>
+#include <cstring>
+
+MongoKeyFetchCounters key_fetch_counters;
+
+// The only field of an equality document
+static bool single_field(const std::string &key, bson_iter_t *field)
+{
+  bson_t doc;
+  bson_iter_t iter;
+  if (!bson_init_static(&doc, (const uint8_t*)key.data(), key.size()) ||
+      !bson_iter_init(&iter, &doc) || !bson_iter_next(&iter)) {
+    return false;
+  }
+  *field = iter;
+  return !bson_iter_next(&iter);
+}
+
+// A value that stands for itself in a $in list, or a {$in: [...]} to merge
+static bool in_list_value(const bson_iter_t *field)
+{
+  bson_type_t type = bson_iter_type(field);
+  if (type == BSON_TYPE_ARRAY || type == BSON_TYPE_REGEX) {
+    return false;
+  }
+  if (type != BSON_TYPE_DOCUMENT) {
+    return true;
+  }
+
+  bson_iter_t child;
+  return bson_iter_recurse(field, &child) && bson_iter_next(&child) &&
+         strcmp(bson_iter_key(&child), "$in") == 0 && BSON_ITER_HOLDS_ARRAY(&child) &&
+         !bson_iter_next(&child);
+}
+
+static bool append_in_value(bson_t *values, uint32_t *count, const bson_iter_t *value)
+{
+  char buf[16];
+  const char *key;
+  size_t key_len = bson_uint32_to_string((*count)++, &key, buf, sizeof(buf));
+  return bson_append_iter(values, key, (int)key_len, value);
+}
+
+static bool append_in_list(bson_t *chunk, const char *field, const std::vector<std::string> &keys,
+                           size_t begin, size_t end)
+{
+  bson_t in_clause;
+  bson_t values;
+  uint32_t count = 0;
+  bool ok = BSON_APPEND_DOCUMENT_BEGIN(chunk, field, &in_clause) &&
+            BSON_APPEND_ARRAY_BEGIN(&in_clause, "$in", &values);
+
+  for (size_t i = begin; ok && i < end; i++) {
+    bson_iter_t iter;
+    single_field(keys[i], &iter);
+    if (bson_iter_type(&iter) != BSON_TYPE_DOCUMENT) {
+      ok = append_in_value(&values, &count, &iter);
+      continue;
+    }
+    // {"_id": {"$in": [ObjectId, "hex"]}} adds both forms
+    bson_iter_t in_iter, element;
+    ok = bson_iter_recurse(&iter, &in_iter) && bson_iter_next(&in_iter) &&
+         bson_iter_recurse(&in_iter, &element);
+    while (ok && bson_iter_next(&element)) {
+      ok = append_in_value(&values, &count, &element);
+    }
+  }
+
+  return ok && bson_append_array_end(&in_clause, &values) &&
+         bson_append_document_end(chunk, &in_clause);
+}
+
+static bool append_or_list(bson_t *chunk, const std::vector<std::string> &keys,
+                           size_t begin, size_t end)
+{
+  bson_t list;
+  bool ok = BSON_APPEND_ARRAY_BEGIN(chunk, "$or", &list);
+  for (size_t i = begin; ok && i < end; i++) {
+    bson_t doc;
+    char buf[16];
+    const char *key;
+    size_t key_len = bson_uint32_to_string((uint32_t)(i - begin), &key, buf, sizeof(buf));
+    ok = bson_init_static(&doc, (const uint8_t*)keys[i].data(), keys[i].size()) &&
+         bson_append_document(&list, key, (int)key_len, &doc);
+  }
+  return ok && bson_append_array_end(chunk, &list);
+}
+
+bool mongodb_key_chunk_filter(const bson_t *base, const std::vector<std::string> &keys,
+                              size_t begin, size_t end, bson_t *filter)
+{
+  if (begin >= end || end > keys.size()) {
+    return false;
+  }
+
+  // One $in when every key is an equality on the same field
+  std::string field;
+  bool same_field = true;
+  for (size_t i = begin; same_field && i < end; i++) {
+    bson_iter_t iter;
+    same_field = single_field(keys[i], &iter) && in_list_value(&iter) &&
+                 (i == begin || field == bson_iter_key(&iter));
+    if (same_field && i == begin) {
+      field = bson_iter_key(&iter);
+    }
+  }
+
+  bson_t chunk;
+  bson_init(&chunk);
+  bool ok = same_field ? append_in_list(&chunk, field.c_str(), keys, begin, end)
+                       : append_or_list(&chunk, keys, begin, end);
+  if (ok) {
+    const bson_t *clauses[2] = { &chunk, base };
+    ok = mongodb_filter_and(filter, clauses, base ? 2 : 1);
+  }
+  bson_destroy(&chunk);
+  if (ok) {
+    key_fetch_counters.chunks++;
+    key_fetch_counters.keys += end - begin;
+  }
+  return ok;
+}
+
+MongoKeyFetch::MongoKeyFetch(const std::string &pool_connection, const std::string &uri,
+                             const std::string &database, const std::string &collection)
+  : pool_connection_string(pool_connection),
+    client_uri(uri),
+    database_name(database),
+    collection_name(collection),
+    next_chunk(0),
+    running(0),
+    failed(false),
+    stop_requested(false)
+{
+}
+
+MongoKeyFetch::~MongoKeyFetch()
+{
+  stop();
+  for (bson_t *chunk : chunks) {
+    bson_destroy(chunk);
+  }
+}
+
+bool MongoKeyFetch::add_chunk(const bson_t *filter)
+{
+  if (!workers.empty()) {
+    return false;
+  }
+  bson_t *chunk = bson_copy(filter);
+  if (!chunk) {
+    return false;
+  }
+  chunks.push_back(chunk);
+  return true;
+}
+
+bool MongoKeyFetch::start()
+{
+  if (!workers.empty()) {
+    return true;
+  }
+
+  size_t count = chunks.size() < MONGODB_KEY_FETCH_WORKERS ? chunks.size()
+                                                            : MONGODB_KEY_FETCH_WORKERS;
+  std::lock_guard<std::mutex> lock(fetch_mutex);
+  for (size_t i = 0; i < count; i++) {
+    workers.emplace_back(&MongoKeyFetch::run, this);
+    running++;
+  }
+  return true;
+}
+
+void MongoKeyFetch::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(fetch_mutex);
+    stop_requested = true;
+  }
+  batch_ready.notify_all();
+  window_space.notify_all();
+
+  for (std::thread &worker : workers) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+}
+
+bool MongoKeyFetch::publish_batch(std::shared_ptr<MongoScanBatch> batch)
+{
+  std::unique_lock<std::mutex> lock(fetch_mutex);
+  window_space.wait(lock, [this] {
+    return stop_requested || ready.size() < MONGODB_KEY_FETCH_WINDOW;
+  });
+  if (stop_requested) {
+    return false;
+  }
+  key_fetch_counters.documents += batch->count;
+  ready.push_back(std::move(batch));
+  lock.unlock();
+  batch_ready.notify_one();
+  return true;
+}
+
+void MongoKeyFetch::run()
+{
+  MongoConnectionPool *pool = get_or_create_connection_pool(pool_connection_string);
+  mongoc_client_t *client = pool ? pool->acquire_connection() : nullptr;
+  bool pooled = client != nullptr;
+  if (!client) {
+    client = mongoc_client_new(client_uri.c_str());
+  }
+
+  mongoc_collection_t *collection = client
+      ? mongoc_client_get_collection(client, database_name.c_str(), collection_name.c_str())
+      : nullptr;
+  bool ok = collection != nullptr;
+
+  bson_t *opts = BCON_NEW("batchSize", BCON_INT32(MONGODB_KEY_FETCH_BATCH_DOCS));
+  bool abandoned = false;
+
+  while (ok && !abandoned) {
+    const bson_t *filter;
+    {
+      std::lock_guard<std::mutex> lock(fetch_mutex);
+      if (stop_requested || failed || next_chunk == chunks.size()) {
+        break;
+      }
+      filter = chunks[next_chunk++];
+    }
+
+    mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(collection, filter, opts, nullptr);
+    auto batch = std::make_shared<MongoScanBatch>();
+    const bson_t *doc;
+
+    while (!abandoned && mongoc_cursor_next(cursor, &doc)) {
+      batch->data.append((const char*)bson_get_data(doc), doc->len);
+      batch->count++;
+      if (batch->count >= MONGODB_KEY_FETCH_BATCH_DOCS) {
+        abandoned = !publish_batch(batch);
+        batch = std::make_shared<MongoScanBatch>();
+      }
+    }
+
+    bson_error_t error;
+    if (mongoc_cursor_error(cursor, &error)) {
+      fprintf(stderr, "KEY_FETCH: Chunk of %s.%s failed: %s\n",
+              database_name.c_str(), collection_name.c_str(), error.message);
+      ok = false;
+    } else if (!abandoned && batch->count) {
+      abandoned = !publish_batch(batch);
+    }
+    mongoc_cursor_destroy(cursor);
+  }
+
+  bson_destroy(opts);
+  if (collection) {
+    mongoc_collection_destroy(collection);
+  }
+  if (pooled) {
+    pool->release_connection(client);
+  } else if (client) {
+    mongoc_client_destroy(client);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(fetch_mutex);
+    running--;
+    if (!ok) {
+      failed = true;
+    }
+  }
+  batch_ready.notify_all();
+}
+
+mongo_key_fetch_status MongoKeyFetch::next_batch(std::shared_ptr<const MongoScanBatch> *batch)
+{
+  std::unique_lock<std::mutex> lock(fetch_mutex);
+  batch_ready.wait(lock, [this] {
+    return failed || !ready.empty() || running == 0;
+  });
+  if (failed) {
+    return MONGO_KEY_FETCH_ERROR;
+  }
+  if (ready.empty()) {
+    return MONGO_KEY_FETCH_END;
+  }
+  *batch = ready.front();
+  ready.pop_front();
+  lock.unlock();
+  window_space.notify_one();
+  return MONGO_KEY_FETCH_BATCH;
+}
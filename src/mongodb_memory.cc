@@ -0,0 +1,325 @@
+/*
+  MongoDB Driver Memory Management Implementation
+
+  Every block carries a 16 byte header in front of the pointer handed to
+  libbson: its size class, the distance back to the start of the backing
+  allocation and the requested size. Freed small blocks go onto the
+  calling thread's free list for their class until the thread's cache is
+  full; blocks may be freed by a different thread than the one that
+  allocated them since blocks of a class are interchangeable.
+*/
+
+#include "my_global.h"
+#include "my_sys.h"
+#include "mysql/psi/mysql_memory.h"
+#include "mongodb_memory.h"
+#include <bson/bson.h>
+#include <cstdio>
+#include <cstring>
+
+MongoMemoryCounters memory_counters;
+
+static PSI_memory_key key_memory_mongodb_bson = PSI_NOT_INSTRUMENTED;
+
+#ifdef HAVE_PSI_INTERFACE
+static PSI_memory_info mongodb_memory_keys[] = {
+  {&key_memory_mongodb_bson, "bson", 0}
+};
+#endif
+
+static std::atomic<size_t> thread_cache_limit(MONGODB_DEFAULT_THREAD_CACHE_BYTES);
+static bool vtable_installed = false;
+
+#define MONGODB_MEMORY_LARGE_CLASS 0xFF
+
+struct BlockHeader {
+  uint32_t size_class;      // Index into the size classes, or MONGODB_MEMORY_LARGE_CLASS
+  uint32_t offset;          // Bytes from the backing allocation to the user pointer
+  uint64_t size;            // Requested bytes
+};
+
+static_assert(sizeof(BlockHeader) == 16, "BlockHeader must keep user pointers 16 byte aligned");
+
+/*
+  Per-thread free lists
+
+  Plain data so it needs no construction; the reaper's destructor returns
+  cached blocks when the thread exits and disables the cache for any frees
+  that happen after it (e.g. from other thread_local destructors).
+*/
+struct ThreadCacheState {
+  void *free_lists[MONGODB_MEMORY_SIZE_CLASSES];
+  size_t bytes;
+  bool registered;
+  bool disabled;
+};
+
+static thread_local ThreadCacheState thread_cache;
+
+static inline size_t class_capacity(uint32_t size_class)
+{
+  return (size_t)MONGODB_MEMORY_MIN_CLASS_SIZE << size_class;
+}
+
+static inline uint32_t class_for(size_t size)
+{
+  for (uint32_t size_class = 0; size_class < MONGODB_MEMORY_SIZE_CLASSES; size_class++) {
+    if (size <= class_capacity(size_class)) {
+      return size_class;
+    }
+  }
+  return MONGODB_MEMORY_LARGE_CLASS;
+}
+
+static inline void *backing_alloc(size_t size)
+{
+  return my_malloc(key_memory_mongodb_bson, size, MYF(0));
+}
+
+static inline void backing_free(void *ptr)
+{
+  my_free(ptr);
+}
+
+static inline void *&next_free(void *block)
+{
+  return *reinterpret_cast<void**>(static_cast<char*>(block) + sizeof(BlockHeader));
+}
+
+struct ThreadCacheReaper {
+  ~ThreadCacheReaper()
+  {
+    for (uint32_t size_class = 0; size_class < MONGODB_MEMORY_SIZE_CLASSES; size_class++) {
+      void *block = thread_cache.free_lists[size_class];
+      while (block) {
+        void *next = next_free(block);
+        backing_free(block);
+        block = next;
+      }
+      thread_cache.free_lists[size_class] = nullptr;
+    }
+    memory_counters.cached_bytes -= (int64_t)thread_cache.bytes;
+    thread_cache.bytes = 0;
+    thread_cache.disabled = true;
+  }
+};
+
+static thread_local ThreadCacheReaper thread_cache_reaper;
+
+static inline bool thread_cache_usable()
+{
+  if (thread_cache.disabled) {
+    return false;
+  }
+  if (!thread_cache.registered) {
+    // First use in this thread - odr-use the reaper so its destructor runs
+    thread_cache.registered = true;
+    (void)&thread_cache_reaper;
+  }
+  return true;
+}
+
+static inline void account_alloc(size_t size)
+{
+  int64_t current = memory_counters.current_bytes += (int64_t)size;
+  int64_t peak = memory_counters.peak_bytes.load(std::memory_order_relaxed);
+  while (current > peak &&
+         !memory_counters.peak_bytes.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {
+  }
+}
+
+static inline void account_free(size_t size)
+{
+  memory_counters.current_bytes -= (int64_t)size;
+}
+
+/*
+  vtable entry points
+*/
+static void *mongodb_bson_malloc(size_t size)
+{
+  uint32_t size_class = class_for(size);
+  char *raw = nullptr;
+
+  if (size_class != MONGODB_MEMORY_LARGE_CLASS && thread_cache_usable() &&
+      thread_cache.free_lists[size_class]) {
+    raw = static_cast<char*>(thread_cache.free_lists[size_class]);
+    thread_cache.free_lists[size_class] = next_free(raw);
+    thread_cache.bytes -= class_capacity(size_class);
+    memory_counters.cached_bytes -= (int64_t)class_capacity(size_class);
+    memory_counters.cache_hits++;
+  } else {
+    size_t payload = size_class == MONGODB_MEMORY_LARGE_CLASS ? size : class_capacity(size_class);
+    raw = static_cast<char*>(backing_alloc(sizeof(BlockHeader) + payload));
+    if (!raw) {
+      return nullptr;
+    }
+  }
+
+  BlockHeader *header = reinterpret_cast<BlockHeader*>(raw);
+  header->size_class = size_class;
+  header->offset = sizeof(BlockHeader);
+  header->size = size;
+  account_alloc(size);
+  memory_counters.allocations++;
+
+  return raw + sizeof(BlockHeader);
+}
+
+static void mongodb_bson_free(void *ptr)
+{
+  if (!ptr) {
+    return;
+  }
+
+  BlockHeader *header = reinterpret_cast<BlockHeader*>(static_cast<char*>(ptr) - sizeof(BlockHeader));
+  char *raw = static_cast<char*>(ptr) - header->offset;
+  uint32_t size_class = header->size_class;
+  account_free((size_t)header->size);
+
+  if (size_class != MONGODB_MEMORY_LARGE_CLASS && thread_cache_usable() &&
+      thread_cache.bytes + class_capacity(size_class) <= thread_cache_limit.load(std::memory_order_relaxed)) {
+    next_free(raw) = thread_cache.free_lists[size_class];
+    thread_cache.free_lists[size_class] = raw;
+    thread_cache.bytes += class_capacity(size_class);
+    memory_counters.cached_bytes += (int64_t)class_capacity(size_class);
+    return;
+  }
+
+  backing_free(raw);
+}
+
+static void *mongodb_bson_calloc(size_t count, size_t size)
+{
+  if (size && count > SIZE_MAX / size) {
+    return nullptr;
+  }
+
+  void *ptr = mongodb_bson_malloc(count * size);
+  if (ptr) {
+    memset(ptr, 0, count * size);
+  }
+  return ptr;
+}
+
+static void *mongodb_bson_realloc(void *ptr, size_t size)
+{
+  if (!ptr) {
+    return mongodb_bson_malloc(size);
+  }
+
+  BlockHeader *header = reinterpret_cast<BlockHeader*>(static_cast<char*>(ptr) - sizeof(BlockHeader));
+  size_t old_size = (size_t)header->size;
+
+  // Still fits the block's size class
+  if (header->size_class != MONGODB_MEMORY_LARGE_CLASS && size <= class_capacity(header->size_class)) {
+    account_free(old_size);
+    account_alloc(size);
+    header->size = size;
+    return ptr;
+  }
+
+  // Large to large - let the backing allocator move it
+  if (header->size_class == MONGODB_MEMORY_LARGE_CLASS && header->offset == sizeof(BlockHeader) &&
+      class_for(size) == MONGODB_MEMORY_LARGE_CLASS) {
+    char *raw = static_cast<char*>(my_realloc(key_memory_mongodb_bson, header,
+                                              sizeof(BlockHeader) + size, MYF(0)));
+    if (!raw) {
+      return nullptr;
+    }
+    header = reinterpret_cast<BlockHeader*>(raw);
+    account_free(old_size);
+    account_alloc(size);
+    header->size = size;
+    return raw + sizeof(BlockHeader);
+  }
+
+  void *moved = mongodb_bson_malloc(size);
+  if (moved) {
+    memcpy(moved, ptr, old_size < size ? old_size : size);
+    mongodb_bson_free(ptr);
+  }
+  return moved;
+}
+
+static void *mongodb_bson_aligned_alloc(size_t alignment, size_t size)
+{
+  if (alignment < sizeof(BlockHeader)) {
+    alignment = sizeof(BlockHeader);
+  }
+
+  char *raw = static_cast<char*>(backing_alloc(sizeof(BlockHeader) + alignment + size));
+  if (!raw) {
+    return nullptr;
+  }
+
+  uintptr_t user = ((uintptr_t)raw + sizeof(BlockHeader) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  BlockHeader *header = reinterpret_cast<BlockHeader*>(user - sizeof(BlockHeader));
+  header->size_class = MONGODB_MEMORY_LARGE_CLASS;
+  header->offset = (uint32_t)(user - (uintptr_t)raw);
+  header->size = size;
+  account_alloc(size);
+  memory_counters.allocations++;
+
+  return reinterpret_cast<void*>(user);
+}
+
+/*
+  Newer libbson versions add aligned_alloc to the vtable; fill it in when
+  the member exists so aligned blocks are freed by the same allocator
+*/
+template <typename Vtable>
+static auto set_aligned_alloc(Vtable *vtable, int) -> decltype(vtable->aligned_alloc = nullptr, void())
+{
+  vtable->aligned_alloc = mongodb_bson_aligned_alloc;
+}
+
+template <typename Vtable>
+static void set_aligned_alloc(Vtable *, long)
+{
+}
+
+bool mongodb_memory_install()
+{
+  if (vtable_installed) {
+    return true;
+  }
+
+#ifdef HAVE_PSI_INTERFACE
+  mysql_memory_register("mongodb", mongodb_memory_keys, array_elements(mongodb_memory_keys));
+#endif
+
+  bson_mem_vtable_t vtable;
+  memset(&vtable, 0, sizeof(vtable));
+  vtable.malloc = mongodb_bson_malloc;
+  vtable.calloc = mongodb_bson_calloc;
+  vtable.realloc = mongodb_bson_realloc;
+  vtable.free = mongodb_bson_free;
+  set_aligned_alloc(&vtable, 0);
+
+  bson_mem_set_vtable(&vtable);
+  vtable_installed = true;
+  return true;
+}
+
+void mongodb_memory_uninstall()
+{
+  if (!vtable_installed) {
+    return;
+  }
+
+  // Blocks still live must be freed by the vtable that allocated them
+  if (memory_counters.current_bytes.load() != 0) {
+    fprintf(stderr, "MONGODB_MEMORY: %lld driver bytes still allocated, keeping allocator installed\n",
+            (long long)memory_counters.current_bytes.load());
+    return;
+  }
+
+  bson_mem_restore_vtable();
+  vtable_installed = false;
+}
+
+void mongodb_memory_set_thread_cache_limit(size_t bytes)
+{
+  thread_cache_limit.store(bytes, std::memory_order_relaxed);
+}
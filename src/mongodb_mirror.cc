@@ -0,0 +1,1224 @@
+/*
+  MongoDB Local Columnar Mirror Implementation
+
+  The worker thread opens the change stream first, then bootstraps the
+  segments with parallel _id range scans, so every change made during the
+  bootstrap is replayed from the stream afterwards. Changes are applied as
+  upserts and deletes keyed by _id; superseded rows are tombstoned and
+  compacted away once they outnumber live rows.
+*/
+
+#include "mongodb_mirror.h"
+#include "mongodb_change_stream.h"
+#include "mongodb_registry.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+// Global mirror storage
+static MongoRegistry<MongoCollectionMirror> global_collection_mirrors;
+
+MongoMirrorCounters mirror_counters;
+
+#define MONGODB_MIRROR_NO_TAIL ((size_t)-1)
+
+static uint64_t wall_clock_ms()
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static inline uint64_t make_row_ref(size_t segment, uint32_t row)
+{
+  return ((uint64_t)segment << 32) | row;
+}
+
+/*
+  Encode one value as a single-element document with an empty key
+*/
+static std::string encode_value(const bson_iter_t *iter)
+{
+  bson_t wrapper;
+  bson_init(&wrapper);
+  bson_append_iter(&wrapper, "", 0, iter);
+  std::string encoded((const char*)bson_get_data(&wrapper), wrapper.len);
+  bson_destroy(&wrapper);
+  return encoded;
+}
+
+static bool decode_value(const std::string &encoded, bson_t *wrapper, bson_iter_t *iter)
+{
+  return bson_init_static(wrapper, (const uint8_t*)encoded.data(), encoded.size()) &&
+         bson_iter_init(iter, wrapper) && bson_iter_next(iter);
+}
+
+MongoMirrorSegment::MongoMirrorSegment(size_t column_count)
+  : columns(column_count), row_count(0), live_rows(0), encoded_bytes(0)
+{
+  for (auto &column : columns) {
+    column.dictionary.emplace_back(); // MONGODB_MIRROR_MISSING_CODE
+  }
+}
+
+/*
+  Append one encoded value to a column, reusing its dictionary code
+  Whole documents are unique, so the root column is not deduplicated.
+*/
+static void append_encoded(MongoMirrorSegment *segment, size_t column_index,
+                           std::unordered_map<std::string, uint32_t> *dictionary_index,
+                           bool root, const std::string &encoded)
+{
+  MongoMirrorColumn &column = segment->columns[column_index];
+  uint32_t code = MONGODB_MIRROR_MISSING_CODE;
+
+  if (!encoded.empty()) {
+    auto it = root ? dictionary_index->end() : dictionary_index->find(encoded);
+    if (it != dictionary_index->end()) {
+      code = it->second;
+    } else {
+      code = (uint32_t)column.dictionary.size();
+      column.dictionary.push_back(encoded);
+      segment->encoded_bytes += encoded.size();
+      if (!root) {
+        dictionary_index->emplace(encoded, code);
+      }
+    }
+  }
+
+  column.codes.push_back(code);
+  segment->encoded_bytes += sizeof(uint32_t);
+}
+
+static void append_document(MongoMirrorSegment *segment,
+                            std::vector<std::unordered_map<std::string, uint32_t>> *dictionary_index,
+                            const std::vector<std::string> &column_names, const bson_t *doc)
+{
+  for (size_t c = 0; c < column_names.size(); c++) {
+    bool root = column_names[c] == MONGODB_MIRROR_ROOT_COLUMN;
+    std::string encoded;
+    bson_iter_t iter;
+
+    if (root) {
+      encoded.assign((const char*)bson_get_data(doc), doc->len);
+    } else if (bson_iter_init_find(&iter, doc, column_names[c].c_str())) {
+      encoded = encode_value(&iter);
+    }
+
+    append_encoded(segment, c, &(*dictionary_index)[c], root, encoded);
+  }
+
+  segment->deleted.push_back(0);
+  segment->row_count++;
+  segment->live_rows++;
+}
+
+/*
+  Constructor - the mirror is idle until start() is called
+*/
+MongoCollectionMirror::MongoCollectionMirror(const std::string &connection_str,
+                                             const std::string &database,
+                                             const std::string &collection,
+                                             const std::vector<std::string> &columns)
+  : connection_string(connection_str),
+    database_name(database),
+    collection_name(collection),
+    table_key(database + "." + collection),
+    root_column(false),
+    stop_requested(false),
+    last_synced_ms(0),
+    live_rows(0),
+    encoded_bytes(0),
+    tail_segment(MONGODB_MIRROR_NO_TAIL),
+    dead_rows(0),
+    resume_token(nullptr)
+{
+  // _id identifies rows for updates and deletes, keep it first
+  column_names.push_back("_id");
+  for (const auto &column : columns) {
+    if (column == "_id") {
+      continue;
+    }
+    if (column == MONGODB_MIRROR_ROOT_COLUMN) {
+      root_column = true;
+    }
+    column_names.push_back(column);
+  }
+}
+
+MongoCollectionMirror::~MongoCollectionMirror()
+{
+  stop();
+
+  if (resume_token) {
+    bson_destroy(resume_token);
+  }
+}
+
+bool MongoCollectionMirror::start()
+{
+  if (worker.joinable()) {
+    return true;
+  }
+
+  stop_requested = false;
+  worker = std::thread(&MongoCollectionMirror::run, this);
+  return true;
+}
+
+void MongoCollectionMirror::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(wait_mutex);
+    stop_requested = true;
+  }
+  wait_cond.notify_all();
+
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+void MongoCollectionMirror::wait_for_retry()
+{
+  std::unique_lock<std::mutex> lock(wait_mutex);
+  wait_cond.wait_for(lock, std::chrono::milliseconds(MONGODB_CHANGE_STREAM_RETRY_MS),
+                     [this] { return stop_requested.load(); });
+}
+
+/*
+  Stale or not yet bootstrapped mirrors are not served - callers scan
+  MongoDB instead
+*/
+std::shared_ptr<const MongoMirrorSnapshot> MongoCollectionMirror::get_snapshot() const
+{
+  if (get_freshness_lag_ms() > MONGODB_MIRROR_MAX_LAG_MS) {
+    return nullptr;
+  }
+  return std::atomic_load_explicit(&published, std::memory_order_acquire);
+}
+
+uint64_t MongoCollectionMirror::get_freshness_lag_ms() const
+{
+  uint64_t synced = last_synced_ms.load();
+  uint64_t now = wall_clock_ms();
+  return synced && now > synced ? now - synced : 0;
+}
+
+/*
+  Worker thread main loop
+*/
+void MongoCollectionMirror::run()
+{
+  uint32_t consecutive_failures = 0;
+  bool ready = false;
+
+  while (!stop_requested.load()) {
+    // Repeated failures usually mean the resume token fell off the oplog
+    if (consecutive_failures > 1 && resume_token) {
+      bson_destroy(resume_token);
+      resume_token = nullptr;
+    }
+
+    mongoc_client_t *client = mongoc_client_new(connection_string.c_str());
+    if (!client) {
+      mirror_counters.stream_errors++;
+      wait_for_retry();
+      continue;
+    }
+
+    mongoc_collection_t *collection = mongoc_client_get_collection(
+      client, database_name.c_str(), collection_name.c_str());
+
+    bson_t *pipeline = BCON_NEW(
+      "pipeline", "[",
+        "{", "$project", "{",
+          "operationType", BCON_INT32(1),
+          "documentKey", BCON_INT32(1),
+          "fullDocument", BCON_INT32(1),
+        "}", "}",
+      "]");
+
+    bson_t opts;
+    bson_init(&opts);
+    BSON_APPEND_INT64(&opts, "maxAwaitTimeMS", MONGODB_CHANGE_STREAM_MAX_AWAIT_MS);
+    BSON_APPEND_UTF8(&opts, "fullDocument", "updateLookup");
+    if (resume_token) {
+      BSON_APPEND_DOCUMENT(&opts, "resumeAfter", resume_token);
+    }
+
+    mongoc_change_stream_t *stream = mongoc_collection_watch(collection, pipeline, &opts);
+    bson_destroy(&opts);
+    bson_destroy(pipeline);
+
+    bson_error_t error;
+    const bson_t *error_doc;
+    bool stream_failed = mongoc_change_stream_error_document(stream, &error, &error_doc);
+
+    // The stream is open before the bootstrap starts, so nothing is missed
+    if (!stream_failed && !resume_token) {
+      if (ready) {
+        mirror_counters.mirrors_ready--;
+        ready = false;
+      }
+      reset_state();
+
+      const bson_t *token = mongoc_change_stream_get_resume_token(stream);
+      if (token) {
+        resume_token = bson_copy(token);
+      }
+
+      uint64_t bootstrap_started_ms = wall_clock_ms();
+      if (bootstrap()) {
+        last_synced_ms = bootstrap_started_ms;
+        publish();
+        mirror_counters.bootstraps++;
+        mirror_counters.mirrors_ready++;
+        ready = true;
+        fprintf(stderr, "MIRROR: Bootstrapped %s with %llu rows\n",
+                table_key.c_str(), (unsigned long long)live_rows.load());
+      } else {
+        snprintf(error.message, sizeof(error.message), "bootstrap scan failed");
+        stream_failed = true;
+        if (resume_token) {
+          bson_destroy(resume_token);
+          resume_token = nullptr;
+        }
+      }
+    }
+
+    uint32_t pending = 0;
+    while (!stream_failed && !stop_requested.load()) {
+      const bson_t *event;
+
+      if (mongoc_change_stream_next(stream, &event)) {
+        if (!apply_event(event)) {
+          // Collection dropped or renamed - rebuild from scratch
+          if (resume_token) {
+            bson_destroy(resume_token);
+            resume_token = nullptr;
+          }
+          break;
+        }
+        consecutive_failures = 0;
+        if (++pending >= MONGODB_MIRROR_PUBLISH_EVENTS) {
+          publish();
+          pending = 0;
+        }
+      } else if (mongoc_change_stream_error_document(stream, &error, &error_doc)) {
+        stream_failed = true;
+        break;
+      } else {
+        // Caught up with the stream
+        if (pending) {
+          publish();
+          pending = 0;
+        }
+        last_synced_ms = wall_clock_ms();
+      }
+
+      const bson_t *token = mongoc_change_stream_get_resume_token(stream);
+      if (token) {
+        if (resume_token) {
+          bson_destroy(resume_token);
+        }
+        resume_token = bson_copy(token);
+      }
+    }
+
+    // Applied changes are covered by the resume token, make them visible
+    if (pending) {
+      publish();
+    }
+
+    mongoc_change_stream_destroy(stream);
+    mongoc_collection_destroy(collection);
+    mongoc_client_destroy(client);
+
+    if (stream_failed) {
+      fprintf(stderr, "MIRROR: Stream error on %s: %s\n", table_key.c_str(), error.message);
+      mirror_counters.stream_errors++;
+      consecutive_failures++;
+      wait_for_retry();
+    }
+  }
+
+  if (ready) {
+    mirror_counters.mirrors_ready--;
+  }
+}
+
+void MongoCollectionMirror::reset_state()
+{
+  std::atomic_store_explicit(&published, std::shared_ptr<const MongoMirrorSnapshot>(),
+                             std::memory_order_release);
+  segments.clear();
+  dirty_segments.clear();
+  id_index.clear();
+  tail_dictionary.clear();
+  tail_segment = MONGODB_MIRROR_NO_TAIL;
+  dead_rows = 0;
+  live_rows = 0;
+  encoded_bytes = 0;
+  last_synced_ms = 0;
+}
+
+void MongoCollectionMirror::build_projection(bson_t *projection) const
+{
+  // The root column needs whole documents
+  if (root_column) {
+    return;
+  }
+
+  for (const auto &column : column_names) {
+    BSON_APPEND_INT32(projection, column.c_str(), 1);
+  }
+}
+
+/*
+  Split the _id space with $bucketAuto and scan the ranges in parallel,
+  each on its own client
+*/
+bool MongoCollectionMirror::bootstrap()
+{
+  mongoc_client_t *client = mongoc_client_new(connection_string.c_str());
+  if (!client) {
+    return false;
+  }
+
+  mongoc_collection_t *collection = mongoc_client_get_collection(
+    client, database_name.c_str(), collection_name.c_str());
+
+  bson_t *pipeline = BCON_NEW(
+    "pipeline", "[",
+      "{", "$bucketAuto", "{",
+        "groupBy", BCON_UTF8("$_id"),
+        "buckets", BCON_INT32(MONGODB_MIRROR_BOOTSTRAP_THREADS),
+      "}", "}",
+    "]");
+
+  mongoc_cursor_t *cursor = mongoc_collection_aggregate(
+    collection, MONGOC_QUERY_NONE, pipeline, nullptr, nullptr);
+  bson_destroy(pipeline);
+
+  std::vector<std::string> bounds;   // Lower bound of every bucket after the first
+  bool same_type = true;
+  bson_type_t bound_type = BSON_TYPE_EOD;
+  const bson_t *doc;
+
+  while (mongoc_cursor_next(cursor, &doc)) {
+    bson_iter_t iter;
+    bson_iter_t min;
+    if (bson_iter_init(&iter, doc) && bson_iter_find_descendant(&iter, "_id.min", &min)) {
+      bson_type_t type = bson_iter_type(&min);
+      bool numeric = type == BSON_TYPE_INT32 || type == BSON_TYPE_INT64 || type == BSON_TYPE_DOUBLE;
+      if (numeric) {
+        type = BSON_TYPE_DOUBLE;
+      }
+      if (bound_type != BSON_TYPE_EOD && bound_type != type) {
+        same_type = false;
+      }
+      bound_type = type;
+      bounds.push_back(encode_value(&min));
+    }
+  }
+
+  bson_error_t error;
+  if (mongoc_cursor_error(cursor, &error) || !same_type) {
+    bounds.clear(); // Fall back to a single scan
+  } else if (!bounds.empty()) {
+    bounds.erase(bounds.begin());
+  }
+  mongoc_cursor_destroy(cursor);
+  mongoc_collection_destroy(collection);
+  mongoc_client_destroy(client);
+
+  // Range filters: (-inf, b1), [b1, b2), ..., [bn, +inf), plus other _id types
+  std::vector<bson_t*> filters;
+  if (bounds.empty()) {
+    filters.push_back(bson_new());
+  } else {
+    for (size_t i = 0; i <= bounds.size(); i++) {
+      bson_t *filter = bson_new();
+      bson_t range;
+      bson_t wrapper;
+      bson_iter_t value;
+
+      BSON_APPEND_DOCUMENT_BEGIN(filter, "_id", &range);
+      if (i > 0 && decode_value(bounds[i - 1], &wrapper, &value)) {
+        bson_append_iter(&range, "$gte", 4, &value);
+      }
+      if (i < bounds.size() && decode_value(bounds[i], &wrapper, &value)) {
+        bson_append_iter(&range, "$lt", 3, &value);
+      }
+      bson_append_document_end(filter, &range);
+      filters.push_back(filter);
+    }
+
+    // Range operators only match their own type bracket
+    bson_t *other = bson_new();
+    bson_t not_clause;
+    bson_t type_clause;
+    BSON_APPEND_DOCUMENT_BEGIN(other, "_id", &not_clause);
+    BSON_APPEND_DOCUMENT_BEGIN(&not_clause, "$not", &type_clause);
+    if (bound_type == BSON_TYPE_DOUBLE) {
+      BSON_APPEND_UTF8(&type_clause, "$type", "number");
+    } else {
+      BSON_APPEND_INT32(&type_clause, "$type", (int32_t)bound_type);
+    }
+    bson_append_document_end(&not_clause, &type_clause);
+    bson_append_document_end(other, &not_clause);
+    filters.push_back(other);
+  }
+
+  std::vector<std::vector<std::shared_ptr<MongoMirrorSegment>>> results(filters.size());
+  std::vector<char> succeeded(filters.size(), 0);
+  std::vector<std::thread> scanners;
+
+  for (size_t i = 0; i < filters.size(); i++) {
+    scanners.emplace_back([this, &filters, &results, &succeeded, i] {
+      succeeded[i] = scan_range(filters[i], &results[i]);
+    });
+  }
+  for (auto &scanner : scanners) {
+    scanner.join();
+  }
+  for (bson_t *filter : filters) {
+    bson_destroy(filter);
+  }
+
+  for (char ok : succeeded) {
+    if (!ok) {
+      return false;
+    }
+  }
+
+  // Adopt the scanned segments and index them by _id
+  for (auto &range : results) {
+    for (auto &segment : range) {
+      size_t index = segments.size();
+      const MongoMirrorColumn &ids = segment->columns[0];
+      for (uint32_t row = 0; row < segment->row_count; row++) {
+        auto inserted = id_index.emplace(ids.dictionary[ids.codes[row]], make_row_ref(index, row));
+        if (!inserted.second) {
+          segment->deleted[row] = 1; // Duplicate across ranges - keep the first
+          segment->live_rows--;
+          dead_rows++;
+        }
+      }
+      segments.push_back(segment);
+    }
+  }
+
+  return !stop_requested.load();
+}
+
+bool MongoCollectionMirror::scan_range(const bson_t *filter,
+                                       std::vector<std::shared_ptr<MongoMirrorSegment>> *out)
+{
+  mongoc_client_t *client = mongoc_client_new(connection_string.c_str());
+  if (!client) {
+    return false;
+  }
+
+  mongoc_collection_t *collection = mongoc_client_get_collection(
+    client, database_name.c_str(), collection_name.c_str());
+
+  bson_t opts;
+  bson_t projection;
+  bson_init(&opts);
+  if (!root_column) {
+    BSON_APPEND_DOCUMENT_BEGIN(&opts, "projection", &projection);
+    build_projection(&projection);
+    bson_append_document_end(&opts, &projection);
+  }
+  BSON_APPEND_INT32(&opts, "batchSize", 1000);
+
+  mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(collection, filter, &opts, nullptr);
+  bson_destroy(&opts);
+
+  std::shared_ptr<MongoMirrorSegment> segment;
+  std::vector<std::unordered_map<std::string, uint32_t>> dictionary_index;
+  const bson_t *doc;
+
+  while (!stop_requested.load() && mongoc_cursor_next(cursor, &doc)) {
+    if (!segment || segment->row_count >= MONGODB_MIRROR_SEGMENT_ROWS) {
+      segment = std::make_shared<MongoMirrorSegment>(column_names.size());
+      dictionary_index.assign(column_names.size(), {});
+      out->push_back(segment);
+    }
+    append_document(segment.get(), &dictionary_index, column_names, doc);
+  }
+
+  bson_error_t error;
+  bool ok = !mongoc_cursor_error(cursor, &error);
+  if (!ok) {
+    fprintf(stderr, "MIRROR: Bootstrap scan of %s failed: %s\n", table_key.c_str(), error.message);
+  }
+
+  mongoc_cursor_destroy(cursor);
+  mongoc_collection_destroy(collection);
+  mongoc_client_destroy(client);
+  return ok;
+}
+
+/*
+  Apply one change event; returns false when the mirror must be rebuilt
+*/
+bool MongoCollectionMirror::apply_event(const bson_t *event)
+{
+  bson_iter_t iter;
+  if (!bson_iter_init_find(&iter, event, "operationType") || !BSON_ITER_HOLDS_UTF8(&iter)) {
+    return true;
+  }
+
+  const char *operation = bson_iter_utf8(&iter, nullptr);
+  mirror_counters.events_applied++;
+
+  if (strcmp(operation, "drop") == 0 || strcmp(operation, "rename") == 0 ||
+      strcmp(operation, "dropDatabase") == 0 || strcmp(operation, "invalidate") == 0) {
+    return false;
+  }
+
+  bool upsert = strcmp(operation, "insert") == 0 || strcmp(operation, "replace") == 0 ||
+                strcmp(operation, "update") == 0;
+  if (!upsert && strcmp(operation, "delete") != 0) {
+    return true; // Index builds and other DDL don't touch rows
+  }
+
+  bson_iter_t doc_iter;
+  if (upsert && bson_iter_init_find(&doc_iter, event, "fullDocument") &&
+      BSON_ITER_HOLDS_DOCUMENT(&doc_iter)) {
+    const uint8_t *data;
+    uint32_t len;
+    bson_t full_document;
+    bson_iter_document(&doc_iter, &len, &data);
+    if (bson_init_static(&full_document, data, len)) {
+      upsert_document(&full_document);
+    }
+    return true;
+  }
+
+  // Deletes, and updates of documents deleted before the lookup
+  bson_iter_t id_iter;
+  if (bson_iter_init(&iter, event) && bson_iter_find_descendant(&iter, "documentKey._id", &id_iter)) {
+    delete_document(encode_value(&id_iter));
+  }
+  return true;
+}
+
+/*
+  Copy a published segment before its first change in this batch
+*/
+MongoMirrorSegment *MongoCollectionMirror::writable_segment(size_t index)
+{
+  auto it = dirty_segments.find(index);
+  if (it != dirty_segments.end()) {
+    return it->second.get();
+  }
+
+  auto copy = std::make_shared<MongoMirrorSegment>(*segments[index]);
+  dirty_segments[index] = copy;
+  segments[index] = copy;
+  return copy.get();
+}
+
+void MongoCollectionMirror::upsert_document(const bson_t *doc)
+{
+  bson_iter_t id_iter;
+  if (!bson_iter_init_find(&id_iter, doc, "_id")) {
+    return;
+  }
+
+  std::string encoded_id = encode_value(&id_iter);
+  delete_document(encoded_id);
+
+  if (tail_segment == MONGODB_MIRROR_NO_TAIL ||
+      segments[tail_segment]->row_count >= MONGODB_MIRROR_SEGMENT_ROWS) {
+    auto segment = std::make_shared<MongoMirrorSegment>(column_names.size());
+    tail_segment = segments.size();
+    segments.push_back(segment);
+    dirty_segments[tail_segment] = segment;
+    tail_dictionary.assign(column_names.size(), {});
+  }
+
+  MongoMirrorSegment *segment = writable_segment(tail_segment);
+  uint32_t row = segment->row_count;
+  append_document(segment, &tail_dictionary, column_names, doc);
+  id_index[encoded_id] = make_row_ref(tail_segment, row);
+  live_rows++;
+}
+
+void MongoCollectionMirror::delete_document(const std::string &encoded_id)
+{
+  auto it = id_index.find(encoded_id);
+  if (it == id_index.end()) {
+    return;
+  }
+
+  MongoMirrorSegment *segment = writable_segment((size_t)(it->second >> 32));
+  uint32_t row = (uint32_t)it->second;
+  if (!segment->deleted[row]) {
+    segment->deleted[row] = 1;
+    segment->live_rows--;
+    dead_rows++;
+    live_rows--;
+  }
+  id_index.erase(it);
+}
+
+/*
+  Publish the current segments as a new snapshot
+*/
+void MongoCollectionMirror::publish()
+{
+  if (dead_rows > MONGODB_MIRROR_SEGMENT_ROWS && dead_rows > live_rows.load()) {
+    compact();
+  }
+
+  auto snapshot = std::make_shared<MongoMirrorSnapshot>();
+  snapshot->column_names = column_names;
+  snapshot->segments = segments;
+  for (const auto &segment : segments) {
+    snapshot->live_rows += segment->live_rows;
+    snapshot->encoded_bytes += segment->encoded_bytes;
+  }
+
+  live_rows = snapshot->live_rows;
+  encoded_bytes = snapshot->encoded_bytes;
+  dirty_segments.clear();
+
+  std::atomic_store_explicit(&published, std::shared_ptr<const MongoMirrorSnapshot>(snapshot),
+                             std::memory_order_release);
+}
+
+/*
+  Rewrite live rows into fresh segments, dropping tombstones and unused
+  dictionary entries
+*/
+void MongoCollectionMirror::compact()
+{
+  std::vector<std::shared_ptr<const MongoMirrorSegment>> compacted;
+  std::shared_ptr<MongoMirrorSegment> current;
+  std::vector<std::unordered_map<std::string, uint32_t>> dictionary_index;
+
+  id_index.clear();
+
+  for (const auto &segment : segments) {
+    for (uint32_t row = 0; row < segment->row_count; row++) {
+      if (segment->deleted[row]) {
+        continue;
+      }
+
+      if (!current || current->row_count >= MONGODB_MIRROR_SEGMENT_ROWS) {
+        if (current) {
+          compacted.push_back(current);
+        }
+        current = std::make_shared<MongoMirrorSegment>(column_names.size());
+        dictionary_index.assign(column_names.size(), {});
+      }
+
+      for (size_t c = 0; c < column_names.size(); c++) {
+        const MongoMirrorColumn &column = segment->columns[c];
+        append_encoded(current.get(), c, &dictionary_index[c],
+                       column_names[c] == MONGODB_MIRROR_ROOT_COLUMN,
+                       column.dictionary[column.codes[row]]);
+      }
+      current->deleted.push_back(0);
+      current->live_rows++;
+
+      const MongoMirrorColumn &ids = segment->columns[0];
+      id_index[ids.dictionary[ids.codes[row]]] = make_row_ref(compacted.size(), current->row_count);
+      current->row_count++;
+    }
+  }
+
+  if (current) {
+    compacted.push_back(current);
+  }
+
+  segments.swap(compacted);
+  dirty_segments.clear();
+  tail_dictionary.clear();
+  tail_segment = MONGODB_MIRROR_NO_TAIL;
+  dead_rows = 0;
+  mirror_counters.compactions++;
+}
+
+/*
+  Filter evaluation on dictionary codes
+*/
+enum mirror_predicate_op {
+  MIRROR_OP_EQ,
+  MIRROR_OP_NE,
+  MIRROR_OP_GT,
+  MIRROR_OP_GTE,
+  MIRROR_OP_LT,
+  MIRROR_OP_LTE,
+  MIRROR_OP_IN,
+  MIRROR_OP_NIN,
+  MIRROR_OP_NOT_ARRAY         // {$not: {$type: "array"}}
+};
+
+struct MongoMirrorPredicate {
+  size_t column;
+  mirror_predicate_op op;
+  std::vector<bson_iter_t> values;   // Point into the filter document
+};
+
+static bool is_numeric_type(bson_type_t type)
+{
+  return type == BSON_TYPE_INT32 || type == BSON_TYPE_INT64 || type == BSON_TYPE_DOUBLE;
+}
+
+static bool is_supported_operand(const bson_iter_t *iter)
+{
+  switch (bson_iter_type(iter)) {
+    case BSON_TYPE_DOUBLE:
+      return !std::isnan(bson_iter_double(iter));
+    case BSON_TYPE_INT32:
+    case BSON_TYPE_INT64:
+    case BSON_TYPE_UTF8:
+    case BSON_TYPE_BOOL:
+    case BSON_TYPE_NULL:
+    case BSON_TYPE_OID:
+    case BSON_TYPE_DATE_TIME:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/*
+  Can compare_values() decide every comparison of this stored value against
+  a supported operand? Documents never equal or order against a scalar, but
+  e.g. Decimal128 does and compare_values() cannot tell how.
+*/
+static bool is_comparable_value(const bson_iter_t *iter)
+{
+  if (BSON_ITER_HOLDS_DOCUMENT(iter)) {
+    return true;
+  }
+
+  if (BSON_ITER_HOLDS_ARRAY(iter)) {
+    bson_iter_t element;
+    if (!bson_iter_recurse(iter, &element)) {
+      return false;
+    }
+    while (bson_iter_next(&element)) {
+      if (!BSON_ITER_HOLDS_ARRAY(&element) && !is_comparable_value(&element)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  return is_supported_operand(iter);
+}
+
+/*
+  Compare two scalars the way MongoDB does within a type bracket
+  (binary string comparison, i.e. the simple collation); returns false
+  when they are not comparable
+*/
+static bool compare_values(const bson_iter_t *a, const bson_iter_t *b, int *result)
+{
+  bson_type_t ta = bson_iter_type(a);
+  bson_type_t tb = bson_iter_type(b);
+
+  if (is_numeric_type(ta) && is_numeric_type(tb)) {
+    if (ta != BSON_TYPE_DOUBLE && tb != BSON_TYPE_DOUBLE) {
+      int64_t x = bson_iter_as_int64(a);
+      int64_t y = bson_iter_as_int64(b);
+      *result = x < y ? -1 : (x > y ? 1 : 0);
+      return true;
+    }
+    double x = bson_iter_as_double(a);
+    double y = bson_iter_as_double(b);
+    if (std::isnan(x) || std::isnan(y)) {
+      return false;
+    }
+    *result = x < y ? -1 : (x > y ? 1 : 0);
+    return true;
+  }
+
+  if (ta != tb) {
+    return false;
+  }
+
+  switch (ta) {
+    case BSON_TYPE_UTF8:
+    {
+      uint32_t la, lb;
+      const char *sa = bson_iter_utf8(a, &la);
+      const char *sb = bson_iter_utf8(b, &lb);
+      int cmp = memcmp(sa, sb, la < lb ? la : lb);
+      *result = cmp ? cmp : (la < lb ? -1 : (la > lb ? 1 : 0));
+      return true;
+    }
+    case BSON_TYPE_BOOL:
+      *result = (int)bson_iter_bool(a) - (int)bson_iter_bool(b);
+      return true;
+    case BSON_TYPE_NULL:
+      *result = 0;
+      return true;
+    case BSON_TYPE_OID:
+      *result = bson_oid_compare(bson_iter_oid(a), bson_iter_oid(b));
+      return true;
+    case BSON_TYPE_DATE_TIME:
+    {
+      int64_t x = bson_iter_date_time(a);
+      int64_t y = bson_iter_date_time(b);
+      *result = x < y ? -1 : (x > y ? 1 : 0);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+static bool scalar_matches(const bson_iter_t *value, mirror_predicate_op op, const bson_iter_t *operand)
+{
+  int cmp;
+  if (!compare_values(value, operand, &cmp)) {
+    return false;
+  }
+
+  switch (op) {
+    case MIRROR_OP_EQ:  return cmp == 0;
+    case MIRROR_OP_GT:  return cmp > 0;
+    case MIRROR_OP_GTE: return cmp >= 0;
+    case MIRROR_OP_LT:  return cmp < 0;
+    case MIRROR_OP_LTE: return cmp <= 0;
+    default:            return false;
+  }
+}
+
+/*
+  Does a stored value (nullptr when the field is missing) satisfy one
+  operand? Arrays match if any element does.
+*/
+static bool value_matches(const bson_iter_t *value, mirror_predicate_op op, const bson_iter_t *operand)
+{
+  bool null_operand = bson_iter_type(operand) == BSON_TYPE_NULL;
+
+  if (!value) {
+    return op == MIRROR_OP_EQ && null_operand;
+  }
+
+  if (BSON_ITER_HOLDS_ARRAY(value)) {
+    bson_iter_t element;
+    if (bson_iter_recurse(value, &element)) {
+      while (bson_iter_next(&element)) {
+        if (scalar_matches(&element, op, operand)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  return scalar_matches(value, op, operand);
+}
+
+static bool predicate_matches(const bson_iter_t *value, const MongoMirrorPredicate &predicate)
+{
+  switch (predicate.op) {
+    case MIRROR_OP_NE:
+      return !value_matches(value, MIRROR_OP_EQ, &predicate.values[0]);
+    case MIRROR_OP_NOT_ARRAY:
+      return !value || !BSON_ITER_HOLDS_ARRAY(value);
+    case MIRROR_OP_IN:
+    case MIRROR_OP_NIN:
+    {
+      bool found = false;
+      for (const auto &operand : predicate.values) {
+        if (value_matches(value, MIRROR_OP_EQ, &operand)) {
+          found = true;
+          break;
+        }
+      }
+      return predicate.op == MIRROR_OP_IN ? found : !found;
+    }
+    default:
+      return value_matches(value, predicate.op, &predicate.values[0]);
+  }
+}
+
+static bool find_column(const MongoMirrorSnapshot &snapshot, const char *name, size_t *column)
+{
+  for (size_t c = 0; c < snapshot.column_names.size(); c++) {
+    if (snapshot.column_names[c] == name && snapshot.column_names[c] != MONGODB_MIRROR_ROOT_COLUMN) {
+      *column = c;
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+  Parse an implicit-AND filter of top-level comparisons; anything else is
+  rejected so the mirror never returns a different result than MongoDB.
+  Stored values compare_values() cannot order are rejected while scanning.
+*/
+static bool parse_filter(const MongoMirrorSnapshot &snapshot, bson_iter_t *iter,
+                         std::vector<MongoMirrorPredicate> *predicates)
+{
+  static const struct { const char *name; mirror_predicate_op op; } operators[] = {
+    {"$eq", MIRROR_OP_EQ}, {"$ne", MIRROR_OP_NE}, {"$gt", MIRROR_OP_GT},
+    {"$gte", MIRROR_OP_GTE}, {"$lt", MIRROR_OP_LT}, {"$lte", MIRROR_OP_LTE},
+    {"$in", MIRROR_OP_IN}, {"$nin", MIRROR_OP_NIN}
+  };
+
+  while (bson_iter_next(iter)) {
+    const char *key = bson_iter_key(iter);
+
+    if (strcmp(key, "$and") == 0) {
+      bson_iter_t clauses;
+      if (!BSON_ITER_HOLDS_ARRAY(iter) || !bson_iter_recurse(iter, &clauses)) {
+        return false;
+      }
+      while (bson_iter_next(&clauses)) {
+        bson_iter_t clause;
+        if (!BSON_ITER_HOLDS_DOCUMENT(&clauses) || !bson_iter_recurse(&clauses, &clause) ||
+            !parse_filter(snapshot, &clause, predicates)) {
+          return false;
+        }
+      }
+      continue;
+    }
+
+    size_t column;
+    if (key[0] == '$' || !find_column(snapshot, key, &column)) {
+      return false;
+    }
+
+    if (!BSON_ITER_HOLDS_DOCUMENT(iter)) {
+      if (!is_supported_operand(iter)) {
+        return false;
+      }
+      predicates->push_back(MongoMirrorPredicate{column, MIRROR_OP_EQ, {*iter}});
+      continue;
+    }
+
+    bson_iter_t op_iter;
+    bool any = false;
+    if (!bson_iter_recurse(iter, &op_iter)) {
+      return false;
+    }
+    while (bson_iter_next(&op_iter)) {
+      const char *op_name = bson_iter_key(&op_iter);
+      MongoMirrorPredicate predicate;
+      bool known = false;
+
+      predicate.column = column;
+      if (strcmp(op_name, "$not") == 0) {
+        // Only the array exclusion of pushed stored-column predicates
+        bson_iter_t type;
+        if (!BSON_ITER_HOLDS_DOCUMENT(&op_iter) || !bson_iter_recurse(&op_iter, &type) ||
+            !bson_iter_next(&type) || strcmp(bson_iter_key(&type), "$type") != 0 ||
+            !BSON_ITER_HOLDS_UTF8(&type) || strcmp(bson_iter_utf8(&type, nullptr), "array") != 0 ||
+            bson_iter_next(&type)) {
+          return false;
+        }
+        predicate.op = MIRROR_OP_NOT_ARRAY;
+        predicates->push_back(predicate);
+        any = true;
+        continue;
+      }
+      for (const auto &candidate : operators) {
+        if (strcmp(op_name, candidate.name) == 0) {
+          predicate.op = candidate.op;
+          known = true;
+          break;
+        }
+      }
+      if (!known) {
+        return false;
+      }
+
+      if (predicate.op == MIRROR_OP_IN || predicate.op == MIRROR_OP_NIN) {
+        bson_iter_t element;
+        if (!BSON_ITER_HOLDS_ARRAY(&op_iter) || !bson_iter_recurse(&op_iter, &element)) {
+          return false;
+        }
+        while (bson_iter_next(&element)) {
+          if (!is_supported_operand(&element)) {
+            return false;
+          }
+          predicate.values.push_back(element);
+        }
+      } else {
+        // Range comparisons against null have bracket rules of their own
+        bool range = predicate.op != MIRROR_OP_EQ && predicate.op != MIRROR_OP_NE;
+        if (!is_supported_operand(&op_iter) || (range && BSON_ITER_HOLDS_NULL(&op_iter))) {
+          return false;
+        }
+        predicate.values.push_back(op_iter);
+      }
+
+      predicates->push_back(predicate);
+      any = true;
+    }
+    if (!any) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool mongodb_mirror_select_rows(const MongoMirrorSnapshot &snapshot, const bson_t *filter,
+                                std::vector<uint64_t> *rows)
+{
+  std::vector<MongoMirrorPredicate> predicates;
+  bson_iter_t iter;
+
+  if (filter && (!bson_iter_init(&iter, filter) || !parse_filter(snapshot, &iter, &predicates))) {
+    return false;
+  }
+
+  rows->clear();
+  rows->reserve((size_t)snapshot.live_rows);
+
+  std::vector<uint8_t> selected;
+  std::vector<uint8_t> code_matches;
+
+  for (size_t s = 0; s < snapshot.segments.size(); s++) {
+    const MongoMirrorSegment &segment = *snapshot.segments[s];
+    if (!segment.live_rows) {
+      continue;
+    }
+
+    selected.resize(segment.row_count);
+    for (uint32_t row = 0; row < segment.row_count; row++) {
+      selected[row] = !segment.deleted[row];
+    }
+
+    for (const auto &predicate : predicates) {
+      const MongoMirrorColumn &column = segment.columns[predicate.column];
+
+      // Evaluate once per distinct value, then filter rows by code
+      code_matches.assign(column.dictionary.size(), 0);
+      for (size_t code = 0; code < column.dictionary.size(); code++) {
+        bson_t wrapper;
+        bson_iter_t value;
+        bool present = code != MONGODB_MIRROR_MISSING_CODE &&
+                       decode_value(column.dictionary[code], &wrapper, &value);
+        if (present && predicate.op != MIRROR_OP_NOT_ARRAY && !is_comparable_value(&value)) {
+          rows->clear();
+          return false; // MongoDB may match it where compare_values() cannot
+        }
+        code_matches[code] = predicate_matches(present ? &value : nullptr, predicate);
+      }
+
+      const uint32_t *codes = column.codes.data();
+      const uint8_t *matches = code_matches.data();
+      uint8_t *sel = selected.data();
+      for (uint32_t row = 0; row < segment.row_count; row++) {
+        sel[row] &= matches[codes[row]];
+      }
+    }
+
+    for (uint32_t row = 0; row < segment.row_count; row++) {
+      if (selected[row]) {
+        rows->push_back(make_row_ref(s, row));
+      }
+    }
+  }
+
+  return true;
+}
+
+/*
+  Rebuild a (projected) document for one row, for the regular row conversion
+*/
+void mongodb_mirror_build_document(const MongoMirrorSnapshot &snapshot, uint64_t row_ref,
+                                   bson_t *doc)
+{
+  const MongoMirrorSegment &segment = *snapshot.segments[(size_t)(row_ref >> 32)];
+  uint32_t row = (uint32_t)row_ref;
+
+  for (size_t c = 0; c < snapshot.column_names.size(); c++) {
+    const MongoMirrorColumn &column = segment.columns[c];
+    const std::string &encoded = column.dictionary[column.codes[row]];
+    if (encoded.empty()) {
+      continue;
+    }
+
+    bson_t stored;
+    if (snapshot.column_names[c] == MONGODB_MIRROR_ROOT_COLUMN) {
+      // The whole document already carries every other column
+      if (bson_init_static(&stored, (const uint8_t*)encoded.data(), encoded.size())) {
+        bson_reinit(doc);
+        bson_concat(doc, &stored);
+      }
+      return;
+    }
+
+    bson_iter_t value;
+    if (decode_value(encoded, &stored, &value)) {
+      const std::string &name = snapshot.column_names[c];
+      bson_append_iter(doc, name.c_str(), (int)name.size(), &value);
+    }
+  }
+}
+
+/*
+  Global helper functions
+*/
+MongoCollectionMirror* get_or_create_collection_mirror(const std::string &connection_string,
+                                                       const std::string &database_name,
+                                                       const std::string &collection_name,
+                                                       const std::vector<std::string> &columns)
+{
+  std::string key = connection_string + "/" + collection_name + "#";
+  for (const auto &column : columns) {
+    key += column;
+    key += ',';
+  }
+
+  return global_collection_mirrors.get_or_create(key, [&] {
+    auto mirror = std::make_shared<MongoCollectionMirror>(
+      connection_string, database_name, collection_name, columns);
+    mirror->start();
+    return mirror;
+  });
+}
+
+void cleanup_all_collection_mirrors()
+{
+  // Join worker threads outside the registry lock
+  for (auto &mirror : global_collection_mirrors.take_all()) {
+    mirror->stop();
+  }
+}
+
+uint64_t mongodb_mirror_max_freshness_lag_ms()
+{
+  uint64_t max_lag = 0;
+  global_collection_mirrors.for_each([&max_lag](MongoCollectionMirror &mirror) {
+    uint64_t lag = mirror.get_freshness_lag_ms();
+    if (lag > max_lag) {
+      max_lag = lag;
+    }
+  });
+  return max_lag;
+}
+
+uint64_t mongodb_mirror_total_rows()
+{
+  uint64_t rows = 0;
+  global_collection_mirrors.for_each([&rows](MongoCollectionMirror &mirror) {
+    rows += mirror.get_live_rows();
+  });
+  return rows;
+}
+
+size_t mongodb_mirror_total_bytes()
+{
+  size_t bytes = 0;
+  global_collection_mirrors.for_each([&bytes](MongoCollectionMirror &mirror) {
+    bytes += mirror.get_encoded_bytes();
+  });
+  return bytes;
+}
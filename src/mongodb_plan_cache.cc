@@ -0,0 +1,164 @@
+/*
+  MongoDB Filter Plan Cache Implementation
+
+  A plan is checked against the translation it came from: walking the
+  filter, its numeric values must be exactly the recorded constants in
+  order. Anything else (a folded bound, a number derived from a date)
+  would not follow the constant when it changes.
+*/
+
+#include "mongodb_plan_cache.h"
+#include <cstring>
+
+MongoFilterPlanCounters filter_plan_counters;
+
+static bool same_number(const bson_value_t *a, const bson_value_t *b)
+{
+  if (a->value_type != b->value_type) {
+    return false;
+  }
+  if (a->value_type == BSON_TYPE_INT64) {
+    return a->value.v_int64 == b->value.v_int64;
+  }
+  // Bitwise, so -0.0 and NaN are told apart
+  return memcmp(&a->value.v_double, &b->value.v_double, sizeof(double)) == 0;
+}
+
+static bool collect_slots(bson_iter_t *iter, const uint8_t *data,
+                          const std::vector<MongoFilterParam> &params, size_t *next,
+                          std::vector<MongoFilterSlot> *slots)
+{
+  while (bson_iter_next(iter)) {
+    bson_type_t type = bson_iter_type(iter);
+    if (type == BSON_TYPE_DOCUMENT || type == BSON_TYPE_ARRAY) {
+      bson_iter_t child;
+      if (!bson_iter_recurse(iter, &child) || !collect_slots(&child, data, params, next, slots)) {
+        return false;
+      }
+      continue;
+    }
+    if (type != BSON_TYPE_INT64 && type != BSON_TYPE_DOUBLE) {
+      continue;
+    }
+    if (*next == params.size() || !same_number(bson_iter_value(iter), &params[*next].value)) {
+      return false;
+    }
+
+    // The value follows the element's key and its terminating NUL
+    const char *key = bson_iter_key(iter);
+    const uint8_t *value = (const uint8_t*)key + strlen(key) + 1;
+    MongoFilterSlot slot;
+    slot.offset = (uint32_t)(value - data);
+    slot.constant = params[*next].constant;
+    slot.type = type;
+    slots->push_back(slot);
+    (*next)++;
+  }
+  return true;
+}
+
+bool mongodb_filter_plan_build(const bson_t *filter, const std::vector<MongoFilterParam> &params,
+                               uint32_t constants, bool exact, MongoFilterPlan *plan)
+{
+  const uint8_t *data = bson_get_data(filter);
+  bson_iter_t iter;
+  size_t next = 0;
+  std::vector<MongoFilterSlot> slots;
+  if (!bson_iter_init(&iter, filter) || !collect_slots(&iter, data, params, &next, &slots) ||
+      next != params.size()) {
+    return false;
+  }
+
+  std::vector<bool> used(constants, false);
+  for (const MongoFilterSlot &slot : slots) {
+    if (slot.constant >= constants) {
+      return false;
+    }
+    used[slot.constant] = true;
+  }
+  for (bool u : used) {
+    if (!u) {
+      return false;
+    }
+  }
+
+  plan->filter.assign((const char*)data, filter->len);
+  plan->slots.swap(slots);
+  plan->constants = constants;
+  plan->exact = exact;
+  return true;
+}
+
+bool mongodb_filter_plan_apply(const MongoFilterPlan &plan, const std::vector<bson_value_t> &values,
+                               bson_t *filter)
+{
+  if (values.size() != plan.constants) {
+    return false;
+  }
+  for (const MongoFilterSlot &slot : plan.slots) {
+    if (values[slot.constant].value_type != slot.type) {
+      return false;
+    }
+  }
+
+  uint8_t *data = bson_reserve_buffer(filter, (uint32_t)plan.filter.size());
+  if (!data) {
+    return false;
+  }
+  memcpy(data, plan.filter.data(), plan.filter.size());
+  for (const MongoFilterSlot &slot : plan.slots) {
+    const bson_value_t &value = values[slot.constant];
+    if (slot.type == BSON_TYPE_INT64) {
+      uint64_t le = BSON_UINT64_TO_LE((uint64_t)value.value.v_int64);
+      memcpy(data + slot.offset, &le, sizeof(le));
+    } else {
+      double le = BSON_DOUBLE_TO_LE(value.value.v_double);
+      memcpy(data + slot.offset, &le, sizeof(le));
+    }
+  }
+  return true;
+}
+
+std::shared_ptr<const MongoFilterPlan> MongoFilterPlanCache::lookup(const std::string &fingerprint)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto it = index.find(fingerprint);
+  if (it == index.end()) {
+    filter_plan_counters.misses++;
+    return nullptr;
+  }
+
+  lru.splice(lru.begin(), lru, it->second);
+  filter_plan_counters.hits++;
+  return it->second->plan;
+}
+
+void MongoFilterPlanCache::insert(const std::string &fingerprint,
+                                  std::shared_ptr<const MongoFilterPlan> plan)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto it = index.find(fingerprint);
+  if (it != index.end()) {
+    it->second->plan = plan;
+    lru.splice(lru.begin(), lru, it->second);
+    return;
+  }
+
+  lru.push_front(Entry{fingerprint, plan});
+  index[fingerprint] = lru.begin();
+  filter_plan_counters.inserts++;
+
+  while (lru.size() > MONGODB_FILTER_PLAN_ENTRIES) {
+    index.erase(lru.back().fingerprint);
+    lru.pop_back();
+    filter_plan_counters.evictions++;
+  }
+}
+
+size_t MongoFilterPlanCache::size()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return lru.size();
+}
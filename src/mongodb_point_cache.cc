@@ -0,0 +1,142 @@
+/*
+  MongoDB Point Lookup Cache Implementation
+
+  Each shard has its own lock, LRU list and share of the byte budget, so
+  concurrent lookups of different keys rarely contend.
+*/
+
+#include "mongodb_point_cache.h"
+#include "mongodb_registry.h"
+#include <functional>
+#include <iterator>
+
+// Global cache storage
+static MongoRegistry<MongoPointCache> global_point_caches;
+
+MongoPointCacheCounters point_cache_counters;
+
+MongoPointCache::MongoPointCache()
+  : generation(0),
+    used_bytes(0)
+{
+}
+
+MongoPointCache::Shard &MongoPointCache::shard_for(const std::string &key)
+{
+  return shards[std::hash<std::string>()(key) % MONGODB_POINT_CACHE_SHARDS];
+}
+
+/*
+  Caller must hold the shard mutex
+*/
+void MongoPointCache::erase_entry(Shard &shard, std::list<Entry>::iterator it)
+{
+  size_t size = it->key.size() + it->document->size();
+  shard.used_bytes -= size;
+  used_bytes -= size;
+  shard.index.erase(it->key);
+  shard.lru.erase(it);
+}
+
+std::shared_ptr<const std::string> MongoPointCache::lookup(const std::string &key)
+{
+  Shard &shard = shard_for(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) {
+    point_cache_counters.misses++;
+    return nullptr;
+  }
+
+  // Expired, or the collection changed since the document was cached
+  if (it->second->generation != generation.load() ||
+      std::chrono::steady_clock::now() >= it->second->expires_at) {
+    erase_entry(shard, it->second);
+    point_cache_counters.misses++;
+    return nullptr;
+  }
+
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  point_cache_counters.hits++;
+  return it->second->document;
+}
+
+/*
+  Insert a fetched document. `generation` must be read before the fetch so
+  a change that raced with it rejects the insert.
+*/
+bool MongoPointCache::insert(const std::string &key, const bson_t *document, uint64_t fetch_generation,
+                             size_t capacity, uint32_t ttl_seconds)
+{
+  size_t shard_capacity = capacity / MONGODB_POINT_CACHE_SHARDS;
+  size_t size = key.size() + document->len;
+
+  if (size > shard_capacity || fetch_generation != generation.load()) {
+    return false;
+  }
+
+  auto bytes = std::make_shared<const std::string>((const char*)bson_get_data(document), document->len);
+
+  Shard &shard = shard_for(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  auto existing = shard.index.find(key);
+  if (existing != shard.index.end()) {
+    erase_entry(shard, existing->second);
+  }
+
+  while (shard.used_bytes + size > shard_capacity && !shard.lru.empty()) {
+    erase_entry(shard, std::prev(shard.lru.end()));
+    point_cache_counters.evictions++;
+  }
+
+  shard.lru.push_front(Entry{key, bytes, fetch_generation,
+                             std::chrono::steady_clock::now() + std::chrono::seconds(ttl_seconds)});
+  shard.index[key] = shard.lru.begin();
+  shard.used_bytes += size;
+  used_bytes += size;
+  point_cache_counters.inserts++;
+
+  return true;
+}
+
+void MongoPointCache::invalidate()
+{
+  generation++;
+  point_cache_counters.invalidations++;
+}
+
+/*
+  Global helper functions
+*/
+MongoPointCache* get_or_create_point_cache(const std::string &connection_string,
+                                           const std::string &collection_name)
+{
+  return global_point_caches.get_or_create(connection_string + "/" + collection_name, [] {
+    return std::make_shared<MongoPointCache>();
+  });
+}
+
+void invalidate_point_cache(const std::string &connection_string,
+                            const std::string &collection_name)
+{
+  MongoPointCache *cache = global_point_caches.find(connection_string + "/" + collection_name);
+  if (cache) {
+    cache->invalidate();
+  }
+}
+
+void cleanup_all_point_caches()
+{
+  global_point_caches.take_all();
+}
+
+size_t mongodb_point_cache_total_bytes()
+{
+  size_t bytes = 0;
+  global_point_caches.for_each([&bytes](MongoPointCache &cache) {
+    bytes += cache.get_used_bytes();
+  });
+  return bytes;
+}
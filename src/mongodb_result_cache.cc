@@ -0,0 +1,172 @@
+/*
+  MongoDB Result Cache Implementation
+
+  LRU cache of converted rows keyed by table identity and the exact BSON
+  filter and find options sent to MongoDB. Invalidation bumps a per-table
+  generation; stale entries are dropped lazily on lookup or by eviction.
+*/
+
+#include "mongodb_result_cache.h"
+#include <iterator>
+
+MongoResultCache mongodb_result_cache;
+
+MongoResultCache::MongoResultCache()
+  : capacity(0),
+    used_bytes(0),
+    hits(0),
+    misses(0),
+    inserts(0),
+    evictions(0),
+    invalidations(0),
+    rescan_hits(0),
+    rescan_inserts(0)
+{
+}
+
+std::shared_ptr<const MongoCachedResult> MongoResultCache::lookup(const std::string &key)
+{
+  std::lock_guard<std::mutex> lock(cache_mutex);
+
+  auto it = index.find(key);
+  if (it == index.end()) {
+    misses++;
+    return nullptr;
+  }
+
+  std::shared_ptr<const MongoCachedResult> result = it->second->result;
+
+  // Expired, or the table changed since the scan was cached
+  auto generation = table_generations.find(result->table_id);
+  bool stale = generation != table_generations.end() &&
+               generation->second != result->generation;
+  if (stale || std::chrono::steady_clock::now() >= result->expires_at) {
+    erase_entry(it->second);
+    misses++;
+    return nullptr;
+  }
+
+  // Move to the front of the LRU list
+  lru.splice(lru.begin(), lru, it->second);
+  hits++;
+  return result;
+}
+
+/*
+  Insert a complete scan result. Rejected when the cache is disabled, the
+  entry is too large, or the table was invalidated while the scan ran.
+*/
+bool MongoResultCache::insert(const std::string &key, std::shared_ptr<const MongoCachedResult> result)
+{
+  if (!result) {
+    return false;
+  }
+
+  size_t size = result->memory_size() + key.size();
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+
+  if (capacity == 0 || size > capacity / MONGODB_RESULT_CACHE_MAX_ENTRY_FRACTION) {
+    return false;
+  }
+
+  auto generation = table_generations.find(result->table_id);
+  uint64_t current = generation != table_generations.end() ? generation->second : 0;
+  if (current != result->generation) {
+    return false; // Data changed mid-scan
+  }
+
+  auto existing = index.find(key);
+  if (existing != index.end()) {
+    erase_entry(existing->second);
+  }
+
+  evict_to(capacity - size);
+
+  lru.push_front(Entry{key, std::move(result)});
+  index[key] = lru.begin();
+  used_bytes += size;
+  inserts++;
+
+  return true;
+}
+
+uint64_t MongoResultCache::table_generation(const std::string &table_id)
+{
+  std::lock_guard<std::mutex> lock(cache_mutex);
+
+  auto it = table_generations.find(table_id);
+  return it != table_generations.end() ? it->second : 0;
+}
+
+void MongoResultCache::invalidate_table(const std::string &table_id)
+{
+  std::lock_guard<std::mutex> lock(cache_mutex);
+
+  table_generations[table_id]++;
+  invalidations++;
+}
+
+void MongoResultCache::clear()
+{
+  std::lock_guard<std::mutex> lock(cache_mutex);
+
+  lru.clear();
+  index.clear();
+  used_bytes = 0;
+}
+
+void MongoResultCache::set_capacity(size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(cache_mutex);
+
+  capacity = bytes;
+  evict_to(capacity);
+}
+
+size_t MongoResultCache::get_capacity() const
+{
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  return capacity;
+}
+
+size_t MongoResultCache::get_max_entry_size() const
+{
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  return capacity / MONGODB_RESULT_CACHE_MAX_ENTRY_FRACTION;
+}
+
+size_t MongoResultCache::get_used_bytes() const
+{
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  return used_bytes;
+}
+
+/*
+  Drop least recently used entries until usage fits target_bytes
+  Caller must hold cache_mutex.
+*/
+void MongoResultCache::evict_to(size_t target_bytes)
+{
+  while (used_bytes > target_bytes && !lru.empty()) {
+    erase_entry(std::prev(lru.end()));
+    evictions++;
+  }
+}
+
+/*
+  Caller must hold cache_mutex. Handlers replaying the entry keep it alive
+  through their own shared_ptr.
+*/
+void MongoResultCache::erase_entry(std::list<Entry>::iterator it)
+{
+  used_bytes -= it->result->memory_size() + it->key.size();
+  index.erase(it->key);
+  lru.erase(it);
+}
+
+std::string mongodb_result_cache_table_id(const std::string &connection_string,
+                                          const std::string &collection_name)
+{
+  return connection_string + "/" + collection_name;
+}
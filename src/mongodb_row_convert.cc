@@ -0,0 +1,170 @@
+/*
+  MongoDB Document to Row Conversion Implementation
+*/
+
+#include "mongodb_row_convert.h"
+#include <cstdio>
+#include <cstring>
+
+#define MONGODB_JSON_ERROR "{\"error\":\"Failed to convert BSON to JSON\"}"
+
+std::vector<MongoColumn> mongodb_row_columns(const std::vector<std::string> &names)
+{
+  std::vector<MongoColumn> columns;
+  columns.reserve(names.size());
+
+  for (const std::string &name : names) {
+    MongoColumn column;
+    column.name = name;
+    if (name == "_id")
+      column.kind = MONGODB_COLUMN_ID;
+    else if (name == MONGODB_ID_TIME_COLUMN)
+      column.kind = MONGODB_COLUMN_ID_TIME;
+    else if (name == "document")
+      column.kind = MONGODB_COLUMN_DOCUMENT;
+    else
+      column.kind = MONGODB_COLUMN_FIELD;
+    columns.push_back(column);
+  }
+
+  return columns;
+}
+
+static void store_json(size_t column, char *json, MongoFieldSink *sink)
+{
+  if (json) {
+    sink->store_string(column, json, strlen(json));
+    bson_free(json);
+  } else {
+    sink->store_string(column, MONGODB_JSON_ERROR, sizeof(MONGODB_JSON_ERROR) - 1);
+  }
+}
+
+static void convert_id(const bson_t *doc, size_t column, MongoFieldSink *sink)
+{
+  bson_iter_t iter;
+  if (!bson_iter_init(&iter, doc) || !bson_iter_find(&iter, "_id")) {
+    sink->set_null(column);
+    return;
+  }
+
+  switch (bson_iter_type(&iter)) {
+    case BSON_TYPE_OID:
+    {
+      char oid_str[25];
+      bson_oid_to_string(bson_iter_oid(&iter), oid_str);
+      sink->store_string(column, oid_str, 24);
+      break;
+    }
+    case BSON_TYPE_UTF8:
+    {
+      uint32_t len;
+      const char *value = bson_iter_utf8(&iter, &len);
+      sink->store_string(column, value, len);
+      break;
+    }
+    case BSON_TYPE_INT32:
+      sink->store_int(column, bson_iter_int32(&iter));
+      break;
+    case BSON_TYPE_INT64:
+      sink->store_int(column, bson_iter_int64(&iter));
+      break;
+    default:
+    {
+      // Other _id types are shown through the document they identify
+      char *json = bson_as_canonical_extended_json(doc, nullptr);
+      if (json)
+        store_json(column, json, sink);
+      else
+        sink->set_null(column);
+      break;
+    }
+  }
+}
+
+static void convert_id_time(const bson_t *doc, size_t column, MongoFieldSink *sink)
+{
+  bson_iter_t iter;
+  if (!bson_iter_init_find(&iter, doc, "_id") || bson_iter_type(&iter) != BSON_TYPE_OID) {
+    sink->set_null(column);
+    return;
+  }
+  sink->store_time(column, (int64_t)bson_oid_get_time_t(bson_iter_oid(&iter)) * 1000);
+}
+
+static void convert_field(const bson_t *doc, const MongoColumn &column, size_t index,
+                          MongoFieldSink *sink)
+{
+  bson_iter_t iter;
+  if (!bson_iter_init(&iter, doc) || !bson_iter_find(&iter, column.name.c_str())) {
+    sink->set_null(index);
+    return;
+  }
+
+  switch (bson_iter_type(&iter)) {
+    case BSON_TYPE_INT32:
+      sink->store_int(index, bson_iter_int32(&iter));
+      break;
+    case BSON_TYPE_INT64:
+      sink->store_int(index, bson_iter_int64(&iter));
+      break;
+    case BSON_TYPE_DOUBLE:
+      sink->store_double(index, bson_iter_double(&iter));
+      break;
+    case BSON_TYPE_UTF8:
+    {
+      uint32_t len;
+      const char *value = bson_iter_utf8(&iter, &len);
+      sink->store_string(index, value, len);
+      break;
+    }
+    case BSON_TYPE_DATE_TIME:
+      sink->store_time(index, bson_iter_date_time(&iter));
+      break;
+    case BSON_TYPE_NULL:
+      // As MongoDB's {field: null}, which also matches missing fields
+      sink->set_null(index);
+      break;
+    default:
+    {
+      // Unmapped types are shown by tag
+      char type_desc[32];
+      int len = snprintf(type_desc, sizeof(type_desc), "[BSON_TYPE_%d]", (int)bson_iter_type(&iter));
+      sink->store_string(index, type_desc, (size_t)len);
+      break;
+    }
+  }
+}
+
+int mongodb_convert_document(const bson_t *doc, const std::vector<MongoColumn> &columns,
+                             MongoFieldSink *sink)
+{
+  if (!doc || !sink)
+    return 1;
+
+  for (size_t i = 0; i < columns.size(); i++) {
+    const MongoColumn &column = columns[i];
+
+    switch (column.kind) {
+      case MONGODB_COLUMN_ID:
+        convert_id(doc, i, sink);
+        break;
+      case MONGODB_COLUMN_ID_TIME:
+        convert_id_time(doc, i, sink);
+        break;
+      case MONGODB_COLUMN_DOCUMENT:
+      {
+        char *json = bson_as_relaxed_extended_json(doc, nullptr);
+        if (!json)
+          json = bson_as_canonical_extended_json(doc, nullptr);
+        store_json(i, json, sink);
+        break;
+      }
+      case MONGODB_COLUMN_FIELD:
+        convert_field(doc, column, i, sink);
+        break;
+    }
+  }
+
+  return 0;
+}
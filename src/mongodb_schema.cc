@@ -23,15 +23,16 @@ static const enum_field_types MYSQL_TYPE_JSON_REPLACEMENT = MYSQL_TYPE_LONG_BLOB
 #endif
 
 // Global schema registry storage
-std::mutex global_schema_mutex;
-std::map<std::string, std::shared_ptr<MongoSchemaRegistry>> global_schema_registries;
+MongoRegistry<MongoSchemaRegistry> global_schema_registries;
 
 /*
   Constructor - Initialize schema registry with MongoDB connection
 */
 MongoSchemaRegistry::MongoSchemaRegistry(const std::string &connection_str)
-  : connection_string(connection_str),
+  : schema_snapshot(std::make_shared<const MongoSchemaSnapshot>()),
+    connection_string(connection_str),
     cache_ttl(std::chrono::seconds(MONGODB_DEFAULT_SCHEMA_CACHE_TTL_SECONDS)),
+    watched_cache_ttl(std::chrono::seconds(MONGODB_WATCHED_SCHEMA_CACHE_TTL_SECONDS)),
     schema_client(nullptr)
 {
   // Initialize MongoDB client for schema operations
@@ -54,9 +55,44 @@ MongoSchemaRegistry::~MongoSchemaRegistry()
   mongoc_cleanup();
 }
 
+/*
+  Map a $type alias returned by the aggregation framework to a BSON type
+*/
+static bson_type_t bson_type_from_alias(const char *alias)
+{
+  static const struct {
+    const char *alias;
+    bson_type_t type;
+  } aliases[] = {
+    {"double", BSON_TYPE_DOUBLE},     {"string", BSON_TYPE_UTF8},
+    {"object", BSON_TYPE_DOCUMENT},   {"array", BSON_TYPE_ARRAY},
+    {"binData", BSON_TYPE_BINARY},    {"undefined", BSON_TYPE_UNDEFINED},
+    {"objectId", BSON_TYPE_OID},      {"bool", BSON_TYPE_BOOL},
+    {"date", BSON_TYPE_DATE_TIME},    {"null", BSON_TYPE_NULL},
+    {"regex", BSON_TYPE_REGEX},       {"javascript", BSON_TYPE_CODE},
+    {"int", BSON_TYPE_INT32},         {"timestamp", BSON_TYPE_TIMESTAMP},
+    {"long", BSON_TYPE_INT64},        {"decimal", BSON_TYPE_DECIMAL128},
+    {"minKey", BSON_TYPE_MINKEY},     {"maxKey", BSON_TYPE_MAXKEY}
+  };
+  
+  for (const auto &entry : aliases) {
+    if (strcmp(alias, entry.alias) == 0) {
+      return entry.type;
+    }
+  }
+  return BSON_TYPE_EOD;
+}
+
 /*
   Infer schema from MongoDB collection by sampling documents
   This is the core Phase 2 functionality for schema discovery
+  
+  Inference runs in two passes, both bounded by sample_budget:
+  1. Server-side: top-level paths are reduced to per-type histograms with
+     $objectToArray/$group, so no documents cross the wire.
+  2. Client-side: only the subdocuments and arrays found in pass 1 are
+     projected and walked to discover nested paths. If the server cannot
+     run pass 1, whole sampled documents are walked instead.
 */
 bool MongoSchemaRegistry::infer_schema_from_collection(const std::string &database_name,
                                                       const std::string &collection_name)
@@ -67,13 +103,13 @@ bool MongoSchemaRegistry::infer_schema_from_collection(const std::string &databa
   
   std::string table_key = database_name + "." + collection_name;
   
-  // Check if we have valid cached schema
-  {
-    std::lock_guard<std::mutex> lock(cache_mutex);
-    auto it = schema_cache.find(table_key);
-    if (it != schema_cache.end() && is_cache_valid(it->second)) {
-      return true; // Valid cache exists
-    }
+  // Taken before sampling: drift reported meanwhile makes this sample stale
+  uint64_t generation = table_generation(table_key);
+  
+  // Check if we have valid cached schema (lock-free snapshot read)
+  std::shared_ptr<const MongoSchemaCache> cached = get_schema(table_key);
+  if (cached && is_cache_valid(*cached)) {
+    return true; // Valid cache exists
   }
   
   // Get MongoDB collection
@@ -85,57 +121,226 @@ bool MongoSchemaRegistry::infer_schema_from_collection(const std::string &databa
     return false;
   }
   
-  // Sample documents from collection for schema inference
-  std::vector<bson_t*> samples;
-  bool sampling_success = sample_collection_documents(collection, samples);
+  std::map<std::string, MongoFieldStats> field_stats;
+  uint64_t documents_sampled = 0;
+  size_t bytes_sampled = 0;
+  bool whole_documents = false;
   
-  if (!sampling_success || samples.empty()) {
+  if (collect_server_side_statistics(collection, field_stats, documents_sampled)) {
+    // Pass 2: pull only the subtrees that can contain nested paths
+    bson_t projection;
+    bson_init(&projection);
+    int projected = 0;
+    
+    for (const auto &entry : field_stats) {
+      const MongoFieldStats &stats = entry.second;
+      bool has_children = stats.type_counts.count(BSON_TYPE_DOCUMENT) ||
+                          stats.type_counts.count(BSON_TYPE_ARRAY);
+      
+      // Keys that cannot be projected by name are left at top level
+      if (!has_children || entry.first == "_id" ||
+          entry.first.find('.') != std::string::npos || entry.first[0] == '$') {
+        continue;
+      }
+      BSON_APPEND_INT32(&projection, entry.first.c_str(), 1);
+      projected++;
+    }
+    
+    if (projected > 0 && sample_budget.max_depth > 1) {
+      BSON_APPEND_INT32(&projection, "_id", 0);
+      
+      std::map<std::string, MongoFieldStats> nested_stats;
+      uint64_t nested_documents = 0;
+      
+      if (sample_collection_documents(collection, &projection, nested_stats,
+                                      nested_documents, bytes_sampled)) {
+        for (auto &entry : nested_stats) {
+          if (entry.second.depth == 0) {
+            // Top level is covered by the server-side histogram; keep only
+            // what it cannot see - the element types of arrays
+            field_stats[entry.first].element_type_counts = entry.second.element_type_counts;
+            continue;
+          }
+          entry.second.sampled_documents = nested_documents;
+          field_stats[entry.first] = entry.second;
+        }
+      }
+    }
+    
+    bson_destroy(&projection);
+  } else {
+    // Server-side aggregation unavailable - walk whole sampled documents
+    if (!sample_collection_documents(collection, nullptr, field_stats,
+                                     documents_sampled, bytes_sampled)) {
+      mongoc_collection_destroy(collection);
+      mongoc_database_destroy(database);
+      return false;
+    }
+    
+    for (auto &entry : field_stats) {
+      entry.second.sampled_documents = documents_sampled;
+    }
+    whole_documents = true;
+  }
+  
+  if (field_stats.empty()) {
     mongoc_collection_destroy(collection);
     mongoc_database_destroy(database);
     return false;
   }
   
-  // Analyze document structure and infer field mappings
-  std::map<std::string, MongoFieldMapping> inferred_fields;
-  
-  for (const bson_t* doc : samples) {
-    analyze_document_structure(doc, inferred_fields);
+  // Build the new schema version off to the side - readers keep using the
+  // previous one until it is published
+  auto cache_entry = std::make_shared<MongoSchemaCache>();
+  cache_entry->collection_name = collection_name;
+  cache_entry->last_updated = std::chrono::steady_clock::now();
+  {
+    // Tables kept current by a change stream only need a safety-net TTL
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    bool watched = watched_tables.count(table_key) > 0;
+    cache_entry->expires_at = cache_entry->last_updated + (watched ? watched_cache_ttl : cache_ttl);
   }
+  cache_entry->is_valid = true;
+  cache_entry->documents_sampled = documents_sampled;
   
-  // Create schema cache entry
-  MongoSchemaCache cache_entry;
-  cache_entry.collection_name = collection_name;
-  cache_entry.last_updated = std::chrono::steady_clock::now();
-  cache_entry.expires_at = cache_entry.last_updated + cache_ttl;
-  cache_entry.is_valid = true;
-  cache_entry.estimated_documents = samples.size(); // Rough estimate
+  // Collection size from metadata (no scan); fall back to the sample size
+  bson_error_t error;
+  int64_t estimated = mongoc_collection_estimated_document_count(
+    collection, nullptr, nullptr, nullptr, &error);
+  cache_entry->estimated_documents = estimated >= 0 ? (ha_rows)estimated
+                                                    : (ha_rows)documents_sampled;
   
-  // Convert field map to vector
-  for (const auto& field_pair : inferred_fields) {
-    cache_entry.field_mappings.push_back(field_pair.second);
+  if (whole_documents && documents_sampled > 0) {
+    cache_entry->average_document_size = bytes_sampled / documents_sampled;
   }
   
-  // Store in cache
-  {
-    std::lock_guard<std::mutex> lock(cache_mutex);
-    schema_cache[table_key] = std::move(cache_entry);
-  }
+  build_field_mappings(field_stats, cache_entry->field_mappings);
+  cache_entry->field_stats = std::move(field_stats);
+  
+  // Publish in cache, unless the table was invalidated while sampling
+  bool published = publish_entry(table_key, generation, std::move(cache_entry));
   
   // Cleanup
-  for (bson_t* doc : samples) {
-    bson_destroy(doc);
-  }
   mongoc_collection_destroy(collection);
   mongoc_database_destroy(database);
   
+  return published;
+}
+
+/*
+  Pass 1 of schema inference: per top-level path type histograms computed
+  by the server. Returns false if the server rejected the pipeline (e.g. no
+  $objectToArray support), in which case callers fall back to client-side
+  sampling.
+*/
+bool MongoSchemaRegistry::collect_server_side_statistics(mongoc_collection_t *collection,
+                                                        std::map<std::string, MongoFieldStats> &stats,
+                                                        uint64_t &documents_sampled)
+{
+  if (!collection) {
+    return false;
+  }
+  
+  bson_t *pipeline = BCON_NEW(
+    "pipeline", "[",
+      "{", "$sample", "{", "size", BCON_INT32((int32_t)sample_budget.max_documents), "}", "}",
+      "{", "$project", "{", "fields", "{", "$objectToArray", BCON_UTF8("$$ROOT"), "}", "}", "}",
+      "{", "$unwind", BCON_UTF8("$fields"), "}",
+      "{", "$group", "{",
+        "_id", "{",
+          "k", BCON_UTF8("$fields.k"),
+          "t", "{", "$type", BCON_UTF8("$fields.v"), "}",
+        "}",
+        "n", "{", "$sum", BCON_INT32(1), "}",
+        "len", "{", "$max", "{", "$cond", "[",
+          "{", "$eq", "[", "{", "$type", BCON_UTF8("$fields.v"), "}", BCON_UTF8("string"), "]", "}",
+          "{", "$strLenBytes", BCON_UTF8("$fields.v"), "}",
+          BCON_INT32(0),
+        "]", "}", "}",
+      "}", "}",
+    "]");
+  
+  bson_t *opts = BCON_NEW("maxTimeMS", BCON_INT64((int64_t)sample_budget.max_time.count()));
+  
+  mongoc_cursor_t *cursor = mongoc_collection_aggregate(
+    collection, MONGOC_QUERY_NONE, pipeline, opts, nullptr);
+  
+  bson_destroy(opts);
+  bson_destroy(pipeline);
+  
+  if (!cursor) {
+    return false;
+  }
+  
+  const bson_t *doc;
+  while (mongoc_cursor_next(cursor, &doc)) {
+    bson_iter_t iter;
+    bson_iter_t key_iter;
+    bson_iter_t type_iter;
+    
+    if (!bson_iter_init(&iter, doc) ||
+        !bson_iter_find_descendant(&iter, "_id.k", &key_iter) ||
+        !BSON_ITER_HOLDS_UTF8(&key_iter)) {
+      continue;
+    }
+    const char *path = bson_iter_utf8(&key_iter, nullptr);
+    
+    bson_iter_init(&iter, doc);
+    if (!bson_iter_find_descendant(&iter, "_id.t", &type_iter) ||
+        !BSON_ITER_HOLDS_UTF8(&type_iter)) {
+      continue;
+    }
+    bson_type_t type = bson_type_from_alias(bson_iter_utf8(&type_iter, nullptr));
+    
+    uint64_t occurrences = 0;
+    uint32_t max_length = 0;
+    if (bson_iter_init_find(&iter, doc, "n")) {
+      occurrences = (uint64_t)bson_iter_as_int64(&iter);
+    }
+    if (bson_iter_init_find(&iter, doc, "len")) {
+      max_length = (uint32_t)bson_iter_as_int64(&iter);
+    }
+    
+    MongoFieldStats &field = stats[path];
+    field.present_count += occurrences;
+    field.type_counts[type] += occurrences;
+    field.max_string_length = std::max(field.max_string_length, max_length);
+  }
+  
+  bson_error_t error;
+  bool has_error = mongoc_cursor_error(cursor, &error);
+  mongoc_cursor_destroy(cursor);
+  
+  if (has_error || stats.empty()) {
+    stats.clear();
+    return false;
+  }
+  
+  // Every document has an _id, so its total is the number of sampled documents
+  auto id_stats = stats.find("_id");
+  documents_sampled = id_stats != stats.end() ? id_stats->second.present_count : 0;
+  for (auto &entry : stats) {
+    documents_sampled = std::max(documents_sampled, entry.second.present_count);
+  }
+  for (auto &entry : stats) {
+    entry.second.sampled_documents = documents_sampled;
+  }
+  
   return true;
 }
 
 /*
   Sample documents from MongoDB collection for schema analysis
+  
+  Documents are analyzed as they arrive, in small batches, and sampling
+  stops as soon as the document, byte or time budget is exhausted - the
+  remainder of the $sample cursor is never fetched.
 */
-bool MongoSchemaRegistry::sample_collection_documents(mongoc_collection_t *collection, 
-                                                     std::vector<bson_t*> &samples)
+bool MongoSchemaRegistry::sample_collection_documents(mongoc_collection_t *collection,
+                                                     const bson_t *projection,
+                                                     std::map<std::string, MongoFieldStats> &stats,
+                                                     uint64_t &documents_sampled,
+                                                     size_t &bytes_sampled)
 {
   if (!collection) {
     return false;
@@ -144,33 +349,49 @@ bool MongoSchemaRegistry::sample_collection_documents(mongoc_collection_t *colle
   // Create aggregation pipeline for sampling
   bson_t *pipeline = bson_new();
   bson_t sample_stage;
+  bson_t sample_opts;
   
   // Use $sample to get random documents for better schema coverage
   BSON_APPEND_DOCUMENT_BEGIN(pipeline, "0", &sample_stage);
-  BSON_APPEND_UTF8(&sample_stage, "$sample", "");
-  bson_t sample_opts;
   BSON_APPEND_DOCUMENT_BEGIN(&sample_stage, "$sample", &sample_opts);
-  BSON_APPEND_INT32(&sample_opts, "size", MONGODB_SCHEMA_SAMPLE_SIZE);
+  BSON_APPEND_INT32(&sample_opts, "size", (int32_t)sample_budget.max_documents);
   bson_append_document_end(&sample_stage, &sample_opts);
   bson_append_document_end(pipeline, &sample_stage);
   
+  if (projection) {
+    bson_t project_stage;
+    BSON_APPEND_DOCUMENT_BEGIN(pipeline, "1", &project_stage);
+    BSON_APPEND_DOCUMENT(&project_stage, "$project", projection);
+    bson_append_document_end(pipeline, &project_stage);
+  }
+  
+  bson_t *opts = BCON_NEW("batchSize", BCON_INT32((int32_t)sample_budget.batch_size),
+                          "maxTimeMS", BCON_INT64((int64_t)sample_budget.max_time.count()));
+  
   // Execute aggregation
   mongoc_cursor_t *cursor = mongoc_collection_aggregate(
-    collection, MONGOC_QUERY_NONE, pipeline, nullptr, nullptr);
+    collection, MONGOC_QUERY_NONE, pipeline, opts, nullptr);
+  
+  bson_destroy(opts);
+  bson_destroy(pipeline);
   
   if (!cursor) {
-    bson_destroy(pipeline);
     return false;
   }
   
-  // Collect sample documents
+  auto deadline = std::chrono::steady_clock::now() + sample_budget.max_time;
+  uint64_t documents = 0;
   const bson_t *doc;
-  int count = 0;
   
-  while (mongoc_cursor_next(cursor, &doc) && count < MONGODB_SCHEMA_SAMPLE_SIZE) {
-    bson_t *doc_copy = bson_copy(doc);
-    samples.push_back(doc_copy);
-    count++;
+  while (documents < sample_budget.max_documents && mongoc_cursor_next(cursor, &doc)) {
+    documents++;
+    bytes_sampled += doc->len;
+    analyze_document_structure(doc, std::string(), 0, false, documents, stats);
+    
+    if (bytes_sampled >= sample_budget.max_bytes ||
+        std::chrono::steady_clock::now() >= deadline) {
+      break;
+    }
   }
   
   // Check for cursor errors
@@ -178,16 +399,24 @@ bool MongoSchemaRegistry::sample_collection_documents(mongoc_collection_t *colle
   bool has_error = mongoc_cursor_error(cursor, &error);
   
   mongoc_cursor_destroy(cursor);
-  bson_destroy(pipeline);
   
-  return !has_error && !samples.empty();
+  documents_sampled = documents;
+  return !has_error && documents > 0;
 }
 
 /*
-  Analyze BSON document structure and extract field mappings
+  Analyze BSON document structure and accumulate per-path statistics
+  
+  Subdocuments are walked up to sample_budget.max_depth levels. Documents
+  stored in arrays contribute their fields under the array's path, which is
+  how MongoDB dot notation addresses them. Presence is counted once per
+  sampled document (document_seq), type frequencies once per value.
 */
-bool MongoSchemaRegistry::analyze_document_structure(const bson_t *doc, 
-                                                    std::map<std::string, MongoFieldMapping> &fields)
+bool MongoSchemaRegistry::analyze_document_structure(const bson_t *doc,
+                                                    const std::string &prefix,
+                                                    uint32_t depth, bool inside_array,
+                                                    uint64_t document_seq,
+                                                    std::map<std::string, MongoFieldStats> &stats)
 {
   if (!doc) {
     return false;
@@ -201,55 +430,51 @@ bool MongoSchemaRegistry::analyze_document_structure(const bson_t *doc,
   // Iterate through document fields
   while (bson_iter_next(&iter)) {
     const char *key = bson_iter_key(&iter);
-    const bson_value_t *value = bson_iter_value(&iter);
+    bson_type_t type = bson_iter_type(&iter);
+    std::string path = prefix.empty() ? std::string(key) : prefix + "." + key;
     
-    std::string field_name = normalize_field_name(key);
+    MongoFieldStats &field = stats[path];
+    field.depth = depth;
+    field.inside_array = field.inside_array || inside_array;
+    field.type_counts[type]++;
+    if (field.last_document_seq != document_seq) {
+      field.last_document_seq = document_seq;
+      field.present_count++;
+    }
     
-    // Skip invalid SQL identifiers
-    if (!is_valid_sql_identifier(field_name)) {
-      continue;
+    if (type == BSON_TYPE_UTF8) {
+      uint32_t len = 0;
+      bson_iter_utf8(&iter, &len);
+      field.max_string_length = std::max(field.max_string_length, len);
     }
     
-    // Create or update field mapping
-    auto it = fields.find(field_name);
-    if (it == fields.end()) {
-      // New field - create mapping
-      MongoFieldMapping mapping;
-      mapping.sql_name = field_name;
-      mapping.mongo_path = key;
-      mapping.sql_type = infer_field_type(value);
-      mapping.is_nullable = true; // MongoDB fields can be missing
-      
-      // Set appropriate max_length based on type
-      switch (mapping.sql_type) {
-        case MYSQL_TYPE_STRING:
-        case MYSQL_TYPE_VAR_STRING:
-          mapping.max_length = 255;
-          break;
-        case MYSQL_TYPE_BLOB:
-        case MYSQL_TYPE_LONG_BLOB:
-          mapping.max_length = 65535;
-          break;
-        case MYSQL_TYPE_MEDIUM_BLOB:
-          mapping.max_length = 1048576; // 1MB for JSON-like data
-          break;
-        default:
-          mapping.max_length = 0;
+    bool descend = depth + 1 < sample_budget.max_depth;
+    
+    if (type == BSON_TYPE_DOCUMENT && descend) {
+      const uint8_t *data;
+      uint32_t len;
+      bson_t subdoc;
+      bson_iter_document(&iter, &len, &data);
+      if (bson_init_static(&subdoc, data, len)) {
+        analyze_document_structure(&subdoc, path, depth + 1, inside_array, document_seq, stats);
       }
-      
-      fields[field_name] = mapping;
-    } else {
-      // Existing field - refine type if needed
-      enum_field_types current_type = it->second.sql_type;
-      enum_field_types inferred_type = infer_field_type(value);
-      
-      // Use most general type if types differ
-      if (current_type != inferred_type) {
-        if (current_type == MYSQL_TYPE_LONG && inferred_type == MYSQL_TYPE_DOUBLE) {
-          it->second.sql_type = MYSQL_TYPE_DOUBLE;
-        } else if (current_type != MYSQL_TYPE_STRING && inferred_type == MYSQL_TYPE_STRING) {
-          it->second.sql_type = MYSQL_TYPE_STRING;
-          it->second.max_length = 255;
+    } else if (type == BSON_TYPE_ARRAY) {
+      bson_iter_t element;
+      if (!bson_iter_recurse(&iter, &element)) {
+        continue;
+      }
+      while (bson_iter_next(&element)) {
+        bson_type_t element_type = bson_iter_type(&element);
+        stats[path].element_type_counts[element_type]++;
+        
+        if (element_type == BSON_TYPE_DOCUMENT && descend) {
+          const uint8_t *data;
+          uint32_t len;
+          bson_t subdoc;
+          bson_iter_document(&element, &len, &data);
+          if (bson_init_static(&subdoc, data, len)) {
+            analyze_document_structure(&subdoc, path, depth + 1, true, document_seq, stats);
+          }
         }
       }
     }
@@ -258,6 +483,128 @@ bool MongoSchemaRegistry::analyze_document_structure(const bson_t *doc,
   return true;
 }
 
+/*
+  Turn path statistics into SQL column mappings
+  
+  Nested paths become flattened column names (address.city -> address_city),
+  the type is chosen from the whole histogram rather than the first value
+  seen, and string columns are sized from the longest sampled value.
+*/
+void MongoSchemaRegistry::build_field_mappings(const std::map<std::string, MongoFieldStats> &stats,
+                                               std::vector<MongoFieldMapping> &mappings)
+{
+  std::map<std::string, bool> used_names;
+  
+  for (const auto &entry : stats) {
+    if (mappings.size() >= MONGODB_MAX_FIELD_MAPPINGS) {
+      break;
+    }
+    
+    const std::string &path = entry.first;
+    const MongoFieldStats &field = entry.second;
+    std::string sql_name = normalize_field_name(path);
+    
+    // Skip invalid SQL identifiers and flattened-name collisions
+    if (!is_valid_sql_identifier(sql_name) || used_names.count(sql_name)) {
+      continue;
+    }
+    used_names[sql_name] = true;
+    
+    MongoFieldMapping mapping;
+    mapping.sql_name = sql_name;
+    mapping.mongo_path = path;
+    mapping.sql_type = resolve_field_type(field);
+    mapping.presence_ratio = field.sampled_documents > 0
+      ? (double)field.present_count / (double)field.sampled_documents
+      : 0.0;
+    mapping.is_nullable = field.present_count < field.sampled_documents ||
+                          field.type_counts.count(BSON_TYPE_NULL) ||
+                          field.inside_array;
+    
+    // Set appropriate max_length based on type
+    switch (mapping.sql_type) {
+      case MYSQL_TYPE_STRING:
+      case MYSQL_TYPE_VAR_STRING:
+      {
+        // Round the longest sampled value up to a power of two for headroom
+        uint32_t length = 32;
+        while (length < field.max_string_length && length < 65535) {
+          length <<= 1;
+        }
+        mapping.max_length = std::min<uint32_t>(length, 65535);
+        if (field.max_string_length > 65535) {
+          mapping.sql_type = MYSQL_TYPE_MEDIUM_BLOB;
+          mapping.max_length = 1048576;
+        }
+        break;
+      }
+      case MYSQL_TYPE_BLOB:
+      case MYSQL_TYPE_LONG_BLOB:
+        mapping.max_length = 65535;
+        break;
+      case MYSQL_TYPE_MEDIUM_BLOB:
+        mapping.max_length = 1048576; // 1MB for JSON-like data
+        break;
+      default:
+        mapping.max_length = 0;
+    }
+    
+    mappings.push_back(mapping);
+  }
+}
+
+/*
+  Pick the narrowest MariaDB type able to hold every sampled value of a path
+*/
+enum_field_types MongoSchemaRegistry::resolve_field_type(const MongoFieldStats &stats)
+{
+  bool has_int32 = false, has_int64 = false, has_double = false, has_decimal = false;
+  bool has_nested = false, has_other = false;
+  bson_type_t single_type = BSON_TYPE_EOD;
+  int distinct_types = 0;
+  
+  for (const auto &entry : stats.type_counts) {
+    switch (entry.first) {
+      case BSON_TYPE_NULL:
+      case BSON_TYPE_UNDEFINED:
+        continue; // Missing values do not constrain the type
+      case BSON_TYPE_INT32:      has_int32 = true; break;
+      case BSON_TYPE_INT64:      has_int64 = true; break;
+      case BSON_TYPE_DOUBLE:     has_double = true; break;
+      case BSON_TYPE_DECIMAL128: has_decimal = true; break;
+      case BSON_TYPE_DOCUMENT:
+      case BSON_TYPE_ARRAY:      has_nested = true; break;
+      default:                   has_other = true; break;
+    }
+    single_type = entry.first;
+    distinct_types++;
+  }
+  
+  if (distinct_types == 0) {
+    return MYSQL_TYPE_STRING; // Only NULLs seen
+  }
+  if (distinct_types == 1) {
+    return infer_field_type(single_type);
+  }
+  
+  bool numeric_only = !has_nested && !has_other;
+  if (numeric_only) {
+    if (has_double) {
+      return MYSQL_TYPE_DOUBLE;
+    }
+    if (has_decimal) {
+      return MYSQL_TYPE_NEWDECIMAL;
+    }
+    return has_int64 ? MYSQL_TYPE_LONGLONG : MYSQL_TYPE_LONG;
+  }
+  
+  if (has_nested && !has_int32 && !has_int64 && !has_double && !has_decimal && !has_other) {
+    return MYSQL_TYPE_MEDIUM_BLOB; // Mix of subdocuments and arrays
+  }
+  
+  return MYSQL_TYPE_STRING;
+}
+
 /*
   Infer MariaDB field type from BSON value
 */
@@ -267,7 +614,12 @@ enum_field_types MongoSchemaRegistry::infer_field_type(const bson_value_t *value
     return MYSQL_TYPE_STRING;
   }
   
-  switch (value->value_type) {
+  return infer_field_type(value->value_type);
+}
+
+enum_field_types MongoSchemaRegistry::infer_field_type(bson_type_t type)
+{
+  switch (type) {
     case BSON_TYPE_DOUBLE:
       return MYSQL_TYPE_DOUBLE;
     
@@ -324,40 +676,140 @@ bool MongoSchemaRegistry::row_to_document(const uchar *buf, TABLE *table, bson_t
   return false;
 }
 
+/*
+  Copying accessor kept for callers that need their own vector.
+  Hot paths should prefer get_schema(), which hands out the published
+  version without copying.
+*/
 bool MongoSchemaRegistry::get_field_mappings(const std::string &table_name,
                                             std::vector<MongoFieldMapping> &mappings)
 {
-  std::lock_guard<std::mutex> lock(cache_mutex);
-  
-  auto it = schema_cache.find(table_name);
-  if (it != schema_cache.end() && is_cache_valid(it->second)) {
-    mappings = it->second.field_mappings;
+  std::shared_ptr<const MongoSchemaCache> cached = get_schema(table_name);
+  if (cached && is_cache_valid(*cached)) {
+    mappings = cached->field_mappings;
     return true;
   }
   
   return false;
 }
 
+/*
+  Lock-free lookup of the current schema version for a table.
+  The returned entry is immutable and stays alive while the caller holds it,
+  even if a refresh publishes a newer version in the meantime.
+*/
+std::shared_ptr<const MongoSchemaCache> MongoSchemaRegistry::get_schema(const std::string &table_name) const
+{
+  std::shared_ptr<const MongoSchemaSnapshot> snapshot = load_snapshot();
+  
+  auto it = snapshot->find(table_name);
+  if (it == snapshot->end()) {
+    return nullptr;
+  }
+  
+  return it->second;
+}
+
+std::shared_ptr<const MongoSchemaSnapshot> MongoSchemaRegistry::load_snapshot() const
+{
+  return std::atomic_load_explicit(&schema_snapshot, std::memory_order_acquire);
+}
+
+uint64_t MongoSchemaRegistry::table_generation(const std::string &table_key)
+{
+  std::lock_guard<std::mutex> lock(writer_mutex);
+  
+  auto it = generations.find(table_key);
+  return it == generations.end() ? 0 : it->second;
+}
+
+/*
+  Publish an entry built from what the table looked like at generation;
+  refused (false) when invalidate_cache() has run since
+*/
+bool MongoSchemaRegistry::publish_entry(const std::string &table_key, uint64_t generation,
+                                        std::shared_ptr<const MongoSchemaCache> entry)
+{
+  std::lock_guard<std::mutex> lock(writer_mutex);
+  
+  auto it = generations.find(table_key);
+  if ((it == generations.end() ? 0 : it->second) != generation) {
+    return false;
+  }
+  store_entry(table_key, std::move(entry));
+  return true;
+}
+
+/*
+  Copy-on-write publication: clone the map of entry pointers (entries
+  themselves are shared, not copied), replace or erase one key and swap the
+  new version in. A null entry erases the key. writer_mutex must be held.
+*/
+void MongoSchemaRegistry::store_entry(const std::string &table_key,
+                                      std::shared_ptr<const MongoSchemaCache> entry)
+{
+  auto next = std::make_shared<MongoSchemaSnapshot>(*load_snapshot());
+  if (entry) {
+    (*next)[table_key] = std::move(entry);
+  } else {
+    next->erase(table_key);
+  }
+  
+  std::shared_ptr<const MongoSchemaSnapshot> published = std::move(next);
+  std::atomic_store_explicit(&schema_snapshot, published, std::memory_order_release);
+}
+
 bool MongoSchemaRegistry::is_cache_valid(const MongoSchemaCache &cache) const
 {
   auto now = std::chrono::steady_clock::now();
   return cache.is_valid && (now < cache.expires_at);
 }
 
+/*
+  The bump, lookup and copy happen under writer_mutex, so neither a
+  refresh that sampled before the call nor another writer can republish
+  the old schema as valid
+*/
 void MongoSchemaRegistry::invalidate_cache(const std::string &table_name)
 {
-  std::lock_guard<std::mutex> lock(cache_mutex);
+  std::lock_guard<std::mutex> lock(writer_mutex);
   
-  auto it = schema_cache.find(table_name);
-  if (it != schema_cache.end()) {
-    it->second.is_valid = false;
+  generations[table_name]++;
+  
+  std::shared_ptr<const MongoSchemaSnapshot> snapshot = load_snapshot();
+  auto it = snapshot->find(table_name);
+  if (it == snapshot->end() || !it->second->is_valid) {
+    return;
+  }
+  
+  // Published entries are immutable - publish an invalidated copy instead
+  auto invalidated = std::make_shared<MongoSchemaCache>(*it->second);
+  invalidated->is_valid = false;
+  store_entry(table_name, std::move(invalidated));
+}
+
+/*
+  Mark a table as watched by a change stream. Watched tables are invalidated
+  on drift, so newly inferred versions get watched_cache_ttl instead of
+  cache_ttl. Existing entries keep their expiry until the next refresh.
+*/
+void MongoSchemaRegistry::set_table_watched(const std::string &table_name, bool watched)
+{
+  std::lock_guard<std::mutex> lock(writer_mutex);
+  
+  if (watched) {
+    watched_tables.insert(table_name);
+  } else {
+    watched_tables.erase(table_name);
   }
 }
 
 void MongoSchemaRegistry::clear_all_cache()
 {
-  std::lock_guard<std::mutex> lock(cache_mutex);
-  schema_cache.clear();
+  std::lock_guard<std::mutex> lock(writer_mutex);
+  
+  std::shared_ptr<const MongoSchemaSnapshot> empty = std::make_shared<const MongoSchemaSnapshot>();
+  std::atomic_store_explicit(&schema_snapshot, empty, std::memory_order_release);
 }
 
 /*
@@ -465,22 +917,12 @@ const char* mysql_type_to_string(enum_field_types type)
 */
 MongoSchemaRegistry* get_or_create_schema_registry(const std::string &connection_string)
 {
-  std::lock_guard<std::mutex> lock(global_schema_mutex);
-  
-  auto it = global_schema_registries.find(connection_string);
-  if (it != global_schema_registries.end()) {
-    return it->second.get();
-  }
-  
-  // Create new registry
-  auto registry = std::make_shared<MongoSchemaRegistry>(connection_string);
-  global_schema_registries[connection_string] = registry;
-  
-  return registry.get();
+  return global_schema_registries.get_or_create(connection_string, [&] {
+    return std::make_shared<MongoSchemaRegistry>(connection_string);
+  });
 }
 
 void cleanup_all_schema_registries()
 {
-  std::lock_guard<std::mutex> lock(global_schema_mutex);
-  global_schema_registries.clear();
+  global_schema_registries.take_all();
 }
@@ -0,0 +1,379 @@
+/*
+  MongoDB Shared Cooperative Scans Implementation
+
+  The producer is paced by the fastest attached reader: it never runs more
+  than MONGODB_SHARED_SCAN_WINDOW batches ahead of it, and stops as soon as
+  the last reader detaches.
+*/
+
+#include "mongodb_shared_scan.h"
+#include "mongodb_registry.h"
+
+// Global coordinator storage
+static MongoRegistry<MongoSharedScanCoordinator> global_shared_scan_coordinators;
+
+MongoSharedScanCounters shared_scan_counters;
+
+MongoSharedScan::MongoSharedScan(const std::string &connection_str, const std::string &database,
+                                 const std::string &collection, const bson_t *scan_filter)
+  : connection_string(connection_str),
+    database_name(database),
+    collection_name(collection),
+    filter(bson_copy(scan_filter)),
+    base_sequence(0),
+    produced(0),
+    max_consumed(0),
+    readers(0),
+    finished(false),
+    failed(false),
+    stop_requested(false)
+{
+}
+
+MongoSharedScan::~MongoSharedScan()
+{
+  stop();
+  bson_destroy(filter);
+}
+
+bool MongoSharedScan::start()
+{
+  if (worker.joinable()) {
+    return true;
+  }
+
+  worker = std::thread(&MongoSharedScan::run, this);
+  return true;
+}
+
+void MongoSharedScan::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+    stop_requested = true;
+  }
+  batch_ready.notify_all();
+  window_space.notify_all();
+
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+/*
+  Producer thread - reads the collection in _id order so readers can
+  describe what they have seen as an _id range
+*/
+void MongoSharedScan::run()
+{
+  mongoc_client_t *client = mongoc_client_new(connection_string.c_str());
+  mongoc_collection_t *collection = nullptr;
+  mongoc_cursor_t *cursor = nullptr;
+  bool ok = client != nullptr;
+
+  if (ok) {
+    collection = mongoc_client_get_collection(client, database_name.c_str(), collection_name.c_str());
+
+    bson_t *opts = BCON_NEW("sort", "{", "_id", BCON_INT32(1), "}",
+                            "batchSize", BCON_INT32(MONGODB_SHARED_SCAN_BATCH_DOCS));
+    cursor = mongoc_collection_find_with_opts(collection, filter, opts, nullptr);
+    bson_destroy(opts);
+
+    auto batch = std::make_shared<MongoScanBatch>();
+    const bson_t *doc;
+    bool abandoned = false;
+
+    while (!abandoned && mongoc_cursor_next(cursor, &doc)) {
+      batch->data.append((const char*)bson_get_data(doc), doc->len);
+      batch->count++;
+
+      if (batch->count >= MONGODB_SHARED_SCAN_BATCH_DOCS) {
+        publish_batch(batch);
+        batch = std::make_shared<MongoScanBatch>();
+
+        std::lock_guard<std::mutex> lock(scan_mutex);
+        abandoned = stop_requested || readers == 0;
+      }
+    }
+
+    bson_error_t error;
+    if (mongoc_cursor_error(cursor, &error)) {
+      fprintf(stderr, "SHARED_SCAN: Scan of %s.%s failed: %s\n",
+              database_name.c_str(), collection_name.c_str(), error.message);
+      ok = false;
+    } else if (!abandoned && batch->count) {
+      publish_batch(batch);
+    }
+  }
+
+  if (cursor) {
+    mongoc_cursor_destroy(cursor);
+  }
+  if (collection) {
+    mongoc_collection_destroy(collection);
+  }
+  if (client) {
+    mongoc_client_destroy(client);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+    finished = true;
+    failed = !ok;
+    if (readers == 0) {
+      window.clear();
+    }
+  }
+  batch_ready.notify_all();
+}
+
+void MongoSharedScan::publish_batch(std::shared_ptr<MongoScanBatch> batch)
+{
+  std::unique_lock<std::mutex> lock(scan_mutex);
+
+  // Stay within the window of the fastest reader
+  window_space.wait(lock, [this] {
+    return stop_requested || readers == 0 || produced - max_consumed < MONGODB_SHARED_SCAN_WINDOW;
+  });
+
+  window.push_back(std::move(batch));
+  produced++;
+  if (window.size() > MONGODB_SHARED_SCAN_WINDOW) {
+    window.pop_front();
+    base_sequence++;
+  }
+  shared_scan_counters.batches_produced++;
+
+  lock.unlock();
+  batch_ready.notify_all();
+}
+
+/*
+  Join the scan at the oldest batch still retained
+*/
+bool MongoSharedScan::attach(uint64_t *first_sequence)
+{
+  std::lock_guard<std::mutex> lock(scan_mutex);
+
+  if (finished || stop_requested) {
+    return false;
+  }
+
+  readers++;
+  *first_sequence = base_sequence;
+  return true;
+}
+
+void MongoSharedScan::detach()
+{
+  {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+    readers--;
+    if (readers == 0 && finished) {
+      window.clear();
+    }
+  }
+  window_space.notify_all();
+}
+
+mongo_shared_scan_status MongoSharedScan::next_batch(uint64_t sequence,
+                                                     std::shared_ptr<const MongoScanBatch> *batch)
+{
+  std::unique_lock<std::mutex> lock(scan_mutex);
+
+  batch_ready.wait(lock, [this, sequence] {
+    return sequence < produced || finished || stop_requested;
+  });
+
+  if (sequence < base_sequence) {
+    return MONGO_SHARED_SCAN_DETACHED;
+  }
+
+  if (sequence < produced) {
+    *batch = window[(size_t)(sequence - base_sequence)];
+    if (sequence + 1 > max_consumed) {
+      max_consumed = sequence + 1;
+      lock.unlock();
+      window_space.notify_all();
+    }
+    return MONGO_SHARED_SCAN_BATCH;
+  }
+
+  return (failed || stop_requested) ? MONGO_SHARED_SCAN_ERROR : MONGO_SHARED_SCAN_END;
+}
+
+bool MongoSharedScan::is_idle()
+{
+  std::lock_guard<std::mutex> lock(scan_mutex);
+  return finished && readers == 0;
+}
+
+/*
+  Coordinator
+*/
+MongoSharedScanCoordinator::MongoSharedScanCoordinator(const std::string &connection_str,
+                                                       const std::string &database,
+                                                       const std::string &collection)
+  : connection_string(connection_str),
+    database_name(database),
+    collection_name(collection)
+{
+}
+
+/*
+  Attach to the in-flight scan for this filter, or start one
+*/
+std::shared_ptr<MongoSharedScan> MongoSharedScanCoordinator::attach(const bson_t *filter,
+                                                                    uint64_t *first_sequence)
+{
+  std::string key((const char*)bson_get_data(filter), filter->len);
+  std::lock_guard<std::mutex> lock(coordinator_mutex);
+
+  auto it = scans.find(key);
+  if (it != scans.end()) {
+    if (it->second->attach(first_sequence)) {
+      shared_scan_counters.readers_joined++;
+      return it->second;
+    }
+  }
+
+  // Drop finished scans nobody reads any more
+  for (auto scan = scans.begin(); scan != scans.end();) {
+    if (scan->second->is_idle()) {
+      scan->second->stop();
+      scan = scans.erase(scan);
+    } else {
+      ++scan;
+    }
+  }
+
+  auto scan = std::make_shared<MongoSharedScan>(connection_string, database_name,
+                                                collection_name, filter);
+  scan->attach(first_sequence);
+  scan->start();
+  scans[key] = scan;
+  shared_scan_counters.scans_started++;
+
+  return scan;
+}
+
+void MongoSharedScanCoordinator::stop_all()
+{
+  std::map<std::string, std::shared_ptr<MongoSharedScan>> stopping;
+
+  {
+    std::lock_guard<std::mutex> lock(coordinator_mutex);
+    stopping.swap(scans);
+  }
+
+  for (auto &entry : stopping) {
+    entry.second->stop();
+  }
+}
+
+/*
+  Reader helpers
+  _id values are kept as single-element documents with an empty key.
+*/
+bool mongodb_shared_scan_document_id(const bson_t *doc, std::string *encoded_id)
+{
+  bson_iter_t iter;
+  if (!bson_iter_init_find(&iter, doc, "_id")) {
+    return false;
+  }
+
+  bson_t wrapper;
+  bson_init(&wrapper);
+  bson_append_iter(&wrapper, "", 0, &iter);
+  encoded_id->assign((const char*)bson_get_data(&wrapper), wrapper.len);
+  bson_destroy(&wrapper);
+  return true;
+}
+
+static bool append_encoded_id(bson_t *doc, const char *key, const std::string &encoded_id)
+{
+  bson_t wrapper;
+  bson_iter_t iter;
+
+  if (!bson_init_static(&wrapper, (const uint8_t*)encoded_id.data(), encoded_id.size()) ||
+      !bson_iter_init(&iter, &wrapper) || !bson_iter_next(&iter)) {
+    return false;
+  }
+  return bson_append_iter(doc, key, -1, &iter);
+}
+
+/*
+  filter AND (_id > last_id OR _id < first_id), either bound optional
+  $expr comparisons use the full BSON order, so _ids of every type are
+  covered. Returns nullptr when both bounds are empty.
+*/
+bson_t *mongodb_shared_scan_remainder_filter(const bson_t *filter, const std::string &first_id,
+                                             const std::string &last_id)
+{
+  if (first_id.empty() && last_id.empty()) {
+    return nullptr;
+  }
+
+  bson_t *remainder = bson_new();
+  bson_t clauses, expr_clause, expr, branches;
+
+  BSON_APPEND_ARRAY_BEGIN(remainder, "$and", &clauses);
+  BSON_APPEND_DOCUMENT(&clauses, "0", filter);
+  BSON_APPEND_DOCUMENT_BEGIN(&clauses, "1", &expr_clause);
+  BSON_APPEND_DOCUMENT_BEGIN(&expr_clause, "$expr", &expr);
+  BSON_APPEND_ARRAY_BEGIN(&expr, "$or", &branches);
+
+  const struct { const char *op; const std::string *bound; } ranges[] = {
+    {"$gt", &last_id}, {"$lt", &first_id}
+  };
+  int index = 0;
+  for (const auto &range : ranges) {
+    if (range.bound->empty()) {
+      continue;
+    }
+
+    char key[16];
+    bson_t branch, operands, literal;
+    snprintf(key, sizeof(key), "%d", index++);
+    BSON_APPEND_DOCUMENT_BEGIN(&branches, key, &branch);
+    BSON_APPEND_ARRAY_BEGIN(&branch, range.op, &operands);
+    BSON_APPEND_UTF8(&operands, "0", "$_id");
+    BSON_APPEND_DOCUMENT_BEGIN(&operands, "1", &literal);
+    append_encoded_id(&literal, "$literal", *range.bound);
+    bson_append_document_end(&operands, &literal);
+    bson_append_array_end(&branch, &operands);
+    bson_append_document_end(&branches, &branch);
+  }
+
+  bson_append_array_end(&expr, &branches);
+  bson_append_document_end(&expr_clause, &expr);
+  bson_append_document_end(&clauses, &expr_clause);
+  bson_append_array_end(remainder, &clauses);
+
+  return remainder;
+}
+
+void mongodb_shared_scan_id_filter(const std::string &encoded_id, bson_t *filter)
+{
+  append_encoded_id(filter, "_id", encoded_id);
+}
+
+/*
+  Global helper functions
+*/
+MongoSharedScanCoordinator* get_or_create_shared_scan_coordinator(const std::string &connection_string,
+                                                                  const std::string &database_name,
+                                                                  const std::string &collection_name)
+{
+  return global_shared_scan_coordinators.get_or_create(connection_string + "/" + collection_name, [&] {
+    return std::make_shared<MongoSharedScanCoordinator>(connection_string, database_name, collection_name);
+  });
+}
+
+void cleanup_all_shared_scan_coordinators()
+{
+  // Join producer threads outside the registry lock
+  for (auto &coordinator : global_shared_scan_coordinators.take_all()) {
+    coordinator->stop_all();
+  }
+}
@@ -3,67 +3,2333 @@
   Translates SQL WHERE conditions to MongoDB match filters
 */
 
-#include "mongodb_translator.h"
+#define MYSQL_SERVER 1
 #include "my_global.h"
-// TODO: Fix complex header dependencies for Item classes
-// Forward declarations instead of full includes to avoid dependency issues
-class Item;
-class Item_func; 
-class Item_cond;
+#include "sql_class.h"
+#include "item.h"
+#include "item_cmpfunc.h"
+#include "tztime.h"
+#include "mongodb_translator.h"
+#include "mongodb_row_convert.h"
+#include "mongodb_plan_cache.h"
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+
+namespace mongodb_translator {
+
+/*
+  How a column's values compare. FLOAT and DECIMAL columns round what they
+  read, so a document could match in one place and not the other; TIME
+  columns have no BSON counterpart. DATE, DATETIME and TIMESTAMP columns
+  read BSON dates.
+*/
+enum MongoValueKind {
+  MONGODB_VALUE_NONE,
+  MONGODB_VALUE_NUMBER,
+  MONGODB_VALUE_STRING,
+  MONGODB_VALUE_TIME
+};
+
+static MongoValueKind field_value_kind(const Field *field)
+{
+  switch (field->real_type()) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_DOUBLE:
+      return MONGODB_VALUE_NUMBER;
+    case MYSQL_TYPE_VARCHAR:
+    case MYSQL_TYPE_VAR_STRING:
+    case MYSQL_TYPE_STRING:
+    case MYSQL_TYPE_BLOB:
+    case MYSQL_TYPE_TINY_BLOB:
+    case MYSQL_TYPE_MEDIUM_BLOB:
+    case MYSQL_TYPE_LONG_BLOB:
+      return MONGODB_VALUE_STRING;
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_NEWDATE:
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_DATETIME2:
+    case MYSQL_TYPE_TIMESTAMP:
+    case MYSQL_TYPE_TIMESTAMP2:
+      return MONGODB_VALUE_TIME;
+    default:
+      return MONGODB_VALUE_NONE;
+  }
+}
+
+/*
+  String comparisons MongoDB can reproduce: it compares UTF-8 bytes and
+  never ignores case, accents or trailing spaces
+*/
+enum MongoStringMatch {
+  MONGODB_STRING_NONE,        // Collation MongoDB cannot reproduce
+  MONGODB_STRING_PAD,         // Binary, trailing spaces ignored (PAD SPACE)
+  MONGODB_STRING_EXACT        // Binary, NO PAD
+};
+
+static MongoStringMatch string_match(CHARSET_INFO *cs)
+{
+  if (!cs || !(cs->state & MY_CS_BINSORT))
+    return MONGODB_STRING_NONE;
+  return (cs->state & MY_CS_NOPAD) ? MONGODB_STRING_EXACT : MONGODB_STRING_PAD;
+}
+
+// Binary order of the charset is the byte order of its UTF-8 form
+static bool string_order_preserved(CHARSET_INFO *cs)
+{
+  return cs == &my_charset_bin || ((cs->state & MY_CS_UNICODE) && cs->mbminlen == 1);
+}
+
+/*
+  How a JSON function reads the document column. Strings compare
+  unquoted either way; in numeric context JSON_EXTRACT reads true as 1,
+  while the text forms read it, like any non-numeric string, as 0.
+*/
+enum MongoJsonRead {
+  MONGODB_JSON_NONE,          // Stored column
+  MONGODB_JSON_TEXT,          // JSON_VALUE, JSON_UNQUOTE(JSON_EXTRACT)
+  MONGODB_JSON_EXTRACT        // JSON_EXTRACT
+};
+
+// What a temporal column's value is cut to, see time_comparison_range()
+enum MongoTimeGrid {
+  MONGODB_GRID_COLUMN,        // The column's own precision
+  MONGODB_GRID_DAY,           // DATE columns, DATE()
+  MONGODB_GRID_YEAR           // YEAR()
+};
+
+/*
+  Left side of a predicate: a stored column, possibly under DATE() or
+  YEAR(), or a value a JSON function reads from the document column,
+  directly or as a virtual column
+*/
+struct MongoOperand {
+  Field *field;               // Column read, nullptr for a bare JSON function
+  CHARSET_INFO *charset;      // Charset of the value MariaDB compares
+  MongoJsonRead json;
+  MongoTimeGrid grid;
+  bool id_time;               // The _id_time column, read from the _id ObjectId
+  const char *name;           // Top-level key of a stored column
+  std::string json_path;      // Dotted path of a JSON read
+
+  const char *path() const
+  {
+    return json == MONGODB_JSON_NONE ? name : json_path.c_str();
+  }
+};
+
+static CHARSET_INFO *comparison_collation(const Item_func *func, const MongoOperand *operand)
+{
+  CHARSET_INFO *cs = func->compare_collation();
+  return cs ? cs : operand->charset;
+}
+
+static bool is_id(const char *path)
+{
+  return strcmp(path, "_id") == 0;
+}
+
+/*
+  Stored columns show an array as its type tag, while MongoDB would match
+  a predicate against each element: their clauses exclude arrays, which
+  no pushed predicate matches
+*/
+static bool scalar_clause(const MongoOperand *operand, bson_t *clause)
+{
+  if (operand->json != MONGODB_JSON_NONE || operand->id_time || is_id(operand->name)) {
+    return true;
+  }
+  return mongodb_filter_scalar(clause, operand->name);
+}
+
+static bool is_function(const Item_func *func, const char *name)
+{
+  LEX_CSTRING func_name = func->func_name_cstring();
+  return func_name.length == strlen(name) && memcmp(func_name.str, name, func_name.length) == 0;
+}
+
+static bool is_regexp(const Item_func *func)
+{
+  return is_function(func, "regexp");
+}
+
+/*
+  Constants can be evaluated while the condition is pushed: no subqueries
+  or stored functions, no reference to the row being read. An index
+  condition is translated per lookup, when columns of the tables read
+  before this one hold their current row.
+*/
+static bool is_constant(const MongoTranslateContext *ctx, Item *item)
+{
+  if (item->is_expensive()) {
+    return false;
+  }
+  if (item->const_item()) {
+    return true;
+  }
+  return ctx->lookup && !(item->used_tables() & (ctx->table->map | RAND_TABLE_BIT));
+}
+
+/*
+  Numeric constants of the condition and the values translation appended
+  for them, from which a filter plan is built
+*/
+struct MongoPlanRecording {
+  std::vector<Item*> constants;         // Slot constants, as condition_shape() numbered them
+  std::vector<MongoFilterParam> params;
+  bool cacheable;
+};
+
+// Constants a filter plan leaves to slots
+static bool slot_constant(Item *item)
+{
+  Item_result type = item->cmp_type();
+  return type == INT_RESULT || type == REAL_RESULT || type == DECIMAL_RESULT;
+}
+
+static void record_value(const MongoTranslateContext *ctx, Item *item, const bson_value_t *value)
+{
+  MongoPlanRecording *recording = ctx->recording;
+  if (!recording) {
+    return;
+  }
+  Item *real = item->real_item();
+  for (size_t i = 0; i < recording->constants.size(); i++) {
+    if (recording->constants[i] == real) {
+      recording->params.push_back(MongoFilterParam{(uint32_t)i, *value});
+      return;
+    }
+  }
+  recording->cacheable = false;
+}
+
+static void forget_values(const MongoTranslateContext *ctx, size_t recorded)
+{
+  if (ctx->recording) {
+    ctx->recording->params.resize(recorded);
+  }
+}
+
+/*
+  The filter depends on a numeric constant other than through the value
+  constant_value() appends (a date read from it, a folded bound), which a
+  plan could not follow. Without an item, on any constant.
+*/
+static void value_dependent(const MongoTranslateContext *ctx, Item *item = nullptr)
+{
+  if (ctx->recording && (!item || slot_constant(item))) {
+    ctx->recording->cacheable = false;
+  }
+}
+
+static bool utf8_string(const String *value, std::string *out)
+{
+  String converted;
+  uint errors = 0;
+  if (converted.copy(value->ptr(), value->length(), value->charset(),
+                     &my_charset_utf8mb4_bin, &errors) || errors) {
+    return false;
+  }
+  if (!bson_utf8_validate(converted.ptr(), converted.length(), true)) {
+    return false;
+  }
+  out->assign(converted.ptr(), converted.length());
+  return true;
+}
+
+static bool constant_utf8(const MongoTranslateContext *ctx, Item *item, std::string *out)
+{
+  if (!is_constant(ctx, item)) {
+    return false;
+  }
+  value_dependent(ctx, item);
+  StringBuffer<MAX_FIELD_WIDTH> buffer;
+  String *value = item->val_str(&buffer);
+  return value && utf8_string(value, out);
+}
+
+// The stored document column of the pushed table
+static bool is_document_column(const MongoTranslateContext *ctx, Item *item)
+{
+  Item *real = item->real_item();
+  if (real->type() != Item::FIELD_ITEM) {
+    return false;
+  }
+  Field *field = ((Item_field*)real)->field;
+  return field && field->table == ctx->table && !field->vcol_info &&
+         strcmp(field->field_name.str, "document") == 0;
+}
+
+/*
+  JSON_VALUE(document, path), JSON_EXTRACT(document, path) or
+  JSON_UNQUOTE(JSON_EXTRACT(document, path)) with a constant path. The
+  document column renders the whole document, so the path reads the value
+  its dotted form names in MongoDB.
+*/
+static bool json_read(const MongoTranslateContext *ctx, Item *item, MongoOperand *operand)
+{
+  if (item->type() != Item::FUNC_ITEM) {
+    return false;
+  }
+
+  Item_func *func = (Item_func*)item;
+  MongoJsonRead read = MONGODB_JSON_EXTRACT;
+  if (is_function(func, "json_unquote") && func->argument_count() == 1) {
+    Item *arg = func->arguments()[0]->real_item();
+    if (arg->type() != Item::FUNC_ITEM || !is_function((Item_func*)arg, "json_extract")) {
+      return false;
+    }
+    func = (Item_func*)arg;
+    read = MONGODB_JSON_TEXT;
+  } else if (is_function(func, "json_value")) {
+    read = MONGODB_JSON_TEXT;
+  } else if (!is_function(func, "json_extract")) {
+    return false;
+  }
+
+  // Several paths make JSON_EXTRACT return an array
+  Item **args = func->arguments();
+  std::string json_path;
+  if (func->argument_count() != 2 || !is_document_column(ctx, args[0]) ||
+      !constant_utf8(ctx, args[1], &json_path) ||
+      !mongodb_filter_json_path(json_path.data(), json_path.size(), &operand->json_path)) {
+    return false;
+  }
+
+  operand->json = read;
+  operand->charset = item->collation.collation;
+  return true;
+}
+
+// A stored column, under its top-level key
+static bool column_operand(Field *field, MongoOperand *operand)
+{
+  const char *name = field->field_name.str;
+  if (!name[0] || name[0] == '$' || strchr(name, '.') || strcmp(name, "document") == 0) {
+    return false;
+  }
+
+  operand->field = field;
+  operand->charset = field->charset();
+  operand->json = MONGODB_JSON_NONE;
+  operand->grid = field->type() == MYSQL_TYPE_DATE ? MONGODB_GRID_DAY : MONGODB_GRID_COLUMN;
+  operand->id_time = strcmp(name, MONGODB_ID_TIME_COLUMN) == 0;
+  operand->name = name;
+  return true;
+}
+
+/*
+  Left side of a predicate on the pushed table. Stored columns map to
+  their top-level key, except the document column and names MongoDB would
+  read as paths or operators; virtual columns and bare functions must be a
+  JSON read of the document column, or DATE() or YEAR() of a temporal
+  column.
+*/
+static bool resolve_operand(const MongoTranslateContext *ctx, Item *item, MongoOperand *operand)
+{
+  Item *real = item->real_item();
+  if (real->type() == Item::FUNC_ITEM) {
+    Item_func *func = (Item_func*)real;
+    bool year = is_function(func, "year");
+    if ((year || is_function(func, "cast_as_date")) && func->argument_count() == 1) {
+      if (!resolve_operand(ctx, func->arguments()[0], operand) ||
+          operand->json != MONGODB_JSON_NONE || operand->grid == MONGODB_GRID_YEAR ||
+          field_value_kind(operand->field) != MONGODB_VALUE_TIME) {
+        return false;
+      }
+      operand->grid = year ? MONGODB_GRID_YEAR : MONGODB_GRID_DAY;
+      return true;
+    }
+    operand->field = nullptr;
+    operand->grid = MONGODB_GRID_COLUMN;
+    operand->id_time = false;
+    return json_read(ctx, real, operand);
+  }
+  if (real->type() != Item::FIELD_ITEM) {
+    return false;
+  }
+
+  Field *field = ((Item_field*)real)->field;
+  if (!field || field->table != ctx->table) {
+    return false;
+  }
+
+  // Virtual columns are computed by MariaDB, never read from a key
+  if (field->vcol_info) {
+    if (!field->vcol_info->expr || !json_read(ctx, field->vcol_info->expr, operand)) {
+      return false;
+    }
+    operand->field = field;
+    operand->charset = field->charset();
+    operand->grid = MONGODB_GRID_COLUMN;
+    operand->id_time = false;
+    return true;
+  }
+
+  return column_operand(field, operand);
+}
+
+/*
+  Kind a constant is evaluated as against the operand. JSON reads compare
+  the way the constant does, numerically with numbers and as text with
+  strings; a numeric virtual column only takes numbers.
+*/
+static MongoValueKind operand_kind(const MongoOperand *operand, Item *constant)
+{
+  MongoValueKind column = operand->field ? field_value_kind(operand->field)
+                                         : MONGODB_VALUE_STRING;
+  if (operand->json == MONGODB_JSON_NONE) {
+    return column;
+  }
+
+  switch (constant->cmp_type()) {
+    case INT_RESULT:
+    case REAL_RESULT:
+    case DECIMAL_RESULT:
+      return column == MONGODB_VALUE_NUMBER || column == MONGODB_VALUE_STRING
+                 ? MONGODB_VALUE_NUMBER : MONGODB_VALUE_NONE;
+    case STRING_RESULT:
+      return column == MONGODB_VALUE_STRING ? MONGODB_VALUE_STRING : MONGODB_VALUE_NONE;
+    default:
+      return MONGODB_VALUE_NONE;
+  }
+}
+
+/*
+  Evaluate a constant as a value of the given kind. SQL NULL becomes a
+  BSON null; strings are converted to UTF-8 into strings, which must
+  outlive the value.
+*/
+static bool constant_value(const MongoTranslateContext *ctx, MongoValueKind kind, Item *item,
+                           std::deque<std::string> *strings, bson_value_t *value)
+{
+  if (!is_constant(ctx, item)) {
+    return false;
+  }
+  if (item->type() == Item::NULL_ITEM) {
+    value->value_type = BSON_TYPE_NULL;
+    return true;
+  }
+
+  switch (kind) {
+    case MONGODB_VALUE_NUMBER:
+      if (item->cmp_type() == INT_RESULT) {
+        longlong v = item->val_int();
+        // Unsigned values above INT64_MAX have no BSON integer
+        if (!item->null_value && item->unsigned_flag && v < 0) {
+          return false;
+        }
+        *value = mongodb_value_int64(v);
+      } else if (item->cmp_type() == REAL_RESULT || item->cmp_type() == DECIMAL_RESULT) {
+        *value = mongodb_value_double(item->val_real());
+      } else {
+        return false;
+      }
+      break;
+    case MONGODB_VALUE_STRING:
+    {
+      if (item->cmp_type() != STRING_RESULT) {
+        return false;
+      }
+      StringBuffer<MAX_FIELD_WIDTH> buffer;
+      String *s = item->val_str(&buffer);
+      if (s) {
+        strings->emplace_back();
+        if (!utf8_string(s, &strings->back())) {
+          return false;
+        }
+        *value = mongodb_value_utf8(strings->back().c_str(), strings->back().size());
+      }
+      break;
+    }
+    default:
+      return false;
+  }
+
+  if (item->null_value) {
+    value->value_type = BSON_TYPE_NULL;
+  } else if (kind == MONGODB_VALUE_NUMBER) {
+    record_value(ctx, item, value);
+  }
+  return true;
+}
+
+/*
+  Equality and [NOT] IN. _id strings of 24 hex digits also match the
+  ObjectId they show, and PAD SPACE collations ignore trailing spaces,
+  which takes an anchored regex per value.
+*/
+static bool append_equality(bson_t *clause, const char *path, MongoValueKind kind,
+                            CHARSET_INFO *cs, const bson_value_t *values, size_t count,
+                            bool negated)
+{
+  bool strings = kind == MONGODB_VALUE_STRING;
+  // The document key compares exactly, as point lookups assume
+  MongoStringMatch match = is_id(path) ? MONGODB_STRING_EXACT : string_match(cs);
+  if (strings && (match == MONGODB_STRING_NONE || (negated && match == MONGODB_STRING_PAD))) {
+    return false;
+  }
+
+  std::deque<std::string> patterns;
+  std::vector<bson_value_t> expanded;
+  bool regex = false;
+
+  for (size_t i = 0; i < count; i++) {
+    const bson_value_t *v = &values[i];
+    if (v->value_type == BSON_TYPE_NULL) {
+      // NOT IN (..., NULL) is never true; IN ignores the NULL
+      if (negated) {
+        return false;
+      }
+      continue;
+    }
+    if (v->value_type != BSON_TYPE_UTF8) {
+      expanded.push_back(*v);
+      continue;
+    }
+
+    const char *s = v->value.v_utf8.str;
+    size_t length = v->value.v_utf8.len;
+    if (is_id(path) && length == 24 && bson_oid_is_valid(s, length)) {
+      bson_oid_t oid;
+      bson_oid_init_from_string(&oid, s);
+      expanded.push_back(mongodb_value_oid(&oid));
+    }
+
+    if (match == MONGODB_STRING_PAD) {
+      patterns.emplace_back();
+      if (!mongodb_regex_pad_space(&patterns.back(), s, length)) {
+        return false;
+      }
+      expanded.push_back(mongodb_value_regex(patterns.back().c_str(), ""));
+      regex = true;
+    } else {
+      expanded.push_back(*v);
+    }
+  }
+
+  // Only NULLs - never true
+  if (expanded.empty()) {
+    return false;
+  }
+  if (expanded.size() == 1 && !regex) {
+    return mongodb_filter_compare(clause, path, negated ? MONGODB_FILTER_NE : MONGODB_FILTER_EQ,
+                                  &expanded[0]);
+  }
+  if (expanded.size() == 1) {
+    return mongodb_filter_regex(clause, path, expanded[0].value.v_regex.regex, "", false);
+  }
+  return mongodb_filter_in(clause, path, expanded.data(), expanded.size(), negated);
+}
+
+// Ranges need MongoDB's order to be the column's order
+static bool range_allowed(MongoValueKind kind, const char *path, CHARSET_INFO *cs)
+{
+  switch (kind) {
+    case MONGODB_VALUE_NUMBER:
+      return true;
+    case MONGODB_VALUE_STRING:
+      // ObjectIds sort apart from strings
+      return !is_id(path) && string_match(cs) == MONGODB_STRING_EXACT &&
+             string_order_preserved(cs);
+    default:
+      return false;
+  }
+}
+
+static MongoFilterOp mirrored(MongoFilterOp op)
+{
+  switch (op) {
+    case MONGODB_FILTER_LT:  return MONGODB_FILTER_GT;
+    case MONGODB_FILTER_LTE: return MONGODB_FILTER_GTE;
+    case MONGODB_FILTER_GT:  return MONGODB_FILTER_LT;
+    case MONGODB_FILTER_GTE: return MONGODB_FILTER_LTE;
+    default:                 return op;
+  }
+}
+
+static bool compare_holds(double x, MongoFilterOp op, double bound)
+{
+  switch (op) {
+    case MONGODB_FILTER_EQ:  return x == bound;
+    case MONGODB_FILTER_NE:  return x != bound;
+    case MONGODB_FILTER_LT:  return x < bound;
+    case MONGODB_FILTER_LTE: return x <= bound;
+    case MONGODB_FILTER_GT:  return x > bound;
+    case MONGODB_FILTER_GTE: return x >= bound;
+  }
+  return false;
+}
+
+/*
+  JSON reads are converted by MariaDB, so their filters keep every
+  document that could match and the condition stays with MariaDB. A
+  numeric comparison keeps the numbers that compare, every string (MariaDB
+  reads its numeric prefix) and, when 0 or 1 compares, what reads as that:
+  every present value but int, long and double reads as 0 (false, null,
+  arrays, and the objects relaxed extended JSON renders Decimal128, dates,
+  ObjectIds and the other types as), true as 1 under JSON_EXTRACT and as 0
+  otherwise. values is one bound, or the list of an IN.
+*/
+static bool json_number_clause(bson_t *clause, const char *path, MongoJsonRead read,
+                               MongoFilterOp op, const bson_value_t *values, size_t count)
+{
+  bool zero = false, one = false;
+  for (size_t i = 0; i < count; i++) {
+    double bound = values[i].value_type == BSON_TYPE_INT64 ? (double)values[i].value.v_int64
+                                                           : values[i].value.v_double;
+    zero = zero || compare_holds(0, op, bound);
+    one = one || compare_holds(1, op, bound);
+  }
+
+  // Strings, or when 0 compares every type that does not keep its number
+  static const char *const string_type[] = {"string"};
+  static const char *const number_types[] = {"int", "long", "double"};
+
+  bson_t numbers, others, truth;
+  bson_init(&numbers);
+  bson_init(&others);
+  bson_init(&truth);
+  const bson_t *alternatives[3] = {&numbers, &others, &truth};
+  size_t alternative_count = 2;
+
+  bool translated = (count == 1 ? mongodb_filter_compare(&numbers, path, op, &values[0])
+                                : mongodb_filter_in(&numbers, path, values, count, false)) &&
+                    (zero ? mongodb_filter_type(&others, path, number_types, 3, true)
+                          : mongodb_filter_type(&others, path, string_type, 1, false));
+  if (translated && !zero && one && read == MONGODB_JSON_EXTRACT) {
+    bson_value_t value = mongodb_value_bool(true);
+    translated = mongodb_filter_compare(&truth, path, MONGODB_FILTER_EQ, &value);
+    alternative_count++;
+  }
+  translated = translated && mongodb_filter_or(clause, alternatives, alternative_count);
+
+  bson_destroy(&numbers);
+  bson_destroy(&others);
+  bson_destroy(&truth);
+  return translated;
+}
+
+/*
+  Values a JSON read equal to a string can hold: the string, and the
+  number or boolean whose JSON text it is (trailing spaces aside, which
+  PAD SPACE ignores). JSON_EXTRACT may also be compared with quoted JSON
+  text. Text of a null, object or array is left to MariaDB.
+*/
+static bool json_string_values(MongoJsonRead read, const bson_value_t *value,
+                               std::deque<std::string> *strings, std::vector<bson_value_t> *out)
+{
+  const char *s = value->value.v_utf8.str;
+  size_t length = value->value.v_utf8.len;
+  while (length && s[length - 1] == ' ') {
+    length--;
+  }
+  if (length && (s[0] == '{' || s[0] == '[')) {
+    return false;
+  }
+  if (length == 4 && memcmp(s, "null", 4) == 0) {
+    return false;
+  }
+
+  out->push_back(*value);
+  if (read == MONGODB_JSON_EXTRACT && length >= 2 && s[0] == '"' && s[length - 1] == '"' &&
+      !memchr(s, '\\', length)) {
+    strings->emplace_back(s + 1, length - 2);
+    out->push_back(mongodb_value_utf8(strings->back().c_str(), strings->back().size()));
+  }
+
+  if ((length == 4 && memcmp(s, "true", 4) == 0) || (length == 5 && memcmp(s, "false", 5) == 0)) {
+    out->push_back(mongodb_value_bool(s[0] == 't'));
+  } else if (length) {
+    std::string text(s, length);
+    char *end;
+    double number = strtod(text.c_str(), &end);
+    if (*end == '\0' && std::isfinite(number)) {
+      out->push_back(mongodb_value_double(number));
+    }
+  }
+  return true;
+}
+
+/*
+  Comparison of a JSON read with constants; only equality (values holds
+  an IN list) compares with strings
+*/
+static bool append_json_comparison(MongoTranslateContext *ctx, bson_t *clause,
+                                   const MongoOperand *operand, MongoValueKind kind,
+                                   CHARSET_INFO *cs, MongoFilterOp op,
+                                   const bson_value_t *values, size_t count)
+{
+  // NULLs never compare; an IN ignores them
+  std::vector<bson_value_t> present;
+  for (size_t i = 0; i < count; i++) {
+    if (values[i].value_type != BSON_TYPE_NULL) {
+      present.push_back(values[i]);
+    }
+  }
+  if (present.empty()) {
+    return false;
+  }
+
+  // Which non-numbers are kept depends on the bounds
+  value_dependent(ctx);
+  bool translated;
+  if (kind == MONGODB_VALUE_NUMBER) {
+    translated = json_number_clause(clause, operand->path(), operand->json, op, present.data(),
+                                    present.size());
+  } else {
+    if (op != MONGODB_FILTER_EQ) {
+      return false;
+    }
+    std::deque<std::string> strings;
+    std::vector<bson_value_t> expanded;
+    for (const bson_value_t &value : present) {
+      if (!json_string_values(operand->json, &value, &strings, &expanded)) {
+        return false;
+      }
+    }
+    translated = append_equality(clause, operand->path(), MONGODB_VALUE_STRING, cs,
+                                 expanded.data(), expanded.size(), false);
+  }
+
+  if (translated) {
+    ctx->exact = false;
+  }
+  return translated;
+}
+
+/*
+  Pattern match over a JSON read: strings must match, anything else is
+  rendered as JSON text and kept for MariaDB to judge
+*/
+static bool append_json_text_match(MongoTranslateContext *ctx, bson_t *clause, const char *path,
+                                   const bson_t *match)
+{
+  static const char *const string_type[] = {"string"};
+  bson_t others;
+  bson_init(&others);
+  const bson_t *alternatives[2] = {match, &others};
+  bool translated = mongodb_filter_type(&others, path, string_type, 1, true) &&
+                    mongodb_filter_or(clause, alternatives, 2);
+  bson_destroy(&others);
+
+  if (translated) {
+    ctx->exact = false;
+  }
+  return translated;
+}
+
+/*
+  Time predicates. A temporal column shows a document's instant in the
+  session time zone, cut to the column's precision (milliseconds at most,
+  as the row sink stores them), to the day for DATE columns and DATE(), or
+  to the year for YEAR(). Comparing that value with a constant bounds the
+  local time to a range, [first, end) in microseconds, whose instants are
+  a BSON Date range on the field. _id_time instants are the creation
+  seconds ObjectIds start with, so its ranges are _id ranges between
+  ObjectIds of those seconds. Either way MongoDB answers from an index.
+  Integer _id_time columns hold epoch seconds, in no time zone.
+*/
+#define MONGODB_USEC_PER_SEC 1000000LL
+#define MONGODB_USEC_PER_DAY (86400 * MONGODB_USEC_PER_SEC)
+#define MONGODB_OID_TIME_END 0x100000000LL
+#define MONGODB_ZONE_SLACK 86400
+#define MONGODB_TIME_LIMIT 253402300800LL     // Seconds to 10000-01-01
+
+struct MongoTimeRange {
+  int64_t first;              // Inclusive, INT64_MIN when unbounded
+  int64_t end;                // Exclusive, INT64_MAX when unbounded
+  bool steady;                // Bounds are exact, see local_instant()
+};
+
+static bool is_time_operand(const MongoOperand *operand)
+{
+  return operand->json == MONGODB_JSON_NONE &&
+         (operand->id_time || field_value_kind(operand->field) == MONGODB_VALUE_TIME);
+}
+
+static int64_t floor_div(int64_t value, int64_t unit)
+{
+  return value / unit - (value % unit < 0);
+}
+
+static int64_t ceil_div(int64_t value, int64_t unit)
+{
+  return -floor_div(-value, unit);
+}
+
+// Seconds since the epoch of a broken-down UTC time
+static int64_t utc_seconds(const MYSQL_TIME *t)
+{
+  int64_t year = (int64_t)t->year - (t->month <= 2);
+  int64_t era = (year >= 0 ? year : year - 399) / 400;
+  int64_t year_of_era = year - era * 400;
+  int64_t day_of_year = (153 * (((int64_t)t->month + 9) % 12) + 2) / 5 + t->day - 1;
+  int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  int64_t days = era * 146097 + day_of_era - 719468;
+  return days * 86400 + t->hour * 3600 + t->minute * 60 + t->second;
+}
+
+// Year of a time in microseconds, the inverse of utc_seconds()
+static int64_t year_of(int64_t usec)
+{
+  int64_t days = floor_div(usec, MONGODB_USEC_PER_DAY) + 719468;
+  int64_t era = floor_div(days, 146097);
+  int64_t day_of_era = days - era * 146097;
+  int64_t year_of_era =
+      (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+  int64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+  // Months count from March, so January and February close the year
+  return era * 400 + year_of_era + ((5 * day_of_year + 2) / 153 >= 10);
+}
+
+static int64_t year_start(int64_t year)
+{
+  MYSQL_TIME t = {};
+  t.year = (uint)year;
+  t.month = 1;
+  t.day = 1;
+  return utc_seconds(&t) * MONGODB_USEC_PER_SEC;
+}
+
+static int64_t zone_offset(Time_zone *tz, int64_t seconds)
+{
+  MYSQL_TIME local;
+  tz->gmt_sec_to_TIME(&local, (my_time_t)seconds);
+  return utc_seconds(&local) - seconds;
+}
+
+// Microseconds between values a column can show
+static int64_t column_unit(const Field *field)
+{
+  int64_t unit = MONGODB_USEC_PER_SEC;
+  if (field->cmp_type() == TIME_RESULT) {
+    for (uint i = 0; i < field->decimals() && i < 3; i++) {
+      unit /= 10;
+    }
+  }
+  return unit;
+}
+
+// Start of the value the operand shows for a local time, and of the next
+static int64_t grid_floor(const MongoOperand *operand, int64_t local)
+{
+  switch (operand->grid) {
+    case MONGODB_GRID_DAY:
+      return floor_div(local, MONGODB_USEC_PER_DAY) * MONGODB_USEC_PER_DAY;
+    case MONGODB_GRID_YEAR:
+      return year_start(year_of(local));
+    default:
+    {
+      int64_t unit = column_unit(operand->field);
+      return floor_div(local, unit) * unit;
+    }
+  }
+}
+
+static int64_t grid_next(const MongoOperand *operand, int64_t start)
+{
+  switch (operand->grid) {
+    case MONGODB_GRID_DAY:
+      return start + MONGODB_USEC_PER_DAY;
+    case MONGODB_GRID_YEAR:
+      return year_start(year_of(start) + 1);
+    default:
+      return start + column_unit(operand->field);
+  }
+}
+
+/*
+  A constant as local microseconds: a date or datetime for temporal
+  columns, a year number under YEAR(), epoch seconds for integer columns.
+  Zero dates and TIME values have no instant.
+*/
+static bool time_constant(const MongoTranslateContext *ctx, const MongoOperand *operand,
+                          Item *item, int64_t *local)
+{
+  if (!is_constant(ctx, item) || item->type() == Item::NULL_ITEM) {
+    return false;
+  }
+  value_dependent(ctx, item);
+
+  if (operand->grid == MONGODB_GRID_YEAR || operand->field->cmp_type() != TIME_RESULT) {
+    if (item->cmp_type() != INT_RESULT) {
+      return false;
+    }
+    longlong v = item->val_int();
+    if (item->null_value || (item->unsigned_flag && v < 0)) {
+      return false;
+    }
+    if (operand->grid == MONGODB_GRID_YEAR) {
+      if (v < 1 || v > 9999) {
+        return false;
+      }
+      *local = year_start(v);
+    } else {
+      if (v <= -MONGODB_TIME_LIMIT || v >= MONGODB_TIME_LIMIT) {
+        return false;
+      }
+      *local = (int64_t)v * MONGODB_USEC_PER_SEC;
+    }
+    return true;
+  }
+
+  MYSQL_TIME ltime;
+  if (item->get_date(ctx->thd, &ltime, Datetime::Options(ctx->thd)) || item->null_value ||
+      (ltime.time_type != MYSQL_TIMESTAMP_DATE && ltime.time_type != MYSQL_TIMESTAMP_DATETIME) ||
+      !ltime.year || !ltime.month || !ltime.day) {
+    return false;
+  }
+  *local = utc_seconds(&ltime) * MONGODB_USEC_PER_SEC + (int64_t)ltime.second_part;
+  return true;
+}
+
+/*
+  Instant showing as a local time. Within a day of a change in the zone's
+  offset local times repeat or are skipped; the bound then moves a day
+  outward, in direction, and *steady is cleared.
+*/
+static int64_t local_instant(Time_zone *tz, int64_t local, int direction, bool *steady)
+{
+  if (!tz) {
+    return local;
+  }
+  int64_t local_seconds = floor_div(local, MONGODB_USEC_PER_SEC);
+  int64_t seconds = local_seconds - zone_offset(tz, local_seconds - zone_offset(tz, local_seconds));
+  if (zone_offset(tz, seconds - MONGODB_ZONE_SLACK) != zone_offset(tz, seconds + MONGODB_ZONE_SLACK)) {
+    seconds += direction * MONGODB_ZONE_SLACK;
+    *steady = false;
+  }
+  return local + (seconds - local_seconds) * MONGODB_USEC_PER_SEC;
+}
+
+/*
+  Instants where operand <op> a local time in microseconds. The value
+  shown is the start of the grid cell a local time falls in, so a value
+  inside a cell is never equal, and bounds move to the cell edges.
+*/
+static bool time_value_range(const MongoTranslateContext *ctx, const MongoOperand *operand,
+                             MongoFilterOp op, int64_t value, MongoTimeRange *range)
+{
+  bool temporal = operand->field->cmp_type() == TIME_RESULT;
+  int64_t start = grid_floor(operand, value);
+  int64_t next = grid_next(operand, start);
+  int64_t edge = start == value ? value : next;
+
+  range->first = INT64_MIN;
+  range->end = INT64_MAX;
+  switch (op) {
+    case MONGODB_FILTER_EQ:
+      if (start != value) {
+        return false;
+      }
+      range->first = value;
+      range->end = next;
+      break;
+    case MONGODB_FILTER_GTE: range->first = edge; break;
+    case MONGODB_FILTER_GT:  range->first = next; break;
+    case MONGODB_FILTER_LT:  range->end = edge; break;
+    case MONGODB_FILTER_LTE: range->end = next; break;
+    default:                 return false;
+  }
+
+  Time_zone *tz = temporal ? ctx->thd->variables.time_zone : nullptr;
+  range->steady = true;
+  if (range->first != INT64_MIN) {
+    range->first = local_instant(tz, range->first, -1, &range->steady);
+  }
+  if (range->end != INT64_MAX) {
+    range->end = local_instant(tz, range->end, 1, &range->steady);
+  }
+  return true;
+}
+
+// Instants where operand <op> constant
+static bool time_comparison_range(const MongoTranslateContext *ctx, const MongoOperand *operand,
+                                  MongoFilterOp op, Item *constant, MongoTimeRange *range)
+{
+  const Field *field = operand->field;
+  bool temporal = field->cmp_type() == TIME_RESULT;
+  if (temporal && !ctx->thd) {
+    return false;
+  }
+  // Fractions rounded rather than truncated into a coarser column
+  if (temporal && !operand->id_time && operand->grid == MONGODB_GRID_COLUMN &&
+      field->decimals() < 3 && (ctx->thd->variables.sql_mode & MODE_TIME_ROUND_FRACTIONAL)) {
+    return false;
+  }
+
+  int64_t value;
+  return time_constant(ctx, operand, constant, &value) &&
+         time_value_range(ctx, operand, op, value, range);
+}
+
+static bson_value_t oid_of_second(bson_oid_t *oid, int64_t seconds)
+{
+  uint8_t bytes[12] = {0};
+  bytes[0] = (uint8_t)(seconds >> 24);
+  bytes[1] = (uint8_t)(seconds >> 16);
+  bytes[2] = (uint8_t)(seconds >> 8);
+  bytes[3] = (uint8_t)seconds;
+  bson_oid_init_from_data(oid, bytes);
+  return mongodb_value_oid(oid);
+}
+
+/*
+  _id_time within a range: ObjectIds of the whole seconds in it. Other
+  _id types read as NULL and fall outside any ObjectId range.
+*/
+static bool append_id_time_range(bson_t *clause, const MongoTimeRange *range)
+{
+  int64_t first = range->first == INT64_MIN ? 0 : ceil_div(range->first, MONGODB_USEC_PER_SEC);
+  int64_t end = range->end == INT64_MAX ? MONGODB_OID_TIME_END
+                                        : ceil_div(range->end, MONGODB_USEC_PER_SEC);
+  first = first < 0 ? 0 : first;
+  end = end > MONGODB_OID_TIME_END ? MONGODB_OID_TIME_END : end;
+  // Never true; MariaDB finds no rows by itself
+  if (first >= end) {
+    return false;
+  }
+
+  if (first == 0 && end == MONGODB_OID_TIME_END) {
+    static const char *const oid_type[] = {"objectId"};
+    return mongodb_filter_type(clause, "_id", oid_type, 1, false);
+  }
+
+  bson_oid_t low_oid, high_oid;
+  bson_value_t low = oid_of_second(&low_oid, first);
+  bson_value_t high = end < MONGODB_OID_TIME_END ? oid_of_second(&high_oid, end) : low;
+  return mongodb_filter_range(clause, "_id", first > 0 ? &low : nullptr, true,
+                              end < MONGODB_OID_TIME_END ? &high : nullptr, false);
+}
+
+/*
+  The operand's instant within a range: whole milliseconds of BSON Dates,
+  which is all a temporal column reads; bounds that are not steady are
+  left for MariaDB to check
+*/
+static bool append_time_range(MongoTranslateContext *ctx, bson_t *clause,
+                              const MongoOperand *operand, const MongoTimeRange *range)
+{
+  if (!range->steady) {
+    ctx->exact = false;
+  }
+  if (operand->id_time) {
+    return append_id_time_range(clause, range);
+  }
+
+  bool bounded_below = range->first != INT64_MIN;
+  bool bounded_above = range->end != INT64_MAX;
+  int64_t first = bounded_below ? ceil_div(range->first, 1000) : 0;
+  int64_t end = bounded_above ? ceil_div(range->end, 1000) : 0;
+  if (bounded_below && bounded_above && first >= end) {
+    return false;
+  }
+  if (!bounded_below && !bounded_above) {
+    static const char *const date_type[] = {"date"};
+    return mongodb_filter_type(clause, operand->path(), date_type, 1, false);
+  }
+
+  bson_value_t low = mongodb_value_date_time(first);
+  bson_value_t high = mongodb_value_date_time(end);
+  return mongodb_filter_range(clause, operand->path(), bounded_below ? &low : nullptr, true,
+                              bounded_above ? &high : nullptr, false);
+}
+
+static bool append_time_comparison(MongoTranslateContext *ctx, bson_t *clause,
+                                   const MongoOperand *operand, MongoFilterOp op,
+                                   Item *constant)
+{
+  MongoTimeRange range;
+  return time_comparison_range(ctx, operand, op, constant, &range) &&
+         append_time_range(ctx, clause, operand, &range);
+}
+
+// Time operand IN (constants): one range per value
+static bool translate_time_in(MongoTranslateContext *ctx, Item_func *func,
+                              const MongoOperand *operand, bson_t *match_doc)
+{
+  Item **args = func->arguments();
+  std::vector<bson_t*> clauses;
+  bool translated = true;
+
+  for (uint i = 1; i < func->argument_count() && translated; i++) {
+    bson_t *clause = bson_new();
+    clauses.push_back(clause);
+    translated = append_time_comparison(ctx, clause, operand, MONGODB_FILTER_EQ, args[i]);
+  }
+  translated = translated && mongodb_filter_or(match_doc, clauses.data(), clauses.size());
+
+  for (bson_t *clause : clauses) {
+    bson_destroy(clause);
+  }
+  return translated;
+}
+
+// operand <op> value
+static bool append_comparison(MongoTranslateContext *ctx, bson_t *clause,
+                              const MongoOperand *operand, MongoValueKind kind,
+                              CHARSET_INFO *cs, MongoFilterOp op, const bson_value_t *value)
+{
+  const char *path = operand->path();
+  if (operand->json != MONGODB_JSON_NONE) {
+    return append_json_comparison(ctx, clause, operand, kind, cs, op, value, 1);
+  }
+  if (op == MONGODB_FILTER_EQ || op == MONGODB_FILTER_NE) {
+    return append_equality(clause, path, kind, cs, value, 1, op == MONGODB_FILTER_NE);
+  }
+  return range_allowed(kind, path, cs) && mongodb_filter_compare(clause, path, op, value);
+}
+
+/*
+  Aggregation expressions for $expr, the fallback for comparisons that
+  are not a column against constants. Columns are typed references to
+  numeric and string columns; arithmetic must compute in integers or
+  doubles, as MongoDB does. Kind NONE is a NULL constant, which fits any
+  other kind. Like the find() filters, values compare as the BSON types
+  of the mapped columns.
+*/
+static bool translate_expression(MongoTranslateContext *ctx, Item *item, bson_t *expr,
+                                 MongoValueKind *kind);
+static bool translate_expression_condition(MongoTranslateContext *ctx, Item *item,
+                                           bson_t *expr);
+
+static bool merge_kind(MongoValueKind *kind, MongoValueKind other)
+{
+  if (*kind == MONGODB_VALUE_NONE) {
+    *kind = other;
+    return true;
+  }
+  return other == MONGODB_VALUE_NONE || other == *kind;
+}
+
+static void destroy_expressions(std::vector<bson_t*> *expressions)
+{
+  for (bson_t *expr : *expressions) {
+    bson_destroy(expr);
+  }
+  expressions->clear();
+}
+
+// Translate items into new expressions, merging their kinds into *kind
+static bool translate_expression_list(MongoTranslateContext *ctx, Item **items, uint count,
+                                      std::vector<bson_t*> *expressions, MongoValueKind *kind)
+{
+  for (uint i = 0; i < count; i++) {
+    MongoValueKind item_kind;
+    expressions->push_back(bson_new());
+    if (!translate_expression(ctx, items[i], expressions->back(), &item_kind) ||
+        !merge_kind(kind, item_kind)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool literal_int(bson_t *expr, int64_t value)
+{
+  bson_value_t literal = mongodb_value_int64(value);
+  return mongodb_expr_literal(expr, &literal);
+}
+
+// Arithmetic MariaDB computes in BIGINT or DOUBLE, as MongoDB does
+static bool translate_arithmetic(MongoTranslateContext *ctx, Item_func *func, const char *op,
+                                 bson_t *expr)
+{
+  if ((func->result_type() != INT_RESULT && func->result_type() != REAL_RESULT) ||
+      func->unsigned_flag) {
+    return false;
+  }
+
+  std::vector<bson_t*> args;
+  MongoValueKind kind = MONGODB_VALUE_NONE;
+  // Unary minus is 0 - x
+  if (func->argument_count() == 1) {
+    args.push_back(bson_new());
+    literal_int(args.back(), 0);
+  }
+  bool translated = translate_expression_list(ctx, func->arguments(), func->argument_count(),
+                                              &args, &kind) &&
+                    kind != MONGODB_VALUE_STRING &&
+                    mongodb_expr_operator(expr, op, args.data(), args.size());
+  destroy_expressions(&args);
+  return translated;
+}
+
+// COALESCE and IFNULL as nested two-argument $ifNull
+static bool translate_coalesce(MongoTranslateContext *ctx, Item_func *func, bson_t *expr,
+                               MongoValueKind *kind)
+{
+  std::vector<bson_t*> args;
+  *kind = MONGODB_VALUE_NONE;
+  bool translated = func->argument_count() >= 2 &&
+                    translate_expression_list(ctx, func->arguments(), func->argument_count(),
+                                              &args, kind);
+  for (size_t i = args.size() - 1; translated && i > 0; i--) {
+    bson_t *pair[2] = {args[i - 1], args[i]};
+    bson_t *combined = bson_new();
+    translated = mongodb_expr_operator(combined, "$ifNull", pair, 2);
+    bson_destroy(args[i - 1]);
+    args[i - 1] = combined;
+  }
+  translated = translated && bson_concat(expr, args[0]);
+  destroy_expressions(&args);
+  return translated;
+}
+
+/*
+  SUBSTRING(s, pos[, len]) with constant positions from 1 on, in code
+  points as MariaDB counts characters. $substrCP reads null as "", so
+  NULL is kept by a $cond.
+*/
+static bool translate_substring(MongoTranslateContext *ctx, Item_func *func, bson_t *expr)
+{
+  Item **args = func->arguments();
+  uint count = func->argument_count();
+  if ((count != 2 && count != 3) || func->collation.collation == &my_charset_bin) {
+    return false;
+  }
+
+  longlong start = 0, length = INT32_MAX;
+  for (uint i = 1; i < count; i++) {
+    if (!is_constant(ctx, args[i]) || args[i]->cmp_type() != INT_RESULT) {
+      return false;
+    }
+    value_dependent(ctx, args[i]);
+    longlong v = args[i]->val_int();
+    if (args[i]->null_value || v < (i == 1 ? 1 : 0) || v > INT32_MAX) {
+      return false;
+    }
+    if (i == 1) {
+      start = v - 1;
+    } else {
+      length = v;
+    }
+  }
+
+  MongoValueKind kind;
+  bson_t string, test, substring, nothing, from, span;
+  bson_init(&string);
+  bson_init(&test);
+  bson_init(&substring);
+  bson_init(&nothing);
+  bson_init(&from);
+  bson_init(&span);
+  bson_value_t null_value;
+  null_value.value_type = BSON_TYPE_NULL;
+  const bson_t *substring_args[3] = {&string, &from, &span};
+  const bson_t *cond_args[3] = {&test, &substring, &nothing};
+  bool translated = translate_expression(ctx, args[0], &string, &kind) &&
+                    kind != MONGODB_VALUE_NUMBER &&
+                    literal_int(&from, start) && literal_int(&span, length) &&
+                    mongodb_expr_operator(&substring, "$substrCP", substring_args, 3) &&
+                    mongodb_expr_not_null(&test, &string) &&
+                    mongodb_expr_literal(&nothing, &null_value) &&
+                    mongodb_expr_operator(expr, "$cond", cond_args, 3);
+  bson_destroy(&string);
+  bson_destroy(&test);
+  bson_destroy(&substring);
+  bson_destroy(&nothing);
+  bson_destroy(&from);
+  bson_destroy(&span);
+  return translated;
+}
+
+/*
+  Searched CASE: WHEN conditions come first in the arguments, then the
+  THEN values, then an optional ELSE
+*/
+static bool translate_case(MongoTranslateContext *ctx, Item_func *func, bson_t *expr,
+                           MongoValueKind *kind)
+{
+  Item **args = func->arguments();
+  uint whens = func->argument_count() / 2;
+  bool with_else = func->argument_count() % 2;
+  if (!whens) {
+    return false;
+  }
+
+  std::vector<bson_t*> cases, values;
+  *kind = MONGODB_VALUE_NONE;
+  bool translated = true;
+  for (uint i = 0; i < whens && translated; i++) {
+    cases.push_back(bson_new());
+    translated = translate_expression_condition(ctx, args[i], cases.back());
+  }
+  translated = translated &&
+               translate_expression_list(ctx, args + whens, whens + with_else, &values, kind) &&
+               mongodb_expr_switch(expr, cases.data(), values.data(), whens,
+                                   with_else ? values.back() : nullptr);
+  destroy_expressions(&cases);
+  destroy_expressions(&values);
+  return translated;
+}
+
+static bool translate_expression(MongoTranslateContext *ctx, Item *item, bson_t *expr,
+                                 MongoValueKind *kind)
+{
+  Item *real = item->real_item();
+  if (is_constant(ctx, real)) {
+    std::deque<std::string> strings;
+    bson_value_t value;
+    *kind = real->cmp_type() == STRING_RESULT ? MONGODB_VALUE_STRING : MONGODB_VALUE_NUMBER;
+    if (!constant_value(ctx, *kind, real, &strings, &value)) {
+      return false;
+    }
+    if (value.value_type == BSON_TYPE_NULL) {
+      *kind = MONGODB_VALUE_NONE;
+    }
+    return mongodb_expr_literal(expr, &value);
+  }
+
+  if (real->type() == Item::FIELD_ITEM) {
+    MongoOperand operand;
+    if (!resolve_operand(ctx, real, &operand) || operand.json != MONGODB_JSON_NONE ||
+        operand.id_time || is_id(operand.path())) {
+      return false;
+    }
+    *kind = field_value_kind(operand.field);
+    if (*kind != MONGODB_VALUE_NUMBER && *kind != MONGODB_VALUE_STRING) {
+      return false;
+    }
+    return mongodb_expr_field(expr, operand.path(), *kind == MONGODB_VALUE_NUMBER
+                                                        ? MONGODB_EXPR_NUMBER
+                                                        : MONGODB_EXPR_STRING);
+  }
+
+  if (real->type() != Item::FUNC_ITEM) {
+    return false;
+  }
+  Item_func *func = (Item_func*)real;
+  *kind = MONGODB_VALUE_NUMBER;
+  if (is_function(func, "+")) {
+    return translate_arithmetic(ctx, func, "$add", expr);
+  }
+  if (is_function(func, "-")) {
+    return translate_arithmetic(ctx, func, "$subtract", expr);
+  }
+  if (is_function(func, "*")) {
+    return translate_arithmetic(ctx, func, "$multiply", expr);
+  }
+  if (is_function(func, "coalesce") || is_function(func, "ifnull")) {
+    return translate_coalesce(ctx, func, expr, kind);
+  }
+  if (func->functype() == Item_func::CASE_SEARCHED_FUNC) {
+    return translate_case(ctx, func, expr, kind);
+  }
 
-namespace mongodb_translator {
+  *kind = MONGODB_VALUE_STRING;
+  if (is_function(func, "substr")) {
+    return translate_substring(ctx, func, expr);
+  }
+  if (is_function(func, "concat")) {
+    std::vector<bson_t*> args;
+    MongoValueKind arg_kind = MONGODB_VALUE_NONE;
+    bool translated = translate_expression_list(ctx, func->arguments(), func->argument_count(),
+                                                &args, &arg_kind) &&
+                      arg_kind != MONGODB_VALUE_NUMBER &&
+                      mongodb_expr_operator(expr, "$concat", args.data(), args.size());
+    destroy_expressions(&args);
+    return translated;
+  }
+  return false;
+}
+
+// Whether MongoDB's comparison holds with side NULL, as null sorts lowest
+static bool null_satisfies(MongoFilterOp op, uint side)
+{
+  switch (op) {
+    case MONGODB_FILTER_EQ:  return false;
+    case MONGODB_FILTER_NE:  return true;
+    case MONGODB_FILTER_GT:
+    case MONGODB_FILTER_GTE: return side == 1;
+    default:                 return side == 0;
+  }
+}
+
+/*
+  left <op> right, true only where SQL's is: neither side NULL. Strings
+  compare as UTF-8 bytes, so the collation must be binary and NO PAD,
+  and keep the byte order for ranges.
+*/
+static bool translate_expression_comparison(MongoTranslateContext *ctx, Item_func *func,
+                                            MongoFilterOp op, bson_t *expr)
+{
+  Item **args = func->arguments();
+  std::vector<bson_t*> sides, terms;
+  MongoValueKind kind = MONGODB_VALUE_NONE;
+  if (!translate_expression_list(ctx, args, 2, &sides, &kind) || kind == MONGODB_VALUE_NONE) {
+    destroy_expressions(&sides);
+    return false;
+  }
+  CHARSET_INFO *cs = func->compare_collation();
+  if (kind == MONGODB_VALUE_STRING &&
+      (string_match(cs) != MONGODB_STRING_EXACT ||
+       (op != MONGODB_FILTER_EQ && op != MONGODB_FILTER_NE && !string_order_preserved(cs)))) {
+    destroy_expressions(&sides);
+    return false;
+  }
+
+  bool translated = true;
+  for (uint i = 0; i < 2 && translated; i++) {
+    // A NULL constant is never compared; other constants need no test
+    if (args[i]->type() == Item::NULL_ITEM ||
+        (is_constant(ctx, args[i]) && args[i]->is_null())) {
+      translated = false;
+    } else if (!is_constant(ctx, args[i]) &&
+               (!is_constant(ctx, args[1 - i]) || null_satisfies(op, i))) {
+      terms.push_back(bson_new());
+      translated = mongodb_expr_not_null(terms.back(), sides[i]);
+    }
+  }
+  if (translated) {
+    terms.push_back(bson_new());
+    translated = mongodb_expr_compare(terms.back(), op, sides[0], sides[1]) &&
+                 (terms.size() == 1 ? bson_concat(expr, terms[0])
+                                    : mongodb_expr_operator(expr, "$and", terms.data(),
+                                                            terms.size()));
+  }
+  destroy_expressions(&sides);
+  destroy_expressions(&terms);
+  return translated;
+}
+
+// A condition as an expression that is true exactly where SQL's is TRUE
+static bool translate_expression_condition(MongoTranslateContext *ctx, Item *item,
+                                           bson_t *expr)
+{
+  if (item->type() == Item::COND_ITEM) {
+    Item_cond *cond = (Item_cond*)item;
+    bool is_and = cond->functype() == Item_func::COND_AND_FUNC;
+    if (!is_and && cond->functype() != Item_func::COND_OR_FUNC) {
+      return false;
+    }
+    std::vector<bson_t*> terms;
+    List_iterator_fast<Item> it(*cond->argument_list());
+    bool translated = true;
+    Item *arg;
+    while (translated && (arg = it++)) {
+      terms.push_back(bson_new());
+      translated = translate_expression_condition(ctx, arg, terms.back());
+    }
+    translated = translated && !terms.empty() &&
+                 mongodb_expr_operator(expr, is_and ? "$and" : "$or", terms.data(),
+                                       terms.size());
+    destroy_expressions(&terms);
+    return translated;
+  }
+
+  if (item->type() != Item::FUNC_ITEM) {
+    return false;
+  }
+  Item_func *func = (Item_func*)item;
+  MongoFilterOp op;
+  switch (func->functype()) {
+    case Item_func::EQ_FUNC: op = MONGODB_FILTER_EQ; break;
+    case Item_func::NE_FUNC: op = MONGODB_FILTER_NE; break;
+    case Item_func::LT_FUNC: op = MONGODB_FILTER_LT; break;
+    case Item_func::LE_FUNC: op = MONGODB_FILTER_LTE; break;
+    case Item_func::GT_FUNC: op = MONGODB_FILTER_GT; break;
+    case Item_func::GE_FUNC: op = MONGODB_FILTER_GTE; break;
+    default:                 return false;
+  }
+  return translate_expression_comparison(ctx, func, op, expr);
+}
+
+/*
+  Value a JSON search function looks into: the document column ("" for
+  the whole document) or a JSON_EXTRACT of it, then an optional constant
+  path below that
+*/
+static bool json_search_target(const MongoTranslateContext *ctx, Item *item, Item *path_item,
+                               std::string *path)
+{
+  MongoOperand operand;
+  if (is_document_column(ctx, item)) {
+    path->clear();
+  } else if (resolve_operand(ctx, item, &operand) && operand.json == MONGODB_JSON_EXTRACT) {
+    *path = operand.json_path;
+  } else {
+    return false;
+  }
+
+  std::string json_path, below;
+  if (!path_item) {
+    return true;
+  }
+  if (!constant_utf8(ctx, path_item, &json_path)) {
+    return false;
+  }
+  if (json_path == "$") {
+    return true;
+  }
+  if (!mongodb_filter_json_path(json_path.data(), json_path.size(), &below)) {
+    return false;
+  }
+  if (!path->empty()) {
+    path->push_back('.');
+  }
+  path->append(below);
+  return true;
+}
+
+static bool translate_condition(const Item *cond, const TABLE *table, bool lookup,
+                                bson_t *match_doc, bool *exact, MongoPlanRecording *recording)
+{
+  MongoTranslateContext ctx;
+  ctx.table = table;
+  ctx.thd = table->in_use;
+  ctx.exact = true;
+  ctx.recording = recording;
+  ctx.lookup = lookup;
+
+  bool translated = translate_item(&ctx, const_cast<Item*>(cond), match_doc);
+
+  // Constants that failed to evaluate must not become a filter
+  if (translated && ctx.thd && ctx.thd->is_error()) {
+    translated = false;
+  }
+  if (exact) {
+    *exact = translated && ctx.exact;
+  }
+  return translated;
+}
 
 /**
  * Convert MariaDB Item to MongoDB BSON match filter
- * Returns true if translation was successful and filter should be pushed down
+ * Returns true if a filter was built; *exact is set when MariaDB need not
+ * evaluate the condition again
  */
-bool translate_condition_to_bson(const Item *cond, bson_t *match_filter) {
-  if (!cond || !match_filter) {
+bool translate_condition_to_bson(const Item *cond, const TABLE *table, bson_t *match_doc,
+                                 bool *exact)
+{
+  if (!cond || !table || !match_doc) {
     return false;
   }
-  
-  // For now, create a simple demonstration filter
-  // TODO: Implement full condition translation when header issues are resolved
-  BSON_APPEND_UTF8(match_filter, "city", "Paris");
-  
+  return translate_condition(cond, table, false, match_doc, exact, nullptr);
+}
+
+/*
+  Filter plan cache key: what translation reads from a condition (items,
+  functions and their flags, columns by position, collations, the
+  session's zone and modes) and the values of every constant except the
+  numeric ones, which are numbered into constants instead. Conditions of
+  one key translate to the same filter but for those numbers.
+*/
+static void key_int(std::string *key, uint64_t value)
+{
+  key->append((const char*)&value, sizeof(value));
+}
+
+static void key_pointer(std::string *key, const void *pointer)
+{
+  key_int(key, (uint64_t)(uintptr_t)pointer);
+}
+
+static bool shape_item(const MongoTranslateContext *ctx, Item *item, std::string *key,
+                       std::vector<Item*> *constants)
+{
+  key_int(key, item->type());
+  if (is_constant(ctx, item)) {
+    key_int(key, item->cmp_type());
+    key_int(key, item->field_type());
+    key_int(key, item->unsigned_flag);
+    key_int(key, item->decimals);
+    key_pointer(key, item->collation.collation);
+    if (item->type() == Item::NULL_ITEM) {
+      return true;
+    }
+    if (slot_constant(item)) {
+      constants->push_back(item->real_item());
+      return true;
+    }
+    if (item->cmp_type() == ROW_RESULT) {
+      return false;
+    }
+    StringBuffer<MAX_FIELD_WIDTH> buffer;
+    String *value = item->val_str(&buffer);
+    if (!value) {
+      key->push_back('N');
+      return true;
+    }
+    key->push_back('S');
+    key_pointer(key, value->charset());
+    key_int(key, value->length());
+    key->append(value->ptr(), value->length());
+    return true;
+  }
+
+  Item *real = item->real_item();
+  if (real != item) {
+    return shape_item(ctx, real, key, constants);
+  }
+
+  switch (item->type()) {
+    case Item::FIELD_ITEM:
+    {
+      Field *field = ((Item_field*)item)->field;
+      if (field && field->table == ctx->table) {
+        key_int(key, field->field_index);
+      } else {
+        key->push_back('O');
+      }
+      return true;
+    }
+    case Item::COND_ITEM:
+    {
+      Item_cond *cond = (Item_cond*)item;
+      key_int(key, cond->functype());
+      List_iterator_fast<Item> it(*cond->argument_list());
+      Item *arg;
+      while ((arg = it++)) {
+        if (!shape_item(ctx, arg, key, constants)) {
+          return false;
+        }
+        key->push_back(',');
+      }
+      key->push_back(')');
+      return true;
+    }
+    case Item::FUNC_ITEM:
+      break;
+    default:
+      key_int(key, item->cmp_type());
+      return true;
+  }
+
+  Item_func *func = (Item_func*)item;
+  LEX_CSTRING name = func->func_name_cstring();
+  key_int(key, func->functype());
+  key_int(key, name.length);
+  key->append(name.str, name.length);
+  key_int(key, func->result_type());
+  key_int(key, func->cmp_type());
+  key_int(key, func->field_type());
+  key_int(key, func->unsigned_flag);
+  key_int(key, func->decimals);
+  key_pointer(key, func->collation.collation);
+  key_pointer(key, func->compare_collation());
+
+  switch (func->functype()) {
+    case Item_func::BETWEEN:
+    case Item_func::IN_FUNC:
+      key_int(key, ((Item_func_opt_neg*)func)->negated);
+      break;
+    case Item_func::LIKE_FUNC:
+      key_int(key, ((Item_func_like*)func)->get_negated());
+      key_int(key, (uint64_t)(int64_t)((Item_func_like*)func)->escape);
+      break;
+    case Item_func::MULT_EQUAL_FUNC:
+    {
+      Item_equal *equal = (Item_equal*)func;
+      Item_equal_fields_iterator it(*equal);
+      Item *field;
+      while ((field = it++)) {
+        if (!shape_item(ctx, field, key, constants)) {
+          return false;
+        }
+        key->push_back(',');
+      }
+      Item *constant = equal->get_const();
+      key->push_back(constant ? '=' : ')');
+      return !constant || shape_item(ctx, constant, key, constants);
+    }
+    default:
+      break;
+  }
+
+  key_int(key, func->argument_count());
+  Item **args = func->arguments();
+  for (uint i = 0; i < func->argument_count(); i++) {
+    if (!shape_item(ctx, args[i], key, constants)) {
+      return false;
+    }
+  }
   return true;
 }
 
-// Placeholder implementations for the declared functions
-bool translate_function_item(const Item_func* func, bson_t* match_doc) {
-  return false;
+static bool condition_shape(const Item *cond, const TABLE *table, bool lookup,
+                            std::string *key, std::vector<Item*> *constants)
+{
+  MongoTranslateContext ctx;
+  ctx.table = table;
+  ctx.thd = table->in_use;
+  ctx.exact = true;
+  ctx.recording = nullptr;
+  ctx.lookup = lookup;
+  if (!ctx.thd) {
+    return false;
+  }
+  key_int(key, lookup);
+  key_pointer(key, ctx.thd->variables.time_zone);
+  key_int(key, ctx.thd->variables.sql_mode);
+  key_int(key, ctx.thd->variables.default_regex_flags);
+  return shape_item(&ctx, const_cast<Item*>(cond), key, constants) && !ctx.thd->is_error();
 }
 
-bool translate_condition_item(const Item_cond* cond, bson_t* match_doc) {
-  return false;
+// Current values of the slot constants, as constant_value() appends them
+static bool slot_values(THD *thd, const std::vector<Item*> &constants,
+                        std::vector<bson_value_t> *values)
+{
+  for (Item *item : constants) {
+    if (item->cmp_type() == INT_RESULT) {
+      longlong v = item->val_int();
+      if (item->null_value || (item->unsigned_flag && v < 0)) {
+        return false;
+      }
+      values->push_back(mongodb_value_int64(v));
+    } else {
+      double v = item->val_real();
+      if (item->null_value) {
+        return false;
+      }
+      values->push_back(mongodb_value_double(v));
+    }
+  }
+  return !thd->is_error();
 }
 
-bool translate_equality(const Item_func* func, bson_t* match_doc) {
-  return false;
+bool translate_condition_cached(const Item *cond, const TABLE *table, bool lookup,
+                                MongoFilterPlanCache *plans, bson_t *match_doc, bool *exact)
+{
+  if (!cond || !table || !match_doc) {
+    return false;
+  }
+
+  std::string fingerprint;
+  MongoPlanRecording recording;
+  if (!plans || !condition_shape(cond, table, lookup, &fingerprint, &recording.constants)) {
+    return translate_condition(cond, table, lookup, match_doc, exact, nullptr);
+  }
+
+  std::shared_ptr<const MongoFilterPlan> plan = plans->lookup(fingerprint);
+  if (plan) {
+    std::vector<bson_value_t> values;
+    if (slot_values(table->in_use, recording.constants, &values) &&
+        mongodb_filter_plan_apply(*plan, values, match_doc)) {
+      if (exact) {
+        *exact = plan->exact;
+      }
+      return true;
+    }
+    // A NULL or out of range number translates differently
+    bson_reinit(match_doc);
+  }
+
+  recording.cacheable = true;
+  bool filter_exact = false;
+  bool translated = translate_condition(cond, table, lookup, match_doc, &filter_exact, &recording);
+  if (translated && recording.cacheable) {
+    std::shared_ptr<MongoFilterPlan> built = std::make_shared<MongoFilterPlan>();
+    if (mongodb_filter_plan_build(match_doc, recording.params,
+                                  (uint32_t)recording.constants.size(), filter_exact,
+                                  built.get())) {
+      plans->insert(fingerprint, built);
+    }
+  }
+  if (exact) {
+    *exact = filter_exact;
+  }
+  return translated;
 }
 
-bool translate_comparison(const Item_func* func, bson_t* match_doc, const char* mongodb_op) {
-  return false;
+/*
+  Equality of a stored column with the value decoded into it, as an exact
+  index read sends its key: the equality and time-range clauses of a
+  pushed "column = constant". Only exact clauses are built; false for
+  columns MongoDB cannot match the way MariaDB compares them.
+*/
+bool translate_key_equality(Field *field, bson_t *match_doc)
+{
+  MongoOperand operand;
+  if (!field || field->vcol_info || !column_operand(field, &operand)) {
+    return false;
+  }
+
+  MongoTranslateContext ctx;
+  ctx.table = field->table;
+  ctx.thd = field->table->in_use;
+  ctx.exact = true;
+  ctx.recording = nullptr;
+  ctx.lookup = false;
+
+  if (is_time_operand(&operand)) {
+    int64_t local;
+    if (field->cmp_type() == TIME_RESULT) {
+      MYSQL_TIME ltime;
+      if (!ctx.thd || field->get_date(&ltime, Datetime::Options(ctx.thd)) ||
+          (ltime.time_type != MYSQL_TIMESTAMP_DATE &&
+           ltime.time_type != MYSQL_TIMESTAMP_DATETIME) ||
+          !ltime.year || !ltime.month || !ltime.day) {
+        return false;
+      }
+      local = utc_seconds(&ltime) * MONGODB_USEC_PER_SEC + (int64_t)ltime.second_part;
+    } else if (field->cmp_type() == INT_RESULT && !field->is_unsigned()) {
+      longlong v = field->val_int();
+      if (v <= -MONGODB_TIME_LIMIT || v >= MONGODB_TIME_LIMIT) {
+        return false;
+      }
+      local = (int64_t)v * MONGODB_USEC_PER_SEC;
+    } else {
+      return false;
+    }
+    MongoTimeRange range;
+    // A widened range would return rows of other keys
+    return time_value_range(&ctx, &operand, MONGODB_FILTER_EQ, local, &range) &&
+           range.steady && append_time_range(&ctx, match_doc, &operand, &range) &&
+           scalar_clause(&operand, match_doc);
+  }
+
+  MongoValueKind kind = field_value_kind(field);
+  bson_value_t value;
+  std::string text;
+  switch (kind) {
+    case MONGODB_VALUE_NUMBER:
+      if (field->cmp_type() == INT_RESULT) {
+        if (field->is_unsigned()) {
+          // Unsigned values above INT64_MAX have no BSON integer
+          ulonglong v = field->val_uint();
+          if (v > (ulonglong)INT64_MAX) {
+            return false;
+          }
+          value = mongodb_value_int64((int64_t)v);
+        } else {
+          value = mongodb_value_int64((int64_t)field->val_int());
+        }
+      } else {
+        value = mongodb_value_double(field->val_real());
+      }
+      break;
+    case MONGODB_VALUE_STRING:
+    {
+      StringBuffer<MAX_FIELD_WIDTH> buffer;
+      String *s = field->val_str(&buffer);
+      if (!s || !utf8_string(s, &text)) {
+        return false;
+      }
+      value = mongodb_value_utf8(text.c_str(), text.size());
+      break;
+    }
+    default:
+      return false;
+  }
+  return append_equality(match_doc, operand.path(), kind, field->charset(), &value, 1, false) &&
+         scalar_clause(&operand, match_doc);
 }
 
-bool translate_in_condition(const Item_func* func, bson_t* match_doc) {
-  return false;
+bool translate_item(MongoTranslateContext *ctx, Item *item, bson_t *match_doc)
+{
+  size_t recorded = ctx->recording ? ctx->recording->params.size() : 0;
+  bool translated;
+  switch (item->type()) {
+    case Item::COND_ITEM:
+      translated = translate_condition_item(ctx, (Item_cond*)item, match_doc);
+      break;
+    case Item::FUNC_ITEM:
+      translated = translate_function_item(ctx, (Item_func*)item, match_doc);
+      break;
+    default:
+      translated = false;
+      break;
+  }
+  // Values of a dropped clause are not in the filter
+  if (!translated) {
+    forget_values(ctx, recorded);
+  }
+  return translated;
 }
 
-bool translate_and_condition(const Item_cond* cond, bson_t* match_doc) {
-  return false;
+bool translate_function_item(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc)
+{
+  switch (func->functype()) {
+    case Item_func::EQ_FUNC:
+    case Item_func::EQUAL_FUNC:
+      return translate_comparison(ctx, func, match_doc, MONGODB_FILTER_EQ);
+    case Item_func::NE_FUNC:
+      return translate_comparison(ctx, func, match_doc, MONGODB_FILTER_NE);
+    case Item_func::LT_FUNC:
+      return translate_comparison(ctx, func, match_doc, MONGODB_FILTER_LT);
+    case Item_func::LE_FUNC:
+      return translate_comparison(ctx, func, match_doc, MONGODB_FILTER_LTE);
+    case Item_func::GT_FUNC:
+      return translate_comparison(ctx, func, match_doc, MONGODB_FILTER_GT);
+    case Item_func::GE_FUNC:
+      return translate_comparison(ctx, func, match_doc, MONGODB_FILTER_GTE);
+    case Item_func::BETWEEN:
+      return translate_between(ctx, func, match_doc);
+    case Item_func::IN_FUNC:
+      return translate_in_condition(ctx, func, match_doc);
+    case Item_func::ISNULL_FUNC:
+      return translate_null_test(ctx, func, match_doc, true);
+    case Item_func::ISNOTNULL_FUNC:
+      return translate_null_test(ctx, func, match_doc, false);
+    case Item_func::LIKE_FUNC:
+      return translate_like(ctx, func, match_doc);
+    case Item_func::NOT_FUNC:
+      return translate_not(ctx, func, match_doc);
+    case Item_func::MULT_EQUAL_FUNC:
+      return translate_multiple_equality(ctx, func, match_doc);
+    default:
+      if (is_regexp(func)) {
+        return translate_regexp(ctx, func, match_doc, false);
+      }
+      if (is_function(func, "json_contains")) {
+        return translate_json_contains(ctx, func, match_doc);
+      }
+      if (is_function(func, "json_overlaps")) {
+        return translate_json_overlaps(ctx, func, match_doc);
+      }
+      return false;
+  }
 }
 
-bool translate_or_condition(const Item_cond* cond, bson_t* match_doc) {
-  return false;
+bool translate_condition_item(MongoTranslateContext *ctx, Item_cond *cond, bson_t *match_doc)
+{
+  bool is_and = cond->functype() == Item_func::COND_AND_FUNC;
+  if (!is_and && cond->functype() != Item_func::COND_OR_FUNC) {
+    return false;
+  }
+
+  std::vector<bson_t*> clauses;
+  List_iterator_fast<Item> it(*cond->argument_list());
+  bool translated = true;
+  Item *arg;
+
+  while ((arg = it++)) {
+    bson_t *clause = bson_new();
+    if (translate_item(ctx, arg, clause)) {
+      clauses.push_back(clause);
+      continue;
+    }
+    bson_destroy(clause);
+    if (!is_and) {
+      translated = false;
+      break;
+    }
+    // The dropped conjunct stays with MariaDB
+    ctx->exact = false;
+  }
+
+  translated = translated && !clauses.empty() &&
+               (is_and ? mongodb_filter_and(match_doc, clauses.data(), clauses.size())
+                       : mongodb_filter_or(match_doc, clauses.data(), clauses.size()));
+
+  for (bson_t *clause : clauses) {
+    bson_destroy(clause);
+  }
+  return translated;
 }
 
-bool convert_sql_field_to_mongodb(const char* sql_field, String* mongodb_field) {
-  return false;
+bool translate_comparison(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc,
+                          MongoFilterOp op)
+{
+  Item **args = func->arguments();
+  MongoOperand operand;
+  Item *constant = args[1];
+  if (!resolve_operand(ctx, args[0], &operand) || !is_constant(ctx, args[1])) {
+    if (!is_constant(ctx, args[0]) || !resolve_operand(ctx, args[1], &operand)) {
+      // Column against column, or computed values
+      if (func->functype() == Item_func::EQUAL_FUNC) {
+        return false;
+      }
+      bson_t expr;
+      bson_init(&expr);
+      bool translated = translate_expression_comparison(ctx, func, op, &expr) &&
+                        mongodb_filter_expr(match_doc, &expr);
+      bson_destroy(&expr);
+      return translated;
+    }
+    constant = args[0];
+    op = mirrored(op);
+  }
+  if (is_time_operand(&operand)) {
+    return append_time_comparison(ctx, match_doc, &operand, op, constant) &&
+           scalar_clause(&operand, match_doc);
+  }
+
+  std::deque<std::string> strings;
+  bson_value_t value;
+  MongoValueKind kind = operand_kind(&operand, constant);
+  if (!constant_value(ctx, kind, constant, &strings, &value)) {
+    return false;
+  }
+
+  // x <=> NULL is IS NULL
+  if (value.value_type == BSON_TYPE_NULL && func->functype() == Item_func::EQUAL_FUNC &&
+      operand.json == MONGODB_JSON_NONE) {
+    return mongodb_filter_null(match_doc, operand.path(), true) &&
+           scalar_clause(&operand, match_doc);
+  }
+
+  return append_comparison(ctx, match_doc, &operand, kind, comparison_collation(func, &operand),
+                           op, &value) &&
+         scalar_clause(&operand, match_doc);
 }
 
-bool add_value_to_bson(bson_t* doc, const char* key, Item* value_item) {
-  return false;
+bool translate_between(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc)
+{
+  Item **args = func->arguments();
+  MongoOperand operand;
+  if (!resolve_operand(ctx, args[0], &operand)) {
+    return false;
+  }
+
+  bool negated = ((Item_func_between*)func)->negated;
+  if (is_time_operand(&operand)) {
+    MongoTimeRange range, high;
+    if (negated ||
+        !time_comparison_range(ctx, &operand, MONGODB_FILTER_GTE, args[1], &range) ||
+        !time_comparison_range(ctx, &operand, MONGODB_FILTER_LTE, args[2], &high)) {
+      return false;
+    }
+    range.end = high.end;
+    range.steady = range.steady && high.steady;
+    return append_time_range(ctx, match_doc, &operand, &range) &&
+           scalar_clause(&operand, match_doc);
+  }
+
+  const char *path = operand.path();
+  MongoValueKind kind = operand_kind(&operand, args[1]);
+  if (operand.json != MONGODB_JSON_NONE ? kind != MONGODB_VALUE_NUMBER || negated
+                                        : !range_allowed(kind, path,
+                                                         comparison_collation(func, &operand))) {
+    return false;
+  }
+
+  std::deque<std::string> strings;
+  bson_value_t low, high;
+  if (!constant_value(ctx, kind, args[1], &strings, &low) ||
+      !constant_value(ctx, kind, args[2], &strings, &high)) {
+    return false;
+  }
+
+  if (operand.json != MONGODB_JSON_NONE) {
+    if (low.value_type == BSON_TYPE_NULL || high.value_type == BSON_TYPE_NULL) {
+      return false;
+    }
+    value_dependent(ctx);
+    bson_t above_low, below_high;
+    bson_init(&above_low);
+    bson_init(&below_high);
+    const bson_t *bounds[2] = {&above_low, &below_high};
+    bool translated =
+        json_number_clause(&above_low, path, operand.json, MONGODB_FILTER_GTE, &low, 1) &&
+        json_number_clause(&below_high, path, operand.json, MONGODB_FILTER_LTE, &high, 1) &&
+        mongodb_filter_and(match_doc, bounds, 2);
+    bson_destroy(&above_low);
+    bson_destroy(&below_high);
+    if (translated) {
+      ctx->exact = false;
+    }
+    return translated;
+  }
+
+  if (!negated) {
+    return mongodb_filter_range(match_doc, path, &low, true, &high, true) &&
+           scalar_clause(&operand, match_doc);
+  }
+
+  // NOT BETWEEN: below low or above high; a NULL bound leaves one side unknown
+  if (low.value_type == BSON_TYPE_NULL || high.value_type == BSON_TYPE_NULL) {
+    return false;
+  }
+  bson_t below, above;
+  bson_init(&below);
+  bson_init(&above);
+  const bson_t *sides[2] = {&below, &above};
+  bool translated = mongodb_filter_compare(&below, path, MONGODB_FILTER_LT, &low) &&
+                    mongodb_filter_compare(&above, path, MONGODB_FILTER_GT, &high) &&
+                    mongodb_filter_or(match_doc, sides, 2);
+  bson_destroy(&below);
+  bson_destroy(&above);
+  return translated && scalar_clause(&operand, match_doc);
+}
+
+bool translate_in_condition(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc)
+{
+  Item **args = func->arguments();
+  MongoOperand operand;
+  if (!resolve_operand(ctx, args[0], &operand)) {
+    return false;
+  }
+
+  bool negated = ((Item_func_in*)func)->negated;
+  if (is_time_operand(&operand)) {
+    return !negated && translate_time_in(ctx, func, &operand, match_doc) &&
+           scalar_clause(&operand, match_doc);
+  }
+  if (negated && operand.json != MONGODB_JSON_NONE) {
+    return false;
+  }
+
+  MongoValueKind kind = operand_kind(&operand, args[1]);
+  std::deque<std::string> strings;
+  std::vector<bson_value_t> values(func->argument_count() - 1);
+  for (uint i = 1; i < func->argument_count(); i++) {
+    if (!constant_value(ctx, kind, args[i], &strings, &values[i - 1])) {
+      return false;
+    }
+  }
+
+  CHARSET_INFO *cs = comparison_collation(func, &operand);
+  if (operand.json != MONGODB_JSON_NONE) {
+    return append_json_comparison(ctx, match_doc, &operand, kind, cs, MONGODB_FILTER_EQ,
+                                  values.data(), values.size());
+  }
+  return append_equality(match_doc, operand.path(), kind, cs, values.data(), values.size(),
+                         negated) &&
+         scalar_clause(&operand, match_doc);
+}
+
+bool translate_null_test(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc,
+                         bool is_null)
+{
+  MongoOperand operand;
+  if (!resolve_operand(ctx, func->arguments()[0], &operand)) {
+    return false;
+  }
+  if (operand.id_time) {
+    static const char *const oid_type[] = {"objectId"};
+    return mongodb_filter_type(match_doc, "_id", oid_type, 1, is_null);
+  }
+  if (operand.json == MONGODB_JSON_NONE) {
+    return mongodb_filter_null(match_doc, operand.path(), is_null) &&
+           scalar_clause(&operand, match_doc);
+  }
+
+  // A JSON read is also NULL inside arrays MongoDB would look into
+  if (is_null || !mongodb_filter_exists(match_doc, operand.path(), true)) {
+    return false;
+  }
+  ctx->exact = false;
+  return true;
+}
+
+bool translate_like(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc)
+{
+  Item_func_like *like = (Item_func_like*)func;
+  Item **args = func->arguments();
+  MongoOperand operand;
+  if (!resolve_operand(ctx, args[0], &operand) || !is_constant(ctx, args[1])) {
+    return false;
+  }
+
+  // A regex never matches an ObjectId _id
+  const char *path = operand.path();
+  if (is_id(path) || is_time_operand(&operand) ||
+      operand_kind(&operand, args[1]) != MONGODB_VALUE_STRING) {
+    return false;
+  }
+  // JSON_EXTRACT matches the pattern against quoted JSON text
+  if (operand.json == MONGODB_JSON_EXTRACT ||
+      (operand.json != MONGODB_JSON_NONE && like->get_negated())) {
+    return false;
+  }
+  // LIKE does not pad, so any binary collation matches byte for byte
+  if (string_match(comparison_collation(func, &operand)) == MONGODB_STRING_NONE) {
+    return false;
+  }
+  if (like->escape < 0 || like->escape > 127) {
+    return false;
+  }
+
+  value_dependent(ctx, args[1]);
+  StringBuffer<MAX_FIELD_WIDTH> buffer;
+  String *pattern = args[1]->val_str(&buffer);
+  std::string utf8;
+  if (!pattern || !utf8_string(pattern, &utf8)) {
+    return false;
+  }
+
+  if (operand.json == MONGODB_JSON_NONE) {
+    return mongodb_filter_like(match_doc, path, utf8.data(), utf8.size(), like->escape,
+                               like->get_negated()) &&
+           scalar_clause(&operand, match_doc);
+  }
+
+  bson_t match;
+  bson_init(&match);
+  bool translated = mongodb_filter_like(&match, path, utf8.data(), utf8.size(), like->escape,
+                                        false) &&
+                    append_json_text_match(ctx, match_doc, path, &match);
+  bson_destroy(&match);
+  return translated;
+}
+
+bool translate_regexp(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc,
+                      bool negated)
+{
+  Item **args = func->arguments();
+  MongoOperand operand;
+  if (!resolve_operand(ctx, args[0], &operand) || !is_constant(ctx, args[1])) {
+    return false;
+  }
+
+  const char *path = operand.path();
+  if (is_id(path) || is_time_operand(&operand) ||
+      operand_kind(&operand, args[1]) != MONGODB_VALUE_STRING) {
+    return false;
+  }
+  if (operand.json == MONGODB_JSON_EXTRACT || (operand.json != MONGODB_JSON_NONE && negated)) {
+    return false;
+  }
+  // default_regex_flags changes how MariaDB compiles every pattern
+  if (ctx->thd && ctx->thd->variables.default_regex_flags) {
+    return false;
+  }
+
+  value_dependent(ctx, args[1]);
+  StringBuffer<MAX_FIELD_WIDTH> buffer;
+  String *pattern = args[1]->val_str(&buffer);
+  std::string utf8;
+  if (!pattern || !utf8_string(pattern, &utf8) || utf8.find('\0') != std::string::npos) {
+    return false;
+  }
+
+  // MariaDB matches caselessly under case-insensitive collations; accents still count
+  CHARSET_INFO *cs = comparison_collation(func, &operand);
+  const char *options = (cs->state & (MY_CS_BINSORT | MY_CS_CSSORT)) ? "" : "i";
+  if (operand.json == MONGODB_JSON_NONE) {
+    return mongodb_filter_regex(match_doc, path, utf8.c_str(), options, negated) &&
+           scalar_clause(&operand, match_doc);
+  }
+
+  bson_t match;
+  bson_init(&match);
+  bool translated = mongodb_filter_regex(&match, path, utf8.c_str(), options, false) &&
+                    append_json_text_match(ctx, match_doc, path, &match);
+  bson_destroy(&match);
+  return translated;
+}
+
+bool translate_json_contains(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc)
+{
+  Item **args = func->arguments();
+  uint count = func->argument_count();
+  std::string path, candidate;
+  if ((count != 2 && count != 3) ||
+      !json_search_target(ctx, args[0], count == 3 ? args[2] : nullptr, &path) ||
+      !constant_utf8(ctx, args[1], &candidate)) {
+    return false;
+  }
+
+  if (!mongodb_filter_json_contains(match_doc, path.c_str(), candidate.data(), candidate.size())) {
+    return false;
+  }
+  ctx->exact = false;
+  return true;
+}
+
+bool translate_json_overlaps(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc)
+{
+  Item **args = func->arguments();
+  if (func->argument_count() != 2) {
+    return false;
+  }
+
+  // Symmetric: either side may be the document
+  std::string path, candidate;
+  Item *constant = args[1];
+  if (!json_search_target(ctx, args[0], nullptr, &path)) {
+    if (!json_search_target(ctx, args[1], nullptr, &path)) {
+      return false;
+    }
+    constant = args[0];
+  }
+  if (!constant_utf8(ctx, constant, &candidate) ||
+      !mongodb_filter_json_overlaps(match_doc, path.c_str(), candidate.data(), candidate.size())) {
+    return false;
+  }
+  ctx->exact = false;
+  return true;
+}
+
+bool translate_not(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc)
+{
+  Item *arg = func->arguments()[0];
+  if (arg->type() == Item::FUNC_ITEM && is_regexp((Item_func*)arg)) {
+    return translate_regexp(ctx, (Item_func*)arg, match_doc, true);
+  }
+
+  // $nor also matches rows where the operand is NULL, which NOT excludes:
+  // the operand must be exact, and the result only narrows the rows
+  MongoTranslateContext operand_ctx = *ctx;
+  operand_ctx.exact = true;
+
+  bson_t operand;
+  bson_init(&operand);
+  bool translated = translate_item(&operand_ctx, arg, &operand) && operand_ctx.exact &&
+                    mongodb_filter_not(match_doc, &operand);
+  bson_destroy(&operand);
+
+  if (translated) {
+    ctx->exact = false;
+  }
+  return translated;
+}
+
+bool translate_multiple_equality(MongoTranslateContext *ctx, Item_func *func, bson_t *match_doc)
+{
+  Item_equal *equal = (Item_equal*)func;
+  Item *constant = equal->get_const();
+  if (!constant && ctx->lookup) {
+    // In an index condition a column of an earlier table gives the value
+    Item_equal_fields_iterator members(*equal);
+    Item *member;
+    while (!constant && (member = members++)) {
+      if (is_constant(ctx, member)) {
+        constant = member;
+      }
+    }
+  }
+  if (!constant) {
+    return false;
+  }
+
+  std::vector<bson_t*> clauses;
+  Item_equal_fields_iterator it(*equal);
+  Item *item;
+
+  while ((item = it++)) {
+    if (item == constant) {
+      continue;
+    }
+    MongoOperand operand;
+    std::deque<std::string> strings;
+    bson_value_t value;
+    bson_t *clause = bson_new();
+    bool translated = false;
+    size_t recorded = ctx->recording ? ctx->recording->params.size() : 0;
+
+    if (resolve_operand(ctx, item, &operand)) {
+      MongoValueKind kind = operand_kind(&operand, constant);
+      translated = is_time_operand(&operand)
+          ? append_time_comparison(ctx, clause, &operand, MONGODB_FILTER_EQ, constant)
+          : constant_value(ctx, kind, constant, &strings, &value) &&
+            append_comparison(ctx, clause, &operand, kind, comparison_collation(func, &operand),
+                              MONGODB_FILTER_EQ, &value);
+      translated = translated && scalar_clause(&operand, clause);
+    }
+    if (translated) {
+      clauses.push_back(clause);
+    } else {
+      bson_destroy(clause);
+      forget_values(ctx, recorded);
+      ctx->exact = false;
+    }
+  }
+
+  bool translated = !clauses.empty() &&
+                    mongodb_filter_and(match_doc, clauses.data(), clauses.size());
+  for (bson_t *clause : clauses) {
+    bson_destroy(clause);
+  }
+  return translated;
 }
 
 } // namespace mongodb_translator
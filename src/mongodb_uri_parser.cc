@@ -6,7 +6,6 @@
 */
 
 #include "mongodb_uri_parser.h"
-#include "my_global.h"
 #include <regex>
 #include <sstream>
 #include <algorithm>
@@ -0,0 +1,227 @@
+/*
+  MongoDB Storage Engine - Distinct Values Tests
+
+  Checks what the group-by handler sends for DISTINCT and COUNT(DISTINCT):
+  the distinct command, the $group pipeline that groups missing and null
+  fields as one NULL, and the column domains COUNT(DISTINCT) is limited
+  to. The handler itself needs mysqld; these are the builders it calls.
+
+  Usage: distinct_test (exits non-zero when a check fails)
+*/
+
+#include "mongodb_distinct.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                        \
+  do {                                                                          \
+    if (!(condition)) {                                                         \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                               \
+    }                                                                           \
+  } while (0)
+
+// doc equals expected, which is destroyed
+static bool equals(const bson_t *doc, bson_t *expected)
+{
+  bool ok = bson_equal(doc, expected);
+  if (!ok) {
+    char *json = bson_as_canonical_extended_json(doc, nullptr);
+    fprintf(stderr, "got %s\n", json ? json : "(invalid)");
+    bson_free(json);
+  }
+  bson_destroy(expected);
+  return ok;
+}
+
+// The operator document at path in doc, as a string of its keys
+static std::string keys_at(const bson_t *doc, const char *path)
+{
+  bson_iter_t iter, child;
+  std::string keys;
+  if (bson_iter_init(&iter, doc) && bson_iter_find_descendant(&iter, path, &child) &&
+      BSON_ITER_HOLDS_DOCUMENT(&child) && bson_iter_recurse(&child, &iter)) {
+    while (bson_iter_next(&iter)) {
+      keys += bson_iter_key(&iter);
+      keys += ' ';
+    }
+  }
+  return keys;
+}
+
+static void test_fields()
+{
+  CHECK(mongodb_distinct_field("city"));
+  CHECK(mongodb_distinct_field("_id"));
+  CHECK(!mongodb_distinct_field(""));
+  CHECK(!mongodb_distinct_field("$city"));
+  CHECK(!mongodb_distinct_field("address.city"));
+  CHECK(!mongodb_distinct_field(std::string("a\0b", 3)));
+}
+
+static void test_command()
+{
+  bson_t command;
+  bson_init(&command);
+  CHECK(mongodb_distinct_command("customers", "city", nullptr, &command));
+  CHECK(equals(&command, BCON_NEW("distinct", BCON_UTF8("customers"),
+                                  "key", BCON_UTF8("city"))));
+
+  bson_t *filter = BCON_NEW("age", "{", "$gt", BCON_INT64(30), "}");
+  bson_reinit(&command);
+  CHECK(mongodb_distinct_command("customers", "city", filter, &command));
+  CHECK(equals(&command, BCON_NEW("distinct", BCON_UTF8("customers"),
+                                  "key", BCON_UTF8("city"),
+                                  "query", "{", "age", "{", "$gt", BCON_INT64(30), "}", "}")));
+
+  bson_reinit(&command);
+  CHECK(!mongodb_distinct_command("customers", "address.city", filter, &command));
+  CHECK(!mongodb_distinct_command(nullptr, "city", filter, &command));
+  bson_destroy(filter);
+  bson_destroy(&command);
+}
+
+static void test_pipeline()
+{
+  bson_t pipeline;
+  bson_init(&pipeline);
+  std::vector<std::string> fields = {"city", "zip"};
+
+  // Missing and null fields group together
+  CHECK(mongodb_distinct_pipeline(fields, nullptr, &pipeline));
+  CHECK(equals(&pipeline, BCON_NEW(
+      "0", "{", "$group", "{", "_id", "{",
+                  "city", "{", "$ifNull", "[", BCON_UTF8("$city"), BCON_NULL, "]", "}",
+                  "zip", "{", "$ifNull", "[", BCON_UTF8("$zip"), BCON_NULL, "]", "}",
+                "}", "}", "}",
+      "1", "{", "$replaceRoot", "{", "newRoot", BCON_UTF8("$_id"), "}", "}")));
+
+  // A filter is matched first; an empty one is left out
+  bson_t *filter = BCON_NEW("age", BCON_INT64(30));
+  bson_reinit(&pipeline);
+  fields.pop_back();
+  CHECK(mongodb_distinct_pipeline(fields, filter, &pipeline));
+  CHECK(equals(&pipeline, BCON_NEW(
+      "0", "{", "$match", "{", "age", BCON_INT64(30), "}", "}",
+      "1", "{", "$group", "{", "_id", "{",
+                  "city", "{", "$ifNull", "[", BCON_UTF8("$city"), BCON_NULL, "]", "}",
+                "}", "}", "}",
+      "2", "{", "$replaceRoot", "{", "newRoot", BCON_UTF8("$_id"), "}", "}")));
+
+  bson_t empty;
+  bson_init(&empty);
+  bson_reinit(&pipeline);
+  CHECK(mongodb_distinct_pipeline(fields, &empty, &pipeline));
+  CHECK(bson_count_keys(&pipeline) == 2);
+
+  fields.push_back("a.b");
+  bson_reinit(&pipeline);
+  CHECK(!mongodb_distinct_pipeline(fields, nullptr, &pipeline));
+  fields.clear();
+  CHECK(!mongodb_distinct_pipeline(fields, nullptr, &pipeline));
+
+  bson_destroy(&empty);
+  bson_destroy(filter);
+  bson_destroy(&pipeline);
+}
+
+static void test_domains()
+{
+  bson_t clause;
+  bson_init(&clause);
+
+  // TINYINT: integers within the column's range, never arrays
+  MongoDistinctDomain tiny = {};
+  tiny.kind = MONGODB_DISTINCT_INTEGER;
+  tiny.min = -128;
+  tiny.max = 127;
+  CHECK(mongodb_distinct_domain_filter("n", tiny, &clause));
+  CHECK(equals(&clause, BCON_NEW(
+      "$and", "[",
+        "{", "n", "{", "$not", "{", "$type", BCON_UTF8("array"), "}", "}", "}",
+        "{", "n", "{", "$type", "[", BCON_UTF8("int"), BCON_UTF8("long"), "]",
+                       "$gte", BCON_INT64(-128), "$lte", BCON_INT64(127), "}", "}",
+      "]")));
+
+  // DOUBLE: arrays excluded, then one branch per numeric type
+  MongoDistinctDomain real = {};
+  real.kind = MONGODB_DISTINCT_DOUBLE;
+  bson_reinit(&clause);
+  CHECK(mongodb_distinct_domain_filter("x", real, &clause));
+  CHECK(keys_at(&clause, "$and.0.x") == "$not ");
+  CHECK(keys_at(&clause, "$and.1.$or.0.x") == "$type ");
+  CHECK(keys_at(&clause, "$and.1.$or.1.x") == "$type $gt $lt ");
+  CHECK(keys_at(&clause, "$and.1.$or.2.x") == "$type $gte $lte ");
+
+  // Strings: the length is counted as the column counts it
+  MongoDistinctDomain text = {};
+  text.kind = MONGODB_DISTINCT_STRING;
+  text.max_length = 10;
+  bson_reinit(&clause);
+  CHECK(mongodb_distinct_domain_filter("s", text, &clause));
+  CHECK(keys_at(&clause, "s") == "$type ");
+  CHECK(keys_at(&clause, "$expr.$and.1.$lte.0") == "$strLenCP ");
+  bson_iter_t iter, limit;
+  CHECK(bson_iter_init(&iter, &clause) &&
+        bson_iter_find_descendant(&iter, "$expr.$and.1.$lte.1", &limit) &&
+        BSON_ITER_HOLDS_INT64(&limit) && bson_iter_int64(&limit) == 10);
+
+  text.length_in_bytes = true;
+  bson_reinit(&clause);
+  CHECK(mongodb_distinct_domain_filter("s", text, &clause));
+  CHECK(keys_at(&clause, "$expr.$and.1.$lte.0") == "$strLenBytes ");
+
+  bson_reinit(&clause);
+  CHECK(!mongodb_distinct_domain_filter("$s", text, &clause));
+  bson_destroy(&clause);
+}
+
+static void test_count_pipeline()
+{
+  MongoDistinctDomain tiny = {};
+  tiny.kind = MONGODB_DISTINCT_INTEGER;
+  tiny.min = -128;
+  tiny.max = 127;
+
+  // The domain is matched with the filter, then the values counted
+  bson_t pipeline;
+  bson_init(&pipeline);
+  bson_t *filter = BCON_NEW("age", BCON_INT64(30));
+  CHECK(mongodb_count_distinct_pipeline("n", tiny, filter, &pipeline));
+  CHECK(keys_at(&pipeline, "0.$match") == "age $and ");
+  CHECK(equals(&pipeline, BCON_NEW(
+      "0", "{", "$match", "{",
+                  "age", BCON_INT64(30),
+                  "$and", "[",
+                    "{", "n", "{", "$not", "{", "$type", BCON_UTF8("array"), "}", "}", "}",
+                    "{", "n", "{", "$type", "[", BCON_UTF8("int"), BCON_UTF8("long"), "]",
+                                   "$gte", BCON_INT64(-128), "$lte", BCON_INT64(127), "}", "}",
+                  "]", "}", "}",
+      "1", "{", "$group", "{", "_id", BCON_UTF8("$n"), "}", "}",
+      "2", "{", "$count", BCON_UTF8("count"), "}")));
+
+  bson_reinit(&pipeline);
+  CHECK(!mongodb_count_distinct_pipeline("n.m", tiny, filter, &pipeline));
+  bson_destroy(filter);
+  bson_destroy(&pipeline);
+}
+
+int main()
+{
+  test_fields();
+  test_command();
+  test_pipeline();
+  test_domains();
+  test_count_pipeline();
+
+  if (failures) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All distinct checks passed\n");
+  return 0;
+}
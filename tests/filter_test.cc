@@ -0,0 +1,404 @@
+/*
+  MongoDB Storage Engine - Filter Builder Tests
+
+  Checks the filters the translator relies on for exact results: PCRE
+  metacharacters in literals, LIKE wildcards and escapes, PAD SPACE
+  equality patterns, stored-column clauses that exclude arrays (with the
+  NULL and array values rows show), and filter plans rewritten with new
+  constants.
+
+  Usage: filter_test (exits non-zero when a check fails)
+*/
+
+#include "mongodb_filter.h"
+#include "mongodb_plan_cache.h"
+#include "mongodb_row_convert.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                        \
+  do {                                                                          \
+    if (!(condition)) {                                                         \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                               \
+    }                                                                           \
+  } while (0)
+
+/*
+  The regex of {path: /pattern/options}, or of {path: {$not: /.../, $ne: null}}
+  when negated
+*/
+static bool regex_of(const bson_t *clause, const char *path, bool negated,
+                     std::string *pattern, std::string *options)
+{
+  bson_iter_t iter;
+  if (!bson_iter_init_find(&iter, clause, path)) {
+    return false;
+  }
+  if (negated) {
+    bson_iter_t ops;
+    if (!BSON_ITER_HOLDS_DOCUMENT(&iter) || !bson_iter_recurse(&iter, &ops) ||
+        !bson_iter_find(&ops, "$not")) {
+      return false;
+    }
+    iter = ops;
+  }
+  if (!BSON_ITER_HOLDS_REGEX(&iter)) {
+    return false;
+  }
+  const char *opts;
+  pattern->assign(bson_iter_regex(&iter, &opts));
+  options->assign(opts);
+  return true;
+}
+
+// {path: "value"}
+static bool equals_string(const bson_t *clause, const char *path, const char *value)
+{
+  bson_iter_t iter;
+  uint32_t length;
+  if (!bson_iter_init_find(&iter, clause, path) || !BSON_ITER_HOLDS_UTF8(&iter)) {
+    return false;
+  }
+  const char *s = bson_iter_utf8(&iter, &length);
+  return length == strlen(value) && memcmp(s, value, length) == 0;
+}
+
+static bool like_regex(const char *pattern, int escape, bool negated,
+                       const char *expected, const char *expected_options)
+{
+  bson_t clause;
+  bson_init(&clause);
+  std::string regex, options;
+  bool ok = mongodb_filter_like(&clause, "name", pattern, strlen(pattern), escape, negated) &&
+            regex_of(&clause, "name", negated, &regex, &options) &&
+            regex == expected && options == expected_options;
+  bson_destroy(&clause);
+  return ok;
+}
+
+static bool like_equality(const char *pattern, int escape, const char *expected)
+{
+  bson_t clause;
+  bson_init(&clause);
+  bool ok = mongodb_filter_like(&clause, "name", pattern, strlen(pattern), escape, false) &&
+            equals_string(&clause, "name", expected);
+  bson_destroy(&clause);
+  return ok;
+}
+
+static void test_regex_literal()
+{
+  std::string regex;
+  const char *all = "\\^$.|?*+()[]{}";
+  CHECK(mongodb_regex_append_literal(&regex, all, strlen(all)));
+  CHECK(regex == "\\\\\\^\\$\\.\\|\\?\\*\\+\\(\\)\\[\\]\\{\\}");
+
+  // Other bytes, UTF-8 included, pass through
+  regex.clear();
+  const char *plain = "a-b_c%d \xc3\xa9/";
+  CHECK(mongodb_regex_append_literal(&regex, plain, strlen(plain)));
+  CHECK(regex == plain);
+
+  // Regexes are C strings in BSON
+  regex.clear();
+  CHECK(!mongodb_regex_append_literal(&regex, "a\0b", 3));
+}
+
+static void test_like()
+{
+  // No wildcards: equality
+  CHECK(like_equality("abc", 0, "abc"));
+  CHECK(like_equality("a.b", 0, "a.b"));
+
+  // Leading and trailing % leave that end unanchored
+  CHECK(like_regex("abc%", 0, false, "^abc", ""));
+  CHECK(like_regex("%abc", 0, false, "abc\\z", ""));
+  CHECK(like_regex("%abc%", 0, false, "abc", ""));
+  CHECK(like_regex("a.c%", 0, false, "^a\\.c", ""));
+  CHECK(like_regex("(x)%", 0, false, "^\\(x\\)", ""));
+
+  // Inner wildcards match newlines too
+  CHECK(like_regex("a_c", 0, false, "^a.c\\z", "s"));
+  CHECK(like_regex("a%c", 0, false, "^a.*c\\z", "s"));
+  CHECK(like_regex("a%%c", 0, false, "^a.*c\\z", "s"));
+  CHECK(like_regex("a_%", 0, false, "^a.", "s"));
+
+  // Escaped wildcards are literals
+  CHECK(like_equality("a\\%b", '\\', "a%b"));
+  CHECK(like_equality("a\\_b", '\\', "a_b"));
+  CHECK(like_regex("10!%%", '!', false, "^10%", ""));
+  CHECK(like_regex("a!_c%", '!', false, "^a_c", ""));
+  CHECK(like_regex("a!.c_", '!', false, "^a\\.c.\\z", "s"));
+  // Without an escape character a backslash is a literal
+  CHECK(like_regex("a\\%", 0, false, "^a\\\\", ""));
+  // A trailing escape character is literal
+  CHECK(like_equality("ab!", '!', "ab!"));
+
+  // NOT LIKE excludes NULL
+  CHECK(like_regex("a_c", 0, true, "^a.c\\z", "s"));
+
+  // Only %: any non-NULL value; NOT LIKE '%' is never true
+  bson_t clause;
+  bson_init(&clause);
+  bson_iter_t iter, ops;
+  CHECK(mongodb_filter_like(&clause, "name", "%%", 2, 0, false));
+  CHECK(bson_iter_init_find(&iter, &clause, "name") && bson_iter_recurse(&iter, &ops) &&
+        bson_iter_find(&ops, "$ne") && BSON_ITER_HOLDS_NULL(&ops));
+  bson_reinit(&clause);
+  CHECK(!mongodb_filter_like(&clause, "name", "%", 1, 0, true));
+
+  // Escapes outside ASCII and NUL bytes are refused
+  CHECK(!mongodb_filter_like(&clause, "name", "a%", 2, 200, false));
+  CHECK(!mongodb_filter_like(&clause, "name", "a\0%", 3, 0, false));
+  bson_destroy(&clause);
+}
+
+static void test_pad_space()
+{
+  std::string regex;
+  CHECK(mongodb_regex_pad_space(&regex, "abc", 3));
+  CHECK(regex == "^abc *\\z");
+
+  // Trailing spaces are optional, not required
+  CHECK(mongodb_regex_pad_space(&regex, "abc  ", 5));
+  CHECK(regex == "^abc *\\z");
+
+  // Leading and inner spaces are kept
+  CHECK(mongodb_regex_pad_space(&regex, " a b", 4));
+  CHECK(regex == "^ a b *\\z");
+
+  CHECK(mongodb_regex_pad_space(&regex, "a.b*", 4));
+  CHECK(regex == "^a\\.b\\* *\\z");
+
+  // '' equals any string of spaces
+  CHECK(mongodb_regex_pad_space(&regex, "   ", 3));
+  CHECK(regex == "^ *\\z");
+
+  CHECK(!mongodb_regex_pad_space(&regex, "a\0", 2));
+}
+
+// clause restricted with mongodb_filter_scalar() equals expected
+static bool scalar_is(bson_t *clause, bson_t *expected)
+{
+  bool ok = mongodb_filter_scalar(clause, "name") && bson_equal(clause, expected);
+  if (!ok) {
+    char *json = bson_as_canonical_extended_json(clause, nullptr);
+    fprintf(stderr, "got %s\n", json ? json : "(invalid)");
+    bson_free(json);
+  }
+  bson_destroy(expected);
+  return ok;
+}
+
+static void test_scalar()
+{
+  bson_t clause;
+  bson_init(&clause);
+  bson_value_t x = mongodb_value_utf8("x", 1);
+  bson_value_t five = mongodb_value_int64(5);
+
+  // Equality keeps one operator document, so it stays on an index
+  CHECK(mongodb_filter_compare(&clause, "name", MONGODB_FILTER_EQ, &x));
+  CHECK(scalar_is(&clause, BCON_NEW("name", "{", "$eq", BCON_UTF8("x"),
+                                    "$not", "{", "$type", BCON_UTF8("array"), "}", "}")));
+
+  // IS NULL: missing or null, not an array holding a null
+  bson_reinit(&clause);
+  CHECK(mongodb_filter_null(&clause, "name", true));
+  CHECK(scalar_is(&clause, BCON_NEW("name", "{", "$eq", BCON_NULL,
+                                    "$not", "{", "$type", BCON_UTF8("array"), "}", "}")));
+
+  bson_reinit(&clause);
+  CHECK(mongodb_filter_null(&clause, "name", false));
+  CHECK(scalar_is(&clause, BCON_NEW("name", "{", "$ne", BCON_NULL,
+                                    "$not", "{", "$type", BCON_UTF8("array"), "}", "}")));
+
+  // <> and NOT IN: an array holding the value is not dropped by $nin alone
+  bson_reinit(&clause);
+  CHECK(mongodb_filter_compare(&clause, "name", MONGODB_FILTER_NE, &x));
+  CHECK(scalar_is(&clause, BCON_NEW("name", "{", "$nin", "[", BCON_UTF8("x"), BCON_NULL, "]",
+                                    "$not", "{", "$type", BCON_UTF8("array"), "}", "}")));
+
+  bson_value_t list[2] = {x, five};
+  bson_reinit(&clause);
+  CHECK(mongodb_filter_in(&clause, "name", list, 2, true));
+  CHECK(scalar_is(&clause, BCON_NEW("name", "{", "$nin", "[", BCON_UTF8("x"), BCON_INT64(5),
+                                    BCON_NULL, "]",
+                                    "$not", "{", "$type", BCON_UTF8("array"), "}", "}")));
+
+  bson_reinit(&clause);
+  CHECK(mongodb_filter_in(&clause, "name", list, 2, false));
+  CHECK(scalar_is(&clause, BCON_NEW("name", "{", "$in", "[", BCON_UTF8("x"), BCON_INT64(5), "]",
+                                    "$not", "{", "$type", BCON_UTF8("array"), "}", "}")));
+
+  // Ranges match array elements too
+  bson_reinit(&clause);
+  CHECK(mongodb_filter_compare(&clause, "name", MONGODB_FILTER_GT, &five));
+  CHECK(scalar_is(&clause, BCON_NEW("name", "{", "$gt", BCON_INT64(5),
+                                    "$not", "{", "$type", BCON_UTF8("array"), "}", "}")));
+
+  // A bare regex becomes $regex
+  bson_reinit(&clause);
+  CHECK(mongodb_filter_like(&clause, "name", "a_", 2, 0, false));
+  CHECK(scalar_is(&clause, BCON_NEW("name", "{", "$regex", BCON_REGEX("^a.\\z", "s"),
+                                    "$not", "{", "$type", BCON_UTF8("array"), "}", "}")));
+
+  // A clause with a $not of its own, or on other keys, is ANDed
+  bson_reinit(&clause);
+  CHECK(mongodb_filter_regex(&clause, "name", "a", "", true));
+  CHECK(scalar_is(&clause, BCON_NEW("$and", "[",
+                                    "{", "name", "{", "$not", BCON_REGEX("a", ""),
+                                                      "$ne", BCON_NULL, "}", "}",
+                                    "{", "name", "{", "$not", "{", "$type", BCON_UTF8("array"),
+                                                      "}", "}", "}",
+                                    "]")));
+
+  bson_t below, above;
+  bson_init(&below);
+  bson_init(&above);
+  bson_value_t nine = mongodb_value_int64(9);
+  const bson_t *sides[2] = {&below, &above};
+  bson_reinit(&clause);
+  CHECK(mongodb_filter_compare(&below, "name", MONGODB_FILTER_LT, &five) &&
+        mongodb_filter_compare(&above, "name", MONGODB_FILTER_GT, &nine) &&
+        mongodb_filter_or(&clause, sides, 2));
+  CHECK(scalar_is(&clause, BCON_NEW("$or", "[",
+                                    "{", "name", "{", "$lt", BCON_INT64(5), "}", "}",
+                                    "{", "name", "{", "$gt", BCON_INT64(9), "}", "}",
+                                    "]",
+                                    "name", "{", "$not", "{", "$type", BCON_UTF8("array"),
+                                                 "}", "}")));
+  bson_destroy(&above);
+  bson_destroy(&below);
+  bson_destroy(&clause);
+}
+
+/*
+  What a row shows: NULL for missing and null fields, so that {name: null}
+  selects exactly the NULL rows, and a tag for arrays
+*/
+class RowSink : public MongoFieldSink {
+public:
+  std::vector<bool> nulls;
+  std::vector<std::string> strings;
+
+  explicit RowSink(size_t columns) : nulls(columns, true), strings(columns) {}
+
+  void set_null(size_t column) override { nulls[column] = true; }
+  void store_int(size_t column, int64_t value) override
+  {
+    nulls[column] = false;
+    strings[column] = std::to_string(value);
+  }
+  void store_double(size_t column, double value) override
+  {
+    nulls[column] = false;
+    strings[column] = std::to_string(value);
+  }
+  void store_string(size_t column, const char *value, size_t length) override
+  {
+    nulls[column] = false;
+    strings[column].assign(value, length);
+  }
+  void store_time(size_t column, int64_t msec_since_epoch) override
+  {
+    store_int(column, msec_since_epoch);
+  }
+};
+
+static void test_row_values()
+{
+  std::vector<std::string> names = {"missing", "null", "array", "name"};
+  std::vector<MongoColumn> columns = mongodb_row_columns(names);
+  bson_t *doc = BCON_NEW("null", BCON_NULL, "array", "[", BCON_UTF8("x"), "]",
+                         "name", BCON_UTF8("x"));
+  RowSink row(columns.size());
+  CHECK(mongodb_convert_document(doc, columns, &row) == 0);
+  CHECK(row.nulls[0]);
+  CHECK(row.nulls[1]);
+  CHECK(!row.nulls[2] && row.strings[2] == "[BSON_TYPE_4]");
+  CHECK(!row.nulls[3] && row.strings[3] == "x");
+  bson_destroy(doc);
+}
+
+// {a: {$gt: a}, b: {$lt: b}, c: "x"}
+static void plan_filter(bson_t *filter, int64_t a, double b)
+{
+  bson_value_t va = mongodb_value_int64(a);
+  bson_value_t vb = mongodb_value_double(b);
+  bson_value_t vc = mongodb_value_utf8("x", 1);
+  mongodb_filter_compare(filter, "a", MONGODB_FILTER_GT, &va);
+  mongodb_filter_compare(filter, "b", MONGODB_FILTER_LT, &vb);
+  mongodb_filter_compare(filter, "c", MONGODB_FILTER_EQ, &vc);
+}
+
+static void test_plan()
+{
+  bson_t filter;
+  bson_init(&filter);
+  plan_filter(&filter, 5, 2.5);
+
+  std::vector<MongoFilterParam> params(2);
+  params[0].constant = 0;
+  params[0].value = mongodb_value_int64(5);
+  params[1].constant = 1;
+  params[1].value = mongodb_value_double(2.5);
+
+  MongoFilterPlan plan;
+  CHECK(mongodb_filter_plan_build(&filter, params, 2, true, &plan));
+  CHECK(plan.slots.size() == 2);
+  CHECK(plan.exact);
+
+  // New constants land where the old ones were
+  std::vector<bson_value_t> values;
+  values.push_back(mongodb_value_int64(-42));
+  values.push_back(mongodb_value_double(7.25));
+  bson_t applied, expected;
+  bson_init(&applied);
+  bson_init(&expected);
+  plan_filter(&expected, -42, 7.25);
+  CHECK(mongodb_filter_plan_apply(plan, values, &applied));
+  CHECK(bson_equal(&applied, &expected));
+
+  // Values of another type or count are refused
+  bson_reinit(&applied);
+  values[0] = mongodb_value_double(1.0);
+  CHECK(!mongodb_filter_plan_apply(plan, values, &applied));
+  values.pop_back();
+  CHECK(!mongodb_filter_plan_apply(plan, values, &applied));
+
+  // A number no constant put there, or a constant with no number, is not
+  // cacheable
+  MongoFilterPlan other;
+  std::vector<MongoFilterParam> partial(params.begin(), params.begin() + 1);
+  CHECK(!mongodb_filter_plan_build(&filter, partial, 1, true, &other));
+  CHECK(!mongodb_filter_plan_build(&filter, params, 3, true, &other));
+  params[1].value = mongodb_value_double(3.5);
+  CHECK(!mongodb_filter_plan_build(&filter, params, 2, true, &other));
+
+  bson_destroy(&expected);
+  bson_destroy(&applied);
+  bson_destroy(&filter);
+}
+
+int main()
+{
+  test_regex_literal();
+  test_like();
+  test_pad_space();
+  test_scalar();
+  test_row_values();
+  test_plan();
+
+  if (failures) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All filter checks passed\n");
+  return 0;
+}